@@ -27,13 +27,25 @@ extern "C" {
 #include <sys/stat.h>
 #include <sys/poll.h>	
 #include <sys/socket.h>	
+#include <sys/uio.h>
+#include <fcntl.h>
 #include <signal.h>
 }
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "../config.h"
 #include "notQt.h"
 
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_SIGNALFD_H)
+# define NOTQT_USE_EPOLL 1
+extern "C" {
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+}
+#endif
+
 using namespace std;
 using namespace nxcl;
 
@@ -55,8 +67,12 @@ notQProcess::notQProcess () :
     error (NOTQPROCNOERROR),
     pid(0),
     signalledStart(false),
-    parentFD(-1)
+    parentFD(-1),
+    finished(false),
+    exitStatus(0),
+    eventLoop(NULL)
 {
+    memset (&this->usage, 0, sizeof (this->usage));
     // Set up the polling structs
     this->p = static_cast<struct pollfd*>(malloc (2*sizeof (struct pollfd)));	
 }
@@ -64,6 +80,9 @@ notQProcess::notQProcess () :
 // Destructor
 notQProcess::~notQProcess ()
 {
+    if (this->eventLoop != NULL) {
+        this->eventLoop->removeProcess (this);
+    }
     free (this->p);
     if (parentFD != -1)
     {
@@ -79,7 +98,64 @@ notQProcess::~notQProcess ()
     void
 notQProcess::writeIn (string& input)
 {
-    write (this->parentToChild[WRITING_END], input.c_str(), input.size());
+    // In the socketpair build stdin shares its file description
+    // with our non-blocking stdout, so cope with short writes.
+    size_t done = 0;
+    while (done < input.size()) {
+        ssize_t n = write (this->parentToChild[WRITING_END],
+                           input.data() + done, input.size() - done);
+        if (n > 0) {
+            done += n;
+        } else if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1 && errno == EAGAIN) {
+            struct pollfd wp;
+            wp.fd = this->parentToChild[WRITING_END];
+            wp.events = POLLOUT;
+            wp.revents = 0;
+            poll (&wp, 1, -1);
+        } else {
+            this->error = NOTQPROCWRITEERR;
+            return;
+        }
+    }
+}
+
+    int
+notQProcess::getParentFD (void)
+{
+    // The event loop must let go of the old descriptors before we
+    // close them; the socketpair lives on in parentFD.
+    if (this->eventLoop != NULL) {
+        this->eventLoop->removeFds (this);
+    }
+
+    this->parentFD = this->parentToChild[WRITING_END];
+    close (this->childToParent[READING_END]);
+
+    // Whoever we give this to expects a blocking descriptor.
+    int fl = fcntl (this->parentFD, F_GETFL);
+    if (fl != -1) {
+        fcntl (this->parentFD, F_SETFL, fl & ~O_NONBLOCK);
+    }
+
+    // Create new pipes
+    pipe (this->parentToChild);
+    pipe (this->childToParent);
+
+    return this->parentFD;
+}
+
+    void
+notQProcess::setEventLoop (notQEventLoop * loop)
+{
+    if (this->eventLoop != NULL && this->eventLoop != loop) {
+        this->eventLoop->removeProcess (this);
+    }
+    this->eventLoop = loop;
+    if (this->eventLoop != NULL && this->pid > 0 && !this->finished) {
+        this->eventLoop->addProcess (this);
+    }
 }
 
 // fork and exec a new process using execv, which takes stdin via a
@@ -92,9 +168,14 @@ notQProcess::start (const string& program, const list<string>& args)
     list<string>::iterator i;
     unsigned int j = 0;
     int theError;
+    int execError[2];
 
     // NB: The first item in the args list should be the program name.
     this->progName = program;
+    this->finished = false;
+    this->error = NOTQPROCNOERROR;
+    this->exitStatus = 0;
+    memset (&this->usage, 0, sizeof (this->usage));
 
 #ifdef NXCL_USE_NXSSH
     // Set up our pipes
@@ -109,18 +190,35 @@ notQProcess::start (const string& program, const list<string>& args)
     childToParent[WRITING_END]=dup(parentToChild[READING_END]);
 #endif
 
+    // The child writes errno here if it can't exec the program;
+    // otherwise exec closes it and we read nothing.
+    if (pipe (execError) == -1) {
+        return NOTQTPROCESS_FAILURE;
+    }
+    fcntl (execError[WRITING_END], F_SETFD, FD_CLOEXEC);
+
     this->pid = fork();
 
     switch (this->pid) {
         case -1:
+            close (execError[READING_END]);
+            close (execError[WRITING_END]);
             return NOTQTPROCESS_FAILURE;
         case 0:
             // This is the CHILD process
 
+            // A notQEventLoop blocks SIGCHLD in the parent; don't
+            // pass that on to the program we're about to run.
+            sigset_t chld;
+            sigemptyset (&chld);
+            sigaddset (&chld, SIGCHLD);
+            sigprocmask (SIG_UNBLOCK, &chld, NULL);
+
             // Close unwanted ends of the pipes
             close (parentToChild[WRITING_END]);
             close (childToParent[READING_END]);
             close (childErrToParent[READING_END]);
+            close (execError[READING_END]);
 
             // Now all we have to do is make the writing file
             // descriptors 0,1 or 2 and they will be used instead
@@ -129,8 +227,8 @@ notQProcess::start (const string& program, const list<string>& args)
                     (dup2 (childToParent[WRITING_END], STDOUT)) == -1 || 
                     (dup2 (childErrToParent[WRITING_END], STDERR)) == -1) {
                 theError = errno;
-                cout << "ERROR! Couldn't get access to stdin/out/err! errno was " << theError << endl;
-                return NOTQTPROCESS_FAILURE;	
+                write (execError[WRITING_END], &theError, sizeof (theError));
+                _exit (-1);
             }
 
             // Allocate memory for the program arguments
@@ -147,18 +245,9 @@ notQProcess::start (const string& program, const list<string>& args)
 
             execv (program.c_str(), argarray);
 
-            // If process returns, error occurred
+            // If process returns, error occurred. Tell the parent.
             theError = errno; 
-            // This'll get picked up by parseResponse
-            cout << "notQProcess error: " << this->pid << " crashed. errno:" << theError << endl;
-
-            // This won't get picked up by the parent process.
-            this->error = NOTQPROCCRASHED;
-
-            // In this case, we close the pipes to signal to the parent that we crashed
-            close (parentToChild[READING_END]);
-            close (childToParent[WRITING_END]);
-            close (childErrToParent[WRITING_END]);
+            write (execError[WRITING_END], &theError, sizeof (theError));
 
             // Child should exit now.
             _exit(-1);
@@ -170,11 +259,40 @@ notQProcess::start (const string& program, const list<string>& args)
             close (parentToChild[READING_END]);
             close (childToParent[WRITING_END]);
             close (childErrToParent[WRITING_END]);
+            close (execError[WRITING_END]);
+
+            // Did the exec work?
+            ssize_t n;
+            while ((n = read (execError[READING_END], &theError, sizeof (theError))) == -1
+                   && errno == EINTR) {}
+            close (execError[READING_END]);
+            if (n == sizeof (theError)) {
+                dbgln ("notQProcess: couldn't run " << program << ", errno " << theError);
+                waitpid (this->pid, &this->exitStatus, 0);
+                close (parentToChild[WRITING_END]);
+                close (childToParent[READING_END]);
+                close (childErrToParent[READING_END]);
+                this->pid = 0;
+                this->error = NOTQPROCFAILEDTOSTART;
+                return NOTQTPROCESS_FAILURE;
+            }
 
             // Write to this->parentToChild[WRITING_END] to write to stdin of the child
             // Read from this->childToParent[READING_END] to read from stdout of child
             // Read from this->childErrToParent[READING_END] to read from stderr of child
 
+            // We drain the reading ends in bulk, so they mustn't block.
+            fcntl (this->childToParent[READING_END], F_SETFL,
+                   fcntl (this->childToParent[READING_END], F_GETFL) | O_NONBLOCK);
+            fcntl (this->childErrToParent[READING_END], F_SETFL,
+                   fcntl (this->childErrToParent[READING_END], F_GETFL) | O_NONBLOCK);
+            this->stdoutBuffer.clear();
+            this->stderrBuffer.clear();
+
+            if (this->eventLoop != NULL) {
+                this->eventLoop->addProcess (this);
+            }
+
             break;
     }
     return NOTQTPROCESS_MAIN_APP;
@@ -186,6 +304,10 @@ notQProcess::start (const string& program, const list<string>& args)
 notQProcess::waitForStarted (void)
 {
     unsigned int i=0;
+    if (this->error == NOTQPROCFAILEDTOSTART) {
+        this->callbacks->errorSignal (this->error);
+        return false;
+    }
     while (this->pid == 0 && i<1000) {
         usleep (1000);
         i++;
@@ -209,6 +331,9 @@ notQProcess::terminate (void)
 {
     kill (this->pid, 15); // 15 is TERM
     // Now check if the process has gone and kill it with signal 9 (KILL)
+    if (this->eventLoop != NULL) {
+        this->eventLoop->removeProcess (this);
+    }
     this->pid = 0;
     this->error = NOTQPROCNOERROR;
     this->signalledStart = false;
@@ -272,7 +397,19 @@ notQProcess::probeProcess (void)
     int theError;
     if (this->signalledStart == true) {
         int rtn = 0;
-        if ((rtn = waitpid (this->pid, (int *)0, WNOHANG)) == this->pid) {
+        if ((rtn = wait4 (this->pid, &this->exitStatus, WNOHANG, &this->usage)) == this->pid) {
+            // It may have written its last words and exited since
+            // we polled; pass them on before saying it has gone.
+            this->p[0].revents = 0;
+            this->p[1].revents = 0;
+            poll (this->p, 2, 0);
+            if (this->p[0].revents & (POLLIN | POLLPRI)) {
+                this->callbacks->readyReadStandardOutputSignal();
+            }
+            if (this->p[1].revents & (POLLIN | POLLPRI)) {
+                this->callbacks->readyReadStandardErrorSignal();
+            }
+            this->finished = true;
             this->callbacks->processFinishedSignal (this->progName);
             return;
         } else if (rtn == -1) {
@@ -291,22 +428,7 @@ notQProcess::probeProcess (void)
 notQProcess::readAllStandardOutput (void)
 {
     string s;
-    int bytes = 0;
-    char c;
-    struct pollfd p;
-
-    p.fd = this->childToParent[READING_END];
-    p.events = POLLIN | POLLPRI;
-    // We know we have at least one character to read, so seed revents
-    p.revents = POLLIN;
-    while (p.revents & POLLIN || p.revents & POLLPRI) {
-        // This read of 1 byte should never block
-        if ((bytes = read (this->childToParent[READING_END], &c, 1)) == 1) {
-            s.append (1, c);
-        }
-        p.revents = 0;
-        poll (&p, 1, 0);
-    }
+    this->standardOutput().takeAll (s);
     return s;
 }
 
@@ -315,25 +437,714 @@ notQProcess::readAllStandardOutput (void)
 notQProcess::readAllStandardError (void)
 {
     string s;
-    int bytes = 0;
-    char c;
-    struct pollfd p;
-
-    p.fd = this->childErrToParent[READING_END];
-    p.events = POLLIN | POLLPRI;
-    // We know we have at least one character to read, so seed revents
-    p.revents = POLLIN;
-    while (p.revents & POLLIN || p.revents & POLLPRI) {
-        // This read of 1 byte should never block because a poll() call tells us there is data
-        if ((bytes = read (this->childErrToParent[READING_END], &c, 1)) == 1) {
-            s.append (1, c);
+    this->standardError().takeAll (s);
+    return s;
+}
+
+    notQRingBuffer&
+notQProcess::standardOutput (void)
+{
+    this->stdoutBuffer.readFrom (this->childToParent[READING_END]);
+    return this->stdoutBuffer;
+}
+
+    notQRingBuffer&
+notQProcess::standardError (void)
+{
+    this->stderrBuffer.readFrom (this->childErrToParent[READING_END]);
+    return this->stderrBuffer;
+}
+
+//@}
+
+/*!
+ * Implementation of the notQRingBuffer class
+ */
+//@{
+
+// Constructor
+notQRingBuffer::notQRingBuffer (size_t initialSize) :
+    buf(NULL),
+    capacity(1),
+    head(0),
+    used(0),
+    eof(false),
+    readCalls(0)
+{
+    while (this->capacity < initialSize) {
+        this->capacity <<= 1;
+    }
+    this->buf = static_cast<char*>(malloc (this->capacity));
+}
+
+// Destructor
+notQRingBuffer::~notQRingBuffer ()
+{
+    free (this->buf);
+}
+
+    void
+notQRingBuffer::grow (size_t newSize)
+{
+    char * nbuf = static_cast<char*>(malloc (newSize));
+    size_t first = this->capacity - this->head;
+    if (first > this->used) {
+        first = this->used;
+    }
+    memcpy (nbuf, this->buf + this->head, first);
+    memcpy (nbuf + first, this->buf, this->used - first);
+    free (this->buf);
+    this->buf = nbuf;
+    this->capacity = newSize;
+    this->head = 0;
+}
+
+    ssize_t
+notQRingBuffer::readFrom (int fd)
+{
+    ssize_t total = 0;
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    for (;;) {
+        if (this->used == this->capacity) {
+            this->grow (this->capacity << 1);
+        }
+
+        // The free space is at most two pieces: from the end of
+        // the data to the end of the buffer, and from the start
+        // of the buffer up to the head.
+        size_t tail = (this->head + this->used) & (this->capacity - 1);
+        size_t space = this->capacity - this->used;
+        struct iovec iov[2];
+        int niov = 1;
+        iov[0].iov_base = this->buf + tail;
+        if (tail >= this->head) {
+            iov[0].iov_len = this->capacity - tail;
+            if (this->head > 0) {
+                iov[1].iov_base = this->buf;
+                iov[1].iov_len = this->head;
+                niov = 2;
+            }
+        } else {
+            iov[0].iov_len = space;
+        }
+
+        ssize_t n = readv (fd, iov, niov);
+        this->readCalls++;
+
+        if (n > 0) {
+            this->used += n;
+            total += n;
+            if (static_cast<size_t>(n) < space) {
+                // A short read means the pipe is empty; don't
+                // spend another syscall finding that out.
+                break;
+            }
+        } else if (n == 0) {
+            this->eof = true;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            return (total > 0) ? total : -1;
         }
-        p.revents = 0;
-        poll (&p, 1, 0);
     }
-    return s;
+    return total;
+}
+
+    size_t
+notQRingBuffer::peek (const char ** data) const
+{
+    *data = this->buf + this->head;
+    size_t first = this->capacity - this->head;
+    return (first < this->used) ? first : this->used;
+}
+
+    void
+notQRingBuffer::consume (size_t n)
+{
+    if (n >= this->used) {
+        this->head = 0;
+        this->used = 0;
+        return;
+    }
+    this->head = (this->head + n) & (this->capacity - 1);
+    this->used -= n;
+}
+
+    void
+notQRingBuffer::takeAll (string& out)
+{
+    const char * data;
+    size_t n;
+    out.reserve (out.size() + this->used);
+    while ((n = this->peek (&data)) > 0) {
+        out.append (data, n);
+        this->consume (n);
+    }
+}
+//@}
+
+/*!
+ * Implementation of the notQEventLoop class
+ */
+//@{
+
+int notQEventLoop::childSignalFD = -1;
+int notQEventLoop::childSignalUsers = 0;
+bool notQEventLoop::childWasBlocked = false;
+int notQEventLoop::childPipe[2] = { -1, -1 };
+struct sigaction notQEventLoop::childOldAction;
+list<notQEventLoop*> notQEventLoop::childLoops;
+
+/*!
+ * The SIGCHLD handler used when there's no signalfd: wake the loops
+ * through childPipe, and pass the signal on to whoever had it before.
+ */
+    void
+notQEventLoop::childHandler (int sig)
+{
+    int saved = errno;
+    if (notQEventLoop::childPipe[1] != -1) {
+        char c = 0;
+        if (write (notQEventLoop::childPipe[1], &c, 1) == -1) {
+            // Full, so the loops will wake anyway.
+        }
+    }
+    if (notQEventLoop::childOldAction.sa_handler != SIG_DFL
+        && notQEventLoop::childOldAction.sa_handler != SIG_IGN
+        && !(notQEventLoop::childOldAction.sa_flags & SA_SIGINFO)) {
+        notQEventLoop::childOldAction.sa_handler (sig);
+    }
+    errno = saved;
+}
+
+// Constructor
+notQEventLoop::notQEventLoop () :
+    epollFD(-1),
+    signalFD(-1),
+    isSetUp(false),
+    childExited(false),
+    quitting(false)
+{
+}
+
+// Destructor
+notQEventLoop::~notQEventLoop ()
+{
+    while (!this->processes.empty()) {
+        notQProcess * proc = this->processes.begin()->first;
+        this->removeProcess (proc);
+        proc->setEventLoop (NULL);
+    }
+    if (this->signalFD != -1) {
+        notQEventLoop::childLoops.remove (this);
+        notQEventLoop::releaseChildSignal();
+    }
+    if (this->epollFD != -1) {
+        close (this->epollFD);
+    }
+}
+
+    int
+notQEventLoop::acquireChildSignal (void)
+{
+    if (notQEventLoop::childSignalUsers > 0) {
+        notQEventLoop::childSignalUsers++;
+        return notQEventLoop::childSignalFD;
+    }
+
+#ifdef NOTQT_USE_EPOLL
+    // SIGCHLD has to be blocked for the signalfd to see it.
+    sigset_t chld, old;
+    sigemptyset (&chld);
+    sigaddset (&chld, SIGCHLD);
+    sigprocmask (SIG_BLOCK, &chld, &old);
+    notQEventLoop::childWasBlocked = sigismember (&old, SIGCHLD);
+
+    notQEventLoop::childSignalFD = signalfd (-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (notQEventLoop::childSignalFD != -1) {
+        notQEventLoop::childSignalUsers++;
+        return notQEventLoop::childSignalFD;
+    }
+    if (!notQEventLoop::childWasBlocked) {
+        sigprocmask (SIG_UNBLOCK, &chld, NULL);
+    }
+#endif
+
+    // No signalfd: a handler writes to a pipe instead.
+    if (pipe (notQEventLoop::childPipe) == -1) {
+        return -1;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl (notQEventLoop::childPipe[i], F_SETFD, FD_CLOEXEC);
+        fcntl (notQEventLoop::childPipe[i], F_SETFL,
+               fcntl (notQEventLoop::childPipe[i], F_GETFL) | O_NONBLOCK);
+    }
+    struct sigaction sa;
+    memset (&sa, 0, sizeof (sa));
+    sa.sa_handler = notQEventLoop::childHandler;
+    sigemptyset (&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    if (sigaction (SIGCHLD, &sa, &notQEventLoop::childOldAction) == -1) {
+        close (notQEventLoop::childPipe[0]);
+        close (notQEventLoop::childPipe[1]);
+        notQEventLoop::childPipe[0] = notQEventLoop::childPipe[1] = -1;
+        return -1;
+    }
+    notQEventLoop::childSignalFD = notQEventLoop::childPipe[0];
+    notQEventLoop::childSignalUsers++;
+    return notQEventLoop::childSignalFD;
 }
 
+    void
+notQEventLoop::childSignalled (void)
+{
+    if (notQEventLoop::childPipe[0] != -1) {
+        char buf[64];
+        while (read (notQEventLoop::childPipe[0], buf, sizeof (buf)) > 0) {}
+    }
+#ifdef NOTQT_USE_EPOLL
+    else {
+        struct signalfd_siginfo si;
+        while (read (notQEventLoop::childSignalFD, &si, sizeof (si)) == sizeof (si)) {}
+    }
+#endif
+
+    // We don't know which child it was, or whose; every loop's
+    // are cheap to ask.
+    list<notQEventLoop*>::iterator l;
+    for (l = notQEventLoop::childLoops.begin();
+         l != notQEventLoop::childLoops.end(); l++) {
+        (*l)->childExited = true;
+    }
+}
+
+    void
+notQEventLoop::releaseChildSignal (void)
+{
+    if (notQEventLoop::childSignalUsers == 0
+        || --notQEventLoop::childSignalUsers > 0) {
+        return;
+    }
+    if (notQEventLoop::childPipe[0] != -1) {
+        sigaction (SIGCHLD, &notQEventLoop::childOldAction, NULL);
+        close (notQEventLoop::childPipe[0]);
+        close (notQEventLoop::childPipe[1]);
+        notQEventLoop::childPipe[0] = notQEventLoop::childPipe[1] = -1;
+        notQEventLoop::childSignalFD = -1;
+        return;
+    }
+    close (notQEventLoop::childSignalFD);
+    notQEventLoop::childSignalFD = -1;
+    if (!notQEventLoop::childWasBlocked) {
+        // Only SIGCHLD: whatever else was blocked since is
+        // none of our business.
+        sigset_t chld;
+        sigemptyset (&chld);
+        sigaddset (&chld, SIGCHLD);
+        sigprocmask (SIG_UNBLOCK, &chld, NULL);
+    }
+}
+
+    void
+notQEventLoop::setUp (void)
+{
+    this->isSetUp = true;
+    this->signalFD = notQEventLoop::acquireChildSignal();
+    if (this->signalFD != -1) {
+        notQEventLoop::childLoops.push_back (this);
+        // Anything started before now may have exited unseen.
+        this->childExited = true;
+    }
+#ifdef NOTQT_USE_EPOLL
+    if (this->signalFD != -1) {
+        this->epollFD = epoll_create1 (EPOLL_CLOEXEC);
+    }
+    if (this->epollFD == -1) {
+        dbgln ("notQEventLoop: couldn't set up epoll, falling back to poll()");
+        return;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = this->signalFD;
+    epoll_ctl (this->epollFD, EPOLL_CTL_ADD, this->signalFD, &ev);
+
+    map<notQProcess*, vector<int> >::iterator i;
+    for (i = this->processes.begin(); i != this->processes.end(); i++) {
+        vector<int> fds;
+        fds.swap (i->second);
+        vector<int>::iterator j;
+        for (j = fds.begin(); j != fds.end(); j++) {
+            this->watchFd (i->first, *j);
+        }
+    }
+    map<int, Watch> watches;
+    watches.swap (this->watches);
+    map<int, Watch>::iterator w;
+    for (w = watches.begin(); w != watches.end(); w++) {
+        this->setWatch (w->first, w->second.events, w->second.cb);
+    }
+#endif
+}
+
+    void
+notQEventLoop::watchFd (notQProcess * proc, int fd)
+{
+    if (fd < 0) {
+        return;
+    }
+#ifdef NOTQT_USE_EPOLL
+    if (this->epollFD != -1) {
+        // Edge triggered: the probe reads everything there is,
+        // and a process whose output nobody reads mustn't keep
+        // the loop spinning.
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLPRI | EPOLLET;
+        ev.data.fd = fd;
+        if (epoll_ctl (this->epollFD, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            dbgln ("notQEventLoop: epoll_ctl failed for fd " << fd << ", errno " << errno);
+            return;
+        }
+    }
+#endif
+    this->processes[proc].push_back (fd);
+}
+
+    void
+notQEventLoop::addProcess (notQProcess * proc)
+{
+    this->removeProcess (proc);
+    // Make sure the process is known, even if it has no pipes.
+    this->processes[proc];
+    this->watchFd (proc, proc->getStdoutFD());
+    this->watchFd (proc, proc->getStderrFD());
+}
+
+    void
+notQEventLoop::removeFds (notQProcess * proc)
+{
+    map<notQProcess*, vector<int> >::iterator i = this->processes.find (proc);
+    if (i == this->processes.end()) {
+        return;
+    }
+#ifdef NOTQT_USE_EPOLL
+    if (this->epollFD != -1) {
+        vector<int>::iterator j;
+        for (j = i->second.begin(); j != i->second.end(); j++) {
+            epoll_ctl (this->epollFD, EPOLL_CTL_DEL, *j, NULL);
+        }
+    }
+#endif
+    i->second.clear();
+}
+
+    void
+notQEventLoop::removeProcess (notQProcess * proc)
+{
+    this->removeFds (proc);
+    this->processes.erase (proc);
+}
+
+    void
+notQEventLoop::setWatch (int fd, short events, notQWatchCallbacks * cb)
+{
+    if (fd < 0) {
+        return;
+    }
+    map<int, Watch>::iterator w = this->watches.find (fd);
+    bool known = (w != this->watches.end());
+
+#ifdef NOTQT_USE_EPOLL
+    if (this->epollFD != -1) {
+        struct epoll_event ev;
+        ev.events = 0;
+        if (events & POLLIN) { ev.events |= EPOLLIN; }
+        if (events & POLLOUT) { ev.events |= EPOLLOUT; }
+        ev.data.fd = fd;
+        int op = (events == 0) ? EPOLL_CTL_DEL : (known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+        if ((events != 0 || known)
+            && epoll_ctl (this->epollFD, op, fd, &ev) == -1) {
+            dbgln ("notQEventLoop: epoll_ctl failed for watch fd " << fd << ", errno " << errno);
+            if (events != 0) {
+                return;
+            }
+        }
+    }
+#endif
+
+    if (events == 0) {
+        if (known) {
+            this->watches.erase (w);
+        }
+        return;
+    }
+    Watch& watch = this->watches[fd];
+    watch.events = events;
+    watch.cb = cb;
+}
+
+    void
+notQEventLoop::setTimer (notQTimerCallbacks * cb, int ms)
+{
+    if (ms < 0) {
+        this->timers.erase (cb);
+        return;
+    }
+    this->timers[cb] = notQEventLoop::now() + ms * 1000LL;
+}
+
+    int
+notQEventLoop::timerWait (int timeout)
+{
+    if (this->timers.empty()) {
+        return timeout;
+    }
+    long long next = this->timers.begin()->second;
+    map<notQTimerCallbacks*, long long>::iterator t;
+    for (t = this->timers.begin(); t != this->timers.end(); t++) {
+        if (t->second < next) {
+            next = t->second;
+        }
+    }
+    // Round up, or we'd wake just before it and spin.
+    long long wait = (next - notQEventLoop::now() + 999) / 1000;
+    if (wait < 0) {
+        wait = 0;
+    }
+    if (timeout < 0 || wait < timeout) {
+        return static_cast<int>(wait);
+    }
+    return timeout;
+}
+
+    int
+notQEventLoop::runTimers (void)
+{
+    long long t0 = notQEventLoop::now();
+    list<notQTimerCallbacks*> due;
+    map<notQTimerCallbacks*, long long>::iterator t;
+    for (t = this->timers.begin(); t != this->timers.end(); t++) {
+        if (t->second <= t0) {
+            due.push_back (t->first);
+        }
+    }
+    int called = 0;
+    list<notQTimerCallbacks*>::iterator d;
+    for (d = due.begin(); d != due.end(); d++) {
+        // An earlier callback may have cancelled or moved it.
+        t = this->timers.find (*d);
+        if (t == this->timers.end() || t->second > t0) {
+            continue;
+        }
+        this->timers.erase (t);
+        (*d)->timerSignal();
+        called++;
+    }
+    return called;
+}
+
+    long long
+notQEventLoop::now (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return static_cast<long long>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+    void
+notQEventLoop::probe (notQProcess * proc)
+{
+    if (this->processes.find (proc) == this->processes.end()) {
+        // A callback from an earlier probe removed it.
+        return;
+    }
+    proc->probeProcess();
+    if (proc->getFinished() || proc->getError() > 0) {
+        this->removeProcess (proc);
+    }
+}
+
+    int
+notQEventLoop::runOnce (int timeout)
+{
+    if (this->isEmpty()) {
+        return -1;
+    }
+
+    if (!this->isSetUp) {
+        this->setUp();
+    }
+    timeout = this->timerWait (timeout);
+
+    // Work from a copy; callbacks may add or remove processes.
+    list<notQProcess*> ready;
+    map<notQProcess*, vector<int> >::iterator i;
+    bool all = false;
+    // Watched descriptors which are ready, and what for.
+    vector<pair<int, short> > readyWatches;
+
+#ifdef NOTQT_USE_EPOLL
+    if (this->epollFD != -1) {
+        struct epoll_event ev[16];
+        // Another loop may have read a SIGCHLD for us; don't
+        // sleep on it.
+        int n = epoll_wait (this->epollFD, ev, 16, this->childExited ? 0 : timeout);
+        if (n == -1) {
+            return (errno == EINTR) ? 0 : -1;
+        }
+        for (int k = 0; k < n; k++) {
+            int fd = ev[k].data.fd;
+            if (fd == this->signalFD) {
+                notQEventLoop::childSignalled();
+                continue;
+            }
+            if (this->watches.find (fd) != this->watches.end()) {
+                short revents = 0;
+                if (ev[k].events & EPOLLIN) { revents |= POLLIN; }
+                if (ev[k].events & EPOLLOUT) { revents |= POLLOUT; }
+                if (ev[k].events & EPOLLHUP) { revents |= POLLHUP; }
+                if (ev[k].events & EPOLLERR) { revents |= POLLERR; }
+                readyWatches.push_back (make_pair (fd, revents));
+                continue;
+            }
+            for (i = this->processes.begin(); i != this->processes.end(); i++) {
+                vector<int>::iterator j;
+                for (j = i->second.begin(); j != i->second.end(); j++) {
+                    if (*j == fd) { break; }
+                }
+                if (j == i->second.end()) {
+                    continue;
+                }
+                if (!(ev[k].events & (EPOLLIN | EPOLLPRI))) {
+                    // Hung up with nothing left to read.
+                    epoll_ctl (this->epollFD, EPOLL_CTL_DEL, fd, NULL);
+                    i->second.erase (j);
+                }
+                ready.push_back (i->first);
+                break;
+            }
+        }
+        if (this->childExited) {
+            this->childExited = false;
+            all = true;
+        }
+    } else
+#endif
+    {
+        vector<struct pollfd> pfds;
+        vector<notQProcess*> owners;
+        for (i = this->processes.begin(); i != this->processes.end(); i++) {
+            vector<int>::iterator j;
+            for (j = i->second.begin(); j != i->second.end(); j++) {
+                struct pollfd pfd;
+                pfd.fd = *j;
+                pfd.events = POLLIN | POLLPRI;
+                pfd.revents = 0;
+                pfds.push_back (pfd);
+                owners.push_back (i->first);
+            }
+        }
+        // The watches go on the end, with no owner.
+        map<int, Watch>::iterator w;
+        for (w = this->watches.begin(); w != this->watches.end(); w++) {
+            struct pollfd pfd;
+            pfd.fd = w->first;
+            pfd.events = w->second.events;
+            pfd.revents = 0;
+            pfds.push_back (pfd);
+            owners.push_back (NULL);
+        }
+        // Then the SIGCHLD descriptor, if we have one.
+        size_t sigIndex = pfds.size();
+        if (this->signalFD != -1) {
+            struct pollfd pfd;
+            pfd.fd = this->signalFD;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            pfds.push_back (pfd);
+            owners.push_back (NULL);
+        }
+        int n = poll (pfds.empty() ? NULL : &pfds[0], pfds.size(),
+                      this->childExited ? 0 : timeout);
+        if (n == -1 && errno != EINTR) {
+            return -1;
+        }
+        // Interrupted by the SIGCHLD handler, we carry on and ask
+        // the processes.
+        for (unsigned int k = 0; k < pfds.size(); k++) {
+            if (k == sigIndex) {
+                if (pfds[k].revents != 0) {
+                    notQEventLoop::childSignalled();
+                }
+                continue;
+            }
+            if (owners[k] == NULL) {
+                if (pfds[k].revents != 0) {
+                    readyWatches.push_back (make_pair (pfds[k].fd, pfds[k].revents));
+                }
+                continue;
+            }
+            if (pfds[k].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+                // Hung up: the probe below reads whatever is
+                // left, and after that it stays readable at EOF;
+                // stop polling it or we'd never sleep again.
+                vector<int>& fds = this->processes[owners[k]];
+                vector<int>::iterator j;
+                for (j = fds.begin(); j != fds.end(); j++) {
+                    if (*j == pfds[k].fd) { fds.erase (j); break; }
+                }
+            }
+        }
+        // poll() doesn't say which process a descriptor was
+        // for, and without SIGCHLD the only way to find out
+        // about an exit is to ask every time we wake up.
+        this->childExited = false;
+        all = true;
+    }
+
+    if (all) {
+        ready.clear();
+        for (i = this->processes.begin(); i != this->processes.end(); i++) {
+            ready.push_back (i->first);
+        }
+    } else {
+        ready.sort();
+        ready.unique();
+    }
+
+    int probed = this->runTimers();
+    vector<pair<int, short> >::iterator rw;
+    for (rw = readyWatches.begin(); rw != readyWatches.end(); rw++) {
+        // An earlier callback may have removed or replaced it.
+        map<int, Watch>::iterator w = this->watches.find (rw->first);
+        if (w == this->watches.end() || w->second.cb == NULL) {
+            continue;
+        }
+        w->second.cb->fdReadySignal (rw->first, rw->second);
+        probed++;
+    }
+
+    list<notQProcess*>::iterator r;
+    for (r = ready.begin(); r != ready.end(); r++) {
+        this->probe (*r);
+        probed++;
+    }
+    return probed;
+}
+
+    void
+notQEventLoop::run (void)
+{
+    this->quitting = false;
+    while (!this->quitting && this->runOnce (-1) >= 0) {}
+}
 //@}
 
 /*!
@@ -32,8 +32,12 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <map>
 extern "C" {
+#include <unistd.h>
+#include <signal.h>
 #include <sys/poll.h>
+#include <sys/resource.h>
 }
 #define NOTQTPROCESS_MAIN_APP 0
 #define NOTQTPROCESS_FAILURE -1
@@ -79,6 +83,122 @@ namespace nxcl {
 		virtual void readyReadStandardErrorSignal (void) {}
 	};
 
+	/*!
+	 * Callbacks for a file descriptor watched by a
+	 * notQEventLoop with notQEventLoop::setWatch().
+	 */
+	class notQWatchCallbacks
+	{
+	public:
+		notQWatchCallbacks() {}
+		virtual ~notQWatchCallbacks() {}
+		/*!
+		 * \arg fd is ready; \arg events holds POLLIN,
+		 * POLLOUT, POLLHUP and/or POLLERR.
+		 */
+		virtual void fdReadySignal (int fd, short events) {}
+	};
+
+	/*!
+	 * Callbacks for a timer set with notQEventLoop::setTimer().
+	 */
+	class notQTimerCallbacks
+	{
+	public:
+		notQTimerCallbacks() {}
+		virtual ~notQTimerCallbacks() {}
+		/*!
+		 * The timer has run out. It is no longer set, so
+		 * this may set it again.
+		 */
+		virtual void timerSignal (void) {}
+	};
+
+	class notQEventLoop;
+
+	/*!
+	 * A byte FIFO used to drain a process's pipes. It grows
+	 * as needed (never shrinks) and is reused from read to
+	 * read, so draining a pipe costs one read() per chunk
+	 * instead of a read() and a poll() per byte.
+	 *
+	 * Readers can look at the data in place with peek() and
+	 * then consume() it, or copy the lot out with takeAll().
+	 */
+	class notQRingBuffer
+	{
+	public:
+		notQRingBuffer (size_t initialSize = 4096);
+		~notQRingBuffer();
+
+		/*!
+		 * Read everything which is available on the
+		 * non-blocking descriptor \arg fd into the buffer.
+		 *
+		 * \return the number of bytes read (0 if none were
+		 * available, or at end of file), or -1 on error.
+		 */
+		ssize_t readFrom (int fd);
+
+		/*!
+		 * Get a pointer to the first contiguous block of
+		 * buffered data in \arg data.
+		 *
+		 * \return the size of that block. This may be less
+		 * than size() if the data wraps around the end of
+		 * the buffer; consume() it and peek() again for the
+		 * rest.
+		 */
+		size_t peek (const char ** data) const;
+		/*!
+		 * Discard the first \arg n bytes.
+		 */
+		void consume (size_t n);
+		/*!
+		 * Append all the buffered data to \arg out and
+		 * empty the buffer.
+		 */
+		void takeAll (string& out);
+		/*!
+		 * Empty the buffer and forget any end of file.
+		 */
+		void clear (void) { this->head = 0; this->used = 0; this->eof = false; }
+
+		size_t size (void) const { return this->used; }
+		bool empty (void) const { return this->used == 0; }
+		/*!
+		 * True once readFrom() has seen end of file.
+		 */
+		bool atEnd (void) const { return this->eof; }
+		/*!
+		 * The number of read() system calls made so far.
+		 */
+		unsigned long getReadCalls (void) const { return this->readCalls; }
+
+	private:
+		/*!
+		 * Reallocate to \arg newSize bytes (a power of two),
+		 * moving the data to the start of the new buffer.
+		 */
+		void grow (size_t newSize);
+
+		char * buf;
+		/*!
+		 * Allocated size, always a power of two.
+		 */
+		size_t capacity;
+		/*!
+		 * Index of the first byte of data.
+		 */
+		size_t head;
+		/*!
+		 * Number of bytes of data.
+		 */
+		size_t used;
+		bool eof;
+		unsigned long readCalls;
+	};
+
 	/*!
 	 * notQProcess is a simple replacement for the Qt class QProcess.
 	 */
@@ -104,9 +224,12 @@ namespace nxcl {
 		 * poll to see if there is data on stderr or stdout
 		 * and to see if the process has exited.
 		 *
-		 * This must be called on a scheduled basis. It checks
-		 * for any stdout/stderr data and also checks whether
-		 * the process is still running.
+		 * This must be called on a scheduled basis, unless
+		 * the process has been given a notQEventLoop with
+		 * setEventLoop(), in which case the event loop calls
+		 * it whenever there is something to look at. It
+		 * checks for any stdout/stderr data and also checks
+		 * whether the process is still running.
 		 */
 		void probeProcess (void);
 
@@ -115,25 +238,44 @@ namespace nxcl {
 		 */
 		//@{
 		pid_t getPid (void) { return this->pid; }
+		string getProgName (void) { return this->progName; }
 		int getError (void) { return this->error; }
 		void setError (int e) { this->error = e; }
-		
-		int getParentFD() 
-		{ 
-			this->parentFD = this->parentToChild[1];
-			close(this->childToParent[0]);
-
-			// Create new pipes
-			pipe(this->parentToChild);
-			pipe(this->childToParent);
+		/*!
+		 * True once the process has been reaped by
+		 * probeProcess(). Cleared by start().
+		 */
+		bool getFinished (void) { return this->finished; }
+		/*!
+		 * The status from waitpid(), and the resources used
+		 * by the process, once getFinished() is true.
+		 */
+		int getExitStatus (void) { return this->exitStatus; }
+		const struct rusage& getUsage (void) { return this->usage; }
+		int getStdoutFD (void) { return this->childToParent[0]; }
+		int getStderrFD (void) { return this->childErrToParent[0]; }
 
-			return this->parentFD;
-		}
+		/*!
+		 * Hand over the parent's end of the stdin/stdout
+		 * socketpair (so that it can be given to another
+		 * process, e.g. nxproxy) and replace it with fresh
+		 * pipes.
+		 */
+		int getParentFD (void);
 
 		/*!
 		 * Setter for the callbacks.
 		 */
 		void setCallbacks (notQProcessCallbacks * cb) { this->callbacks = cb; }
+
+		/*!
+		 * Attach the process to an event loop. When the
+		 * process is started, its stdout and stderr pipes are
+		 * registered with the loop, which then calls
+		 * probeProcess() when there is data or the process
+		 * exits. Pass NULL to go back to manual probing.
+		 */
+		void setEventLoop (notQEventLoop * loop);
 		//@}
 
 		/*! 
@@ -142,6 +284,14 @@ namespace nxcl {
 		//@{
 		string readAllStandardOutput (void);
 		string readAllStandardError (void);
+		/*!
+		 * Drain the stdout (or stderr) pipe into the
+		 * process's buffer and return that, so the caller
+		 * can peek() and consume() the data without copying
+		 * it into a string.
+		 */
+		notQRingBuffer& standardOutput (void);
+		notQRingBuffer& standardError (void);
 		/*!
 		 * Wait for the process to get itself going. Do this
 		 * by looking at pid.  If no pid after a while,
@@ -188,6 +338,12 @@ namespace nxcl {
 		 * Used in the poll() call in probeProcess()
 		 */
 		struct pollfd * p;
+		/*!
+		 * Data read from the stdout and stderr pipes which
+		 * hasn't been taken yet.
+		 */
+		notQRingBuffer stdoutBuffer;
+		notQRingBuffer stderrBuffer;
 		/*!
 		 * Pointer to a callback object
 		 */
@@ -197,6 +353,238 @@ namespace nxcl {
 		 * old parent FD for comm with child
 		 */
 		int parentFD;
+		/*!
+		 * Set when waitpid() has reaped the process.
+		 */
+		bool finished;
+		int exitStatus;
+		struct rusage usage;
+		/*!
+		 * The event loop which watches this process, or NULL.
+		 */
+		notQEventLoop * eventLoop;
+	};
+
+	/*!
+	 * A minimal event loop for notQProcess objects - the
+	 * notQt counterpart of QEventLoop.
+	 *
+	 * Instead of calling notQProcess::probeProcess() on a
+	 * timer, register the processes with a notQEventLoop and
+	 * call runOnce() or run(). The loop sleeps in the kernel
+	 * until one of the stdout/stderr pipes becomes readable
+	 * or a child process exits, and only then probes the
+	 * processes concerned.
+	 *
+	 * On Linux, this uses epoll and a signalfd for SIGCHLD.
+	 * Nothing is set up until the loop is first run; from
+	 * then until the last such loop is destroyed, the
+	 * library blocks SIGCHLD in the calling thread (child
+	 * processes started by notQProcess get it unblocked
+	 * again). A program which handles SIGCHLD itself won't
+	 * see it in that time. All the loops share one signalfd,
+	 * and whichever reads a SIGCHLD passes it on to the
+	 * others, since it can't tell whose child exited.
+	 *
+	 * Elsewhere it falls back to poll(). SIGCHLD isn't
+	 * blocked then; instead, while any loop is set up, the
+	 * library installs a SIGCHLD handler which writes to a
+	 * pipe that the loops poll, and which calls the
+	 * program's own handler (if it had one that takes a
+	 * single int) after it.
+	 *
+	 * Several NXClientLib objects can share one loop via
+	 * NXClientLib::setEventLoop().
+	 */
+	class notQEventLoop
+	{
+	public:
+		notQEventLoop();
+		~notQEventLoop();
+
+		/*!
+		 * Watch \arg proc's stdout and stderr pipes, and
+		 * its exit. Normally called by notQProcess::start()
+		 * for processes given this loop with
+		 * notQProcess::setEventLoop(). Calling it again for
+		 * the same process re-reads its file descriptors.
+		 */
+		void addProcess (notQProcess * proc);
+		/*!
+		 * Stop watching \arg proc.
+		 */
+		void removeProcess (notQProcess * proc);
+		/*!
+		 * Stop watching \arg proc's pipes, but carry on
+		 * watching for its exit.
+		 */
+		void removeFds (notQProcess * proc);
+
+		/*!
+		 * Watch \arg fd for \arg events (POLLIN and/or
+		 * POLLOUT) and call \arg cb when it is ready. This
+		 * lets other event sources - a D-Bus connection, for
+		 * instance - share the loop with the processes.
+		 *
+		 * Calling it again for the same fd replaces the
+		 * events and callbacks; events of 0 stops watching
+		 * it. Unlike the process pipes, these watches are
+		 * level triggered, so cb is called on every
+		 * runOnce() for as long as fd stays ready.
+		 */
+		void setWatch (int fd, short events, notQWatchCallbacks * cb);
+		void removeWatch (int fd) { this->setWatch (fd, 0, NULL); }
+
+		/*!
+		 * Call \arg cb once, from runOnce(), \arg ms
+		 * milliseconds from now. Each callbacks object has
+		 * one timer; calling it again moves the timer, and
+		 * removeTimer() (or a negative ms) cancels it.
+		 */
+		void setTimer (notQTimerCallbacks * cb, int ms);
+		void removeTimer (notQTimerCallbacks * cb) { this->setTimer (cb, -1); }
+
+		/*!
+		 * Wait up to \arg timeout milliseconds (-1 for no
+		 * limit) for something to happen, or the next timer
+		 * if that's sooner, and probe the processes which
+		 * have something to say.
+		 *
+		 * \return the number of processes probed and
+		 * watches and timers called (0 on timeout), or -1 if
+		 * there is nothing to watch or wait for or an error
+		 * occurred.
+		 */
+		int runOnce (int timeout = -1);
+		/*!
+		 * Call runOnce() until quit() is called or there are
+		 * no more processes, watches or timers.
+		 */
+		void run (void);
+		/*!
+		 * Make run() return after the current iteration.
+		 */
+		void quit (void) { this->quitting = true; }
+
+		bool isEmpty (void)
+		{
+			return this->processes.empty() && this->watches.empty()
+				&& this->timers.empty();
+		}
+
+	private:
+		/*!
+		 * Probe proc, and forget about it if it has exited.
+		 */
+		void probe (notQProcess * proc);
+		/*!
+		 * \return \arg timeout, or the milliseconds until the
+		 * next timer if that's sooner.
+		 */
+		int timerWait (int timeout);
+		/*!
+		 * Call the timers which have run out.
+		 *
+		 * \return how many were called.
+		 */
+		int runTimers (void);
+		/*!
+		 * Microseconds on the monotonic clock
+		 */
+		static long long now (void);
+		/*!
+		 * Register fd with the kernel (once the epoll set
+		 * exists) and record it against proc.
+		 */
+		void watchFd (notQProcess * proc, int fd);
+		/*!
+		 * Take a share of the SIGCHLD descriptor, create the
+		 * epoll set and register what we already watch. Called
+		 * the first time the loop is run.
+		 */
+		void setUp (void);
+		/*!
+		 * Block SIGCHLD and open the shared signalfd or, if
+		 * there's no signalfd, install childHandler() and its
+		 * pipe; unless another loop already has.
+		 *
+		 * \return the descriptor which is readable after a
+		 * SIGCHLD, or -1 on failure.
+		 */
+		static int acquireChildSignal (void);
+		/*!
+		 * Give up a share taken by acquireChildSignal(); the
+		 * last one closes the descriptor, and unblocks SIGCHLD
+		 * (unless it was blocked before) or puts back the old
+		 * handler.
+		 */
+		static void releaseChildSignal (void);
+		/*!
+		 * Empty the SIGCHLD descriptor, and tell every loop
+		 * that a child has exited.
+		 */
+		static void childSignalled (void);
+		/*!
+		 * The SIGCHLD handler used without a signalfd
+		 */
+		static void childHandler (int sig);
+
+		/*!
+		 * The processes we're looking after, each with the
+		 * descriptors we watch for it.
+		 */
+		map<notQProcess*, vector<int> > processes;
+		/*!
+		 * A descriptor registered with setWatch().
+		 */
+		struct Watch {
+			short events;
+			notQWatchCallbacks * cb;
+		};
+		/*!
+		 * The descriptors registered with setWatch().
+		 */
+		map<int, Watch> watches;
+		/*!
+		 * The timers set with setTimer(), and when each runs
+		 * out (see now()).
+		 */
+		map<notQTimerCallbacks*, long long> timers;
+		/*!
+		 * The epoll instance, or -1 if using poll().
+		 */
+		int epollFD;
+		/*!
+		 * The shared SIGCHLD descriptor, or -1 if there
+		 * isn't one or the loop isn't set up yet.
+		 */
+		int signalFD;
+		/*!
+		 * True once setUp() has been called.
+		 */
+		bool isSetUp;
+		/*!
+		 * A child has exited since we last probed every
+		 * process; set by whichever loop read the SIGCHLD.
+		 */
+		bool childExited;
+		/*!
+		 * The SIGCHLD block and signalfd (or handler and
+		 * pipe) shared by all the loops which have been set
+		 * up, and those loops.
+		 */
+		//@{
+		static int childSignalFD;
+		static int childSignalUsers;
+		static bool childWasBlocked;
+		static int childPipe[2];
+		static struct sigaction childOldAction;
+		static list<notQEventLoop*> childLoops;
+		//@}
+		/*!
+		 * Set by quit().
+		 */
+		bool quitting;
 	};
 
 	/*!
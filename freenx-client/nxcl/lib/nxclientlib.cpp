@@ -46,6 +46,22 @@ extern "C" {
 #include <stdlib.h>
 #include <string.h>
 
+/*!
+ * How long to wait, in milliseconds, for the server to finish talking
+ * on the connection which nxproxy is to take over.
+ */
+#define NXCL_SWITCH_WAIT 1000
+
+/*!
+ * With auto-reconnect, ssh asks the server whether it is alive after
+ * this many seconds of silence, and gives up on the link after this
+ * many questions go unanswered.
+ */
+//@{
+#define NXCL_ALIVE_INTERVAL 5
+#define NXCL_ALIVE_COUNT 3
+//@}
+
 /*
  * On the location of nxproxy and nxssh binaries
  * --------------------------------------------- 
@@ -69,20 +85,39 @@ NXClientLibCallbacks::~NXClientLibCallbacks()
 {
 }
 
-void NXClientLibCallbacks::startedSignal (string name)
+void NXClientLibCallbacks::startedSignal (notQProcess * proc)
 {
     this->parent->externalCallbacks->write
-        (NXCL_PROCESS_STARTED, name + _(" process started"));
+        (NXCL_PROCESS_STARTED, proc->getProgName() + _(" process started"));
+    this->parent->traceStage ("process started", proc->getProgName());
 }
 
-void NXClientLibCallbacks::processFinishedSignal (string name)
+void NXClientLibCallbacks::exitedSignal (notQProcess * proc,
+                                         const NXProcessExit& status)
 {
     this->parent->externalCallbacks->write
-        (NXCL_PROCESS_EXITED, name + _(" process exited"));
-    parent->setIsFinished (true);
+        (NXCL_PROCESS_EXITED, proc->getProgName() + _(" process exited"));
+    this->parent->traceStage ("process exited", status.name + ": " + status.describe());
+
+    // nxauth only runs to set up the X authority.
+    bool lost = proc != this->parent->getNXAuthProcess()
+        && this->parent->linkLost (proc, status);
+
+    // Not an error if we are reconnecting.
+    if (!status.clean() && !lost) {
+        this->parent->externalCallbacks->error
+            (status.name + _(" crashed or exited: ") + status.describe());
+    } else {
+        this->parent->externalCallbacks->debug
+            (status.name + " " + status.describe());
+    }
+
+    if (proc != this->parent->getNXAuthProcess() && !lost) {
+        parent->setIsFinished (true);
+    }
 }
 
-void NXClientLibCallbacks::errorSignal (int error)
+void NXClientLibCallbacks::errorSignal (notQProcess * proc, int error)
 {
     string message;
     switch (error) {
@@ -106,17 +141,27 @@ void NXClientLibCallbacks::errorSignal (int error)
             break;
     }
 
+    this->parent->traceStage ("process error", proc->getProgName() + ": " + message);
     this->parent->externalCallbacks->error (message);
 }
 
-void NXClientLibCallbacks::readyReadStandardOutputSignal()
+void NXClientLibCallbacks::readyReadStandardOutputSignal (notQProcess * proc)
 {
-    this->parent->processParseStdout();
+    if (proc == this->parent->getNXSSHProcess()) {
+        this->parent->processParseStdout();
+    } else {
+        // Nobody reads the others' output; don't let it pile up.
+        proc->standardOutput().clear();
+    }
 }
 
-void NXClientLibCallbacks::readyReadStandardErrorSignal()
+void NXClientLibCallbacks::readyReadStandardErrorSignal (notQProcess * proc)
 {
-    this->parent->processParseStderr();
+    if (proc == this->parent->getNXSSHProcess()) {
+        this->parent->processParseStderr();
+    } else {
+        proc->standardError().clear();
+    }
 }
 
 /*!
@@ -124,7 +169,9 @@ void NXClientLibCallbacks::readyReadStandardErrorSignal()
  */
 void NXClientLibCallbacks::noSessionsSignal()
 {
-    this->parent->externalCallbacks->noSessionsSignal();
+    if (!this->parent->resumeLost (list<NXResumeData>())) {
+        this->parent->externalCallbacks->noSessionsSignal();
+    }
 }
 
 void NXClientLibCallbacks::loginFailedSignal()
@@ -144,7 +191,56 @@ void NXClientLibCallbacks::authenticatedSignal()
 
 void NXClientLibCallbacks::sessionsSignal (list<NXResumeData> data)
 {
-    this->parent->externalCallbacks->resumeSessionsSignal (data);
+    if (!this->parent->resumeLost (data)) {
+        this->parent->externalCallbacks->resumeSessionsSignal (data);
+    }
+}
+
+void NXClientLibCallbacks::startingSessionSignal (NXSessionData * data)
+{
+    this->parent->startingSession (data);
+}
+
+void NXClientLibCallbacks::sessionsChangedSignal (const NXResumeDelta& delta)
+{
+    this->parent->externalCallbacks->sessionsChangedSignal (delta);
+}
+
+void NXClientLibCallbacks::stageSignal (const string& stage)
+{
+    this->parent->traceStage ("stage", stage);
+}
+
+void NXClientLibCallbacks::controlReadySignal (void)
+{
+    this->parent->externalCallbacks->controlReadySignal();
+}
+
+void NXClientLibCallbacks::controlListSignal (list<NXResumeData> data)
+{
+    this->parent->traceStage ("listed sessions");
+    this->parent->externalCallbacks->controlListSignal (data);
+}
+
+void NXClientLibCallbacks::controlTerminatedSignal (const string& id, bool terminated)
+{
+    this->parent->traceStage ("terminated session", id);
+    this->parent->externalCallbacks->controlTerminatedSignal (id, terminated);
+}
+
+void NXClientLibCallbacks::serverInfoSignal (const NXServerInfo& info)
+{
+    this->parent->learntServer (info);
+}
+
+void NXClientLibCallbacks::timerSignal (void)
+{
+    this->parent->reconnect();
+}
+
+void NXClientLibCallbacks::switchReadySignal (NXSwitchResult result)
+{
+    this->parent->switchReady (result);
 }
 //@}
 
@@ -153,24 +249,37 @@ void NXClientLibCallbacks::sessionsSignal (list<NXResumeData> data)
  */
 //@{
 NXClientLib::NXClientLib() :
-    nxsshProcess(new notQProcess()),
-    nxproxyProcess(new notQProcess()),
-    x11Process(new notQProcess()),
-    nxauthProcess(new notQProcess())
+    eventLoop(&ownEventLoop),
+    relay(NULL),
+    proxySwitch(NULL)
 {
     this->isFinished = false;
     this->readyForProxy = false;
+    this->byeSent = false;
+    this->switchSeen = false;
+    this->proxyInvoked = false;
     this->sessionRunning = false;
     this->proxyData.encrypted = false;
     this->password = false;
+    this->serverPort = 22;
+    this->useServerCache = true;
+    this->autoReconnect = false;
+    this->reconnectMax = 10;
+    this->reconnectFirstMs = 500;
+    this->reconnectMaxMs = 30000;
+    this->sshEncryption = true;
+    this->reconnectAttempt = 0;
+    this->reconnectAt = 0;
 
     dbgln ("In NXClientLib constructor");
 
-    /* Set up callback pointers */
-    this->nxsshProcess->setCallbacks (&callbacks);
-    this->nxproxyProcess->setCallbacks (&callbacks);
-    this->x11Process->setCallbacks (&callbacks);
-    this->nxauthProcess->setCallbacks (&callbacks);
+    /* The processes, all handled by callbacks */
+    this->processes.add ("nxssh", &callbacks);
+    this->processes.add ("nxproxy", &callbacks);
+    this->processes.add ("x11", &callbacks);
+    this->processes.add ("nxauth", &callbacks);
+
+    this->setEventLoop (this->eventLoop);
 
     this->session.setCallbacks (&callbacks);
     this->callbacks.setParent (this);
@@ -181,6 +290,11 @@ NXClientLib::NXClientLib() :
 NXClientLib::~NXClientLib()
 {
     dbgln ("In NXClientLib destructor");
+    // The loop may be shared, and outlive us.
+    this->eventLoop->removeTimer (&this->callbacks);
+    // These use nxssh's descriptor, so go first.
+    delete this->proxySwitch;
+    delete this->relay;
 }
 
 void NXClientLib::invokeNXSSH (string publicKey, string serverHost,
@@ -189,11 +303,24 @@ void NXClientLib::invokeNXSSH (string publicKey, string serverHost,
     list<string> arguments;
     stringstream argtmp;
     proxyData.server = serverHost;
+    this->serverPort = port;
+    this->sshPublicKey = publicKey;
+    this->sshKey = key;
+    this->sshEncryption = encryption;
 
     dbgln("invokeNXSSH called");
 
+    NXServerInfo info;
+    if (this->useServerCache && this->serverCache.lookup (serverHost, port, info)) {
+        dbgln ("Server " << serverHost << ":" << port << " is cached, version "
+                << info.version);
+        this->session.setServerInfo (info);
+    } else {
+        this->session.clearServerInfo();
+    }
+
     // We use same environment for the process as was used for the
-    // parent, so remove nxsshProcess->setEnvironment();
+    // parent, so remove this->getNXSSHProcess()->setEnvironment();
 
     // Start to build the arguments for the nxssh command.
     // notQProcess requires that argv[0] contains the program name
@@ -243,6 +370,14 @@ void NXClientLib::invokeNXSSH (string publicKey, string serverHost,
     arguments.push_back ("-oRSAAuthentication no");
     arguments.push_back ("-oRhostsRSAAuthentication no");
     arguments.push_back ("-oPubkeyAuthentication yes");
+    if (this->autoReconnect) {
+        argtmp.str("");
+        argtmp << "-oServerAliveInterval " << NXCL_ALIVE_INTERVAL;
+        arguments.push_back (argtmp.str());
+        argtmp.str("");
+        argtmp << "-oServerAliveCountMax " << NXCL_ALIVE_COUNT;
+        arguments.push_back (argtmp.str());
+    }
     // FF-FIXME: Perhaps the user wants to login as user directly
     //arguments.push_back ("-c nxserver");
 
@@ -271,9 +406,13 @@ void NXClientLib::invokeNXSSH (string publicKey, string serverHost,
     string nxsshPath = this->getPath ("ssh");
 #endif
 
-    this->nxsshProcess->start(nxsshPath, arguments);
+    // The trace of a connection starts here.
+    this->trace.clear();
+    this->linkMeter.reset();
+    this->traceStage ("starting nxssh");
+    this->getNXSSHProcess()->start(nxsshPath, arguments);
 
-    if (this->nxsshProcess->waitForStarted() == false) {
+    if (this->getNXSSHProcess()->waitForStarted() == false) {
         this->externalCallbacks->write
             (NXCL_PROCESS_ERROR, _("Error starting nxssh!"));
         this->isFinished = true;
@@ -291,7 +430,22 @@ void NXClientLib::requestConfirmation (string msg)
 
 void NXClientLib::reset()
 {
-    this->nxsshProcess->terminate();
+    // terminate() would signal our whole process group if nxssh
+    // had already gone.
+    if (this->getNXSSHProcess()->getPid() > 0) {
+        this->getNXSSHProcess()->terminate();
+    }
+    this->stdoutFramer.reset();
+    this->stderrFramer.reset();
+    delete this->proxySwitch;
+    this->proxySwitch = NULL;
+    delete this->relay;
+    this->relay = NULL;
+    this->byeSent = false;
+    this->switchSeen = false;
+    this->proxyInvoked = false;
+    this->readyForProxy = false;
+    this->sessionRunning = false;
     this->isFinished = false;
     this->proxyData.encrypted = false;
     this->password = false;	
@@ -304,176 +458,162 @@ void NXClientLib::loginFailed()
         (NXCL_LOGIN_FAILED, _("Got \"Login Failed\""));
 
     this->isFinished = true;
-    this->nxsshProcess->terminate();
+    this->getNXSSHProcess()->terminate();
 }
 
 void NXClientLib::processParseStdout()
 {
-    string message = nxsshProcess->readAllStandardOutput();
-
-    this->externalCallbacks->stdoutSignal (message);
-
-    dbgln ("NXClientLib::processParseStdout() called");
-
-    int response = 0;
+    notQRingBuffer& output = this->getNXSSHProcess()->standardOutput();
 
-    // Message 211 is sent if ssh is asking to continue with an unknown host
-    if ((response = session.parseResponse(message)) == 211) {
-        this->requestConfirmation (message);
-    }
-
-    dbgln ("NXClientLib::processParseStdout(): response = " << response);
-
-    if (response == 100000) {
-        // A program never started.
-        this->isFinished = true;
+    if (output.empty()) {
         return;
-    } else if (response > 100000) {
-        dbgln ("A process crashed or exited");
-
-        int pid = response - 100000;
+    }
 
-        if (this->nxsshProcess->getPid() == pid) {
-            this->nxsshProcess->setError(NOTQPROCCRASHED);
+    // Partial lines are kept by the framer until the rest arrives.
+    size_t n = this->stdoutFramer.feed (output);
 
-            this->externalCallbacks->error
-                (_("nxsshProcess crashed or exited"));
+    this->externalCallbacks->stdoutSignal (this->stdoutFramer.recent (n));
 
-            this->isFinished = true;
-        } else if (this->nxproxyProcess->getPid() == pid) {
-            this->nxproxyProcess->setError(NOTQPROCCRASHED);
+    dbgln ("NXClientLib::processParseStdout(): The message is '"
+            + this->stdoutFramer.recent (n) + "'(msg end)");
 
-            this->externalCallbacks->error
-                (_("nxproxyProcess crashed or exited"));
+    this->linkMeter.received (n, NXTrace::now());
 
-            this->isFinished = true;
-        } else {
-            this->externalCallbacks->error
-                (_("Warning: Don't know what crashed "
-                   "(in processParseStdout())"));
-        }
-        return;
+    NXLine line;
+    while (this->isFinished == false && this->switchSeen == false
+           && this->stdoutFramer.next (line)) {
+        this->parseStdoutLine (line);
     }
+    return;
+}
 
-    // If message 204 is picked, that's authentication failed.
-    if (response == 204) {
-        this->externalCallbacks->write (NXCL_AUTH_FAILED,
-                _("Got \"Authentication Failed\" from nxssh.\n"
-                    "Please check the certificate for the first SSL "
-                    "authentication stage,\n"
-                    "in which the \"nx\" user is authenticated."));
-        this->isFinished = true;
-        return;
-    }
+void NXClientLib::parseStdoutLine (const NXLine& line)
+{
+    dbgln ("NXClientLib::parseStdoutLine(): Processing the message '"
+            + line.str() + "'(end msg)");
 
-    // 147 is server capacity reached
-    if (response == 147) {
-        this->externalCallbacks->serverCapacitySignal();
-        this->isFinished = true;
+    this->traceReply (line);
+
+#ifndef NXCL_USE_NXSSH
+    if (this->byeSent && NXSwitch::isByeEcho (line.str())) {
+        // The server has finished with stdout; anything after
+        // this is for nxproxy.
+        this->traceStage ("bye echoed");
+        this->switchSeen = true;
         return;
     }
+#endif
 
-    dbgln ("NXClientLib::processParseStdout(): The message is '"
-            + message + "'(msg end)");
-
-    dbgln ("...and response is " << response);
-
-    notQtUtilities::ensureUnixNewlines (message);
+    switch (line.code) {
+        case 211:
+            // ssh is asking to continue with an unknown host
+            this->requestConfirmation (line.str());
+            break;
 
-    list<string> msglist;
-    list<string>::iterator msgiter;
+        case 204:
+            // Authentication failed.
+            this->externalCallbacks->write (NXCL_AUTH_FAILED,
+                    _("Got \"Authentication Failed\" from nxssh.\n"
+                        "Please check the certificate for the first SSL "
+                        "authentication stage,\n"
+                        "in which the \"nx\" user is authenticated."));
+            this->isFinished = true;
+            return;
 
-    notQtUtilities::splitString (message, '\n', msglist);
+        case 147:
+            // Server capacity reached
+            this->externalCallbacks->serverCapacitySignal();
+            this->isFinished = true;
+            return;
 
-    for (msgiter = msglist.begin(); msgiter != msglist.end(); msgiter++) {
-        dbgln ("NXClientLib::processParseStdout(): Processing the message '"
-                + (*msgiter) + "'(end msg)");
+    }
 
-        // On some connections this is sent via stdout instead of stderr?
-        if (proxyData.encrypted && readyForProxy &&
-                ((*msgiter).find("NX> 999 Bye")!=string::npos)) 
+    // On some connections this is sent via stdout instead of stderr?
+    if (proxyData.encrypted && readyForProxy && line.code == 999) 
 #ifdef NXCL_USE_NXSSH
-	{
-            // This is "NX> 299 Switching connection to: " in
-            // version 1.5.0. This was changed in nxssh version
-            // 2.0.0-8 (see the nxssh CHANGELOG).
-            string switchCommand = "NX> 299 Switch connection to: ";
+    {
+        // This is "NX> 299 Switching connection to: " in
+        // version 1.5.0. This was changed in nxssh version
+        // 2.0.0-8 (see the nxssh CHANGELOG).
+        string switchCommand = "NX> 299 Switch connection to: ";
 
-            stringstream ss;
+        stringstream ss;
 
-            ss << "127.0.0.1:" << proxyData.port << " cookie: " <<
-                proxyData.cookie << "\n";
-            switchCommand += ss.str();
+        ss << "127.0.0.1:" << proxyData.port << " cookie: " <<
+            proxyData.cookie << "\n";
+        switchCommand += ss.str();
 
-            this->write (switchCommand);
-        } else if ((*msgiter).find
-                ("NX> 287 Redirected I/O to channel descriptors") !=
-                string::npos) {
+        this->write (switchCommand);
+    } else if (line.code == 287) {
 
-            this->externalCallbacks->write
-                (287, _("The session has been started successfully"));
-            this->externalCallbacks->connectedSuccessfullySignal();
-            this->sessionRunning = true;
-        }
+        this->externalCallbacks->write
+            (287, _("The session has been started successfully"));
+        this->externalCallbacks->connectedSuccessfullySignal();
+        this->sessionRunning = true;
+    }
 #else /* don't use nxssh, start nxproxy -stdin */
-	{
-		invokeProxy();
-	}
+    {
+        this->traceStage ("server said bye", "stdout");
+        this->switchSeen = true;
+        invokeProxy();
+        return;
+    }
 #endif
 
-        if ((*msgiter).find("Password") != string::npos) {
-            this->externalCallbacks->write
-                (NXCL_AUTHENTICATING, _("Authenticating with NX server"));
-            this->password = true;
-        }
+    if (line.contains ("Password")) {
+        this->externalCallbacks->write
+            (NXCL_AUTHENTICATING, _("Authenticating with NX server"));
+        this->password = true;
+    }
 
-        if (!readyForProxy) {
-            string msg = session.parseSSH (*msgiter);
-            if (msg == "204\n" || msg == "147\n") {
-                // Auth failed.
-                dbgln ("NXClientLib::processParseStdout: Got auth failed"
-                        " or capacity reached, calling this->parseSSH.");
-                msg = this->parseSSH (*msgiter);
+    if (!readyForProxy) {
+        string msg = session.parseSSH (line);
+        if (msg == "204\n" || msg == "147\n") {
+            // Auth failed.
+            dbgln ("NXClientLib::parseStdoutLine: Got auth failed"
+                    " or capacity reached, calling this->parseSSH.");
+            msg = this->parseSSH (line);
 #ifndef NXCL_USE_NXSSH
-		this->isFinished = true;
+            this->isFinished = true;
 #endif
-            }
-            if (msg.size() > 0) {
-                this->write (msg);
-            }
-        } else {
-            this->write (this->parseSSH (*msgiter));
         }
+        if (msg.size() > 0) {
+            this->write (msg);
+        }
+    } else {
+        this->write (this->parseSSH (line));
     }
-    return;
 }
 
 void NXClientLib::processParseStderr()
 {
-    string message = nxsshProcess->readAllStandardError();
+    notQRingBuffer& output = this->getNXSSHProcess()->standardError();
+
+    if (output.empty()) {
+        return;
+    }
+
+    string message;
+    output.takeAll (message);
 
     dbgln ("In NXClientLib::processParseStderr for message: '"
             + message + "'(msg end)");
 
     this->externalCallbacks->stderrSignal (message);
 
-    // Now we need to split the message if necessary based on the
-    // \n or \r characters
-    notQtUtilities::ensureUnixNewlines (message);
+    this->stderrFramer.feed (message.data(), message.size());
 
-    list<string> msglist;
-    list<string>::iterator msgiter;
-    notQtUtilities::splitString (message, '\n', msglist);
-
-    for (msgiter=msglist.begin(); msgiter!=msglist.end(); msgiter++) {
+    NXLine line;
+    while (this->stderrFramer.next (line)) {
 
         dbgln ("NXClientLib::processParseStderr: Processing the message '"
-                + (*msgiter) + "'(end msg)");
+                + line.str() + "'(end msg)");
+
+        this->traceReply (line);
 
-        if (proxyData.encrypted && readyForProxy &&
-                ((*msgiter).find("NX> 999 Bye") != string::npos)) 
+        if (proxyData.encrypted && readyForProxy && line.code == 999) 
 #ifdef NXCL_USE_NXSSH
-	{
+        {
 
             string switchCommand = "NX> 299 Switch connection to: ";
             stringstream ss;
@@ -484,41 +624,42 @@ void NXClientLib::processParseStderr()
             switchCommand += ss.str();
             this->write(switchCommand);
 
-        } else if ((*msgiter).find
-                ("NX> 287 Redirected I/O to channel descriptors") !=
-                string::npos) {
-
-            this->externalCallbacks->write
-                (287, _("The session has been started successfully"));
-            this->externalCallbacks->connectedSuccessfullySignal();
-
-        } else if ((*msgiter).find
-                ("NX> 209 Remote host identification has changed") !=
-                string::npos) {
-
-            this->externalCallbacks->write(209, _("SSH Host Key Problem"));
-            this->isFinished = true;
-
-        } else if ((*msgiter).find
-                ("NX> 280 Ignoring EOF on the monitored channel") !=
-                string::npos) {
-
-            this->externalCallbacks->write
-                (280, _("Got \"NX> 280 Ignoring EOF on the monitored channel\""
-                        " from nxssh..."));
-            this->isFinished = true;
-
-        } else if ((*msgiter).find
-                ("Host key verification failed") != string::npos) {
-            this->externalCallbacks->write
-                (NXCL_HOST_KEY_VERIFAILED,
-                 _("SSH host key verification failed"));
-            this->isFinished = true;
+        } else {
+            switch (line.code) {
+                case 287:
+                    this->externalCallbacks->write
+                        (287, _("The session has been started successfully"));
+                    this->externalCallbacks->connectedSuccessfullySignal();
+                    break;
+
+                case 209:
+                    // Remote host identification has changed
+                    this->externalCallbacks->write(209, _("SSH Host Key Problem"));
+                    this->isFinished = true;
+                    break;
+
+                case 280:
+                    this->externalCallbacks->write
+                        (280, _("Got \"NX> 280 Ignoring EOF on the monitored channel\""
+                                " from nxssh..."));
+                    this->isFinished = true;
+                    break;
+
+                case 0:
+                    if (line.contains ("Host key verification failed")) {
+                        this->externalCallbacks->write
+                            (NXCL_HOST_KEY_VERIFAILED,
+                             _("SSH host key verification failed"));
+                        this->isFinished = true;
+                    }
+                    break;
+            }
         }
 #else /* don't use nxssh, use nxproxy -stdin */
-	{
-		invokeProxy();
-	}
+        {
+            this->traceStage ("server said bye", "stderr");
+            invokeProxy();
+        }
 #endif
     }
 }
@@ -529,7 +670,8 @@ void NXClientLib::write (string data)
 
     dbgln ("Writing '" << data << "' to nxssh process.");
 
-    this->nxsshProcess->writeIn(data);
+    this->getNXSSHProcess()->writeIn(data);
+    this->linkMeter.sent (NXTrace::now());
 
     if (password) {
         data = "********";
@@ -564,6 +706,211 @@ void NXClientLib::setSessionData (NXSessionData *nxSessionData)
     }
 }
 
+void NXClientLib::setEventLoop (notQEventLoop * loop)
+{
+    this->eventLoop->removeTimer (&this->callbacks);
+    this->eventLoop = loop;
+    this->processes.setEventLoop (loop);
+    if (this->reconnectAt != 0) {
+        long long r = (this->reconnectAt - NXTrace::now() + 999) / 1000;
+        loop->setTimer (&this->callbacks, r > 0 ? static_cast<int>(r) : 0);
+    }
+}
+
+int NXClientLib::runOnce (int timeout)
+{
+    int wait = this->getTimeout();
+    if (wait >= 0 && (timeout < 0 || wait < timeout)) {
+        timeout = wait;
+    }
+    int rtn = this->eventLoop->runOnce (timeout);
+    this->runTimeouts();
+    return rtn;
+}
+
+int NXClientLib::getTimeout (void)
+{
+    return this->session.getPipelineWait();
+}
+
+void NXClientLib::runTimeouts (void)
+{
+    string reply = this->session.pipelineStalled();
+    if (!reply.empty()) {
+        this->traceStage ("login pipelining stalled");
+        this->write (reply);
+    }
+}
+
+void NXClientLib::setAutoReconnect (bool on, int maxAttempts)
+{
+    this->autoReconnect = on;
+    this->reconnectMax = maxAttempts;
+}
+
+void NXClientLib::setReconnectDelay (int firstMs, int maxMs)
+{
+    this->reconnectFirstMs = firstMs;
+    this->reconnectMaxMs = maxMs;
+}
+
+bool NXClientLib::linkLost (notQProcess * proc, const NXProcessExit& status)
+{
+    if (!this->autoReconnect || this->isFinished) {
+        return false;
+    }
+    if (this->reconnectAt != 0) {
+        // Already waiting to reconnect; the other process going.
+        return true;
+    }
+    notQProcess * proxy = this->getNXProxyProcess();
+    if (proc != proxy && proxy->getPid() > 0) {
+        // nxproxy will go too, and its exit tells us whether the
+        // session ended or the link was lost.
+        return true;
+    }
+
+    if (this->reconnectAttempt == 0) {
+        // Only a session which was under way, and which didn't
+        // end normally (suspended or terminated, nxproxy exits
+        // cleanly).
+        if (!this->proxyInvoked || this->proxyData.id.empty()
+            || (proc == proxy && status.clean())) {
+            return false;
+        }
+        // "nxhost-1001-5C7E1B0A7D1E4D3E8A54C2BF3E1D9C4A"; the
+        // server lists the last part.
+        string::size_type dash = this->proxyData.id.rfind ('-');
+        this->reconnectID = (dash == string::npos)
+            ? this->proxyData.id : this->proxyData.id.substr (dash + 1);
+        this->traceStage ("link lost", status.name + ": " + status.describe());
+    }
+
+    if (this->reconnectAttempt >= this->reconnectMax) {
+        this->giveUpReconnecting (_("Couldn't reconnect to the server"));
+        return true;
+    }
+
+    int delay = this->reconnectFirstMs;
+    for (int i = 0; i < this->reconnectAttempt && delay < this->reconnectMaxMs; i++) {
+        delay *= 2;
+    }
+    if (delay > this->reconnectMaxMs) {
+        delay = this->reconnectMaxMs;
+    }
+    this->reconnectAttempt++;
+    this->reconnectAt = NXTrace::now() + delay * 1000LL;
+    this->eventLoop->setTimer (&this->callbacks, delay);
+
+    stringstream ss;
+    ss << "attempt " << this->reconnectAttempt << " in " << delay << "ms";
+    this->traceStage ("reconnecting", ss.str());
+    this->externalCallbacks->write
+        (NXCL_RECONNECTING, _("Lost the link to the server, reconnecting"));
+    this->externalCallbacks->reconnectingSignal (this->reconnectAttempt, delay);
+    return true;
+}
+
+void NXClientLib::reconnect (void)
+{
+    this->reconnectAt = 0;
+
+    // Whatever is left of the last connection
+    if (this->getNXProxyProcess()->getPid() > 0) {
+        this->getNXProxyProcess()->terminate();
+    }
+    this->reset();
+    this->session.runSession();
+
+    this->invokeNXSSH (this->sshPublicKey, this->proxyData.server,
+                       this->sshEncryption, this->sshKey, this->serverPort);
+
+    stringstream ss;
+    ss << "attempt " << this->reconnectAttempt << ", session " << this->reconnectID;
+    this->traceStage ("reconnect", ss.str());
+}
+
+void NXClientLib::giveUpReconnecting (const string& why)
+{
+    this->traceStage ("not reconnecting", why);
+    this->reconnectAttempt = 0;
+    this->reconnectAt = 0;
+    this->eventLoop->removeTimer (&this->callbacks);
+    this->externalCallbacks->error (why);
+    this->isFinished = true;
+    if (this->getNXSSHProcess()->getPid() > 0) {
+        this->getNXSSHProcess()->terminate();
+    }
+}
+
+bool NXClientLib::resumeLost (const list<NXResumeData>& sessions)
+{
+    if (this->reconnectAttempt == 0) {
+        return false;
+    }
+
+    int n = 0;
+    list<NXResumeData>::const_iterator i;
+    for (i = sessions.begin(); i != sessions.end(); i++, n++) {
+        if (i->sessionID == this->reconnectID) {
+            this->traceStage ("resuming", this->reconnectID);
+            this->chooseResumable (n);
+            return true;
+        }
+    }
+    this->giveUpReconnecting (_("The session is no longer on the server"));
+    return true;
+}
+
+void NXClientLib::learntServer (const NXServerInfo& info)
+{
+    this->traceStage ("logged in", this->session.getLoginPipelined()
+            ? "pipelined" : "one command per prompt");
+    if (this->useServerCache
+        && !this->serverCache.store (this->proxyData.server, this->serverPort, info)) {
+        dbgln ("Couldn't write the server cache " << this->serverCache.getPath());
+    }
+}
+
+void NXClientLib::startingSession (NXSessionData * data)
+{
+    NXLinkStats stats = this->linkMeter.getStats();
+
+    stringstream ss;
+    if (stats.minRtt < 0) {
+        ss << "not measured";
+    } else {
+        ss << (stats.minRtt + 500) / 1000 << "ms round trip ("
+           << stats.samples << " timed, median "
+           << (stats.medianRtt + 500) / 1000 << "ms)";
+    }
+    if (stats.bytesPerSecond >= 0) {
+        ss << ", " << stats.bytesPerSecond / 1024 << " KB/s";
+    }
+    ss << ", looks like " << stats.linkType;
+    this->traceStage ("link measured", ss.str());
+
+    if (data->linkType == "auto") {
+        data->linkType = stats.linkType;
+        data->imageCompressionMethod = stats.imageCompressionMethod;
+        data->imageCompressionLevel = stats.imageCompressionLevel;
+        data->cache = stats.cache;
+        data->images = stats.images;
+        this->externalCallbacks->write
+            (NXCL_LINK_MEASURED, _("Measured the link: ") + ss.str()
+             + _(", using the settings for that"));
+    } else if (data->linkType != stats.linkType) {
+        this->traceStage ("link type", data->linkType + " was chosen, not "
+                          + stats.linkType);
+    }
+    this->externalCallbacks->linkMeasuredSignal (stats);
+}
+
+void NXClientLib::run (void)
+{
+    while (this->isFinished == false && this->runOnce (-1) >= 0) {}
+}
+
 void NXClientLib::runSession ()
 {
     session.runSession();
@@ -575,88 +922,109 @@ void NXClientLib::runSession ()
 }
 
 string NXClientLib::parseSSH (string message)
+{
+    NXLine line;
+    line.data = message.data();
+    line.size = message.size();
+    line.code = NXLineFramer::parseCode (line.data, line.size);
+    line.prompt = false;
+    return this->parseSSH (line);
+}
+
+string NXClientLib::parseSSH (const NXLine& line)
 {
     string rMessage;
-    string::size_type pos;
     rMessage = "";
 
-    dbgln ("NXClientLib::parseSSH called for message '" + message + "'");
-
-    if ((pos = message.find("NX> 700 Session id: ")) != string::npos) {
-        this->externalCallbacks->write (700, _("Got a session ID"));
-        proxyData.id = message.substr(pos+20, message.length()-pos);
-
-    } else if ((pos = message.find("NX> 705 Session display: ")) != string::npos) {
-        stringstream portss;
-        int portnum;
-        portss << message.substr(pos+25, message.length()-pos);
-        portss >> portnum;		
-        proxyData.display = portnum;
-        proxyData.port = portnum + 4000;
+    dbgln ("NXClientLib::parseSSH called for message '" + line.str() + "'");
 
-    } else if
-        ((pos = message.find("NX> 706 Agent cookie: ")) != string::npos) {
-
-        proxyData.cookie = message.substr(pos+22, message.length()-pos);
-        this->externalCallbacks->write (706, _("Got an agent cookie"));
-
-    } else if
-        ((pos = message.find("NX> 702 Proxy IP: ")) != string::npos) {
+    switch (line.code) {
+        case 700:
+            if (line.startsWith ("NX> 700 Session id: ")) {
+                this->externalCallbacks->write (700, _("Got a session ID"));
+                proxyData.id = line.after (20);
+            }
+            break;
 
-        proxyData.proxyIP = message.substr(pos+18, message.length()-pos);
-        this->externalCallbacks->write (702, _("Got a proxy IP"));
+        case 705:
+            if (line.startsWith ("NX> 705 Session display: ")) {
+                stringstream portss;
+                int portnum;
+                portss << line.after (25);
+                portss >> portnum;		
+                proxyData.display = portnum;
+                proxyData.port = portnum + 4000;
+            }
+            break;
 
-    } else if
-        (message.find("NX> 707 SSL tunneling: 1") != string::npos) {
+        case 706:
+            if (line.startsWith ("NX> 706 Agent cookie: ")) {
+                proxyData.cookie = line.after (22);
+                this->externalCallbacks->write (706, _("Got an agent cookie"));
+            }
+            break;
 
-        this->externalCallbacks->write
-            (702, _("All data will be SSL tunnelled"));
+        case 702:
+            if (line.startsWith ("NX> 702 Proxy IP: ")) {
+                proxyData.proxyIP = line.after (18);
+                this->externalCallbacks->write (702, _("Got a proxy IP"));
+            }
+            break;
 
-        proxyData.encrypted = true;
+        case 707:
+            if (line.startsWith ("NX> 707 SSL tunneling: 1")) {
+                this->externalCallbacks->write
+                    (702, _("All data will be SSL tunnelled"));
 
-    } else if (message.find("NX> 147 Server capacity") != string::npos) {
+                proxyData.encrypted = true;
+            }
+            break;
 
-        this->externalCallbacks->write
-            (147, _("Got \"Server Capacity Reached\" from nxssh."));
+        case 147:
+            this->externalCallbacks->write
+                (147, _("Got \"Server Capacity Reached\" from nxssh."));
 
-        this->externalCallbacks->serverCapacitySignal();
-        this->isFinished = true;
+            this->externalCallbacks->serverCapacitySignal();
+            this->isFinished = true;
+            break;
 
-    } 
 #ifdef NXCL_USE_NXSSH
-    else if
-        (message.find ("NX> 204 Authentication failed.") != string::npos) {
-
-        this->externalCallbacks->write
-            (204, _("NX SSH Authentication Failed, finishing"));
-        this->isFinished = true;
-    }
+        case 204:
+            if (line.startsWith ("NX> 204 Authentication failed.")) {
+                this->externalCallbacks->write
+                    (204, _("NX SSH Authentication Failed, finishing"));
+                this->isFinished = true;
+            }
+            break;
 #endif
 
-    if (message.find("NX> 710 Session status: running") != string::npos) {
+        case 710:
+            if (!line.startsWith ("NX> 710 Session status: running")) {
+                break;
+            }
 
-        this->externalCallbacks->write
-            (710, _("Session status is \"running\""));
-    }
+            this->externalCallbacks->write
+                (710, _("Session status is \"running\""));
 
-    // FF-FIXME: This is technically incorrect as the proxy is just ready once 1002 and 1006 have 
-    // been sent.
-    if (message.find("NX> 710 Session status: running") != string::npos) {
-        
-	//this->externalCallbacks->write
-        //    (1006, _("Session status is \"running\""));
+            // FF-FIXME: This is technically incorrect as the proxy is just ready once 1002 and 1006 have 
+            // been sent.
+            //this->externalCallbacks->write
+            //    (1006, _("Session status is \"running\""));
 
 #ifdef NXCL_USE_NXSSH
-        invokeProxy();
+            invokeProxy();
 #else
-	if (!proxyData.encrypted)
-        	invokeProxy();
+            if (!proxyData.encrypted)
+                invokeProxy();
 #endif
-        session.wipeSessions();
-        if (proxyData.encrypted)
-	        rMessage = "bye\n";
-	else
-	        rMessage = "quit\n";
+            session.wipeSessions();
+            if (proxyData.encrypted) {
+                rMessage = "bye\n";
+                this->byeSent = true;
+                this->traceStage ("bye sent");
+            } else
+                rMessage = "quit\n";
+            break;
     }
 
     return rMessage;
@@ -664,6 +1032,12 @@ string NXClientLib::parseSSH (string message)
 
 void NXClientLib::invokeProxy()
 {
+    // The server may say "NX> 999 Bye" on both stdout and stderr.
+    if (this->proxyInvoked) {
+        return;
+    }
+    this->proxyInvoked = true;
+
     this->externalCallbacks->write
         (NXCL_INVOKE_PROXY, _("Starting NX session"));
 
@@ -698,11 +1072,11 @@ void NXClientLib::invokeProxy()
 
     string openPath = this->getPath("open");
     
-    this->x11Process->start(openPath, x11Arguments);
+    this->getX11Process()->start(openPath, x11Arguments);
 
     this->x11Probe = true;
     
-    if (this->x11Process->waitForStarted() == false) {
+    if (this->getX11Process()->waitForStarted() == false) {
         this->externalCallbacks->write
             (NXCL_PROCESS_ERROR, _("Error starting X11!"));
         this->isFinished = true;
@@ -790,36 +1164,150 @@ void NXClientLib::invokeProxy()
     options << data.str();
     options.close();
 
+    ss.str("");
+    ss << "nx/nx,options=" << nxdir << ":" << proxyData.display;
+    this->proxyDisplay = ss.str();
+
+#ifndef NXCL_USE_NXSSH
+    if (proxyData.encrypted) {
+        // nxproxy starts from switchReady(), once the server
+        // has finished with the connection.
+        this->switchToProxy();
+        return;
+    }
+#endif
+    this->startProxy (-1);
+}
+
+void NXClientLib::startProxy (int commFD)
+{
     // Build arguments for the call to the nxproxy command
     list<string> arguments;
     arguments.push_back("nxproxy"); // argv[0] has to be the program name
     arguments.push_back("-S");
 
-    ss.str("");
-    ss << "nx/nx,options=" << nxdir << ":" << proxyData.display;
+    // Set now: another session in the loop may have set them
+    // since invokeProxy().
+    setenv("NX_DISPLAY", this->proxyDisplay.c_str(), 1);
+    if (commFD != -1) {
+        stringstream ss;
+        ss << commFD;
+        dbgln ("NX_COMMFD=" << commFD);
+        setenv("NX_COMMFD", ss.str().c_str(), 1);
+    }
+
+    // Find a path for the nxproxy process using getPath()
+    string nxproxyPath = this->getPath ("nxproxy");
+    this->traceStage ("starting nxproxy");
+    this->getNXProxyProcess()->start(nxproxyPath, arguments);
+
+    if (this->relay != NULL) {
+        this->relay->proxyStarted();
+    }
 
-    setenv("NX_DISPLAY", ss.str().c_str(), 1);
+    if (this->getNXProxyProcess()->waitForStarted() == false) {
+        this->externalCallbacks->write
+            (NXCL_PROCESS_ERROR, _("Error starting nxproxy!"));
+        this->isFinished = true;
+    } else if (this->reconnectAttempt != 0) {
+        this->reconnectAttempt = 0;
+        this->traceStage ("reconnected", this->reconnectID);
+        this->externalCallbacks->reconnectedSignal();
+    }
+}
 
 #ifndef NXCL_USE_NXSSH
-    if (proxyData.encrypted)
-    {
-    	ss.str("");
-    	ss << this->nxsshProcess->getParentFD();
-	fprintf(stderr, "NX_COMMFD=%d", this->nxsshProcess->getParentFD());
-    	setenv("NX_COMMFD", ss.str().c_str(), 1);
-	// FF-FIXME: need to wait for 2 secs due to race condition with "bye" in buffer
-	sleep(2);
+void NXClientLib::switchToProxy (void)
+{
+    delete this->proxySwitch;
+    this->proxySwitch = new NXSwitch (this->eventLoop);
+    this->proxySwitch->setCallbacks (&this->callbacks);
+
+    // Whatever stdoutFramer has left was read after the server's
+    // last line of NX protocol.
+    string pending;
+    this->stdoutFramer.takePending (pending);
+    this->proxySwitch->setBuffered (pending);
+    this->proxySwitch->setDone (this->switchSeen);
+
+    // From here on the connection is read by the switch, and
+    // then nxproxy; not by nxssh's notQProcess.
+    this->proxySwitch->start (this->getNXSSHProcess()->getParentFD(),
+                              NXCL_SWITCH_WAIT);
+}
+
+void NXClientLib::switchReady (NXSwitchResult result)
+{
+    NXSwitch * sw = this->proxySwitch;
+
+    list<string>::const_iterator i;
+    for (i = sw->getText().begin(); i != sw->getText().end(); i++) {
+        this->traceStage ("server text", *i);
     }
-#endif
 
-    // Find a path for the nxproxy process using getPath()
-    string nxproxyPath = this->getPath ("nxproxy");
-    this->nxproxyProcess->start(nxproxyPath, arguments);
+    switch (result) {
+        case NXSWITCH_DONE:
+            this->traceStage ("switch ready", "server done");
+            break;
+        case NXSWITCH_PROXY_DATA:
+            this->traceStage ("switch ready", "proxy data waiting");
+            break;
+        case NXSWITCH_LEFTOVER:
+            this->traceStage ("switch ready", "proxy data read");
+            break;
+        case NXSWITCH_TIMEOUT:
+            this->traceStage ("switch ready", "timed out");
+            break;
+        case NXSWITCH_EOF:
+            this->traceStage ("switch ready", "connection closed");
+            break;
+    }
+
+    int fd = sw->getFD();
+    if (sw->getLeftover().empty()) {
+        this->startProxy (fd);
+        return;
+    }
+
+    // We can't put back what we have read, so nxproxy gets a
+    // socket of ours which sees that first.
+    stringstream ss;
+    ss << sw->getLeftover().size() << " bytes";
+    this->traceStage ("relaying", ss.str());
 
-    if (this->nxproxyProcess->waitForStarted() == false) {
+    this->relay = new NXCommRelay (this->eventLoop);
+    if (this->relay->start (fd, sw->getLeftover()) == false) {
+        delete this->relay;
+        this->relay = NULL;
         this->externalCallbacks->write
             (NXCL_PROCESS_ERROR, _("Error starting nxproxy!"));
         this->isFinished = true;
+        return;
+    }
+    this->startProxy (this->relay->getProxyFD());
+}
+#endif
+
+void NXClientLib::traceStage (const string& stage, const string& detail)
+{
+    this->trace.mark (stage, detail);
+    this->externalCallbacks->traceSignal (this->trace.getEvents().back());
+    this->externalCallbacks->debug
+        (detail.empty() ? stage : stage + ": " + detail);
+}
+
+void NXClientLib::traceReply (const NXLine& line)
+{
+    // Only the number; some of these lines carry the session
+    // cookie.
+    stringstream ss;
+    ss << line.code;
+    if (line.code == 211) {
+        this->traceStage ("host key prompt", ss.str());
+    } else if (line.code == 287) {
+        this->traceStage ("redirected I/O", ss.str());
+    } else if (line.code >= 700 && line.code < 800) {
+        this->traceStage ("session reply", ss.str());
     }
 }
 
@@ -879,11 +1367,11 @@ void NXClientLib::startX11 (string resolution, string name)
 
     string nxwinPath = this->getPath("nxwin");
 
-    this->x11Process->start(nxwinPath, nxwinArguments);
+    this->getX11Process()->start(nxwinPath, nxwinArguments);
 
     this->x11Probe = true;
 
-    if (this->x11Process->waitForStarted() == false) {
+    if (this->getX11Process()->waitForStarted() == false) {
         this->externalCallbacks->write
             (NXCL_PROCESS_ERROR, _("Error starting nxwin!"));
         this->isFinished = true;
@@ -915,13 +1403,11 @@ void NXClientLib::startX11 (string resolution, string name)
     nxauthArguments.push_back("MIT-MAGIC-COOKIE-1");
     nxauthArguments.push_back(cookie);
 
-    this->nxauthProcess->setCallbacks (&callbacks);
-
     string nxauthPath = this->getPath("nxauth");
 
-    this->nxauthProcess->start(nxauthPath, nxauthArguments);
+    this->getNXAuthProcess()->start(nxauthPath, nxauthArguments);
 
-    if (this->nxauthProcess->waitForStarted() == false) {
+    if (this->getNXAuthProcess()->waitForStarted() == false) {
         this->externalCallbacks->write
             (NXCL_PROCESS_ERROR, _("Error starting nxauth!"));
         this->isFinished = true;
@@ -931,12 +1417,56 @@ void NXClientLib::startX11 (string resolution, string name)
 
 bool NXClientLib::chooseResumable (int n)
 {
-    return (this->session.chooseResumable(n));
+    if (!this->session.chooseResumable(n)) {
+        return false;
+    }
+    this->write (this->session.releaseChoice());
+    return true;
 }
 
 bool NXClientLib::terminateSession (int n)
 {
-    return (this->session.terminateSession(n));
+    if (!this->session.terminateSession(n)) {
+        return false;
+    }
+    this->write (this->session.releaseChoice());
+    return true;
+}
+
+bool NXClientLib::chooseNewSession (void)
+{
+    if (!this->session.chooseNewSession()) {
+        return false;
+    }
+    this->write (this->session.releaseChoice());
+    return true;
+}
+
+bool NXClientLib::requestList (void)
+{
+    if (!this->session.requestList()) {
+        return false;
+    }
+    this->write (this->session.takeRequests());
+    return true;
+}
+
+bool NXClientLib::requestTerminate (const string& id)
+{
+    if (!this->session.requestTerminate (id)) {
+        return false;
+    }
+    this->write (this->session.takeRequests());
+    return true;
+}
+
+bool NXClientLib::requestQuit (void)
+{
+    if (!this->session.requestQuit()) {
+        return false;
+    }
+    this->write (this->session.takeRequests());
+    return true;
 }
 
 string NXClientLib::getPath (string prog)
@@ -28,6 +28,12 @@
 #include "nxsession.h"
 #include <list>
 #include "notQt.h"
+#include "nxlineframer.h"
+#include "nxsupervisor.h"
+#include "nxswitch.h"
+#include "nxtrace.h"
+#include "nxservercache.h"
+#include "nxlinkmeter.h"
 
 
 using namespace std;
@@ -62,9 +68,61 @@ namespace nxcl {
             virtual void stderrSignal (string msg) {}
             virtual void stdinSignal (string msg) {}
             virtual void resumeSessionsSignal (list<NXResumeData>) {}
+            /*!
+             * How the list of sessions differs from the last one
+             * (see NXSessionCallbacks::sessionsChangedSignal()).
+             * Called before resumeSessionsSignal(),
+             * noSessionsSignal() or controlListSignal().
+             */
+            virtual void sessionsChangedSignal (const NXResumeDelta&) {}
             virtual void noSessionsSignal (void) {}
             virtual void serverCapacitySignal (void) {}
             virtual void connectedSuccessfullySignal (void) {}
+            /*!
+             * Called as the connection reaches each stage (see
+             * NXClientLib::getTrace()).
+             */
+            virtual void traceSignal (const NXTraceEvent& event) {}
+            /*!
+             * With NXClientLib::setAutoReconnect():
+             */
+            //@{
+            /*!
+             * The link to the server has gone, and attempt
+             * \arg attempt to resume the session will be made in
+             * \arg delayMs milliseconds.
+             */
+            virtual void reconnectingSignal (int attempt, int delayMs) {}
+            /*!
+             * The session has been resumed, and nxproxy started
+             * again.
+             */
+            virtual void reconnectedSignal (void) {}
+            //@}
+            /*!
+             * Emitted before a session is started or resumed,
+             * with what the login measured of the link and, if
+             * the session's linkType was "auto", the settings
+             * chosen for it (see NXLinkMeter).
+             */
+            virtual void linkMeasuredSignal (const NXLinkStats& stats) {}
+            /*!
+             * In control mode (NXClientLib::setControlMode()):
+             */
+            //@{
+            /*!
+             * We have logged in, and requests can be answered.
+             */
+            virtual void controlReadySignal (void) {}
+            /*!
+             * The answer to NXClientLib::requestList()
+             */
+            virtual void controlListSignal (list<NXResumeData>) {}
+            /*!
+             * The answer to NXClientLib::requestTerminate()
+             */
+            virtual void controlTerminatedSignal (string id, bool terminated) {}
+            //@}
     };
 
     /*!
@@ -76,7 +134,7 @@ namespace nxcl {
      * ones that we want to call via this->parent in
      * NXClientLibCallbacks. They're the ones that are called from
      * within objects of other classes (such as this->session
-     * (NXSession) or this->nxsshProcess (notQProcess).
+     * (NXSession) or getNXSSHProcess() (notQProcess)).
      */
     class NXClientLibBase 
     {
@@ -85,11 +143,31 @@ namespace nxcl {
             virtual ~NXClientLibBase() {}
 
             virtual void setIsFinished (bool status) {}
+            virtual notQProcess* getNXSSHProcess (void) { return NULL; }
+            virtual notQProcess* getNXAuthProcess (void) { return NULL; }
             virtual void processParseStdout (void) {}
             virtual void processParseStderr (void) {}
             virtual void loginFailed (void) {}
             virtual void readyproxy (void) {}
             virtual void doneAuth (void) {}
+            virtual void traceStage (const string& stage, const string& detail = "") {}
+            virtual void learntServer (const NXServerInfo& info) {}
+            virtual void startingSession (NXSessionData * data) {}
+            /*!
+             * Auto-reconnect: return true to stop \arg proc's exit
+             * finishing the connection, or the list of sessions
+             * being passed on.
+             */
+            //@{
+            virtual bool linkLost (notQProcess * proc, const NXProcessExit& status) { return false; }
+            virtual bool resumeLost (const list<NXResumeData>& sessions) { return false; }
+            virtual void reconnect (void) {}
+            //@}
+            /*!
+             * The server has finished with the connection nxproxy
+             * is to take over.
+             */
+            virtual void switchReady (NXSwitchResult result) {}
 
             /*!
              * External callbacks pointer is held in NXClientLibBase
@@ -104,8 +182,10 @@ namespace nxcl {
      * Callbacks class. This derives from several other base
      * callbacks classes, defining the behaviour of the callbacks.
      */
-    class NXClientLibCallbacks : public notQProcessCallbacks,
-        public NXSessionCallbacks
+    class NXClientLibCallbacks : public NXProcessHandler,
+        public NXSessionCallbacks,
+        public notQTimerCallbacks,
+        public NXSwitchCallbacks
     {
         public:
             NXClientLibCallbacks();
@@ -116,14 +196,14 @@ namespace nxcl {
              */
             //@{
             /*!
-             * From notQProcess:
+             * From the processes, via NXProcessSupervisor:
              */
             //@{
-            void startedSignal (string name);
-            void errorSignal (int error);
-            void processFinishedSignal (string name);
-            void readyReadStandardOutputSignal (void);
-            void readyReadStandardErrorSignal (void);
+            void startedSignal (notQProcess * proc);
+            void errorSignal (notQProcess * proc, int error);
+            void exitedSignal (notQProcess * proc, const NXProcessExit& status);
+            void readyReadStandardOutputSignal (notQProcess * proc);
+            void readyReadStandardErrorSignal (notQProcess * proc);
             //@}
             /*!
              * From NXSession:
@@ -134,7 +214,23 @@ namespace nxcl {
             void readyForProxySignal (void);
             void authenticatedSignal (void);
             void sessionsSignal (list<NXResumeData>);
+            void sessionsChangedSignal (const NXResumeDelta&);
+            void stageSignal (const string& stage);
+            void controlReadySignal (void);
+            void controlListSignal (list<NXResumeData>);
+            void controlTerminatedSignal (const string& id, bool terminated);
+            void serverInfoSignal (const NXServerInfo& info);
+            void startingSessionSignal (NXSessionData * data);
             //@}
+            /*!
+             * From the event loop, when the next attempt to
+             * reconnect is due:
+             */
+            void timerSignal (void);
+            /*!
+             * From NXSwitch:
+             */
+            void switchReadySignal (NXSwitchResult result);
             //@}
 
             /*!
@@ -153,7 +249,7 @@ namespace nxcl {
             ~NXClientLib();
 
             /*!
-             * Set up data and then call this->nxsshProcess.start().
+             * Set up data and then call getNXSSHProcess()->start().
              * 
              * \param publicKey is the path to the ssh public key
              * file to authenticate with.  Pass "supplied" to use
@@ -180,7 +276,7 @@ namespace nxcl {
             /*!
              * Overloaded to give callback data on write.
              * 
-             * Writes data to this->nxsshProcess stdin and also
+             * Writes data to getNXSSHProcess() stdin and also
              * out to the user via stdoutCallback
              */
             void write (string data);
@@ -199,18 +295,19 @@ namespace nxcl {
             void allowSSHConnect (bool auth);
 
             /*!
-             * Set up data and then call this->nxproxyProcess.start()
+             * Set up data and then call getNXProxyProcess()->start()
              */
             void invokeProxy (void);
 
             /*!
              * Parse a line of output from
-             * this->nxsshProcess. This is called when the proxy
+             * getNXSSHProcess(). This is called when the proxy
              * has started, or if NX authentication
              * failed. Otherwise, this->session.parseSSH() is
              * used.
              */
             string parseSSH (string message);
+            string parseSSH (const NXLine& line);
 
             /*!
              * Read through the nx session file, and if we find a
@@ -238,6 +335,49 @@ namespace nxcl {
              */
             bool terminateSession (int n);
 
+            /*!
+             * Start a new session even though there are
+             * resumable ones.
+             *
+             * If the session was told to defer the choice
+             * (NXSession::setDeferChoice()), these three carry
+             * on the conversation with the server, so they can
+             * be called at any time after resumeSessionsSignal()
+             * rather than from within it.
+             */
+            bool chooseNewSession (void);
+
+            /*!
+             * Control mode: keep one login to the server open for
+             * any number of requests to list or terminate
+             * sessions, before starting or resuming one with
+             * chooseNewSession() or chooseResumable(n) (n being
+             * from the last list), or quitting. Requests are
+             * written without waiting for the answers to earlier
+             * ones, unless setPipelining(false) is called. See
+             * NXSession::setControlMode().
+             *
+             * Call these before invokeNXSSH().
+             */
+            //@{
+            void setControlMode (bool c) { this->session.setControlMode (c); }
+            void setPipelining (bool p) { this->session.setPipelining (p); }
+            //@}
+            /*!
+             * Requests in control mode. These may be made before
+             * we have logged in, and are sent as soon as possible;
+             * the answers come through controlListSignal() and
+             * controlTerminatedSignal().
+             *
+             * \return false if not in control mode, or if a
+             * session has been started or we have asked to quit.
+             */
+            //@{
+            bool requestList (void);
+            bool requestTerminate (const string& id);
+            bool requestQuit (void);
+            //@}
+
             void runSession (void);
 
             void startX11 (string resolution, string name);
@@ -265,6 +405,40 @@ namespace nxcl {
             void reset (void);
             void processParseStdout (void);
             void processParseStderr (void);
+            /*!
+             * Store what the login learnt of the server in the
+             * server cache.
+             */
+            void learntServer (const NXServerInfo& info);
+            /*!
+             * Pass on what was measured of the link, and if
+             * \arg data's linkType is "auto", replace it and the
+             * image compression and cache settings with those
+             * chosen for the link.
+             */
+            void startingSession (NXSessionData * data);
+            /*!
+             * If auto-reconnect is on and \arg proc's exit means
+             * the link to the server has gone, arrange to resume
+             * the session.
+             */
+            bool linkLost (notQProcess * proc, const NXProcessExit& status);
+            /*!
+             * Choose the session we are reconnecting to from
+             * \arg sessions.
+             */
+            bool resumeLost (const list<NXResumeData>& sessions);
+            /*!
+             * Make the next attempt to reconnect.
+             */
+            void reconnect (void);
+#ifndef NXCL_USE_NXSSH
+            /*!
+             * Start nxproxy on the connection, now that the
+             * server has finished with it.
+             */
+            void switchReady (NXSwitchResult result);
+#endif
 
             /*!
              * SSH requests confirmation to go ahead with
@@ -311,24 +485,130 @@ namespace nxcl {
 
             void setSessionData (NXSessionData *);
 
+            /*!
+             * The server cache
+             *
+             * invokeNXSSH() looks the server up in an
+             * NXServerCache, so that if we have logged in to it
+             * before the login can be pipelined (see
+             * NXSession::setServerInfo()), and what the login
+             * learns is stored there.
+             */
+            //@{
+            void setUseServerCache (bool use) { this->useServerCache = use; }
+            /*!
+             * Use the cache file \arg path rather than
+             * ~/.nx/cache/servers.
+             */
+            void setServerCachePath (const string& path)
+            {
+                this->serverCache = NXServerCache (path);
+            }
+            //@}
+
+            /*!
+             * Auto-reconnect
+             *
+             * If nxproxy exits with an error once the session is
+             * under way - the link to the server has gone - log
+             * in again and resume the same session, rather than
+             * finishing. The attempts are \arg firstMs apart at
+             * first, doubling each time up to \arg maxMs; after
+             * \arg maxAttempts in a row fail, or if the server
+             * no longer has the session, we give up and finish.
+             *
+             * ssh is also told to check that the server is alive
+             * every few seconds, so that a link which has gone
+             * quiet is noticed in seconds, not when TCP gives up.
+             *
+             * Call these before invokeNXSSH().
+             */
+            //@{
+            void setAutoReconnect (bool on, int maxAttempts = 10);
+            void setReconnectDelay (int firstMs, int maxMs);
+            /*!
+             * The attempt we are waiting to make or making, or 0
+             * if we aren't reconnecting.
+             */
+            int getReconnectAttempt (void) const { return this->reconnectAttempt; }
+            //@}
+
+            /*!
+             * What the exchanges with the server since
+             * invokeNXSSH() have shown of the link, and the
+             * settings which would be chosen for a session with
+             * linkType "auto" now.
+             */
+            NXLinkStats getLinkStats (void) const { return this->linkMeter.getStats(); }
+
+            /*!
+             * Milliseconds until runTimeouts() must be called,
+             * or -1 if there's nothing to wait for. runOnce()
+             * does both itself; a program which runs a shared
+             * event loop itself should too. (The wait before
+             * reconnecting is a timer in the event loop.)
+             */
+            //@{
+            int getTimeout (void);
+            void runTimeouts (void);
+            //@}
+
+            /*!
+             * Use \arg loop instead of this object's own event
+             * loop, so that several NXClientLib objects can be
+             * driven from one place.
+             */
+            void setEventLoop (notQEventLoop * loop);
+
+            notQEventLoop* getEventLoop (void)
+            {
+                return this->eventLoop;
+            }
+
+            /*!
+             * Wait up to \arg timeout milliseconds (-1 to wait
+             * indefinitely) for output from, or the exit of,
+             * nxssh/nxproxy and deal with it. This replaces
+             * calling probeProcess() on each process in a sleep
+             * loop.
+             *
+             * \return as notQEventLoop::runOnce().
+             */
+            int runOnce (int timeout = -1);
+
+            /*!
+             * Call runOnce() until the connection has finished
+             * (getIsFinished() returns true) or there are no
+             * more processes to wait for.
+             */
+            void run (void);
+
             notQProcess* getNXSSHProcess (void)
             {
-                return this->nxsshProcess;
+                return this->processes.get ("nxssh");
             }
 
             notQProcess* getNXProxyProcess (void)
             {
-                return this->nxproxyProcess;
+                return this->processes.get ("nxproxy");
             }
 
             notQProcess* getX11Process (void)
             {
-                return this->x11Process;
+                return this->processes.get ("x11");
             }
 
             notQProcess* getNXAuthProcess (void)
             {
-                return this->nxauthProcess;
+                return this->processes.get ("nxauth");
+            }
+
+            /*!
+             * The child processes of this connection.
+             */
+            NXProcessSupervisor& getProcesses (void)
+            {
+                return this->processes;
             }
 
             bool getIsFinished (void)
@@ -360,9 +640,58 @@ namespace nxcl {
             {
                 return this->sessionRunning;
             }
+
+            /*!
+             * The stages the connection has been through, and
+             * when.
+             */
+            const NXTrace& getTrace (void) const
+            {
+                return this->trace;
+            }
             //@}
 
+            /*!
+             * Record that the connection has reached \arg stage,
+             * and pass it on through the traceSignal and debug
+             * callbacks.
+             */
+            void traceStage (const string& stage, const string& detail = "");
+
         private:
+            /*!
+             * Deal with one line of stdout from nxssh.
+             */
+            void parseStdoutLine (const NXLine& line);
+
+            /*!
+             * Trace the server's replies which mark progress:
+             * the host key prompt, the 700s describing the
+             * session and "287 Redirected I/O".
+             */
+            void traceReply (const NXLine& line);
+
+            /*!
+             * Auto-reconnect: stop trying because of \arg why.
+             */
+            void giveUpReconnecting (const string& why);
+
+            /*!
+             * Start nxproxy, giving it \arg commFD as NX_COMMFD
+             * unless that is -1.
+             */
+            void startProxy (int commFD);
+
+#ifndef NXCL_USE_NXSSH
+            /*!
+             * Once the server has said "NX> 999 Bye", start
+             * reading what it still has to say on the connection
+             * that nxproxy is to take over; switchReady() is
+             * called when it has said it.
+             */
+            void switchToProxy (void);
+#endif
+
             /*!
              * Try a number of different paths to try to find the
              * program prog's full path.
@@ -390,6 +719,21 @@ namespace nxcl {
              * Set true when nxssh is ready to launch the nxproxy process.
              */
             bool readyForProxy;
+            /*!
+             * Set true when we have said "bye" to the server, so
+             * that it hands the connection over to nxproxy.
+             */
+            bool byeSent;
+            /*!
+             * Set true when the server has finished talking on
+             * nxssh's stdout after our "bye". Anything after
+             * that is for nxproxy, so it is left in stdoutFramer.
+             */
+            bool switchSeen;
+            /*!
+             * Set true once invokeProxy() has been called.
+             */
+            bool proxyInvoked;
             /*!
              * Set true when the NX session is under way. This
              * means we can reduce the polling frequency right
@@ -402,35 +746,49 @@ namespace nxcl {
              */
             bool password;
 
-            // FIXME: I hold the actual data, and a pointer to the
-            // data here. I tried to get rid of the pointer, and
-            // modify main.cpp in ../nxcl and that didn't work
-            // properly - I'm not sure why. I suppose I could get
-            // rid of the objects here, and then call
-            // pNxsshProcess = new notQProcess; in the
-            // constructor...
-            /*!
-             * The nxssh process object
-             */
-            notQProcess* nxsshProcess;
             /*!
-             * The nxproxy process object
+             * The child processes: "nxssh", "nxproxy", and on
+             * some platforms "x11" and "nxauth".
              */
-            notQProcess* nxproxyProcess;
+            NXProcessSupervisor processes;
             /*!
-             * The X11 process object
+             * The event loop used unless setEventLoop() is called.
              */
-            notQProcess* x11Process;
+            notQEventLoop ownEventLoop;
             /*!
-             * The nxauth process object
+             * The event loop which watches our processes.
              */
-            notQProcess* nxauthProcess;
+            notQEventLoop* eventLoop;
             /*!
              * A callbacks object. This holds the various callback
              * methods. The callback methods are defined here, but
              * are callable from notQProcess etc.
              */
             NXClientLibCallbacks callbacks;
+            /*!
+             * Split nxssh's stdout and stderr into lines,
+             * keeping partial lines between reads.
+             */
+            NXLineFramer stdoutFramer;
+            NXLineFramer stderrFramer;
+            /*!
+             * Copies between nxproxy and the server if we read
+             * some of nxproxy's data before it started.
+             */
+            NXCommRelay *relay;
+            /*!
+             * Reads the server's last lines before nxproxy takes
+             * the connection over.
+             */
+            NXSwitch *proxySwitch;
+            /*!
+             * NX_DISPLAY for nxproxy
+             */
+            string proxyDisplay;
+            /*!
+             * The stages of the connection.
+             */
+            NXTrace trace;
             /*!
              * A temporary file to hold the ssl key
              */
@@ -445,6 +803,34 @@ namespace nxcl {
              * and id.
              */
             ProxyData proxyData;
+            /*!
+             * The ssh port of the server, for the server cache
+             */
+            int serverPort;
+            NXServerCache serverCache;
+            bool useServerCache;
+            /*!
+             * Times our writes to nxssh and the replies
+             */
+            NXLinkMeter linkMeter;
+            /*!
+             * Auto-reconnect: the settings, the arguments of
+             * invokeNXSSH() to connect again with, the ID of the
+             * session to resume, and when the next attempt is
+             * due (0 if none is).
+             */
+            //@{
+            bool autoReconnect;
+            int reconnectMax;
+            int reconnectFirstMs;
+            int reconnectMaxMs;
+            string sshPublicKey;
+            string sshKey;
+            bool sshEncryption;
+            string reconnectID;
+            int reconnectAttempt;
+            long long reconnectAt;
+            //@}
             /*!
              * Username for the connection
              */
@@ -0,0 +1,539 @@
+/***************************************************************************
+                            nxconfigparser.cpp
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+extern "C" {
+#include <unistd.h>
+#include <fcntl.h>
+}
+
+#include "nxconfigparser.h"
+
+using namespace std;
+using namespace nxcl;
+
+/*!
+ * The NXConfigData field (or the .nxs option which goes into one)
+ * for each key.
+ */
+enum NXConfigField {
+    NXCONFIG_SESSIONNAME,
+    NXCONFIG_SERVERHOST,
+    NXCONFIG_SERVERPORT,
+    NXCONFIG_USER,
+    NXCONFIG_SESSIONTYPE,
+    NXCONFIG_CUSTOMCOMMAND,
+    NXCONFIG_CACHE,
+    NXCONFIG_IMAGES,
+    NXCONFIG_LINKTYPE,
+    NXCONFIG_RENDER,
+    NXCONFIG_IMAGEMETHOD,
+    NXCONFIG_IMAGELEVEL,
+    NXCONFIG_GEOMETRY,
+    NXCONFIG_KEYBOARD,
+    NXCONFIG_KBTYPE,
+    NXCONFIG_MEDIA,
+    NXCONFIG_AGENTSERVER,
+    NXCONFIG_AGENTUSER,
+    NXCONFIG_CUPS,
+    NXCONFIG_KEY,
+    NXCONFIG_ENCRYPTION,
+    NXCONFIG_FULLSCREEN,
+    NXCONFIG_VIRTUALDESKTOP,
+    NXCONFIG_NXSESSION,
+    NXCONFIG_NXDESKTOP,
+    NXCONFIG_NXRESOLUTION,
+    NXCONFIG_NXWIDTH,
+    NXCONFIG_NXHEIGHT
+};
+
+struct NXConfigKey {
+    const char * key;
+    NXConfigField field;
+};
+
+/*!
+ * The keys of qtnx's .nxml files and of .nxs files, which must be
+ * kept in strcmp() order for the binary search in option().
+ */
+static const NXConfigKey configKeys[] = {
+    { "Agent Server", NXCONFIG_AGENTSERVER },
+    { "Agent User", NXCONFIG_AGENTUSER },
+    { "Audio", NXCONFIG_MEDIA },
+    { "Authentication Key", NXCONFIG_KEY },
+    { "CUPS Port", NXCONFIG_CUPS },
+    { "Cache size", NXCONFIG_CACHE },
+    { "Cache size on disk", NXCONFIG_IMAGES },
+    { "Command line", NXCONFIG_CUSTOMCOMMAND },
+    { "Connection Name", NXCONFIG_SESSIONNAME },
+    { "Custom Session Command", NXCONFIG_CUSTOMCOMMAND },
+    { "Desktop", NXCONFIG_NXDESKTOP },
+    { "Desktop Geometry", NXCONFIG_GEOMETRY },
+    { "Disk Cache", NXCONFIG_CACHE },
+    { "Enable Fullscreen Desktop", NXCONFIG_FULLSCREEN },
+    { "Enable SSL encryption", NXCONFIG_ENCRYPTION },
+    { "Image Cache", NXCONFIG_IMAGES },
+    { "Image Compression Method", NXCONFIG_IMAGEMETHOD },
+    { "JPEG Compression Level", NXCONFIG_IMAGELEVEL },
+    { "JPEG Quality", NXCONFIG_IMAGELEVEL },
+    { "Keyboard Layout", NXCONFIG_KEYBOARD },
+    { "Keyboard Type", NXCONFIG_KBTYPE },
+    { "Link Type", NXCONFIG_LINKTYPE },
+    { "Link speed", NXCONFIG_LINKTYPE },
+    { "Media", NXCONFIG_MEDIA },
+    { "Public Key", NXCONFIG_KEY },
+    { "Resolution", NXCONFIG_NXRESOLUTION },
+    { "Resolution height", NXCONFIG_NXHEIGHT },
+    { "Resolution width", NXCONFIG_NXWIDTH },
+    { "Server Hostname", NXCONFIG_SERVERHOST },
+    { "Server Port", NXCONFIG_SERVERPORT },
+    { "Server host", NXCONFIG_SERVERHOST },
+    { "Server port", NXCONFIG_SERVERPORT },
+    { "Session", NXCONFIG_NXSESSION },
+    { "Session Type", NXCONFIG_SESSIONTYPE },
+    { "Use Render Extension", NXCONFIG_RENDER },
+    { "Use SSL Tunnelling", NXCONFIG_ENCRYPTION },
+    { "User", NXCONFIG_USER },
+    { "Virtual desktop", NXCONFIG_VIRTUALDESKTOP }
+};
+
+static bool keyLess (const NXConfigKey& k, const char * key)
+{
+    return strcmp (k.key, key) < 0;
+}
+
+static bool isTrue (const string& value)
+{
+    return strcasecmp (value.c_str(), "true") == 0;
+}
+
+static bool isSpace (char c)
+{
+    return (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+}
+
+/*!
+ * Append the attribute value \arg s (without its quotes) to \arg out,
+ * replacing entity and character references.
+ */
+static void decode (const char * s, size_t len, string& out)
+{
+    const char * amp;
+    const char * end = s + len;
+
+    while ((amp = static_cast<const char*>(memchr (s, '&', end - s))) != NULL) {
+        out.append (s, amp - s);
+        const char * semi = static_cast<const char*>(memchr (amp, ';', end - amp));
+        if (semi == NULL) {
+            s = amp;
+            break;
+        }
+
+        string ent (amp + 1, semi - amp - 1);
+        if (ent == "amp") {
+            out += '&';
+        } else if (ent == "lt") {
+            out += '<';
+        } else if (ent == "gt") {
+            out += '>';
+        } else if (ent == "quot") {
+            out += '"';
+        } else if (ent == "apos") {
+            out += '\'';
+        } else if (ent.size() > 1 && ent[0] == '#') {
+            unsigned long c = (ent[1] == 'x')
+                ? strtoul (ent.c_str() + 2, NULL, 16)
+                : strtoul (ent.c_str() + 1, NULL, 10);
+            // As UTF-8
+            if (c < 0x80) {
+                out += static_cast<char>(c);
+            } else if (c < 0x800) {
+                out += static_cast<char>(0xc0 | (c >> 6));
+                out += static_cast<char>(0x80 | (c & 0x3f));
+            } else if (c < 0x10000) {
+                out += static_cast<char>(0xe0 | (c >> 12));
+                out += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+                out += static_cast<char>(0x80 | (c & 0x3f));
+            } else {
+                out += static_cast<char>(0xf0 | ((c >> 18) & 0x07));
+                out += static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+                out += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+                out += static_cast<char>(0x80 | (c & 0x3f));
+            }
+        } else {
+            // Not one we know; leave it be.
+            out.append (amp, semi - amp + 1);
+        }
+        s = semi + 1;
+    }
+    out.append (s, end - s);
+}
+
+/*!
+ * Implementation of NXConfigParser
+ */
+//@{
+NXConfigParser::NXConfigParser (NXConfigData * d) :
+    data(d),
+    inTag(false),
+    quote(0),
+    kind(0),
+    options(0),
+    skipGroup(false),
+    haveGeometry(false)
+{
+}
+
+NXConfigParser::~NXConfigParser ()
+{
+}
+
+    bool
+NXConfigParser::parse (const char * buf, size_t len)
+{
+    const char * p = buf;
+    const char * end = buf + len;
+
+    while (p < end) {
+        if (!this->inTag) {
+            // Skip the text between tags
+            p = static_cast<const char*>(memchr (p, '<', end - p));
+            if (p == NULL) {
+                break;
+            }
+            p++;
+            this->inTag = true;
+            this->quote = 0;
+            this->kind = 0;
+            if (p == end) {
+                break;
+            }
+        }
+        if (this->kind == 0) {
+            this->kind = *p;
+        }
+
+        // Find the '>' which ends the tag; in an element, one in
+        // a quoted attribute value doesn't count.
+        const char * gt = NULL;
+        if (this->kind == '!') {
+            gt = static_cast<const char*>(memchr (p, '>', end - p));
+        } else {
+            for (const char * q = p; q < end; q++) {
+                if (this->quote != 0) {
+                    if (*q == this->quote) {
+                        this->quote = 0;
+                    }
+                } else if (*q == '"' || *q == '\'') {
+                    this->quote = *q;
+                } else if (*q == '>') {
+                    gt = q;
+                    break;
+                }
+            }
+        }
+        if (gt == NULL) {
+            // Carry the start of the tag over to the next call
+            this->pending.append (p, end - p);
+            break;
+        }
+
+        const char * t = p;
+        size_t tlen = gt - p;
+        if (!this->pending.empty()) {
+            // The tag was split between calls
+            this->pending.append (p, gt - p);
+            t = this->pending.data();
+            tlen = this->pending.size();
+        }
+        p = gt + 1;
+
+        if (this->kind == '!' && tlen >= 3 && memcmp (t, "!--", 3) == 0
+            && (tlen < 5 || memcmp (t + tlen - 2, "--", 2) != 0)) {
+            // A '>' inside a comment
+            if (this->pending.empty()) {
+                this->pending.assign (t, tlen);
+            }
+            this->pending += '>';
+            continue;
+        }
+
+        bool ok = this->tag (t, tlen);
+        this->pending.clear();
+        this->inTag = false;
+        if (!ok) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+    bool
+NXConfigParser::tag (const char * t, size_t len)
+{
+    const char * p = t;
+    const char * end = t + len;
+
+    if (len == 0) {
+        this->error = "empty tag";
+        return false;
+    }
+    if (*p == '?' || *p == '!') {
+        // <?xml?>, <!DOCTYPE> and comments tell us nothing we need.
+        return true;
+    }
+    if (*p == '/') {
+        if (len >= 6 && memcmp (t, "/group", 6) == 0
+            && (len == 6 || isSpace (t[6]))) {
+            this->skipGroup = false;
+        }
+        return true;
+    }
+
+    // The element name
+    while (p < end && !isSpace (*p) && *p != '/') {
+        p++;
+    }
+    bool isOption = (p - t == 6 && memcmp (t, "option", 6) == 0);
+    bool isGroup = (p - t == 5 && memcmp (t, "group", 5) == 0);
+    if (!isOption && !isGroup) {
+        // The root element
+        return true;
+    }
+
+    string key, value, name;
+    bool haveKey = false;
+    while (p < end) {
+        while (p < end && isSpace (*p)) {
+            p++;
+        }
+        if (p == end || *p == '/') {
+            break;
+        }
+
+        const char * attr = p;
+        while (p < end && *p != '=' && !isSpace (*p)) {
+            p++;
+        }
+        size_t attrLen = p - attr;
+        while (p < end && isSpace (*p)) {
+            p++;
+        }
+        if (p == end || *p != '=') {
+            this->error = "attribute without a value in <" + string (t, len) + ">";
+            return false;
+        }
+        p++;
+        while (p < end && isSpace (*p)) {
+            p++;
+        }
+        if (p == end || (*p != '"' && *p != '\'')) {
+            this->error = "unquoted attribute in <" + string (t, len) + ">";
+            return false;
+        }
+        char quote = *p++;
+        const char * close = static_cast<const char*>(memchr (p, quote, end - p));
+        if (close == NULL) {
+            this->error = "unterminated attribute in <" + string (t, len) + ">";
+            return false;
+        }
+
+        if (attrLen == 3 && memcmp (attr, "key", 3) == 0) {
+            decode (p, close - p, key);
+            haveKey = true;
+        } else if (attrLen == 5 && memcmp (attr, "value", 5) == 0) {
+            decode (p, close - p, value);
+        } else if (attrLen == 4 && memcmp (attr, "name", 4) == 0) {
+            decode (p, close - p, name);
+        }
+        p = close + 1;
+    }
+
+    if (isGroup) {
+        this->skipGroup = (name == "Windows Session" || name == "VNC Session");
+    } else if (haveKey && !this->skipGroup) {
+        this->option (key, value);
+    }
+    return true;
+}
+
+    void
+NXConfigParser::option (const string& key, const string& value)
+{
+    const NXConfigKey * first = configKeys;
+    const NXConfigKey * last = configKeys + sizeof (configKeys) / sizeof (configKeys[0]);
+    const NXConfigKey * k = lower_bound (first, last, key.c_str(), keyLess);
+
+    if (k == last || key != k->key) {
+        return;
+    }
+    this->options++;
+
+    NXConfigData * d = this->data;
+    switch (k->field) {
+    case NXCONFIG_SESSIONNAME:
+        d->sessionName = value;
+        break;
+    case NXCONFIG_SERVERHOST:
+        d->serverHost = value;
+        break;
+    case NXCONFIG_SERVERPORT:
+        d->serverPort = atoi (value.c_str());
+        break;
+    case NXCONFIG_USER:
+        d->sessionUser = value;
+        break;
+    case NXCONFIG_SESSIONTYPE:
+        d->sessionType = value;
+        break;
+    case NXCONFIG_CUSTOMCOMMAND:
+        d->customCommand = value;
+        break;
+    case NXCONFIG_CACHE:
+        d->cache = atoi (value.c_str());
+        break;
+    case NXCONFIG_IMAGES:
+        d->images = atoi (value.c_str());
+        break;
+    case NXCONFIG_LINKTYPE:
+        d->linkType = value;
+        break;
+    case NXCONFIG_RENDER:
+        d->render = isTrue (value);
+        break;
+    case NXCONFIG_IMAGEMETHOD:
+        if (value == "JPEG") {
+            d->imageCompressionMethod = -1;
+        } else if (value == "PNG") {
+            d->imageCompressionMethod = 2;
+        } else if (value == "Raw X11") {
+            d->imageCompressionMethod = 0;
+        }
+        break;
+    case NXCONFIG_IMAGELEVEL:
+        d->imageCompressionLevel = atoi (value.c_str());
+        break;
+    case NXCONFIG_GEOMETRY:
+        d->geometry = value;
+        this->haveGeometry = true;
+        break;
+    case NXCONFIG_KEYBOARD:
+        d->keyboard = value;
+        break;
+    case NXCONFIG_KBTYPE:
+        d->kbtype = value;
+        break;
+    case NXCONFIG_MEDIA:
+        d->media = isTrue (value);
+        break;
+    case NXCONFIG_AGENTSERVER:
+        d->agentServer = value;
+        break;
+    case NXCONFIG_AGENTUSER:
+        d->agentUser = value;
+        break;
+    case NXCONFIG_CUPS:
+        d->cups = atoi (value.c_str());
+        break;
+    case NXCONFIG_KEY:
+        d->key = value;
+        break;
+    case NXCONFIG_ENCRYPTION:
+        d->encryption = isTrue (value);
+        break;
+    case NXCONFIG_FULLSCREEN:
+        d->fullscreen = isTrue (value);
+        break;
+    case NXCONFIG_VIRTUALDESKTOP:
+        d->virtualDesktop = isTrue (value);
+        break;
+    case NXCONFIG_NXSESSION:
+        this->nxSession = value;
+        break;
+    case NXCONFIG_NXDESKTOP:
+        this->nxDesktop = value;
+        break;
+    case NXCONFIG_NXRESOLUTION:
+        if (value == "fullscreen") {
+            d->fullscreen = true;
+        } else if (value.find ('x') != string::npos) {
+            d->geometry = value;
+            this->haveGeometry = true;
+        }
+        break;
+    case NXCONFIG_NXWIDTH:
+        this->nxWidth = value;
+        break;
+    case NXCONFIG_NXHEIGHT:
+        this->nxHeight = value;
+        break;
+    }
+}
+
+    bool
+NXConfigParser::finish (void)
+{
+    // .nxs files have "Session" unix and "Desktop" kde where
+    // nxcl wants unix-kde.
+    if (!this->nxSession.empty()) {
+        string type = this->nxSession;
+        if (type == "unix" && !this->nxDesktop.empty()) {
+            string desktop = this->nxDesktop;
+            transform (desktop.begin(), desktop.end(), desktop.begin(), ::tolower);
+            if (desktop == "console" && !this->data->customCommand.empty()) {
+                desktop = "application";
+            }
+            type += "-" + desktop;
+        }
+        this->data->sessionType = type;
+    }
+
+    if (!this->haveGeometry && !this->nxWidth.empty() && !this->nxHeight.empty()) {
+        this->data->geometry = this->nxWidth + "x" + this->nxHeight;
+    }
+
+    if (this->inTag) {
+        this->error = "the file ends inside a tag";
+        return false;
+    }
+    return true;
+}
+
+    bool
+NXConfigParser::parseFile (const string& path, NXConfigData& data)
+{
+    int fd = open (path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    NXConfigParser parser (&data);
+    char buf[4096];
+    ssize_t n;
+    bool ok = true;
+    while (ok && (n = read (fd, buf, sizeof (buf))) > 0) {
+        ok = parser.parse (buf, n);
+    }
+    close (fd);
+
+    return (parser.finish() && ok);
+}
+//@}
@@ -0,0 +1,129 @@
+/* -*-c++-*- */
+/***************************************************************************
+                             nxconfigparser.h
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*!
+ * \file nxconfigparser.h Reads connection settings files into
+ * NXConfigData.
+ */
+
+#ifndef _NXCONFIGPARSER_H_
+#define _NXCONFIGPARSER_H_
+
+#include <string>
+#include "nxdata.h"
+
+using namespace std;
+
+namespace nxcl {
+
+    /*!
+     * NXConfigParser reads a connection settings file into an
+     * NXConfigData. It understands both the .nxml files written by
+     * qtnx (<option key="Server Hostname" value="..."/>) and the
+     * .nxs files written by the NoMachine client and nxlaunch
+     * (<group name="General"><option key="Server host" .../>).
+     *
+     * The file is parsed in a single pass as it is fed in, without
+     * building a document tree: each option's key is looked up in
+     * a sorted table of the keys we know about, and the value is
+     * stored straight into the NXConfigData. Options we don't know
+     * about are skipped, and fields for which the file has no
+     * option are left as they were.
+     *
+     * Only as much XML as these files use is understood: elements,
+     * attributes in single or double quotes, the five predefined
+     * entities and character references, comments, <!DOCTYPE> and
+     * <?xml?>. There is no validation.
+     */
+    class NXConfigParser
+    {
+        public:
+            NXConfigParser (NXConfigData * data);
+            ~NXConfigParser();
+
+            /*!
+             * Parse the next \arg len bytes of the file. A tag
+             * may be split across calls. Returns false if the
+             * file is not well formed enough to go on.
+             */
+            bool parse (const char * buf, size_t len);
+            /*!
+             * The end of the file. Fills in the fields which
+             * depend on more than one option (the session type
+             * and geometry of .nxs files). Returns false if the
+             * file ended inside a tag.
+             */
+            bool finish (void);
+
+            /*!
+             * The number of options which were recognised.
+             */
+            int getOptions (void) const { return this->options; }
+            string getError (void) const { return this->error; }
+
+            /*!
+             * Parse the file at \arg path into \arg data.
+             * Returns false if it couldn't be read or parsed.
+             */
+            static bool parseFile (const string& path, NXConfigData& data);
+
+        private:
+            /*!
+             * Deal with one tag; \arg tag is what was between
+             * the < and the >.
+             */
+            bool tag (const char * tag, size_t len);
+            void option (const string& key, const string& value);
+
+            NXConfigData * data;
+            /*!
+             * The start of a tag which hasn't been finished yet.
+             */
+            string pending;
+            bool inTag;
+            /*!
+             * The quote of the attribute value we're in, if
+             * any, and the first character of the tag.
+             */
+            //@{
+            char quote;
+            char kind;
+            //@}
+            int options;
+            string error;
+            /*!
+             * True inside the <group> of a .nxs file which holds
+             * the settings of a Windows or VNC server, whose keys
+             * ("User", "Image Cache") clash with the ones we use.
+             */
+            bool skipGroup;
+
+            /*!
+             * Options of .nxs files which go into the same
+             * NXConfigData field, and are put together by
+             * finish().
+             */
+            //@{
+            string nxSession;
+            string nxDesktop;
+            string nxWidth;
+            string nxHeight;
+            bool haveGeometry;
+            //@}
+    };
+
+} // namespace
+#endif
@@ -22,6 +22,7 @@
 #define _NXDATA_H_
 
 #include <string>
+#include <list>
 
 /*!
  * Some definitions of numbers that we can send over to the frontend
@@ -38,6 +39,8 @@
 #define NXCL_FINISHED               1000009
 #define NXCL_ALIVE                  1000010
 #define NXCL_PROCESS_ERROR          1000011
+#define NXCL_RECONNECTING           1000012
+#define NXCL_LINK_MEASURED          1000013
 
 using namespace std;
 
@@ -115,5 +118,76 @@ namespace nxcl {
 		string sessionName;
 	};
 
+	/*!
+	 * What we know of an NX server from its greeting and from
+	 * how it answered the login. Kept between connections by
+	 * NXServerCache.
+	 */
+	struct NXServerInfo {
+		/*!
+		 * The version in its HELLO, like "3.2.0-74-SVN"
+		 */
+		string version;
+		/*!
+		 * True for FreeNX, false for NoMachine's server
+		 */
+		bool freenx;
+		/*!
+		 * The SET commands it accepted, like "SHELL_MODE SHELL"
+		 */
+		list<string> sets;
+		/*!
+		 * True if the SET commands and "login" may be sent to
+		 * it in one go, rather than one per prompt.
+		 */
+		bool pipelining;
+	};
+
+	/*!
+	 * How fast the link to the server looked during the login
+	 * (see NXLinkMeter), and what was chosen from that for a
+	 * session whose linkType was "auto".
+	 */
+	struct NXLinkStats {
+		/*!
+		 * The number of round trips timed, from writing to
+		 * the server to the first of its reply.
+		 */
+		int samples;
+		/*!
+		 * The shortest and the median of them, in
+		 * microseconds, or -1 if there were none.
+		 */
+		long long minRtt;
+		long long medianRtt;
+		/*!
+		 * Bytes per second of the fastest long reply, or -1
+		 * if no reply was long enough to tell.
+		 */
+		long long bytesPerSecond;
+		/*!
+		 * The settings chosen
+		 */
+		//@{
+		string linkType;
+		int imageCompressionMethod;
+		int imageCompressionLevel;
+		int cache;
+		int images;
+		//@}
+	};
+
+	/*!
+	 * How a list of sessions differs from the one before it.
+	 * Sessions are matched by sessionID; a session in both lists
+	 * whose other fields differ (it has been suspended, say) is
+	 * changed.
+	 */
+	struct NXResumeDelta {
+		list<NXResumeData> added;
+		list<NXResumeData> changed;
+		list<string> removed;
+	};
+
 } // namespace
 #endif
@@ -0,0 +1,261 @@
+/***************************************************************************
+                              nxdiscovery.cpp
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+extern "C" {
+#include <signal.h>
+#include <sys/types.h>
+}
+
+#include "nxdiscovery.h"
+#include "nxclientlib.h"
+#include "nxtrace.h"
+
+using namespace std;
+using namespace nxcl;
+
+/*!
+ * One server's connection, and its callbacks.
+ */
+class NXDiscovery::Host : public NXClientLibExternalCallbacks
+{
+    public:
+        Host (NXDiscovery * p, const NXDiscoveryHost& h) :
+            parent(p)
+        {
+            this->result.host = h;
+            this->result.status = NXDISCOVERY_WAITING;
+            this->result.loginUsec = 0;
+            this->result.latencyUsec = 0;
+            this->lib.setExternalCallbacks (this);
+            this->lib.setEventLoop (&p->loop);
+        }
+
+        void write (string msg) {}
+        void write (int num, string msg)
+        {
+            if (num != NXCL_PROCESS_STARTED && num != NXCL_PROCESS_EXITED) {
+                this->lastMessage = msg;
+            }
+        }
+        void error (string msg) { this->lastError = msg; }
+
+        void controlReadySignal (void)
+        {
+            this->result.loginUsec = NXTrace::now() - this->parent->start;
+        }
+        void controlListSignal (list<NXResumeData> sessions)
+        {
+            if (this->result.status == NXDISCOVERY_WAITING) {
+                this->result.sessions = sessions;
+                this->parent->done (this, NXDISCOVERY_LISTED);
+            }
+        }
+
+        NXDiscovery * parent;
+        NXClientLib lib;
+        NXSessionData data;
+        NXDiscoveryResult result;
+        string lastMessage;
+        string lastError;
+};
+
+/*!
+ * Implementation of NXDiscovery
+ */
+//@{
+NXDiscovery::NXDiscovery () :
+    callbacks(NULL),
+    timeout(NXDISCOVERY_DEFAULT_TIMEOUT),
+    waiting(0),
+    start(0),
+    elapsed(0)
+{
+    // Only the listsession command uses these. An empty type
+    // lists sessions of any type.
+    this->sessionData.sessionName = "";
+    this->sessionData.sessionType = "";
+    this->sessionData.cache = 8;
+    this->sessionData.images = 32;
+    this->sessionData.linkType = "adsl";
+    this->sessionData.render = true;
+    this->sessionData.backingstore = "when_requested";
+    this->sessionData.imageCompressionMethod = 2;
+    this->sessionData.imageCompressionLevel = 1;
+    this->sessionData.geometry = "800x600+0+0";
+    this->sessionData.keyboard = "defkeymap";
+    this->sessionData.kbtype = "pc105/defkeymap";
+    this->sessionData.media = false;
+    this->sessionData.cups = 0;
+    this->sessionData.encryption = true;
+    this->sessionData.fullscreen = false;
+    this->sessionData.virtualDesktop = false;
+    this->sessionData.suspended = false;
+    this->sessionData.xRes = 800;
+    this->sessionData.yRes = 600;
+    this->sessionData.depth = 24;
+    this->sessionData.display = 0;
+    this->sessionData.terminate = false;
+}
+
+NXDiscovery::~NXDiscovery ()
+{
+    // Give each nxssh a moment to exit after "quit" (or after
+    // being signalled), so that it is reaped.
+    long long deadline = NXTrace::now() + NXDISCOVERY_GRACE * 1000LL;
+    for (;;) {
+        bool running = false;
+        vector<Host*>::iterator i;
+        for (i = this->hosts.begin(); i != this->hosts.end(); i++) {
+            notQProcess * p = (*i)->lib.getNXSSHProcess();
+            if (p != NULL && p->getPid() > 0 && !(*i)->lib.getIsFinished()) {
+                running = true;
+            }
+        }
+        long long left = (deadline - NXTrace::now()) / 1000;
+        if (!running || left <= 0
+            || this->loop.runOnce (static_cast<int>(left)) < 0) {
+            break;
+        }
+    }
+
+    vector<Host*>::iterator i;
+    for (i = this->hosts.begin(); i != this->hosts.end(); i++) {
+        notQProcess * p = (*i)->lib.getNXSSHProcess();
+        if (p != NULL && p->getPid() > 0 && !(*i)->lib.getIsFinished()) {
+            p->terminate();
+        }
+        delete *i;
+    }
+}
+
+    void
+NXDiscovery::addHost (const NXDiscoveryHost& host)
+{
+    this->hosts.push_back (new Host (this, host));
+}
+
+    void
+NXDiscovery::run (void)
+{
+    this->start = NXTrace::now();
+    this->waiting = 0;
+
+    vector<Host*>::iterator i;
+    for (i = this->hosts.begin(); i != this->hosts.end(); i++) {
+        Host * h = *i;
+        NXDiscoveryHost& hh = h->result.host;
+        h->data = this->sessionData;
+
+        h->lib.setCustomPath (this->customPath);
+        h->lib.setControlMode (true);
+        h->lib.requestList();
+        h->lib.requestQuit();
+
+        // In the same order as Nxcl::startTheNXConnection()
+        h->lib.setSessionData (&h->data);
+        h->lib.setUsername (hh.user);
+        h->lib.setPassword (hh.pass);
+
+        this->waiting++;
+        h->lib.invokeNXSSH (hh.key.empty() ? "default" : "supplied",
+                            hh.host, true, hh.key, hh.port);
+    }
+
+    long long deadline = this->start + this->timeout * 1000LL;
+    while (this->waiting > 0) {
+        long long left = (deadline - NXTrace::now() + 999) / 1000;
+        int rtn = -1;
+        if (left > 0) {
+            int wait = static_cast<int>(left);
+            for (i = this->hosts.begin(); i != this->hosts.end(); i++) {
+                int w = (*i)->lib.getTimeout();
+                if (w >= 0 && w < wait) {
+                    wait = w;
+                }
+            }
+            rtn = this->loop.runOnce (wait);
+            for (i = this->hosts.begin(); i != this->hosts.end(); i++) {
+                (*i)->lib.runTimeouts();
+            }
+        }
+
+        for (i = this->hosts.begin(); i != this->hosts.end(); i++) {
+            Host * h = *i;
+            if (h->result.status != NXDISCOVERY_WAITING) {
+                continue;
+            }
+            if (h->lib.getIsFinished()) {
+                this->done (h, NXDISCOVERY_FAILED);
+            } else if (left <= 0 || rtn < 0) {
+                // Out of time, or nothing left to wait for.
+                notQProcess * p = h->lib.getNXSSHProcess();
+                if (p != NULL && p->getPid() > 0) {
+                    kill (p->getPid(), SIGTERM);
+                }
+                this->done (h, left <= 0 ? NXDISCOVERY_TIMEOUT : NXDISCOVERY_FAILED);
+            }
+        }
+    }
+
+    this->elapsed = NXTrace::now() - this->start;
+}
+
+    void
+NXDiscovery::done (Host * h, NXDiscoveryStatus status)
+{
+    h->result.status = status;
+    h->result.latencyUsec = NXTrace::now() - this->start;
+    if (status == NXDISCOVERY_FAILED) {
+        h->result.error = h->lastError.empty() ? h->lastMessage : h->lastError;
+    } else if (status == NXDISCOVERY_TIMEOUT) {
+        h->result.error = "timed out";
+    }
+    this->waiting--;
+
+    if (this->callbacks != NULL) {
+        this->callbacks->hostSignal (h->result);
+    }
+}
+
+    vector<NXDiscoveryResult>
+NXDiscovery::getResults (void) const
+{
+    vector<NXDiscoveryResult> r;
+    vector<Host*>::const_iterator i;
+    for (i = this->hosts.begin(); i != this->hosts.end(); i++) {
+        r.push_back ((*i)->result);
+    }
+    return r;
+}
+
+    list<NXDiscoveredSession>
+NXDiscovery::getSessions (void) const
+{
+    list<NXDiscoveredSession> s;
+    vector<Host*>::const_iterator i;
+    for (i = this->hosts.begin(); i != this->hosts.end(); i++) {
+        const NXDiscoveryResult& r = (*i)->result;
+        list<NXResumeData>::const_iterator j;
+        for (j = r.sessions.begin(); j != r.sessions.end(); j++) {
+            NXDiscoveredSession d;
+            d.host = r.host.host;
+            d.port = r.host.port;
+            d.session = *j;
+            s.push_back (d);
+        }
+    }
+    return s;
+}
+//@}
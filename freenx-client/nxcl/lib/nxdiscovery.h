@@ -0,0 +1,196 @@
+/* -*-c++-*- */
+/***************************************************************************
+                               nxdiscovery.h
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*!
+ * \file nxdiscovery.h Lists the sessions on several servers at once.
+ */
+
+#ifndef _NXDISCOVERY_H_
+#define _NXDISCOVERY_H_
+
+#include <string>
+#include <list>
+#include <vector>
+#include "notQt.h"
+#include "nxdata.h"
+
+using namespace std;
+
+namespace nxcl {
+
+    class NXClientLib;
+
+    /*!
+     * How long NXDiscovery waits for each server by default, in
+     * milliseconds.
+     */
+#define NXDISCOVERY_DEFAULT_TIMEOUT 10000
+    /*!
+     * How long the NXDiscovery destructor waits for each nxssh to
+     * exit after "quit", in milliseconds, before terminating it.
+     */
+#define NXDISCOVERY_GRACE 1000
+
+    /*!
+     * A server to list the sessions of.
+     */
+    struct NXDiscoveryHost {
+        NXDiscoveryHost() : port(22) {}
+        string host;
+        int port;
+        string user;
+        string pass;
+        /*!
+         * The nxssh key to log in to the nx user with; the
+         * default key if empty.
+         */
+        string key;
+    };
+
+    /*!
+     * What has become of a server.
+     */
+    enum NXDiscoveryStatus {
+        /*!
+         * We're still waiting for its list.
+         */
+        NXDISCOVERY_WAITING,
+        /*!
+         * It sent its list.
+         */
+        NXDISCOVERY_LISTED,
+        /*!
+         * The connection or the login failed; see
+         * NXDiscoveryResult::error.
+         */
+        NXDISCOVERY_FAILED,
+        /*!
+         * It didn't send its list in time.
+         */
+        NXDISCOVERY_TIMEOUT
+    };
+
+    struct NXDiscoveryResult {
+        NXDiscoveryHost host;
+        NXDiscoveryStatus status;
+        /*!
+         * Microseconds from starting nxssh to logging in, and to
+         * receiving the list (or failing).
+         */
+        //@{
+        long long loginUsec;
+        long long latencyUsec;
+        //@}
+        /*!
+         * The last message from NXClientLib, if it failed.
+         */
+        string error;
+        list<NXResumeData> sessions;
+    };
+
+    /*!
+     * A session found by NXDiscovery, with its server.
+     */
+    struct NXDiscoveredSession {
+        string host;
+        int port;
+        NXResumeData session;
+    };
+
+    /*!
+     * Virtual callback class for NXDiscovery.
+     */
+    class NXDiscoveryCallbacks
+    {
+        public:
+            NXDiscoveryCallbacks() {}
+            virtual ~NXDiscoveryCallbacks() {}
+            /*!
+             * A server has sent its list, failed or timed out.
+             */
+            virtual void hostSignal (const NXDiscoveryResult& result) {}
+    };
+
+    /*!
+     * NXDiscovery logs in to each server with an NXClientLib in
+     * control mode, asks for the list of sessions and quits. The
+     * connections all share one event loop and run in parallel,
+     * so run() takes as long as the slowest server (or the
+     * timeout), not the sum of them.
+     */
+    class NXDiscovery
+    {
+        public:
+            NXDiscovery();
+            ~NXDiscovery();
+
+            void addHost (const NXDiscoveryHost& host);
+            /*!
+             * Give up on each server which hasn't sent its list
+             * within \arg ms milliseconds of run() starting.
+             */
+            void setTimeout (int ms) { this->timeout = ms; }
+            /*!
+             * The session settings sent in the listsession
+             * command. By default, sessions of any type are
+             * listed.
+             */
+            void setSessionData (const NXSessionData& data) { this->sessionData = data; }
+            void setCustomPath (const string& path) { this->customPath = path; }
+            void setCallbacks (NXDiscoveryCallbacks * cb) { this->callbacks = cb; }
+
+            /*!
+             * Connect to all the servers, and return when each
+             * has sent its list, failed or timed out.
+             */
+            void run (void);
+
+            /*!
+             * One result per server, in the order they were
+             * added.
+             */
+            vector<NXDiscoveryResult> getResults (void) const;
+            /*!
+             * The sessions on all the servers which sent a list.
+             */
+            list<NXDiscoveredSession> getSessions (void) const;
+            /*!
+             * How long run() took, in microseconds.
+             */
+            long long getElapsed (void) const { return this->elapsed; }
+
+        private:
+            class Host;
+            friend class Host;
+
+            /*!
+             * \arg h has sent its list, failed or timed out.
+             */
+            void done (Host * h, NXDiscoveryStatus status);
+
+            notQEventLoop loop;
+            vector<Host*> hosts;
+            NXSessionData sessionData;
+            NXDiscoveryCallbacks * callbacks;
+            string customPath;
+            int timeout;
+            int waiting;
+            long long start;
+            long long elapsed;
+    };
+
+} // namespace
+#endif
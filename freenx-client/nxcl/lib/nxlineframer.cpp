@@ -0,0 +1,215 @@
+/***************************************************************************
+                             nxlineframer.cpp
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <algorithm>
+#include <string.h>
+
+#include "nxlineframer.h"
+
+using namespace std;
+using namespace nxcl;
+
+/*!
+ * Implementation of NXLine
+ */
+//@{
+    bool
+NXLine::startsWith (const char * prefix) const
+{
+    size_t n = strlen (prefix);
+    return (n <= this->size && memcmp (this->data, prefix, n) == 0);
+}
+
+    bool
+NXLine::equals (const string& s) const
+{
+    return (s.size() == this->size && memcmp (this->data, s.data(), this->size) == 0);
+}
+
+    bool
+NXLine::contains (const char * needle) const
+{
+    size_t n = strlen (needle);
+    return (search (this->data, this->data + this->size, needle, needle + n)
+            != this->data + this->size);
+}
+
+    string
+NXLine::after (size_t n) const
+{
+    if (n >= this->size) {
+        return "";
+    }
+    return string (this->data + n, this->size - n);
+}
+//@}
+
+/*!
+ * Implementation of NXLineFramer
+ */
+//@{
+NXLineFramer::NXLineFramer () :
+    pos(0)
+{
+}
+
+NXLineFramer::~NXLineFramer ()
+{
+}
+
+    void
+NXLineFramer::reset (void)
+{
+    this->buffer.clear();
+    this->pos = 0;
+}
+
+    void
+NXLineFramer::takePending (string& out)
+{
+    out.append (this->buffer, this->pos, string::npos);
+    this->reset();
+}
+
+    void
+NXLineFramer::feed (const char * data, size_t n)
+{
+    // Lines handed out so far are finished with now.
+    if (this->pos > 0) {
+        this->buffer.erase (0, this->pos);
+        this->pos = 0;
+    }
+    this->buffer.append (data, n);
+}
+
+    size_t
+NXLineFramer::feed (notQRingBuffer& buf)
+{
+    if (this->pos > 0) {
+        this->buffer.erase (0, this->pos);
+        this->pos = 0;
+    }
+    size_t total = buf.size();
+    this->buffer.reserve (this->buffer.size() + total);
+    const char * data;
+    size_t n;
+    while ((n = buf.peek (&data)) > 0) {
+        this->buffer.append (data, n);
+        buf.consume (n);
+    }
+    return total;
+}
+
+    string
+NXLineFramer::recent (size_t n) const
+{
+    if (n > this->buffer.size()) {
+        n = this->buffer.size();
+    }
+    return this->buffer.substr (this->buffer.size() - n);
+}
+
+    bool
+NXLineFramer::next (NXLine& line)
+{
+    if (this->pos >= this->buffer.size()) {
+        return false;
+    }
+
+    const char * start = this->buffer.data() + this->pos;
+    size_t avail = this->buffer.size() - this->pos;
+    const char * nl = static_cast<const char*>(memchr (start, '\n', avail));
+    size_t len;
+
+    line.prompt = false;
+    if (avail > 8 && memcmp (start, "NX> 105 ", 8) == 0
+        && (nl == NULL || nl - start > 8) && start[8] != '\r') {
+        // The prompt, followed by the echo of a command we had
+        // already sent (a pipelined login): give the prompt on
+        // its own, and the echo as the next line.
+        len = 8;
+        this->pos += len;
+        line.prompt = true;
+    } else if (nl != NULL) {
+        len = nl - start;
+        this->pos += len + 1;
+    } else {
+        if (!NXLineFramer::isPrompt (start, avail,
+                                     NXLineFramer::parseCode (start, avail))) {
+            // Wait for the rest of the line.
+            return false;
+        }
+        len = avail;
+        this->pos += len;
+        line.prompt = true;
+    }
+
+    // ssh likes \r\n
+    while (len > 0 && start[0] == '\r') {
+        start++;
+        len--;
+    }
+    while (len > 0 && start[len-1] == '\r') {
+        len--;
+    }
+
+    line.data = start;
+    line.size = len;
+    line.code = NXLineFramer::parseCode (start, len);
+    return true;
+}
+
+    int
+NXLineFramer::parseCode (const char * data, size_t n)
+{
+    if (n < 5 || memcmp (data, "NX> ", 4) != 0) {
+        return 0;
+    }
+    int code = 0;
+    for (size_t i = 4; i < n && data[i] >= '0' && data[i] <= '9'; i++) {
+        code = code * 10 + (data[i] - '0');
+    }
+    return code;
+}
+
+    bool
+NXLineFramer::isPrompt (const char * data, size_t n, int code)
+{
+    if (n == 0 || data[n-1] != ' ') {
+        return false;
+    }
+
+    // A prompt which has only partly arrived mustn't be taken for
+    // the whole of it ("NX> 101 " is the start of "NX> 101 User: ").
+    switch (code) {
+        case 105: // ready for a command
+            return (n == 8);
+        case 101: // User:
+        case 102: // Password:
+        case 106: // Parameters:
+            return (n >= 2 && data[n-2] == ':');
+    }
+
+    // ssh's own questions
+    static const char * questions[] = { "assword: ", "(yes/no)? ", NULL };
+    for (int i = 0; questions[i] != NULL; i++) {
+        size_t q = strlen (questions[i]);
+        if (n >= q && memcmp (data + n - q, questions[i], q) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+//@}
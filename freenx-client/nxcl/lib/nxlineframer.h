@@ -0,0 +1,149 @@
+/* -*-c++-*- */
+/***************************************************************************
+                              nxlineframer.h
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*!
+ * \file nxlineframer.h Splits the output of nxssh into lines of the
+ * NX protocol, keeping partial lines across reads.
+ */
+
+#ifndef _NXLINEFRAMER_H_
+#define _NXLINEFRAMER_H_
+
+#include <string>
+#include "notQt.h"
+
+using namespace std;
+
+namespace nxcl {
+
+    /*!
+     * One line of output from nxssh, as handed out by
+     * NXLineFramer. data points into the framer's buffer and is
+     * not NUL terminated; it stays valid until the next call to
+     * NXLineFramer::feed().
+     */
+    struct NXLine {
+        const char * data;
+        size_t size;
+        /*!
+         * The number from an "NX> NNN" line, or 0.
+         */
+        int code;
+        /*!
+         * True if the line wasn't terminated, because the
+         * other end is waiting for us to answer it (e.g. "NX>
+         * 105 ").
+         */
+        bool prompt;
+
+        bool startsWith (const char * prefix) const;
+        bool equals (const string& s) const;
+        bool contains (const char * needle) const;
+        /*!
+         * The line as a string
+         */
+        string str (void) const { return string (this->data, this->size); }
+        /*!
+         * The rest of the line after the first \arg n characters
+         */
+        string after (size_t n) const;
+    };
+
+    /*!
+     * NXLineFramer accumulates output from nxssh and hands it out
+     * a line at a time. A line which hasn't been terminated yet
+     * is kept until the rest of it arrives, unless it is one of
+     * the prompts after which the server (or ssh) waits for
+     * input without sending a newline; those are handed out
+     * straight away with NXLine::prompt set. A "NX> 105 " prompt
+     * with the echo of a command we had already sent after it is
+     * handed out as two lines.
+     *
+     * The response code of each "NX> NNN" line is parsed once,
+     * here, so that callers can switch on it rather than search
+     * each line for the messages they know about.
+     */
+    class NXLineFramer
+    {
+        public:
+            NXLineFramer();
+            ~NXLineFramer();
+
+            /*!
+             * Take all the data in \arg buf, straight from its
+             * contiguous blocks.
+             *
+             * \return the number of bytes taken.
+             */
+            size_t feed (notQRingBuffer& buf);
+            void feed (const char * data, size_t n);
+
+            /*!
+             * Get the next line into \arg line.
+             *
+             * \return false if there is no complete line (or
+             * prompt) available yet.
+             */
+            bool next (NXLine& line);
+
+            /*!
+             * Forget any buffered data.
+             */
+            void reset (void);
+
+            /*!
+             * The number of bytes buffered but not yet handed out.
+             */
+            size_t pending (void) const { return this->buffer.size() - this->pos; }
+
+            /*!
+             * Append the bytes buffered but not yet handed out
+             * to \arg out, and forget them.
+             */
+            void takePending (string& out);
+
+            /*!
+             * The last \arg n bytes fed, whether or not they
+             * have been handed out yet.
+             */
+            string recent (size_t n) const;
+
+            /*!
+             * Parse the response number of an "NX> NNN ..."
+             * line.
+             *
+             * \return the number, or 0 if the line doesn't start
+             * with "NX> " and a number.
+             */
+            static int parseCode (const char * data, size_t n);
+
+            /*!
+             * Is \arg data (an unterminated line) one of the
+             * prompts after which the other end waits for us?
+             */
+            static bool isPrompt (const char * data, size_t n, int code);
+
+        private:
+            /*!
+             * Data received but not yet handed out starts at
+             * buffer[pos].
+             */
+            string buffer;
+            size_t pos;
+    };
+
+} // namespace
+#endif
@@ -0,0 +1,150 @@
+/***************************************************************************
+                              nxlinkmeter.cpp
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <algorithm>
+
+#include "nxlinkmeter.h"
+
+using namespace std;
+using namespace nxcl;
+
+/*!
+ * The link types from slowest to fastest, the longest round trip and
+ * the lowest rate for each, and the settings to use with it. JPEG
+ * (-1) loses some detail to save bandwidth; PNG (2) doesn't. A bigger
+ * cache saves more of a slow link.
+ */
+static const struct LinkProfile {
+    const char * linkType;
+    long long maxRtt;           // microseconds
+    long long minRate;          // bytes per second
+    int imageCompressionMethod;
+    int imageCompressionLevel;
+    int cache;                  // MB
+    int images;                 // MB
+} profiles[] = {
+    { "modem",  -1,               0, -1, 4, 16, 64 },
+    { "isdn",   250000,        8000, -1, 5, 16, 64 },
+    { "adsl",   80000,        16000, -1, 7, 8,  32 },
+    { "wan",    20000,       256000,  2, 9, 8,  32 },
+    { "lan",    2000,       1250000,  2, 9, 4,  16 }
+};
+static const int nProfiles = sizeof (profiles) / sizeof (profiles[0]);
+static const int adslProfile = 2;
+
+NXLinkMeter::NXLinkMeter()
+{
+    this->reset();
+}
+
+NXLinkMeter::~NXLinkMeter()
+{
+}
+
+void NXLinkMeter::reset (void)
+{
+    this->sentAt = 0;
+    this->burstStart = 0;
+    this->burstLast = 0;
+    this->burstBytes = 0;
+    this->rtts.clear();
+    this->bestRate = -1;
+}
+
+void NXLinkMeter::sent (long long now)
+{
+    this->endBurst();
+    if (this->sentAt == 0) {
+        this->sentAt = now;
+    }
+}
+
+void NXLinkMeter::received (size_t bytes, long long now)
+{
+    if (this->sentAt != 0) {
+        // The first of the reply
+        this->rtts.push_back (now - this->sentAt);
+        this->sentAt = 0;
+        this->burstStart = now;
+        this->burstLast = now;
+        this->burstBytes = 0;
+    } else if (this->burstStart != 0) {
+        this->burstLast = now;
+        this->burstBytes += bytes;
+    }
+}
+
+void NXLinkMeter::endBurst (void)
+{
+    if (this->burstStart != 0 && this->burstBytes >= MIN_BURST
+        && this->burstLast > this->burstStart) {
+        long long rate = this->burstBytes * 1000000LL
+            / (this->burstLast - this->burstStart);
+        if (rate > this->bestRate) {
+            this->bestRate = rate;
+        }
+    }
+    this->burstStart = 0;
+}
+
+NXLinkStats NXLinkMeter::getStats (void) const
+{
+    NXLinkStats stats;
+    stats.samples = this->rtts.size();
+    stats.minRtt = -1;
+    stats.medianRtt = -1;
+    if (!this->rtts.empty()) {
+        vector<long long> sorted (this->rtts);
+        sort (sorted.begin(), sorted.end());
+        stats.minRtt = sorted.front();
+        stats.medianRtt = sorted[sorted.size() / 2];
+    }
+
+    // A reply still arriving counts too.
+    stats.bytesPerSecond = this->bestRate;
+    if (this->burstStart != 0 && this->burstBytes >= MIN_BURST
+        && this->burstLast > this->burstStart) {
+        long long rate = this->burstBytes * 1000000LL
+            / (this->burstLast - this->burstStart);
+        if (rate > stats.bytesPerSecond) {
+            stats.bytesPerSecond = rate;
+        }
+    }
+
+    chooseSettings (stats);
+    return stats;
+}
+
+void NXLinkMeter::chooseSettings (NXLinkStats& stats)
+{
+    int p = adslProfile;
+    if (stats.minRtt >= 0) {
+        // The fastest the round trip allows, and no faster than
+        // the rate, if we have one.
+        for (p = nProfiles - 1; p > 0; p--) {
+            if (stats.minRtt <= profiles[p].maxRtt
+                && (stats.bytesPerSecond < 0
+                    || stats.bytesPerSecond >= profiles[p].minRate)) {
+                break;
+            }
+        }
+    }
+
+    stats.linkType = profiles[p].linkType;
+    stats.imageCompressionMethod = profiles[p].imageCompressionMethod;
+    stats.imageCompressionLevel = profiles[p].imageCompressionLevel;
+    stats.cache = profiles[p].cache;
+    stats.images = profiles[p].images;
+}
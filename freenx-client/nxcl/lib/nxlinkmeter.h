@@ -0,0 +1,109 @@
+/* -*-c++-*- */
+/***************************************************************************
+                              nxlinkmeter.h
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*!
+ * \file nxlinkmeter.h Times the exchanges with the NX server during
+ * the login, to choose the link settings for a session.
+ */
+
+#ifndef _NXLINKMETER_H_
+#define _NXLINKMETER_H_
+
+#include <vector>
+#include "nxdata.h"
+
+using namespace std;
+
+namespace nxcl {
+
+    /*!
+     * Measures the link to the server from the exchanges the
+     * login makes anyway: hello, the SET commands, login, the
+     * user name and the list of sessions. Each is a round trip;
+     * the shortest is taken as the link's, since the others
+     * include whatever the server did before answering (checking
+     * the password, say). A reply long enough to arrive in
+     * pieces gives the rate at which the server's data comes.
+     *
+     * Nothing extra is sent: the server has no command which
+     * does nothing, and anything it doesn't know ends the login.
+     */
+    class NXLinkMeter
+    {
+        public:
+            NXLinkMeter();
+            ~NXLinkMeter();
+
+            void reset (void);
+
+            /*!
+             * Something was written to the server at \arg now
+             * (NXTrace::now()).
+             */
+            void sent (long long now);
+            /*!
+             * \arg bytes were read from the server at \arg now.
+             */
+            void received (size_t bytes, long long now);
+
+            /*!
+             * What has been measured so far; the settings in
+             * it are chooseSettings()'s for that.
+             */
+            NXLinkStats getStats (void) const;
+
+            /*!
+             * Fill in the link type, image compression and
+             * cache sizes in \arg stats for its measurements.
+             * With no measurements, "adsl" and its settings,
+             * the middle of the range.
+             */
+            static void chooseSettings (NXLinkStats& stats);
+
+            /*!
+             * The fewest bytes in a reply, after its first read,
+             * for its rate to be taken.
+             */
+            static const size_t MIN_BURST = 2048;
+
+        private:
+            /*!
+             * When we last wrote to the server, until the reply
+             * begins; 0 otherwise.
+             */
+            long long sentAt;
+            /*!
+             * The reply now arriving: when its first read came,
+             * when the last did, and the bytes after the first.
+             */
+            long long burstStart;
+            long long burstLast;
+            size_t burstBytes;
+            /*!
+             * The round trips, in microseconds
+             */
+            vector<long long> rtts;
+            long long bestRate;
+
+            /*!
+             * The reply now arriving is over; take its rate if
+             * it was long enough.
+             */
+            void endBurst (void);
+    };
+
+} // namespace
+#endif
@@ -0,0 +1,156 @@
+/***************************************************************************
+                               nxmatcher.cpp
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <queue>
+#include <string.h>
+
+#include "nxmatcher.h"
+
+using namespace std;
+using namespace nxcl;
+
+NXPatternMatcher::NXPatternMatcher () :
+    nClasses(1),
+    built(false)
+{
+    memset (this->classOf, 0, sizeof (this->classOf));
+}
+
+NXPatternMatcher::~NXPatternMatcher ()
+{
+}
+
+    unsigned int
+NXPatternMatcher::add (const string& pattern)
+{
+    if (this->patterns.size() >= 32) {
+        return 0;
+    }
+    this->patterns.push_back (pattern);
+    this->built = false;
+    return 1u << (this->patterns.size() - 1);
+}
+
+    void
+NXPatternMatcher::build (void)
+{
+    memset (this->classOf, 0, sizeof (this->classOf));
+    this->nClasses = 1;
+    for (unsigned int i = 0; i < this->patterns.size(); i++) {
+        for (unsigned int j = 0; j < this->patterns[i].size(); j++) {
+            unsigned char c = this->patterns[i][j];
+            if (this->classOf[c] == 0) {
+                this->classOf[c] = this->nClasses++;
+            }
+        }
+    }
+
+    unsigned int k = this->nClasses;
+
+    // The trie of the patterns; -1 for "no edge" until the
+    // failure links fill the gaps in.
+    this->delta.assign (k, -1);
+    this->output.assign (1, 0);
+    for (unsigned int i = 0; i < this->patterns.size(); i++) {
+        int state = 0;
+        for (unsigned int j = 0; j < this->patterns[i].size(); j++) {
+            unsigned int cls = this->classOf[(unsigned char)this->patterns[i][j]];
+            if (this->delta[state*k + cls] == -1) {
+                this->delta[state*k + cls] = this->output.size();
+                this->delta.resize (this->delta.size() + k, -1);
+                this->output.push_back (0);
+            }
+            state = this->delta[state*k + cls];
+        }
+        this->output[state] |= 1u << i;
+    }
+
+    // Breadth first, so that each state's failure state is
+    // complete before it is needed.
+    vector<int> fail (this->output.size(), 0);
+    queue<int> q;
+    for (unsigned int cls = 0; cls < k; cls++) {
+        int s = this->delta[cls];
+        if (s == -1) {
+            this->delta[cls] = 0;
+        } else {
+            fail[s] = 0;
+            q.push (s);
+        }
+    }
+    while (!q.empty()) {
+        int state = q.front();
+        q.pop();
+        this->output[state] |= this->output[fail[state]];
+        for (unsigned int cls = 0; cls < k; cls++) {
+            int s = this->delta[state*k + cls];
+            if (s == -1) {
+                this->delta[state*k + cls] = this->delta[fail[state]*k + cls];
+            } else {
+                fail[s] = this->delta[fail[state]*k + cls];
+                q.push (s);
+            }
+        }
+    }
+
+    // Lay the table out for match(): one row of k+1 entries per
+    // state, the last being the state's output, and the states
+    // numbered by the offset of their row.
+    unsigned int nStates = this->output.size();
+    this->table.resize (nStates * (k+1));
+    for (unsigned int state = 0; state < nStates; state++) {
+        for (unsigned int cls = 0; cls < k; cls++) {
+            this->table[state*(k+1) + cls] = this->delta[state*k + cls] * (k+1);
+        }
+        this->table[state*(k+1) + k] = this->output[state];
+    }
+
+    // Bytes which leave the automaton in its start state can be
+    // skipped over without looking them up.
+    for (unsigned int c = 0; c < 256; c++) {
+        this->skip[c] = (this->delta[this->classOf[c]] == 0);
+    }
+
+    this->built = true;
+}
+
+    unsigned int
+NXPatternMatcher::match (const char * data, size_t n) const
+{
+    if (!this->built) {
+        return 0;
+    }
+
+    const unsigned char * p = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char * end = p + n;
+    const unsigned int * table = &this->table[0];
+    unsigned int k = this->nClasses;
+    unsigned int found = 0;
+    unsigned int state = 0;
+
+    while (p < end) {
+        if (state == 0) {
+            while (p < end && this->skip[*p]) {
+                p++;
+            }
+            if (p == end) {
+                break;
+            }
+        }
+        state = table[state + this->classOf[*p++]];
+        found |= table[state + k];
+    }
+    return found;
+}
@@ -0,0 +1,101 @@
+/* -*-c++-*- */
+/***************************************************************************
+                                nxmatcher.h
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*!
+ * \file nxmatcher.h Finds which of a set of strings occur in a line
+ * of output, in one pass over the line.
+ */
+
+#ifndef _NXMATCHER_H_
+#define _NXMATCHER_H_
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace nxcl {
+
+    /*!
+     * An Aho-Corasick automaton for up to 32 patterns. Add the
+     * patterns, call build() once, and then match() reports every
+     * pattern found anywhere in a line as a bit mask, reading each
+     * byte of the line once however many patterns there are.
+     *
+     * The automaton is kept as a table of transitions on classes
+     * of bytes: each byte which appears in some pattern is a class
+     * of its own and all the other bytes share class 0, which
+     * keeps the table small.
+     */
+    class NXPatternMatcher
+    {
+        public:
+            NXPatternMatcher();
+            ~NXPatternMatcher();
+
+            /*!
+             * Add a pattern, before build() is called.
+             *
+             * \return the bit which match() sets when the
+             * pattern is found, or 0 if there are already 32
+             * patterns.
+             */
+            unsigned int add (const string& pattern);
+
+            /*!
+             * Build the automaton from the patterns added so far.
+             */
+            void build (void);
+
+            /*!
+             * \return the bits of all the patterns found in the
+             * \arg n bytes at \arg data.
+             */
+            unsigned int match (const char * data, size_t n) const;
+            unsigned int match (const string& s) const
+            {
+                return this->match (s.data(), s.size());
+            }
+
+            bool isBuilt (void) const { return this->built; }
+
+        private:
+            vector<string> patterns;
+            /*!
+             * The class of each byte value
+             */
+            unsigned char classOf[256];
+            unsigned int nClasses;
+            /*!
+             * While building, delta[state*nClasses + class] is the
+             * next state and output[state] the patterns which end
+             * at the state.
+             */
+            vector<int> delta;
+            vector<unsigned int> output;
+            /*!
+             * The same, as used by match(); see build().
+             */
+            vector<unsigned int> table;
+            /*!
+             * Bytes which can't start a pattern
+             */
+            bool skip[256];
+            bool built;
+    };
+
+} // namespace
+#endif
@@ -0,0 +1,178 @@
+/***************************************************************************
+                             nxservercache.cpp
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+extern "C" {
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+}
+
+#include "nxservercache.h"
+
+using namespace std;
+using namespace nxcl;
+
+/*!
+ * Split \arg s at each \arg sep. (Unlike
+ * notQtUtilities::splitString(), empty and one character fields are
+ * kept.)
+ */
+template <class C>
+static void split (const string& s, char sep, C& out)
+{
+    string::size_type start = 0, end;
+
+    out.clear();
+    while ((end = s.find (sep, start)) != string::npos) {
+        out.push_back (s.substr (start, end - start));
+        start = end + 1;
+    }
+    out.push_back (s.substr (start));
+}
+
+/*!
+ * Read one line of the cache file into \arg info, if it is for
+ * \arg host and \arg port.
+ */
+static bool parseLine (const string& line, const string& host, int port, NXServerInfo& info)
+{
+    vector<string> f;
+    split (line, '\t', f);
+    if (f.size() < 6 || f[0] != host || atoi (f[1].c_str()) != port) {
+        return false;
+    }
+
+    info.version = f[2];
+    info.freenx = (f[3] == "freenx");
+    info.pipelining = (f[4] == "1");
+    info.sets.clear();
+    if (!f[5].empty()) {
+        split (f[5], ',', info.sets);
+    }
+    return true;
+}
+
+/*!
+ * Implementation of NXServerCache
+ */
+//@{
+NXServerCache::NXServerCache (const string& p) :
+    path(p)
+{
+    if (this->path.empty()) {
+        this->path = NXServerCache::defaultPath();
+    }
+}
+
+NXServerCache::~NXServerCache()
+{
+}
+
+    string
+NXServerCache::defaultPath (void)
+{
+    const char * home = getenv ("HOME");
+    string p = (home != NULL) ? home : "";
+    return p + "/.nx/cache/servers";
+}
+
+    bool
+NXServerCache::lookup (const string& host, int port, NXServerInfo& info)
+{
+    ifstream f (this->path.c_str());
+    string line;
+
+    while (getline (f, line)) {
+        if (!line.empty() && line[0] != '#' && parseLine (line, host, port, info)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+    bool
+NXServerCache::store (const string& host, int port, const NXServerInfo& info)
+{
+    return this->rewrite (host, port, &info);
+}
+
+    bool
+NXServerCache::forget (const string& host, int port)
+{
+    return this->rewrite (host, port, NULL);
+}
+
+    bool
+NXServerCache::rewrite (const string& host, int port, const NXServerInfo * info)
+{
+    // Make the directories, ~/.nx/cache for the default path.
+    string::size_type slash = this->path.rfind ('/');
+    if (slash != string::npos && slash > 0) {
+        string dir = this->path.substr (0, slash);
+        string::size_type up = dir.rfind ('/');
+        if (up != string::npos && up > 0) {
+            mkdir (dir.substr (0, up).c_str(), 0700);
+        }
+        mkdir (dir.c_str(), 0700);
+    }
+
+    stringstream tmp;
+    tmp << this->path << ".tmp." << getpid();
+    ofstream out (tmp.str().c_str());
+    if (!out.is_open()) {
+        return false;
+    }
+    out << "# nxcl: what we know of the NX servers we have logged in to\n";
+
+    // Everything else we can read, as it was
+    ifstream in (this->path.c_str());
+    string line;
+    while (getline (in, line)) {
+        NXServerInfo old;
+        vector<string> f;
+        split (line, '\t', f);
+        if (line.empty() || line[0] == '#' || f.size() < 6
+            || parseLine (line, host, port, old)) {
+            continue;
+        }
+        out << line << "\n";
+    }
+    in.close();
+
+    if (info != NULL) {
+        out << host << "\t" << port << "\t" << info->version << "\t"
+            << (info->freenx ? "freenx" : "nomachine") << "\t"
+            << (info->pipelining ? 1 : 0) << "\t";
+        list<string>::const_iterator it;
+        for (it = info->sets.begin(); it != info->sets.end(); it++) {
+            out << (it == info->sets.begin() ? "" : ",") << *it;
+        }
+        out << "\n";
+    }
+
+    out.close();
+    if (out.fail() || rename (tmp.str().c_str(), this->path.c_str()) != 0) {
+        unlink (tmp.str().c_str());
+        return false;
+    }
+    return true;
+}
+//@}
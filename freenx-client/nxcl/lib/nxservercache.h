@@ -0,0 +1,91 @@
+/* -*-c++-*- */
+/***************************************************************************
+                              nxservercache.h
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*!
+ * \file nxservercache.h What we learnt of each NX server at the last
+ * login, kept between connections so that the next login can take
+ * fewer round trips.
+ */
+
+#ifndef _NXSERVERCACHE_H_
+#define _NXSERVERCACHE_H_
+
+#include <string>
+#include "nxdata.h"
+
+using namespace std;
+
+namespace nxcl {
+
+    /*!
+     * The NXServerInfo of each server we have logged in to, by
+     * host and port, in a text file (by default
+     * ~/.nx/cache/servers), one server per line:
+     *
+     * host <tab> port <tab> version <tab> freenx|nomachine <tab>
+     * pipelining (0 or 1) <tab> SET commands, separated by commas
+     *
+     * The file is read afresh for each lookup and rewritten whole
+     * (through a temporary file and a rename) for each store, so
+     * several nxcl processes can share it; the last to store a
+     * server wins. It is only a cache: a line which can't be read
+     * is ignored.
+     */
+    class NXServerCache
+    {
+        public:
+            /*!
+             * \arg path is the cache file; "" for the default.
+             */
+            NXServerCache (const string& path = "");
+            ~NXServerCache();
+
+            /*!
+             * \return false if there's nothing on \arg host and
+             * \arg port in the cache.
+             */
+            bool lookup (const string& host, int port, NXServerInfo& info);
+            /*!
+             * Replace what the cache has on \arg host and \arg
+             * port with \arg info.
+             *
+             * \return false if the file couldn't be written.
+             */
+            bool store (const string& host, int port, const NXServerInfo& info);
+            /*!
+             * Drop \arg host and \arg port from the cache.
+             */
+            bool forget (const string& host, int port);
+
+            string getPath (void) const { return this->path; }
+
+            /*!
+             * ~/.nx/cache/servers
+             */
+            static string defaultPath (void);
+
+        private:
+            /*!
+             * Rewrite the file without \arg host and \arg port,
+             * and with \arg info for them if it isn't NULL.
+             */
+            bool rewrite (const string& host, int port, const NXServerInfo * info);
+
+            string path;
+    };
+
+} // namespace
+#endif
@@ -30,15 +30,43 @@ enum { HELLO_NXCLIENT,
     LIST_SESSIONS,
     PARSESESSIONS,
     STARTSESSION,
-    FINISHED };
+    FINISHED,
+    CONTROL };
+
+static const char * stageNames[] = {
+    "hello",
+    "acknowledge",
+    "shell mode",
+    "auth mode",
+    "login",
+    "list sessions",
+    "parse sessions",
+    "start session",
+    "finished",
+    "control"
+};
 
 #define CLIENT_VERSION "3.0.0"
 
+/*!
+ * How long the server may sit at a prompt during a pipelined login
+ * (see NXSession::setServerInfo()) without reading the next command
+ * before we decide it has dropped it. The echo normally follows the
+ * prompt in the same write.
+ */
+#define PIPELINE_STALL_MS 2000
+
 #include <iostream>
+#include <map>
+#include <stdlib.h>
+#include <string.h>
 
 #include "notQt.h"
 #include "nxclientlib.h"
 #include "nxsession.h"
+#include "nxmatcher.h"
+#include "nxlineframer.h"
+#include "nxtrace.h"
 
 using namespace std;
 using namespace nxcl;
@@ -47,8 +75,19 @@ NXSession::NXSession() :
     devurand_fd(-1),
     stage(HELLO_NXCLIENT),
     sessionDataSet(false),
+    deferChoice(false),
+    choiceMade(true),
+    choiceHeld(false),
+    controlMode(false),
+    pipelining(true),
     nxUsername("nouser"),
-    nxPassword("nopass")
+    nxPassword("nopass"),
+    resumeColumns(0),
+    haveCachedInfo(false),
+    loginPipelined(false),
+    pipelineFailed(false),
+    echoes(0),
+    stallAt(0)
 {
 }
 
@@ -60,567 +99,1045 @@ void NXSession::resetSession()
 {
     this->stage = 0;
     this->sessionDataSet = false;
+    this->choiceMade = true;
+    this->choiceHeld = false;
+    this->queuedRequests.clear();
+    this->sentRequests.clear();
+    this->loginPipelined = false;
+    this->pipelineFailed = false;
+    this->unechoed.clear();
+    this->echoedSets.clear();
+    this->stallAt = 0;
+}
+
+/*!
+ * The strings which parseSSH() looks for in the server's output, in
+ * the order they are added to the matcher (so P_YESNO is bit 0,
+ * and so on).
+ */
+enum {
+    P_YESNO = 1<<0,
+    P_PASSWORD = 1<<1,
+    P_DENIED = 1<<2,
+    P_SU_FAILED = 1<<3,
+    P_UNKNOWN_ID = 1<<4,
+    P_HELLO = 1<<5
+};
+
+static const char * handshakePatterns[] = {
+    "Are you sure you want to continue connecting (yes/no)?",
+    "assword",
+    "Permission denied",
+    "su: Authentication failure",
+    "Unknown id:",
+    "HELLO NXSERVER - Version",
+    NULL
+};
+
+/*!
+ * Stand-ins for "any stage" and "any response" in the table below
+ */
+#define ANY_STAGE -1
+#define ANY_RESPONSE -1
+
+/*!
+ * The handshake. For each line from the server, the rows for
+ * ANY_STAGE are tried first and then the rows for the current
+ * stage, in order. A row applies if the response number matches and
+ * (if it lists any) one of its patterns was found in the line; its
+ * action is called and then the stage moves on by "next". Where more
+ * than one row sets the reply, the last one wins.
+ */
+const NXSession::Transition NXSession::transitions[] = {
+#ifdef NXCL_USE_NXSSH
+    { ANY_STAGE, 211, 0, &NXSession::answerContinue, 0 },
+    { ANY_STAGE, 204, 0, &NXSession::authFailed, 0 },
+#endif
+    { ANY_STAGE, 147, 0, &NXSession::capacityReached, 0 },
+
+    { HELLO_NXCLIENT, ANY_RESPONSE, P_YESNO, &NXSession::answerYes, 0 },
+    { HELLO_NXCLIENT, ANY_RESPONSE, P_PASSWORD, &NXSession::sendPassword, 0 },
+    { HELLO_NXCLIENT, ANY_RESPONSE, P_DENIED | P_SU_FAILED | P_UNKNOWN_ID,
+        &NXSession::authFailed, 0 },
+    { HELLO_NXCLIENT, ANY_RESPONSE, P_HELLO, &NXSession::sendHello, 1 },
+
+    { ACKNOWLEDGE, 105, 0, NULL, 1 },
+
+    { SHELL_MODE, 105, 0, &NXSession::sendShellMode, 1 },
+
+    { AUTH_MODE, 105, 0, &NXSession::sendAuthMode, 1 },
+
+    { AUTH_MODE, 0, 0, &NXSession::checkEcho, 0 },
+
+    { LOGIN, 0, 0, &NXSession::checkEcho, 0 },
+    { LOGIN, 105, 0, &NXSession::sendLogin, 0 },
+    { LOGIN, 101, 0, &NXSession::sendUsername, 0 },
+    { LOGIN, 102, 0, &NXSession::sendPassword, 0 },
+    { LOGIN, 103, 0, &NXSession::loggedIn, 1 },
+    { LOGIN, 404, 0, &NXSession::loginFailed, 0 },
+
+    { LIST_SESSIONS, ANY_RESPONSE, 0, &NXSession::listSessions, 0 },
+
+    { PARSESESSIONS, ANY_RESPONSE, 0, &NXSession::collectSessions, 0 },
+
+    { STARTSESSION, ANY_RESPONSE, 0, &NXSession::startSession, 0 },
+
+    { FINISHED, ANY_RESPONSE, 0, &NXSession::readyForProxy, 0 },
+
+    { CONTROL, ANY_RESPONSE, 0, &NXSession::controlLine, 0 }
+};
+
+/*!
+ * The matcher for handshakePatterns, built the first time it's
+ * needed.
+ */
+static const NXPatternMatcher& handshakeMatcher (void)
+{
+    static NXPatternMatcher matcher;
+    if (!matcher.isBuilt()) {
+        for (int i = 0; handshakePatterns[i] != NULL; i++) {
+            matcher.add (handshakePatterns[i]);
+        }
+        matcher.build();
+    }
+    return matcher;
 }
 
 string NXSession::parseSSH(string message)
 {
-    dbgln ("NXSession::parseSSH called for: " + message);
+    NXLine line;
+    line.data = message.data();
+    line.size = message.size();
+    line.code = NXLineFramer::parseCode (line.data, line.size);
+    line.prompt = false;
+    return this->parseSSH (line);
+}
+
+string NXSession::parseSSH (const NXLine& message)
+{
+    dbgln ("NXSession::parseSSH called for: " + message.str());
 
-    int response = parseResponse (message);
+    int response = message.code;
     string returnMessage;
+    int startStage = this->stage;
 
-#ifdef NXCL_USE_NXSSH
-    if (response == 211) {
-        if (doSSH == true) {
-            returnMessage = "yes";
-            doSSH = false;
-        } else
-            returnMessage = "no";
+    const unsigned int nTransitions = sizeof (transitions) / sizeof (transitions[0]);
+    // Only look for the patterns if a row needs them.
+    bool matched = false;
+    unsigned int found = 0;
+
+    // The ANY_STAGE rows, then this stage's rows (which may be a
+    // different stage from the one we started in).
+    int stages[2] = { ANY_STAGE, 0 };
+
+    for (int pass = 0; pass < 2; pass++) {
+
+        if (pass == 1) {
+            stages[1] = this->stage;
+            dbgln ("Stage " << this->stage);
+        }
+
+        int delta = 0;
+        for (unsigned int i = 0; i < nTransitions; i++) {
+
+            const Transition& t = transitions[i];
+
+            if (t.stage != stages[pass]
+                || (t.response != ANY_RESPONSE && t.response != response)) {
+                continue;
+            }
+
+            if (t.patterns != 0) {
+                if (!matched) {
+                    found = handshakeMatcher().match (message.data, message.size);
+                    matched = true;
+                }
+                if ((found & t.patterns) == 0) {
+                    continue;
+                }
+            }
+
+            if (t.action != NULL) {
+                (this->*t.action) (message, response, returnMessage);
+            }
+            delta += t.next;
+        }
+        this->stage += delta;
     }
 
-    if (response == 204) { // Authentication failed
-        returnMessage = "204";
+    if (this->stage != startStage) {
+        this->callbacks->stageSignal (NXSession::stageName (this->stage));
     }
+
+    dbgln ("NXSession::parseSSH, about to return a message: " + returnMessage);
+
+    if (!returnMessage.empty()) {
+        returnMessage.append("\n");
+        return returnMessage;
+    } else
+        return "";
+}
+
+/*!
+ * Actions for the rows of NXSession::transitions
+ */
+//@{
+#ifdef NXCL_USE_NXSSH
+void NXSession::answerContinue (const NXLine& message, int response, string& returnMessage)
+{
+    if (doSSH == true) {
+        returnMessage = "yes";
+        doSSH = false;
+    } else
+        returnMessage = "no";
+}
 #endif
 
-    if (response == 147) { // Server capacity reached
-        returnMessage = "147";
-        this->stage = FINISHED;
-    }
-
-    switch (this->stage) {
-        case HELLO_NXCLIENT:
-            dbgln ("HELLO_NXCLIENT stage");
-
-	    if (message.find("Are you sure you want to continue connecting (yes/no)?") != string::npos)
-            	returnMessage = "yes"; // FF-FIXME: Or 211?
-	    
-	    if (message.find("assword") != string::npos)
-            	returnMessage = nxPassword; // FF-FIXME: -> What to do? What to do?
-	    
-	    if (message.find("Permission denied") != string::npos || 
-	            message.find("su: Authentication failure") != string::npos || 
-		    message.find("Unknown id:") != string::npos)
-                returnMessage = "204"; // Authentication failed
-
-            if (message.find("HELLO NXSERVER - Version") != string::npos) {
-                this->callbacks->authenticatedSignal();
-                returnMessage = "hello NXCLIENT - Version ";
-                returnMessage.append(CLIENT_VERSION);
-                this->stage++;
-            }
+void NXSession::authFailed (const NXLine& message, int response, string& returnMessage)
+{
+    returnMessage = "204"; // Authentication failed
+}
 
-            break;
-        case ACKNOWLEDGE:
-            dbgln ("ACKNOWLEDGE stage");
+void NXSession::capacityReached (const NXLine& message, int response, string& returnMessage)
+{
+    returnMessage = "147";
+    this->stage = FINISHED;
+}
 
-            if (response == 105)
-                this->stage++;
+void NXSession::answerYes (const NXLine& message, int response, string& returnMessage)
+{
+    returnMessage = "yes"; // FF-FIXME: Or 211?
+}
 
-            break;
-        case SHELL_MODE:
-            dbgln ("SHELL_MODE stage");
+void NXSession::sendPassword (const NXLine& message, int response, string& returnMessage)
+{
+    returnMessage = nxPassword;
+}
 
-            if (response == 105) {
-                returnMessage = "SET SHELL_MODE SHELL";
-                this->stage++;
-            }
+void NXSession::sendHello (const NXLine& message, int response, string& returnMessage)
+{
+    // "HELLO NXSERVER - Version 3.2.0-74-SVN OS (GPL, using
+    // backend: 3.5.0)" from FreeNX, "HELLO NXSERVER - Version
+    // 3.5.0-9 - LFE" from NoMachine.
+    string hello = message.str();
+    string::size_type v = hello.find ("Version ");
+    string::size_type end;
+    this->serverInfo = NXServerInfo();
+    if (v != string::npos) {
+        v += 8;
+        end = hello.find (' ', v);
+        this->serverInfo.version = hello.substr (v, end == string::npos ? end : end - v);
+    }
+    this->serverInfo.freenx = message.contains ("(GPL");
+    this->serverInfo.pipelining = false;
+
+    // Only pipeline the login to a server which took the same SET
+    // commands last time.
+    list<string> sets;
+    sets.push_back ("SHELL_MODE SHELL");
+    sets.push_back ("AUTH_MODE PASSWORD");
+    this->loginPipelined = (this->haveCachedInfo
+            && this->cachedInfo.pipelining
+            && this->cachedInfo.version == this->serverInfo.version
+            && this->cachedInfo.sets == sets);
+    this->pipelineFailed = false;
+    this->lastCommand.clear();
+    this->echoes = 0;
+    dbgln ("Server version " << this->serverInfo.version
+            << (this->loginPipelined ? ", pipelining the login" : ""));
+
+    this->callbacks->authenticatedSignal();
+    returnMessage = "hello NXCLIENT - Version ";
+    returnMessage.append(CLIENT_VERSION);
+}
 
-            break;
-        case AUTH_MODE:
-            dbgln ("AUTH_MODE stage");
+void NXSession::sendShellMode (const NXLine& message, int response, string& returnMessage)
+{
+    if (this->loginPipelined) {
+        this->unechoed.clear();
+        this->unechoed.push_back ("SET SHELL_MODE SHELL");
+        this->unechoed.push_back ("SET AUTH_MODE PASSWORD");
+        this->unechoed.push_back ("login");
+        this->echoedSets.clear();
+        returnMessage = "SET SHELL_MODE SHELL\nSET AUTH_MODE PASSWORD\nlogin";
+        // Past AUTH_MODE; this row's step takes us on to LOGIN.
+        this->stage = AUTH_MODE;
+        return;
+    }
+    returnMessage = "SET SHELL_MODE SHELL";
+    this->lastCommand = returnMessage;
+}
 
-            if (response == 105) {
-                returnMessage = "SET AUTH_MODE PASSWORD";
-                this->stage++;
-            }
+void NXSession::sendAuthMode (const NXLine& message, int response, string& returnMessage)
+{
+    this->serverInfo.sets.push_back ("SHELL_MODE SHELL");
+    returnMessage = "SET AUTH_MODE PASSWORD";
+    this->lastCommand = returnMessage;
+}
 
-            break;
-        case LOGIN:
-            dbgln ("LOGIN stage");
-
-            switch (response) {
-                case 105:
-                    returnMessage = "login";
-                    break;
-                case 101:
-                    returnMessage = nxUsername;
-                    break;
-                case 102:
-                    returnMessage = nxPassword;
-                    break;
-                case 103:
-                    this->stage++;
-                    break;
-                case 404:
-                    this->callbacks->loginFailedSignal();
+void NXSession::sendLogin (const NXLine& message, int response, string& returnMessage)
+{
+    if (this->loginPipelined) {
+        if (!this->echoedSets.empty()) {
+            // The prompt after a SET we sent with the others. The
+            // echo of the next command should follow.
+            this->serverInfo.sets.push_back (this->echoedSets.front());
+            this->echoedSets.pop_front();
+            if (this->echoedSets.empty() && !this->unechoed.empty()) {
+                this->stallAt = NXTrace::now() + PIPELINE_STALL_MS * 1000LL;
             }
+            return;
+        }
+        if (this->unechoed.empty()) {
+            // "login" has been echoed; the 101 is on its way.
+            return;
+        }
 
-            break;
-        case LIST_SESSIONS:
-            dbgln ("LIST_SESSIONS stage");
-
-            if (this->sessionData->terminate == true) {
-                // Wait for termination
-                dbgln ("Waiting for termination");
-
-                if (response == 900) {
-                    stringstream termsession;
-
-                    termsession << "NX> 900 Session id: "
-                        << this->sessionData->id
-                        << " terminated.";
-
-                    if (message.find (termsession.str().c_str(), 0) == 0) {
-                        // Session terminated.
-                        this->sessionData->terminate = false;
-                    } else {
-                        usleep (10000);
-                    }
-                }
+        // A prompt for a command which the server hasn't read:
+        // it has thrown away the rest of what we sent.
+        returnMessage = this->unpipeline();
+        return;
+    }
+    this->serverInfo.sets.push_back ("AUTH_MODE PASSWORD");
+    returnMessage = "login";
+    this->lastCommand = returnMessage;
+}
 
-            } else if (response == 105) {
-                // Get a list of the available sessions on the server, for
-                // given user, with given status, and any type. Not sure if
-                // geometry is ignored or not.
-                stringstream ss;
+void NXSession::checkEcho (const NXLine& message, int response, string& returnMessage)
+{
+    if (!this->loginPipelined) {
+        if (!this->lastCommand.empty() && message.equals (this->lastCommand)) {
+            this->echoes++;
+            this->lastCommand.clear();
+        }
+        return;
+    }
+    if (this->unechoed.empty() || !message.equals (this->unechoed.front())) {
+        return;
+    }
+    if (message.startsWith ("SET ")) {
+        this->echoedSets.push_back (message.after (4));
+    }
+    this->unechoed.pop_front();
+    this->stallAt = 0;
+}
 
-                // We want to list suspended or running sessions, with this
-                // command:
-                dbgln ("this->resumeSessions.size() == "
-                        << this->resumeSessions.size());
+string NXSession::unpipeline (void)
+{
+    string next = this->unechoed.front();
+
+    dbgln ("The server dropped '" << next << "'; no longer pipelining the login");
+    this->loginPipelined = false;
+    this->pipelineFailed = true;
+    this->unechoed.clear();
+    this->echoedSets.clear();
+    this->stallAt = 0;
+
+    // Back to the stage which follows sending next
+    if (next == "SET SHELL_MODE SHELL") {
+        this->stage = AUTH_MODE;
+    } else {
+        this->stage = LOGIN;
+    }
+    return next;
+}
 
-                if (this->sessionData->sessionType == "shadow") {
-                    // This is how to list shadow sessions. Run NoMachine's
-                    // client and see ~/.nx/temp/(pid)/sshlog for connection
-                    // details
-                    ss << "listsession --type=\"shadow\"";
+int NXSession::getPipelineWait (void)
+{
+    if (this->stallAt == 0) {
+        return -1;
+    }
+    long long wait = (this->stallAt - NXTrace::now()) / 1000;
+    return (wait > 0) ? static_cast<int>(wait) : 0;
+}
 
-                } else {
+string NXSession::pipelineStalled (void)
+{
+    if (this->stallAt == 0 || NXTrace::now() < this->stallAt) {
+        return "";
+    }
+    return this->unpipeline() + "\n";
+}
 
-                    ss << "listsession --user=\"" << nxUsername
-                        << "\" --status=\"suspended,running\" --geometry=\""
-                        << this->sessionData->xRes << "x"
-                        << this->sessionData->yRes << "x"
-                        << this->sessionData->depth
-                        << (this->sessionData->render ? "+render" : "")
-
-                        // If you leave --type blank, you can re-connect to any
-                        // sessions available.
-                        << "\" --type=\"" << this->sessionData->sessionType
-                        << "\"";
-                }
+void NXSession::loggedIn (const NXLine& message, int response, string& returnMessage)
+{
+    // Worth trying to pipeline the next login if the server echoed
+    // each command, unless pipelining has failed here, now or (with
+    // this version) before.
+    if (this->loginPipelined) {
+        this->serverInfo.pipelining = true;
+    } else if (this->pipelineFailed || this->echoes < 3) {
+        this->serverInfo.pipelining = false;
+    } else if (this->haveCachedInfo && this->cachedInfo.version == this->serverInfo.version) {
+        this->serverInfo.pipelining = this->cachedInfo.pipelining;
+    } else {
+        this->serverInfo.pipelining = true;
+    }
+    this->callbacks->serverInfoSignal (this->serverInfo);
+}
+
+void NXSession::sendUsername (const NXLine& message, int response, string& returnMessage)
+{
+    returnMessage = nxUsername;
+}
+
+void NXSession::loginFailed (const NXLine& message, int response, string& returnMessage)
+{
+    this->callbacks->loginFailedSignal();
+}
+
+void NXSession::listSessions (const NXLine& message, int response, string& returnMessage)
+{
+    dbgln ("LIST_SESSIONS stage");
+
+    if (this->controlMode && response == 105) {
+        // Logged in; wait for requests.
+        this->stage = CONTROL;
+        this->callbacks->controlReadySignal();
+        returnMessage = this->nextCommands();
 
-                returnMessage = ss.str();
-                this->stage++;
+    } else if (this->sessionData->terminate == true) {
+        // Wait for termination
+        dbgln ("Waiting for termination");
+
+        if (response == 900) {
+            stringstream termsession;
+
+            termsession << "NX> 900 Session id: "
+                << this->sessionData->id
+                << " terminated.";
+
+            if (message.startsWith (termsession.str().c_str())) {
+                // Session terminated.
+                this->sessionData->terminate = false;
+            } else {
+                usleep (10000);
             }
-            break;
-        case PARSESESSIONS:
-            dbgln ("PARSESESSIONS stage");
+        }
 
-            if ((this->sessionData->sessionType == "shadow" &&
-                        response != 105) ||
-                    (this->sessionData->sessionType != "shadow" &&
-                        response != 148)  ) {
+    } else if (response == 105) {
+        // We want to list suspended or running sessions.
+        this->resumeColumns = 0;
+        returnMessage = this->listCommand();
+        this->stage++;
+    }
+}
 
-                dbgln ("Building resumeSessions:"
-                        << " resumeSessions.push_back(message);");
+void NXSession::collectSessions (const NXLine& message, int response, string& returnMessage)
+{
+    dbgln ("PARSESESSIONS stage");
 
-                this->resumeSessions.push_back(message);
+    if ((this->sessionData->sessionType == "shadow" &&
+                response != 105) ||
+            (this->sessionData->sessionType != "shadow" &&
+                response != 148)  ) {
 
-            } else if ((this->sessionData->sessionType == "shadow" &&
-                        response == 105)
-                    || (this->sessionData->sessionType != "shadow" &&
-                        response == 148)) {
+        // One more line of the session list
+        parseResumeLine (message.data, message.size);
 
-                dbgln ("Parsing resumeSessions:"
-                        << " parseResumeSessions(resumeSessions);");
+    } else if ((this->sessionData->sessionType == "shadow" &&
+                response == 105)
+            || (this->sessionData->sessionType != "shadow" &&
+                response == 148)) {
 
-                parseResumeSessions (this->resumeSessions);
+        dbgln ("End of the session list");
 
-                dbgln ("parseResumeSessions(resumeSessions) returned");
+        resumeSessionsParsed();
 
-                // Now, the problem we have here, is that when
-                // we return from the last 105 response, we
-                // don't then get another stdout message to
-                // act upon. So, we want to recurse back into
-                // parseSSH to get onto the STARTSESSION stage here:
-                returnMessage = this->parseSSH (message);
-            }
-            break;
+        // Now, the problem we have here, is that when
+        // we return from the last 105 response, we
+        // don't then get another stdout message to
+        // act upon. So, we want to recurse back into
+        // parseSSH to get onto the STARTSESSION stage here:
+        returnMessage = this->parseSSH (message);
+    }
+}
 
-        case STARTSESSION:
-            dbgln ("STARTSESSION stage");
-            if (response == 105 && sessionDataSet) {
+void NXSession::startSession (const NXLine& message, int response, string& returnMessage)
+{
+    dbgln ("STARTSESSION stage");
+    if (response == 105 && this->deferChoice && !this->choiceMade) {
+        // Answered by releaseChoice() once the choice is made.
+        dbgln ("Holding the 105 until a session is chosen");
+        this->choiceHeld = true;
+        return;
+    }
+    if (response == 105 && sessionDataSet) {
+
+        dbgln ("response is 105 and sessionDataSet is true");;
+        this->callbacks->startingSessionSignal (this->sessionData);
+        int media = 0;
+        string fullscreen = "";
+        if (this->sessionData->media) {
+            media = 1;
+        }
 
-                dbgln ("response is 105 and sessionDataSet is true");;
-                int media = 0;
-                string fullscreen = "";
-                if (this->sessionData->media) {
-                    media = 1;
-                }
+        if (this->sessionData->fullscreen) {
+            this->sessionData->geometry = "fullscreen";
+            fullscreen = "+fullscreen";
+        }
 
-                if (this->sessionData->fullscreen) {
-                    this->sessionData->geometry = "fullscreen";
-                    fullscreen = "+fullscreen";
-                }
+        if (this->sessionData->sessionType == "shadow" &&
+                this->sessionData->terminate == false) {
 
-                if (this->sessionData->sessionType == "shadow" &&
-                        this->sessionData->terminate == false) {
-
-                    dbgln ("It's a shadow session!");
-                    stringstream ss;
-
-                    // These are the session parameters that NoMachine's client
-                    // sends for resume
-
-                    ss << "attachsession "
-                        << "--link=\"" << this->sessionData->linkType << "\" "
-                        << "--backingstore=\""
-                            << this->sessionData->backingstore << "\" "
-                        << "--encryption=\"" << this->sessionData->encryption
-                            << "\" "
-                        << "--cache=\"" << this->sessionData->cache << "M\" "
-                        << "--images=\"" << this->sessionData->images << "M\" "
-                        // probably has been autodetected from my display
-                        << "--shmem=\"1\" "
-                        // probably has been autodetected from my display
-                        << "--shpix=\"1\" "
-                        // probably has been autodetected from my display
-                        << "--strict=\"0\" "
-                        // probably has been autodetected from my display
-                        << "--composite=\"1\" "
-                        << "--media=\"" << media << "\" "
-                        << "--session=\"" << this->sessionData->sessionName
-                            << "\" "
-                        << "--type=\"" << this->sessionData->sessionType
-                            << "\" "
-                        // FIXME: This may be some other OS if you compile it on
-                        // Sun, Windows, etc.
-                        << "--client=\"linux\" "
-                        << "--keyboard=\"" << this->sessionData->keyboard
-                            << "\" "
-                        << "--id=\"" << this->sessionData->id << "\" "
-                        // This may be the key?
-                        << "--display=\"0\" "
-                        << "--geometry=\"" << this->sessionData->geometry
-                            << "\" ";
-
-                    returnMessage = ss.str();
-
-                    dbgln ("session parameter command: " + ss.str());
-
-                    this->stage++;
-
-                } else if (this->sessionData->terminate == true) {
-
-                    stringstream ss;
-
-                    // These are the session parameters that NoMachine's client
-                    // sends for resume
-                    ss << "Terminate --sessionid=\"" << this->sessionData->id
-                        << "\"";
-
-                    returnMessage = ss.str();
-
-                    dbgln ("session parameter command: " + ss.str());
-
-                    // Back to listsessions after terminating a session.
-                    this->stage -= 2;
-
-                    // Clear the list of sessions to resume
-                    this->resumeSessions.clear();
-                    this->runningSessions.clear();
-
-                } else if (this->sessionData->suspended) {
-
-                    dbgln ("this->sessionData->suspended is true");
-
-                    stringstream ss;
-
-                    // These are the session parameters that NoMachine's client
-                    // sends for resume
-                    ss << "restoresession --id=\"" << this->sessionData->id <<
-                        "\" --session=\"" << this->sessionData->sessionName <<
-                        "\" --type=\"" << this->sessionData->sessionType <<
-                        "\" --cache=\"" << this->sessionData->cache <<
-                        "M\" --images=\"" << this->sessionData->images <<
-                        "M\" --cookie=\"" << generateCookie() <<
-                        "\" --link=\"" << this->sessionData->linkType <<
-                        "\" --kbtype=\"" << this->sessionData->kbtype <<
-                        "\" --nodelay=\"1\" --encryption=\""
-                            << this->sessionData->encryption <<
-                        "\" --backingstore=\""
-                            << this->sessionData->backingstore <<
-                        "\" --geometry=\"" << this->sessionData->geometry <<
-                        "\" --media=\"" << media <<
-                        "\" --agent_server=\""
-                            << this->sessionData->agentServer <<
-                        "\" --agent_user=\"" << this->sessionData->agentUser <<
-                        "\" --agent_password=\""
-                            << this->sessionData->agentPass << "\"";
-
-                    returnMessage = ss.str();
-
-                    dbgln ("session parameter command: " + ss.str());
-
-                    this->stage++;
+            dbgln ("It's a shadow session!");
+            stringstream ss;
 
-                } else {
+            // These are the session parameters that NoMachine's client
+            // sends for resume
+
+            ss << "attachsession "
+                << "--link=\"" << this->sessionData->linkType << "\" "
+                << "--backingstore=\""
+                    << this->sessionData->backingstore << "\" "
+                << "--encryption=\"" << this->sessionData->encryption
+                    << "\" "
+                << "--cache=\"" << this->sessionData->cache << "M\" "
+                << "--images=\"" << this->sessionData->images << "M\" "
+                // probably has been autodetected from my display
+                << "--shmem=\"1\" "
+                // probably has been autodetected from my display
+                << "--shpix=\"1\" "
+                // probably has been autodetected from my display
+                << "--strict=\"0\" "
+                // probably has been autodetected from my display
+                << "--composite=\"1\" "
+                << "--media=\"" << media << "\" "
+                << "--session=\"" << this->sessionData->sessionName
+                    << "\" "
+                << "--type=\"" << this->sessionData->sessionType
+                    << "\" "
+                // FIXME: This may be some other OS if you compile it on
+                // Sun, Windows, etc.
+                << "--client=\"linux\" "
+                << "--keyboard=\"" << this->sessionData->keyboard
+                    << "\" "
+                << "--id=\"" << this->sessionData->id << "\" "
+                // This may be the key?
+                << "--display=\"0\" "
+                << "--geometry=\"" << this->sessionData->geometry
+                    << "\" ";
+
+            returnMessage = ss.str();
+
+            dbgln ("session parameter command: " + ss.str());
+
+            this->stage++;
+
+        } else if (this->sessionData->terminate == true) {
 
-                    dbgln ("this->sessionData->suspended is false, and it's" <<
-                            " not a shadow session.");
+            stringstream ss;
 
-                    stringstream ss;
+            // These are the session parameters that NoMachine's client
+            // sends for resume
+            ss << "Terminate --sessionid=\"" << this->sessionData->id
+                << "\"";
 
-                    ss << "startsession --session=\""
-                            << this->sessionData->sessionName
+            returnMessage = ss.str();
 
-                        << "\" --type=\"" << this->sessionData->sessionType
-                        << "\" --cache=\"" << this->sessionData->cache
-                        << "M\" --images=\"" << this->sessionData->images
-                        << "M\" --cookie=\"" << generateCookie()
-                        << "\" --link=\"" << this->sessionData->linkType
-                        << "\" --render=\""
-                            << (this->sessionData->render ? 1 : 0)
+            dbgln ("session parameter command: " + ss.str());
 
-                        << "\" --encryption=\""
-                            << this->sessionData->encryption
+            // Back to listsessions after terminating a session.
+            this->stage -= 2;
 
-                        << "\" --backingstore=\""
-                            << this->sessionData->backingstore
+            // Clear the list of sessions to resume
+            this->resumeColumns = 0;
+            this->runningSessions.clear();
 
-                        << "\" --imagecompressionmethod=\""
-                        << this->sessionData->imageCompressionMethod
-                        << "\" --geometry=\"" << this->sessionData->geometry
-                        << "\" --screeninfo=\"" << this->sessionData->xRes
-                        << "x" << this->sessionData->yRes << "x"
-                        << this->sessionData->depth
-                        << (this->sessionData->render ? "+render" : "")
-                        << fullscreen << "\" --keyboard=\""
-                            << this->sessionData->keyboard
+        } else if (this->sessionData->suspended) {
 
-                        << "\" --kbtype=\"" << this->sessionData->kbtype
-                        << "\" --media=\"" << media
-                        << "\" --agent_server=\""
-                            << this->sessionData->agentServer
+            dbgln ("this->sessionData->suspended is true");
 
-                        << "\" --agent_user=\""
-                            << this->sessionData->agentUser
+            stringstream ss;
 
-                        << "\" --agent_password=\""
-                            << this->sessionData->agentPass
+            // These are the session parameters that NoMachine's client
+            // sends for resume
+            ss << "restoresession --id=\"" << this->sessionData->id <<
+                "\" --session=\"" << this->sessionData->sessionName <<
+                "\" --type=\"" << this->sessionData->sessionType <<
+                "\" --cache=\"" << this->sessionData->cache <<
+                "M\" --images=\"" << this->sessionData->images <<
+                "M\" --cookie=\"" << generateCookie() <<
+                "\" --link=\"" << this->sessionData->linkType <<
+                "\" --kbtype=\"" << this->sessionData->kbtype <<
+                "\" --nodelay=\"1\" --encryption=\""
+                    << this->sessionData->encryption <<
+                "\" --backingstore=\""
+                    << this->sessionData->backingstore <<
+                "\" --geometry=\"" << this->sessionData->geometry <<
+                "\" --media=\"" << media <<
+                "\" --agent_server=\""
+                    << this->sessionData->agentServer <<
+                "\" --agent_user=\"" << this->sessionData->agentUser <<
+                "\" --agent_password=\""
+                    << this->sessionData->agentPass << "\"";
+
+            returnMessage = ss.str();
+
+            dbgln ("session parameter command: " + ss.str());
+
+            this->stage++;
 
-                        << "\"";
+        } else {
 
-                    ss << " --title=\"sebtest\""; // testing a window title
+            dbgln ("this->sessionData->suspended is false, and it's" <<
+                    " not a shadow session.");
 
-                    if (this->sessionData->sessionType == "unix-application") {
-                        ss << " --application=\"" 
-                            << this->sessionData->customCommand << "\"";
+            stringstream ss;
 
-                        if (this->sessionData->virtualDesktop == true) {
-                            ss << " --rootless=\"0\" --virtualdesktop=\"1\"";
-                        } else {
-                            ss << " --rootless=\"1\" --virtualdesktop=\"0\"";
-                        }
+            ss << "startsession --session=\""
+                    << this->sessionData->sessionName
 
-                    } else if
-                        (this->sessionData->sessionType == "unix-console") {
+                << "\" --type=\"" << this->sessionData->sessionType
+                << "\" --cache=\"" << this->sessionData->cache
+                << "M\" --images=\"" << this->sessionData->images
+                << "M\" --cookie=\"" << generateCookie()
+                << "\" --link=\"" << this->sessionData->linkType
+                << "\" --render=\""
+                    << (this->sessionData->render ? 1 : 0)
 
-                        if (this->sessionData->virtualDesktop == true) {
-                            ss << " --rootless=\"0\" --virtualdesktop=\"1\"";
-                        } else {
-                            ss << " --rootless=\"1\" --virtualdesktop=\"0\"";
-                        }
+                << "\" --encryption=\""
+                    << this->sessionData->encryption
 
-                    } else if
-                        (this->sessionData->sessionType == "unix-default") {
-                        // ignore this - does anyone use it?
-                    }
+                << "\" --backingstore=\""
+                    << this->sessionData->backingstore
 
-                    returnMessage = ss.str();
+                << "\" --imagecompressionmethod=\""
+                << this->sessionData->imageCompressionMethod
+                << "\" --geometry=\"" << this->sessionData->geometry
+                << "\" --screeninfo=\"" << this->sessionData->xRes
+                << "x" << this->sessionData->yRes << "x"
+                << this->sessionData->depth
+                << (this->sessionData->render ? "+render" : "")
+                << fullscreen << "\" --keyboard=\""
+                    << this->sessionData->keyboard
 
-                    dbgln ("session parameter command: " + ss.str());
+                << "\" --kbtype=\"" << this->sessionData->kbtype
+                << "\" --media=\"" << media
+                << "\" --agent_server=\""
+                    << this->sessionData->agentServer
 
-                    this->stage++;
+                << "\" --agent_user=\""
+                    << this->sessionData->agentUser
+
+                << "\" --agent_password=\""
+                    << this->sessionData->agentPass
+
+                << "\"";
+
+            ss << " --title=\"sebtest\""; // testing a window title
+
+            if (this->sessionData->sessionType == "unix-application") {
+                ss << " --application=\"" 
+                    << this->sessionData->customCommand << "\"";
+
+                if (this->sessionData->virtualDesktop == true) {
+                    ss << " --rootless=\"0\" --virtualdesktop=\"1\"";
+                } else {
+                    ss << " --rootless=\"1\" --virtualdesktop=\"0\"";
                 }
-            } else {
-                dbgln ("either response is not 105 or sessionDataSet is"
-                        << " false.");
+
+            } else if
+                (this->sessionData->sessionType == "unix-console") {
+
+                if (this->sessionData->virtualDesktop == true) {
+                    ss << " --rootless=\"0\" --virtualdesktop=\"1\"";
+                } else {
+                    ss << " --rootless=\"1\" --virtualdesktop=\"0\"";
+                }
+
+            } else if
+                (this->sessionData->sessionType == "unix-default") {
+                // ignore this - does anyone use it?
             }
-            break;
 
-        case FINISHED:
-            dbgln ("FINISHED stage. Response is " << response
-                    << ". That should mean that session set up is complete.");
-            this->callbacks->readyForProxySignal();
-    }
+            returnMessage = ss.str();
 
-    dbgln ("NXSession::parseSSH, about to return a message: " + returnMessage);
+            dbgln ("session parameter command: " + ss.str());
 
-    if (!returnMessage.empty()) {
-        returnMessage.append("\n");
-        return returnMessage;
-    } else
-        return "";
+            this->stage++;
+        }
+    } else {
+        dbgln ("either response is not 105 or sessionDataSet is"
+                << " false.");
+    }
 }
 
-void NXSession::setSessionData (NXSessionData *sd)
+void NXSession::readyForProxy (const NXLine& message, int response, string& returnMessage)
 {
-    this->sessionData = sd;
+    dbgln ("FINISHED stage. Response is " << response
+            << ". That should mean that session set up is complete.");
+    this->callbacks->readyForProxySignal();
 }
 
-int NXSession::parseResponse(string message)
+void NXSession::controlLine (const NXLine& message, int response, string& returnMessage)
 {
-    string::size_type idx1, idx2;
+    dbgln ("CONTROL stage");
 
-    int response;
+    if (this->sentRequests.empty()) {
+        // Nothing outstanding. If the server is prompting,
+        // it's ready for whatever has been queued.
+        if (response == 105) {
+            returnMessage = this->nextCommands();
+        }
+        return;
+    }
 
-    dbgln ("NXSession::parseResponse called for message:" << message);
+    if (response == 105) {
+        // The end of the oldest answer.
+        this->requestAnswered();
+        returnMessage = this->nextCommands();
+        return;
+    }
 
-    if ((idx1 = message.find ("notQProcess error", 0)) != string::npos) {
+    Request& r = this->sentRequests.front();
+    switch (r.type) {
+        case LIST_REQUEST:
+            if (!r.done) {
+                // The first line of this list
+                this->runningSessions.clear();
+                this->resumeColumns = 0;
+                r.done = true;
+            }
+            // The table, but not the "NX> " lines around it
+            if (response == 0) {
+                parseResumeLine (message.data, message.size);
+            }
+            break;
 
-        dbgln ("Found notQProcess error");
+        case TERMINATE_REQUEST:
+            if (response == 900) {
+                r.done = true;
+            }
+            break;
 
-        // This means a process crashed, we're going to return a number >100000
-        // to indicate this.
-        if ( ((idx2 = message.find ("crashed", 0)) != string::npos) && 
-                idx2 > idx1) {
+        default:
+            break;
+    }
+}
+//@}
 
-            stringstream ss;
-            ss << message.substr((idx1+19), idx2-1-(idx1+19));
+string NXSession::listCommand (void)
+{
+    // Get a list of the available sessions on the server, for given
+    // user, with given status, and any type. Not sure if geometry
+    // is ignored or not.
+    stringstream ss;
 
-            // This is the pid that crashed
-            ss >> response;
+    if (this->sessionData->sessionType == "shadow") {
+        // This is how to list shadow sessions. Run NoMachine's
+        // client and see ~/.nx/temp/(pid)/sshlog for connection
+        // details
+        ss << "listsession --type=\"shadow\"";
 
-            // Add 100000 and return this
-            response += 100000;
+    } else {
 
-            return response;
-        } else {
-            dbgln ("Uh oh, didn't find \"crashed\"");
-        }
+        ss << "listsession --user=\"" << nxUsername
+            << "\" --status=\"suspended,running\" --geometry=\""
+            << this->sessionData->xRes << "x"
+            << this->sessionData->yRes << "x"
+            << this->sessionData->depth
+            << (this->sessionData->render ? "+render" : "")
+
+            // If you leave --type blank, you can re-connect to any
+            // sessions available.
+            << "\" --type=\"" << this->sessionData->sessionType
+            << "\"";
     }
 
-    // Find out the server response number
-    // This will only be present in strings which contain "NX>"
-    if (message.find("NX>") != string::npos && message.find("NX>") == 0) {
-        idx1 = message.find("NX>") + 4;
+    return ss.str();
+}
 
-        if ((idx2 = message.find(" ", idx1)) == string::npos) {
-            if ((idx2 = message.find("\n", idx1)) == string::npos) {
-                idx2 = message.size();
-            }
+/*!
+ * Control mode
+ */
+//@{
+bool NXSession::getControlReady (void)
+{
+    if (this->stage != CONTROL) {
+        return false;
+    }
+    list<Request>::iterator i;
+    for (i = this->sentRequests.begin(); i != this->sentRequests.end(); i++) {
+        if (i->type == QUIT_REQUEST) {
+            return false;
         }
-
-        if (idx2>idx1) {
-            stringstream ss;
-            ss << message.substr(idx1, idx2-idx1);
-            ss >> response;
-        } else {
-            response = 0;
+    }
+    for (i = this->queuedRequests.begin(); i != this->queuedRequests.end(); i++) {
+        if (i->type == QUIT_REQUEST || i->type == START_REQUEST) {
+            return false;
         }
-
-    } else {
-        response = 0;
     }
+    return true;
+}
 
-    dbgln ("NXSession::parseResponse() returning " << response);
-    return response;
+bool NXSession::requestList (void)
+{
+    return this->queueRequest (LIST_REQUEST);
 }
 
-void NXSession::parseResumeSessions(list<string> rawdata)
+bool NXSession::requestTerminate (const string& id)
 {
-    // Was: QStringList sessions, and got rawdata appended to it?
-    list<string> sessions;
-    list<string>::iterator iter, at;
+    return this->queueRequest (TERMINATE_REQUEST, id);
+}
 
-    dbgln ("NXSession::parseResumeSessions called.");
+bool NXSession::requestQuit (void)
+{
+    return this->queueRequest (QUIT_REQUEST);
+}
 
-    for (iter = rawdata.begin(); iter != rawdata.end(); iter++) {
-        if (((*iter).find("-------") != string::npos) && !(*iter).empty()) {
-            at = iter;
+bool NXSession::queueRequest (RequestType type, const string& id)
+{
+    // Requests may be queued before we've logged in, but not
+    // after a session has been started or we've said we'll quit.
+    if (!this->controlMode
+        || (this->stage > LIST_SESSIONS && !this->getControlReady())) {
+        return false;
+    }
+    list<Request>::iterator i;
+    for (i = this->queuedRequests.begin(); i != this->queuedRequests.end(); i++) {
+        if (i->type == QUIT_REQUEST || i->type == START_REQUEST) {
+            return false;
         }
     }
 
-    for (iter = ++at; iter != rawdata.end(); iter++) {
-        if ((!(*iter).find("NX> 148") != string::npos) && !(*iter).empty()) {
-            sessions.push_back(*iter);
-        }
+    Request r;
+    r.type = type;
+    r.id = id;
+    r.done = false;
+    this->queuedRequests.push_back (r);
+    return true;
+}
+
+string NXSession::takeRequests (void)
+{
+    int startStage = this->stage;
+    string commands = this->nextCommands();
+    if (this->stage != startStage) {
+        this->callbacks->stageSignal (NXSession::stageName (this->stage));
     }
+    if (!commands.empty()) {
+        commands.append ("\n");
+    }
+    return commands;
+}
 
-    list < vector<string> > rawsessions;
-    list < vector<string> >::iterator rsIter;
+string NXSession::nextCommands (void)
+{
+    string commands;
 
-    // Clean up each string in sessions[i], then push back
-    // sessions[i] onto rawsessions., except that means
-    // rawsessions is then just a list<string>...
-    vector<string> session;
-    vector<string>::iterator seshIter;
+    if (this->stage != CONTROL) {
+        return commands;
+    }
 
-    for (iter = sessions.begin(); iter != sessions.end(); iter++) {
-        session.clear();
+    while (!this->queuedRequests.empty()) {
+        Request r = this->queuedRequests.front();
 
-        // Simplify one line of list<string> sessions
-        (*iter) = notQtUtilities::simplify (*iter); 
+        // Without pipelining, one request at a time. A session
+        // is only started once everything before it is answered,
+        // as the rest of the conversation is about the session.
+        if (!this->sentRequests.empty()
+            && (!this->pipelining || r.type == START_REQUEST)) {
+            break;
+        }
+        this->queuedRequests.pop_front();
+
+        string command;
+        switch (r.type) {
+            case LIST_REQUEST:
+                command = this->listCommand();
+                break;
+            case TERMINATE_REQUEST:
+                command = "Terminate --sessionid=\"" + r.id + "\"";
+                break;
+            case QUIT_REQUEST:
+                command = "quit";
+                break;
+            case START_REQUEST:
+                {
+                    // From here on it's the usual conversation.
+                    NXLine prompt;
+                    prompt.data = "NX> 105 ";
+                    prompt.size = 8;
+                    prompt.code = 105;
+                    prompt.prompt = true;
+                    this->stage = STARTSESSION;
+                    this->startSession (prompt, 105, command);
+                }
+                break;
+        }
 
-        // Split one line of list<string> sessions into a vector<string>
-        notQtUtilities::splitString (*iter, ' ', session); 
+        if (!commands.empty()) {
+            commands.append ("\n");
+        }
+        commands.append (command);
 
-        // Add that to rawsessions
-        rawsessions.push_back(session);
+        if (r.type == START_REQUEST) {
+            break;
+        }
+        this->sentRequests.push_back (r);
     }
 
-    NXResumeData resData;
+    return commands;
+}
+
+void NXSession::requestAnswered (void)
+{
+    Request r = this->sentRequests.front();
+    this->sentRequests.pop_front();
+
+    switch (r.type) {
+        case LIST_REQUEST:
+            if (!r.done) {
+                // Not even a blank line
+                this->runningSessions.clear();
+            }
+            this->resumeColumns = 0;
+            this->reportSessions();
+            this->callbacks->controlListSignal (this->runningSessions);
+            break;
+
+        case TERMINATE_REQUEST:
+            this->callbacks->controlTerminatedSignal (r.id, r.done);
+            break;
+
+        default:
+            break;
+    }
+}
+//@}
+
+void NXSession::setSessionData (NXSessionData *sd)
+{
+    this->sessionData = sd;
+}
+
+int NXSession::parseResponse(string message)
+{
+    int response;
+
+    dbgln ("NXSession::parseResponse called for message:" << message);
+
+    // Find out the server response number
+    // This will only be present in strings which start "NX> "
+    response = NXLineFramer::parseCode (message.data(), message.size());
 
-    for (rsIter = rawsessions.begin(); rsIter != rawsessions.end(); rsIter++) {
-        stringstream ss1, ss2;
-        int tmp;
+    dbgln ("NXSession::parseResponse() returning " << response);
+    return response;
+}
 
-        dbgln ("*rsIter.size() == " << (*rsIter).size());
-        ss1 << (*rsIter)[0];
-        ss1 >> tmp;
+void NXSession::parseResumeSessions(const list<string>& rawdata)
+{
+    list<string>::const_iterator iter;
 
-        resData.display = tmp;
+    dbgln ("NXSession::parseResumeSessions called.");
 
-        dbgln ("resData.display = " << resData.display);
-        resData.sessionType = (*rsIter)[1];
+    this->resumeColumns = 0;
+    for (iter = rawdata.begin(); iter != rawdata.end(); iter++) {
+        parseResumeLine ((*iter).data(), (*iter).size());
+    }
 
-        dbgln ("resData.sessionType = " << resData.sessionType);
-        resData.sessionID = (*rsIter)[2];
+    resumeSessionsParsed();
+    dbgln ("NXSession::parseResumeSessions() returning.");
+}
 
-        dbgln ("resData.sessionID = " << resData.sessionID);
-        resData.options = (*rsIter)[3];
+static inline bool isBlank (char c)
+{
+    return (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+}
 
-        dbgln ("resData.options = " << resData.options);
-        ss2 << (*rsIter)[4];
-        ss2 >> tmp;
+void NXSession::parseResumeLine (const char * data, size_t n)
+{
+    const char * end = data + n;
+    const char * p = data;
 
-        resData.depth = tmp;
+    while (p < end && isBlank (*p)) { p++; }
+    while (end > p && isBlank (*(end-1))) { end--; }
 
-        dbgln ("resData.depth = " << resData.depth);
-        resData.screen = (*rsIter)[5];
+    if (p == end) {
+        return;
+    }
 
-        dbgln ("resData.screen = " << resData.screen);
-        resData.available = (*rsIter)[6];
+    // The ruler under the column headings, such as
+    // "------- ---------------- ---------- ..." tells us how many
+    // columns there are, and that the sessions follow.
+    if (*p == '-' && end - p >= 7 && memcmp (p, "-------", 7) == 0) {
+        this->resumeColumns = 0;
+        bool inColumn = false;
+        for (; p < end; p++) {
+            if (*p == '-' && !inColumn) {
+                this->resumeColumns++;
+            }
+            inColumn = (*p == '-');
+        }
+        dbgln ("Session list has " << this->resumeColumns << " columns");
+        return;
+    }
 
-        dbgln ("resData.available = " << resData.available);
-        resData.sessionName = (*rsIter)[7];
+    if (this->resumeColumns < 8) {
+        // Not into the list yet.
+        return;
+    }
 
-        dbgln ("resData.sessionName = " << resData.sessionName);
-        this->runningSessions.push_back(resData);
+    // The servers pad the columns with printf, but the widths
+    // don't always match their own ruler (FreeNX's "Available"
+    // column is wider than its dashes), so split on whitespace;
+    // only the last column, the session name, may contain
+    // spaces, and it runs to the end of the line.
+    const char * field[8];
+    size_t len[8];
+    int f;
+    for (f = 0; f < 7 && p < end; f++) {
+        field[f] = p;
+        while (p < end && !isBlank (*p)) { p++; }
+        len[f] = p - field[f];
+        while (p < end && isBlank (*p)) { p++; }
     }
+    if (f < 7) {
+        dbgln ("Too few columns in session list line; ignoring it");
+        return;
+    }
+    field[7] = p;
+    len[7] = end - p;
+
+    // Fill in the new entry where it lies, rather than copying it
+    // into the list.
+    this->runningSessions.push_back (NXResumeData());
+    NXResumeData& resData = this->runningSessions.back();
+
+    // (atoi stops at the blank after the number)
+    resData.display = atoi (field[0]);
+    resData.sessionType.assign (field[1], len[1]);
+    resData.sessionID.assign (field[2], len[2]);
+    resData.options.assign (field[3], len[3]);
+    resData.depth = atoi (field[4]);
+    resData.screen.assign (field[5], len[5]);
+    resData.available.assign (field[6], len[6]);
+    resData.sessionName.assign (field[7], len[7]);
+
+    dbgln ("resData: display " << resData.display
+            << " type " << resData.sessionType
+            << " id " << resData.sessionID
+            << " options " << resData.options
+            << " depth " << resData.depth
+            << " screen " << resData.screen
+            << " available " << resData.available
+            << " name " << resData.sessionName);
+}
 
+void NXSession::resumeSessionsParsed (void)
+{
     if (this->runningSessions.size() != 0) {
         this->suspendedSessions = true;
+        this->choiceMade = false;
 
-        dbgln ("NXSession::parseResumeSessions(): Calling sessionsSignal.");
+        dbgln ("NXSession::resumeSessionsParsed(): Calling sessionsSignal.");
 
         // runningSessions is a list of NXResumeData
+        this->reportSessions();
         this->callbacks->sessionsSignal (this->runningSessions);
     } else {
-        dbgln ("NXSession::parseResumeSessions(): Calling"
+        dbgln ("NXSession::resumeSessionsParsed(): Calling"
                 << " this->callbacks->noSessionsSignal()");
 
         // In case we previously had one resumable session,
@@ -629,12 +1146,15 @@ void NXSession::parseResumeSessions(list<string> rawdata)
         // startsession is called, not restoresession. hence
         // set sessionData->suspended to false.
         this->sessionData->suspended = false;
+        this->choiceMade = true;
+        this->reportSessions();
         this->callbacks->noSessionsSignal();
     }
 
+    this->resumeColumns = 0;
+
     dbgln ("Increment stage");
     this->stage++;
-    dbgln ("NXSession::parseResumeSessions() returning.");
 }
 
 void NXSession::wipeSessions()
@@ -644,6 +1164,71 @@ void NXSession::wipeSessions()
     }
 }
 
+static bool sameSession (const NXResumeData& a, const NXResumeData& b)
+{
+    return (a.display == b.display
+            && a.sessionType == b.sessionType
+            && a.options == b.options
+            && a.depth == b.depth
+            && a.screen == b.screen
+            && a.available == b.available
+            && a.sessionName == b.sessionName);
+}
+
+bool NXSession::diffSessions (const list<NXResumeData>& before,
+                              const list<NXResumeData>& after,
+                              NXResumeDelta& delta)
+{
+    map<string, const NXResumeData*> old;
+    list<NXResumeData>::const_iterator it;
+
+    for (it = before.begin(); it != before.end(); it++) {
+        old[(*it).sessionID] = &(*it);
+    }
+
+    // What's left in old once the new list has been through it
+    // has gone.
+    for (it = after.begin(); it != after.end(); it++) {
+        map<string, const NXResumeData*>::iterator o = old.find ((*it).sessionID);
+        if (o == old.end()) {
+            delta.added.push_back (*it);
+        } else {
+            if (!sameSession (*o->second, *it)) {
+                delta.changed.push_back (*it);
+            }
+            old.erase (o);
+        }
+    }
+    for (it = before.begin(); it != before.end(); it++) {
+        if (old.find ((*it).sessionID) != old.end()) {
+            delta.removed.push_back ((*it).sessionID);
+        }
+    }
+
+    return !(delta.added.empty() && delta.changed.empty() && delta.removed.empty());
+}
+
+void NXSession::reportSessions (void)
+{
+    NXResumeDelta delta;
+
+    if (diffSessions (this->reportedSessions, this->runningSessions, delta)) {
+        dbgln ("NXSession::reportSessions(): " << delta.added.size() << " added, "
+                << delta.changed.size() << " changed, "
+                << delta.removed.size() << " removed");
+        this->reportedSessions = this->runningSessions;
+        this->callbacks->sessionsChangedSignal (delta);
+    }
+}
+
+const char * NXSession::stageName (int s)
+{
+    if (s < 0 || s >= static_cast<int>(sizeof (stageNames) / sizeof (stageNames[0]))) {
+        return "unknown";
+    }
+    return stageNames[s];
+}
+
 string NXSession::generateCookie()
 {
     unsigned long long int int1, int2;
@@ -653,6 +1238,8 @@ string NXSession::generateCookie()
 
     fillRand((unsigned char*)&int1, sizeof(int1));
     fillRand((unsigned char*)&int2, sizeof(int2));
+    close (devurand_fd);
+    devurand_fd = -1;
     cookie << int1 << int2;
     return cookie.str();
 }
@@ -704,8 +1291,15 @@ bool NXSession::chooseResumable (int n)
     // With depth in there too?
     this->sessionData->geometry = geom.str();
     this->sessionData->suspended=true;
+    // In case an earlier choice was to terminate a session.
+    this->sessionData->terminate = false;
 
     this->sessionDataSet = true;
+    this->choiceMade = true;
+
+    if (this->controlMode) {
+        return this->queueRequest (START_REQUEST);
+    }
 
     dbgln ("NXSession::chooseResumable returning true.");
     return true;
@@ -721,12 +1315,16 @@ bool NXSession::terminateSession (int n)
         return false;
     }
 
-    // Set to false while we change the contents of sessionData
-    this->sessionDataSet = false;
-
     list<NXResumeData>::iterator it = this->runningSessions.begin();
     for (int i = 0; i<n; i++) { it++; }
 
+    if (this->controlMode) {
+        return this->requestTerminate ((*it).sessionID);
+    }
+
+    // Set to false while we change the contents of sessionData
+    this->sessionDataSet = false;
+
     this->sessionData->terminate = true;
     this->sessionData->display = (*it).display;
     this->sessionData->sessionName = (*it).sessionName;
@@ -734,7 +1332,33 @@ bool NXSession::terminateSession (int n)
     this->sessionData->suspended=true;
 
     this->sessionDataSet = true;
+    this->choiceMade = true;
 
     return true;
 }
 
+bool NXSession::chooseNewSession (void)
+{
+    dbgln ("NXSession::chooseNewSession called.");
+    this->sessionData->suspended = false;
+    this->sessionData->terminate = false;
+    this->sessionDataSet = true;
+    this->choiceMade = true;
+    if (this->controlMode) {
+        return this->queueRequest (START_REQUEST);
+    }
+    return true;
+}
+
+string NXSession::releaseChoice (void)
+{
+    if (this->controlMode) {
+        return this->takeRequests();
+    }
+    if (!this->choiceHeld || !this->choiceMade) {
+        return "";
+    }
+    this->choiceHeld = false;
+    return this->parseSSH ("NX> 105 ");
+}
+
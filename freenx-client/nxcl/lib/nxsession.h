@@ -28,6 +28,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include "nxdata.h"
+#include "nxlineframer.h"
 #include <list>
 
 namespace nxcl {
@@ -50,6 +51,45 @@ namespace nxcl {
              */
             virtual void authenticatedSignal (void) {}
             virtual void sessionsSignal (list<NXResumeData>) {}
+            /*!
+             * Emitted, before sessionsSignal(), noSessionsSignal()
+             * or controlListSignal(), when a list of sessions
+             * differs from the last one this NXSession received.
+             * The first list is all additions.
+             */
+            virtual void sessionsChangedSignal (const NXResumeDelta&) {}
+            /*!
+             * Emitted when the handshake moves on to \arg stage
+             * (see NXSession::stageName()).
+             */
+            virtual void stageSignal (const string& stage) {}
+            /*!
+             * In control mode (see NXSession::setControlMode()),
+             * emitted once we have logged in and requests can be
+             * sent.
+             */
+            virtual void controlReadySignal (void) {}
+            /*!
+             * The answer to NXSession::requestList().
+             */
+            virtual void controlListSignal (list<NXResumeData>) {}
+            /*!
+             * The answer to NXSession::requestTerminate(); \arg
+             * terminated is false if the server didn't say it had
+             * terminated session \arg id.
+             */
+            virtual void controlTerminatedSignal (const string& id, bool terminated) {}
+            /*!
+             * Emitted once logged in, with what was learnt of
+             * the server (see setServerInfo()).
+             */
+            virtual void serverInfoSignal (const NXServerInfo& info) {}
+            /*!
+             * Emitted just before the command to start, resume or
+             * attach to a session is made from \arg data, so that
+             * its settings can still be changed.
+             */
+            virtual void startingSessionSignal (NXSessionData * data) {}
     };
 
     /*!
@@ -63,13 +103,154 @@ namespace nxcl {
             ~NXSession();
 
             string parseSSH (string);
+            /*!
+             * Act on one line from the server, as handed out by
+             * an NXLineFramer, without copying it.
+             *
+             * \return the reply to send, if any, with its newline.
+             */
+            string parseSSH (const NXLine& line);
             int parseResponse (string);
-            void parseResumeSessions (list<string>);
+            void parseResumeSessions (const list<string>&);
             void resetSession (void);
             void wipeSessions (void);
             bool chooseResumable (int n);
             bool terminateSession (int n);
+            /*!
+             * Start a new session rather than resume one of
+             * those listed.
+             */
+            bool chooseNewSession (void);
+            /*!
+             * If the server's prompt after the list of sessions
+             * was held back (see setDeferChoice()) and a choice
+             * has now been made, answer it.
+             *
+             * \return the reply for nxssh, or "" if there is
+             * nothing to send.
+             */
+            string releaseChoice (void);
+
+            /*!
+             * Control mode
+             *
+             * Normally, once logged in, we list the sessions and
+             * start or resume one. In control mode, the
+             * connection waits after logging in for requests
+             * instead, so that any number of lists and
+             * terminations can be made over one login. The
+             * requests are queued until the server is ready, and
+             * then (unless setPipelining(false) was called)
+             * written without waiting for the answers to those
+             * before them; each answer ends with the server's
+             * next "NX> 105" prompt.
+             *
+             * chooseResumable() or chooseNewSession() end control
+             * mode: the session is started once the requests
+             * before it have been answered, and then the
+             * connection carries on as usual. requestQuit() ends
+             * the connection instead.
+             */
+            //@{
+            void setControlMode (bool c) { controlMode = c; }
+            bool getControlMode (void) { return controlMode; }
+            void setPipelining (bool p) { pipelining = p; }
+            /*!
+             * True once logged in, in control mode, until a
+             * session is started or we quit.
+             */
+            bool getControlReady (void);
+            /*!
+             * The number of requests queued or not yet
+             * answered.
+             */
+            unsigned int getRequestsPending (void)
+            {
+                return queuedRequests.size() + sentRequests.size();
+            }
+            /*!
+             * Queue a request.
+             *
+             * \return false if the connection is no longer in
+             * control mode.
+             */
+            //@{
+            bool requestList (void);
+            bool requestTerminate (const string& id);
+            bool requestQuit (void);
+            //@}
+            /*!
+             * The commands for the requests which can be sent
+             * now, for nxssh.
+             *
+             * \return the commands, or "" if there is nothing to
+             * send yet.
+             */
+            string takeRequests (void);
+            //@}
             string generateCookie (void);
+            /*!
+             * Login pipelining
+             *
+             * Normally each SET command, and then "login", waits
+             * for the server's "NX> 105" prompt after the one
+             * before. If setServerInfo() has been given what an
+             * earlier login learnt of this server (see
+             * NXServerCache), and the server greets us with the
+             * same version, they are all sent in one write
+             * instead, saving a round trip for each SET.
+             *
+             * The server echoes each command it reads. If a
+             * prompt comes before the echo of a command we sent,
+             * or nothing comes for PIPELINE_STALL_MS after the
+             * prompt for a SET, the server has dropped the rest,
+             * and they are sent one per prompt as usual.
+             */
+            //@{
+            void setServerInfo (const NXServerInfo& info)
+            {
+                this->cachedInfo = info;
+                this->haveCachedInfo = true;
+            }
+            void clearServerInfo (void) { this->haveCachedInfo = false; }
+            /*!
+             * What this login has learnt of the server, passed to
+             * serverInfoSignal() once logged in.
+             */
+            const NXServerInfo& getServerInfo (void) const { return this->serverInfo; }
+            /*!
+             * True if the SET commands and login were sent
+             * together and the server took them all.
+             */
+            bool getLoginPipelined (void) const { return this->loginPipelined; }
+            /*!
+             * Milliseconds until pipelineStalled() should be
+             * called, or -1 if there's nothing to wait for.
+             */
+            int getPipelineWait (void);
+            /*!
+             * If the server has sat at a prompt for
+             * PIPELINE_STALL_MS without reading the next command
+             * we sent, give up pipelining.
+             *
+             * \return the command to send now, or "".
+             */
+            string pipelineStalled (void);
+            //@}
+            /*!
+             * Fill in \arg delta with the difference between
+             * the lists of sessions \arg before and \arg after.
+             *
+             * \return false if they hold the same sessions.
+             */
+            static bool diffSessions (const list<NXResumeData>& before,
+                                      const list<NXResumeData>& after,
+                                      NXResumeDelta& delta);
+            /*!
+             * The name of the handshake stage \arg s, such as
+             * "login" or "list sessions".
+             */
+            static const char * stageName (int s);
             void runSession (void) { sessionDataSet = true; }
 
             /*!
@@ -108,6 +289,29 @@ namespace nxcl {
                 doSSH = allow;
             }
 
+            /*!
+             * If \arg defer is true, don't start a session at
+             * the server's prompt after the list of sessions
+             * until chooseResumable(), terminateSession() or
+             * chooseNewSession() has been called, so the choice
+             * can be made after sessionsSignal() returns.
+             * Otherwise, if sessionsSignal() makes no choice, a
+             * new session is started.
+             */
+            void setDeferChoice (bool defer)
+            {
+                deferChoice = defer;
+            }
+
+            /*!
+             * True while a list of sessions has been sent to
+             * sessionsSignal() and no choice has been made.
+             */
+            bool getAwaitingChoice (void)
+            {
+                return !choiceMade;
+            }
+
             void setSessionData (NXSessionData*);
 
             NXSessionData* getSessionData()
@@ -129,6 +333,109 @@ namespace nxcl {
         private:
             void reset (void);
             void fillRand(unsigned char *, size_t);
+            /*!
+             * Call sessionsChangedSignal() if runningSessions
+             * differs from reportedSessions, and remember it.
+             */
+            void reportSessions (void);
+
+            /*!
+             * One row of the handshake table used by parseSSH():
+             * in \arg stage, on a line with \arg response (and
+             * containing one of \arg patterns, if that's not 0),
+             * call \arg action, then move on \arg next stages.
+             */
+            struct Transition {
+                int stage;
+                int response;
+                unsigned int patterns;
+                void (NXSession::*action) (const NXLine& message,
+                                           int response,
+                                           string& returnMessage);
+                int next;
+            };
+            static const Transition transitions[];
+
+            /*!
+             * Actions for transitions[]. Each may set
+             * returnMessage, the reply to the server.
+             */
+            //@{
+#ifdef NXCL_USE_NXSSH
+            void answerContinue (const NXLine&, int, string&);
+#endif
+            void authFailed (const NXLine&, int, string&);
+            void capacityReached (const NXLine&, int, string&);
+            void answerYes (const NXLine&, int, string&);
+            void sendPassword (const NXLine&, int, string&);
+            void sendHello (const NXLine&, int, string&);
+            void sendShellMode (const NXLine&, int, string&);
+            void sendAuthMode (const NXLine&, int, string&);
+            void sendLogin (const NXLine&, int, string&);
+            void checkEcho (const NXLine&, int, string&);
+            /*!
+             * The server dropped the commands we sent together
+             * from unechoed.front() on; go back to sending one
+             * per prompt, and return the next.
+             */
+            string unpipeline (void);
+            void loggedIn (const NXLine&, int, string&);
+            void sendUsername (const NXLine&, int, string&);
+            void loginFailed (const NXLine&, int, string&);
+            void listSessions (const NXLine&, int, string&);
+            void collectSessions (const NXLine&, int, string&);
+            void startSession (const NXLine&, int, string&);
+            void readyForProxy (const NXLine&, int, string&);
+            void controlLine (const NXLine&, int, string&);
+            //@}
+
+            /*!
+             * The listsession command for sessionData.
+             */
+            string listCommand (void);
+
+            /*!
+             * Requests in control mode
+             */
+            //@{
+            enum RequestType { LIST_REQUEST, TERMINATE_REQUEST,
+                START_REQUEST, QUIT_REQUEST };
+            struct Request {
+                RequestType type;
+                /*!
+                 * The session to terminate
+                 */
+                string id;
+                /*!
+                 * Set if the server said it was done.
+                 */
+                bool done;
+            };
+            /*!
+             * Queue a request of \arg type, for \arg id.
+             */
+            bool queueRequest (RequestType type, const string& id = "");
+            /*!
+             * The commands for the queued requests which can be
+             * sent now, one per line.
+             */
+            string nextCommands (void);
+            /*!
+             * The server has answered the oldest request sent.
+             */
+            void requestAnswered (void);
+            //@}
+
+            /*!
+             * Take one line of the server's list of sessions (the
+             * table which follows "NX> 127 Sessions list"),
+             * adding a session found there to runningSessions.
+             */
+            void parseResumeLine (const char * data, size_t n);
+            /*!
+             * Called at the end of the list of sessions.
+             */
+            void resumeSessionsParsed (void);
 
             /*!
              * This is the answer to give to the ssh server if it
@@ -146,6 +453,34 @@ namespace nxcl {
              * Set to true of sessionData has been populated
              */
             bool sessionDataSet;
+            /*!
+             * See setDeferChoice()
+             */
+            bool deferChoice;
+            /*!
+             * False from the end of a list of sessions until one
+             * is chosen.
+             */
+            bool choiceMade;
+            /*!
+             * Set when the server's prompt to start a session has
+             * been held back waiting for the choice.
+             */
+            bool choiceHeld;
+            /*!
+             * See setControlMode()
+             */
+            bool controlMode;
+            /*!
+             * See setPipelining()
+             */
+            bool pipelining;
+            /*!
+             * Requests waiting to be sent, and those sent but not
+             * yet answered, oldest first.
+             */
+            list<Request> queuedRequests;
+            list<Request> sentRequests;
             /*!
              * Holds the stage of the process which we have
              * reached as we go through the process of
@@ -165,14 +500,62 @@ namespace nxcl {
              */
             string nxPassword;
             /*!
-             * A list of sessions which can be resumed, as strings.
+             * The number of columns in the list of sessions being
+             * received, from its ruler, or 0 before the ruler.
              */
-            list<string> resumeSessions;
+            int resumeColumns;
             /*!
              * A list of running sessions, held as NXResumeData
              * structures.
              */
             list<NXResumeData> runningSessions;
+            /*!
+             * The last list of sessions passed on to the
+             * callbacks, to compare the next one with. Unlike
+             * runningSessions, it outlives wipeSessions() and
+             * resetSession().
+             */
+            list<NXResumeData> reportedSessions;
+            /*!
+             * Login pipelining (see setServerInfo())
+             */
+            //@{
+            NXServerInfo cachedInfo;
+            bool haveCachedInfo;
+            /*!
+             * What we have learnt this time
+             */
+            NXServerInfo serverInfo;
+            /*!
+             * True while the SET commands and login sent
+             * together are being answered, and after, if the
+             * server took them all.
+             */
+            bool loginPipelined;
+            /*!
+             * True if the server dropped some of them.
+             */
+            bool pipelineFailed;
+            /*!
+             * The commands sent together which the server has
+             * not yet echoed, and the SET commands it has echoed
+             * but not yet prompted after.
+             */
+            list<string> unechoed;
+            list<string> echoedSets;
+            /*!
+             * Without pipelining, the last command sent, until
+             * it is echoed, and how many have been echoed. Only
+             * a server which echoes them all can be pipelined.
+             */
+            string lastCommand;
+            int echoes;
+            /*!
+             * When to give up waiting for the next echo
+             * (NXTrace::now()), or 0.
+             */
+            long long stallAt;
+            //@}
             /*!
              * Data for this session.
              */
@@ -0,0 +1,156 @@
+/***************************************************************************
+                                nxstatus.h
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*!
+ * \file nxstatus.h The status channel: the records nxcl sends, to
+ * anyone who connects to its status socket, about the progress of
+ * its sessions, and a C helper for reading them. It is plain C, so
+ * that front-ends written in C (nxlaunch) can use it too.
+ *
+ * The socket is a Unix stream socket, made by NXStatusServer (see
+ * nxstatusserver.h). nxcl makes it at nxstatus_default_path() for its
+ * pid, or at $NXCL_STATUS if that is set. Nothing is read from
+ * subscribers; D-Bus remains the way to control nxcl.
+ *
+ * Each record is a 16 byte header followed by its fields, all numbers
+ * in network byte order:
+ *
+ *   uint16  length of the whole record, header included
+ *   uint8   type, NXSTATUS_HELLO and so on
+ *   uint8   0
+ *   uint32  session number (the N of org.freenx.nxcl.nxclN)
+ *   int64   microseconds on the monotonic clock
+ *
+ * A field is a one byte tag, then for NXSTATUS_INT an int64, and for
+ * NXSTATUS_STRING a uint16 length, the bytes and a 0 byte which the
+ * length doesn't count. The fields of each type of record are listed
+ * below; readers should skip fields and records they don't know,
+ * since more may be added.
+ *
+ * A subscriber first gets a NXSTATUS_HELLO, then the last stage, link
+ * measurement and message of each session under way, then records as
+ * they happen. One which falls more than NXSTATUS_MAX_QUEUED bytes
+ * behind is disconnected, rather than holding nxcl up.
+ */
+
+#ifndef _NXSTATUS_H_
+#define _NXSTATUS_H_
+
+#include <stddef.h>
+
+#define NXSTATUS_VERSION        1
+#define NXSTATUS_HEADER_SIZE    16
+#define NXSTATUS_MAX_RECORD     65535
+#define NXSTATUS_MAX_QUEUED     (256 * 1024)
+
+/*
+ * Record types, and their fields
+ */
+#define NXSTATUS_HELLO          1	/* version, nxcl's pid */
+#define NXSTATUS_INFO           2	/* NXCL_ or NX message number (0 if none), text */
+#define NXSTATUS_ERROR          3	/* text */
+#define NXSTATUS_STAGE          4	/* stage, detail (see NXTrace) */
+#define NXSTATUS_LINK           5	/* shortest and median round trip in
+					   microseconds, bytes per second, all
+					   -1 if not measured; link type
+					   (see NXLinkStats) */
+#define NXSTATUS_SESSION        6	/* a resumable session: display, ID,
+					   type, name, status */
+#define NXSTATUS_SESSIONS_END   7	/* the end of a list of sessions */
+#define NXSTATUS_FINISHED       8	/* the session is over */
+
+/*
+ * Field tags
+ */
+#define NXSTATUS_INT            'i'
+#define NXSTATUS_STRING         's'
+
+#define NXSTATUS_MAX_FIELDS     16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct nxstatus_field {
+	int tag;
+	long long i;
+	/* For strings: 0 terminated, and valid until the next
+	 * nxstatus_read() */
+	const char * s;
+	size_t len;
+};
+
+struct nxstatus_record {
+	int type;
+	unsigned long session;
+	long long usec;
+	int nfields;
+	struct nxstatus_field fields[NXSTATUS_MAX_FIELDS];
+};
+
+struct nxstatus_client;
+
+/*!
+ * Write the default path of the status socket of the nxcl with
+ * process ID \arg pid to \arg buf: $XDG_RUNTIME_DIR/nxcl-PID.status
+ * if XDG_RUNTIME_DIR is set, otherwise /tmp/nxcl-UID/status-PID.
+ *
+ * \return 0, or -1 if it didn't fit in \arg size bytes.
+ */
+int nxstatus_default_path (long pid, char * buf, size_t size);
+
+/*!
+ * Connect to the status socket at \arg path.
+ *
+ * \return the client, or NULL with errno set.
+ */
+struct nxstatus_client * nxstatus_open (const char * path);
+void nxstatus_close (struct nxstatus_client * c);
+
+/*!
+ * The socket, to wait on with poll() or a main loop. It is
+ * non-blocking.
+ */
+int nxstatus_fd (struct nxstatus_client * c);
+
+/*!
+ * Read what has arrived.
+ *
+ * \return the number of bytes read, 0 if nxcl has gone (or dropped
+ * us), or -1 on error (errno is EAGAIN if there was nothing to read).
+ */
+long nxstatus_read (struct nxstatus_client * c);
+
+/*!
+ * Take the next whole record read into \arg rec.
+ *
+ * \return 1 if there was one, 0 if more must be read first, or -1 if
+ * the data is corrupt.
+ */
+int nxstatus_next (struct nxstatus_client * c, struct nxstatus_record * rec);
+
+/*!
+ * Decode the record in the \arg n bytes at \arg data into \arg rec.
+ * The strings point into \arg data.
+ *
+ * \return 0, or -1 if it isn't a whole, well formed record.
+ */
+int nxstatus_decode (const char * data, size_t n, struct nxstatus_record * rec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,220 @@
+/***************************************************************************
+                              nxstatusclient.c
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * The reading side of the status channel (see nxstatus.h). Plain C,
+ * with nothing but libc, so that it can be built into front-ends which
+ * don't link to libnxcl.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "nxstatus.h"
+
+/* Room for two of the longest records */
+#define BUFFER_SIZE (2 * NXSTATUS_MAX_RECORD)
+
+struct nxstatus_client {
+	int fd;
+	/* The unread data is buf[start] to buf[end] */
+	size_t start;
+	size_t end;
+	char buf[BUFFER_SIZE];
+};
+
+static unsigned long
+get16 (const unsigned char * p)
+{
+	return ((unsigned long)p[0] << 8) | p[1];
+}
+
+static unsigned long
+get32 (const unsigned char * p)
+{
+	return (get16 (p) << 16) | get16 (p + 2);
+}
+
+static long long
+get64 (const unsigned char * p)
+{
+	return (long long)(((unsigned long long)get32 (p) << 32) | get32 (p + 4));
+}
+
+int
+nxstatus_default_path (long pid, char * buf, size_t size)
+{
+	const char * runtime = getenv ("XDG_RUNTIME_DIR");
+	int n;
+
+	if (runtime != NULL && runtime[0] != '\0') {
+		n = snprintf (buf, size, "%s/nxcl-%ld.status", runtime, pid);
+	} else {
+		n = snprintf (buf, size, "/tmp/nxcl-%ld/status-%ld", (long)getuid(), pid);
+	}
+	return (n < 0 || (size_t)n >= size) ? -1 : 0;
+}
+
+struct nxstatus_client *
+nxstatus_open (const char * path)
+{
+	struct nxstatus_client * c;
+	struct sockaddr_un addr;
+
+	if (strlen (path) >= sizeof (addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	strcpy (addr.sun_path, path);
+
+	c = malloc (sizeof (struct nxstatus_client));
+	if (c == NULL) {
+		return NULL;
+	}
+	c->start = 0;
+	c->end = 0;
+	c->fd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (c->fd < 0) {
+		free (c);
+		return NULL;
+	}
+	if (connect (c->fd, (struct sockaddr *)&addr, sizeof (addr)) < 0) {
+		int e = errno;
+		close (c->fd);
+		free (c);
+		errno = e;
+		return NULL;
+	}
+	fcntl (c->fd, F_SETFL, fcntl (c->fd, F_GETFL) | O_NONBLOCK);
+	fcntl (c->fd, F_SETFD, FD_CLOEXEC);
+	return c;
+}
+
+void
+nxstatus_close (struct nxstatus_client * c)
+{
+	if (c != NULL) {
+		close (c->fd);
+		free (c);
+	}
+}
+
+int
+nxstatus_fd (struct nxstatus_client * c)
+{
+	return c->fd;
+}
+
+long
+nxstatus_read (struct nxstatus_client * c)
+{
+	ssize_t n;
+
+	/* Move what's left of a record to the front, so there is
+	 * always room for the rest of it. */
+	if (c->start > 0) {
+		memmove (c->buf, c->buf + c->start, c->end - c->start);
+		c->end -= c->start;
+		c->start = 0;
+	}
+	do {
+		n = read (c->fd, c->buf + c->end, BUFFER_SIZE - c->end);
+	} while (n < 0 && errno == EINTR);
+	if (n > 0) {
+		c->end += n;
+	}
+	return n;
+}
+
+int
+nxstatus_next (struct nxstatus_client * c, struct nxstatus_record * rec)
+{
+	const unsigned char * p = (const unsigned char *)c->buf + c->start;
+	size_t avail = c->end - c->start;
+	size_t len;
+
+	if (avail < 2) {
+		return 0;
+	}
+	len = get16 (p);
+	if (len < NXSTATUS_HEADER_SIZE) {
+		return -1;
+	}
+	if (avail < len) {
+		return 0;
+	}
+	if (nxstatus_decode (c->buf + c->start, len, rec) < 0) {
+		return -1;
+	}
+	c->start += len;
+	return 1;
+}
+
+int
+nxstatus_decode (const char * data, size_t n, struct nxstatus_record * rec)
+{
+	const unsigned char * p = (const unsigned char *)data;
+	size_t pos = NXSTATUS_HEADER_SIZE;
+
+	if (n < NXSTATUS_HEADER_SIZE || get16 (p) != n) {
+		return -1;
+	}
+	rec->type = p[2];
+	rec->session = get32 (p + 4);
+	rec->usec = get64 (p + 8);
+	rec->nfields = 0;
+
+	while (pos < n) {
+		struct nxstatus_field f;
+		f.tag = p[pos++];
+		f.i = 0;
+		f.s = NULL;
+		f.len = 0;
+		if (f.tag == NXSTATUS_INT) {
+			if (pos + 8 > n) {
+				return -1;
+			}
+			f.i = get64 (p + pos);
+			pos += 8;
+		} else if (f.tag == NXSTATUS_STRING) {
+			if (pos + 2 > n) {
+				return -1;
+			}
+			f.len = get16 (p + pos);
+			pos += 2;
+			if (pos + f.len + 1 > n || p[pos + f.len] != '\0') {
+				return -1;
+			}
+			f.s = data + pos;
+			pos += f.len + 1;
+		} else {
+			/* We can't tell how long it is. */
+			return -1;
+		}
+		if (rec->nfields < NXSTATUS_MAX_FIELDS) {
+			rec->fields[rec->nfields++] = f;
+		}
+	}
+	return 0;
+}
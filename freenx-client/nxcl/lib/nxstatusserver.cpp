@@ -0,0 +1,354 @@
+/***************************************************************************
+                             nxstatusserver.cpp
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+}
+
+#include "nxstatusserver.h"
+
+#ifndef MSG_NOSIGNAL
+// A program using us there must ignore SIGPIPE.
+#define MSG_NOSIGNAL 0
+#endif
+
+using namespace std;
+using namespace nxcl;
+
+static void put16 (string& s, unsigned long v)
+{
+    s += static_cast<char>((v >> 8) & 0xff);
+    s += static_cast<char>(v & 0xff);
+}
+
+static void put32 (string& s, unsigned long v)
+{
+    put16 (s, (v >> 16) & 0xffff);
+    put16 (s, v & 0xffff);
+}
+
+static void put64 (string& s, long long v)
+{
+    unsigned long long u = static_cast<unsigned long long>(v);
+    put32 (s, static_cast<unsigned long>(u >> 32));
+    put32 (s, static_cast<unsigned long>(u & 0xffffffffULL));
+}
+
+/*!
+ * Implementation of NXStatusRecord
+ */
+//@{
+NXStatusRecord::NXStatusRecord (int t, unsigned int s) :
+    type(t),
+    session(s)
+{
+    // The length goes in when the fields are added.
+    put16 (this->data, NXSTATUS_HEADER_SIZE);
+    this->data += static_cast<char>(t);
+    this->data += '\0';
+    put32 (this->data, s);
+    put64 (this->data, NXTrace::now());
+}
+
+NXStatusRecord::~NXStatusRecord()
+{
+}
+
+void NXStatusRecord::addInt (long long i)
+{
+    if (this->data.size() + 9 > NXSTATUS_MAX_RECORD) {
+        return;
+    }
+    this->data += static_cast<char>(NXSTATUS_INT);
+    put64 (this->data, i);
+    this->data[0] = static_cast<char>(this->data.size() >> 8);
+    this->data[1] = static_cast<char>(this->data.size() & 0xff);
+}
+
+void NXStatusRecord::addString (const string& s)
+{
+    if (this->data.size() + 4 > NXSTATUS_MAX_RECORD) {
+        return;
+    }
+    size_t len = s.size();
+    if (this->data.size() + 4 + len > NXSTATUS_MAX_RECORD) {
+        len = NXSTATUS_MAX_RECORD - this->data.size() - 4;
+    }
+    this->data += static_cast<char>(NXSTATUS_STRING);
+    put16 (this->data, len);
+    this->data.append (s, 0, len);
+    this->data += '\0';
+    this->data[0] = static_cast<char>(this->data.size() >> 8);
+    this->data[1] = static_cast<char>(this->data.size() & 0xff);
+}
+//@}
+
+/*!
+ * Implementation of NXStatusServer
+ */
+//@{
+NXStatusServer::NXStatusServer() :
+    listenFD(-1),
+    loop(NULL),
+    dropped(0)
+{
+}
+
+NXStatusServer::~NXStatusServer()
+{
+    this->close();
+}
+
+string NXStatusServer::defaultPath (void)
+{
+    char buf[256];
+    if (nxstatus_default_path (getpid(), buf, sizeof (buf)) < 0) {
+        return "";
+    }
+    string p = buf;
+    const char * runtime = getenv ("XDG_RUNTIME_DIR");
+    if (runtime == NULL || runtime[0] == '\0') {
+        // /tmp/nxcl-UID must be ours, and no-one else's to look in.
+        string dir = p.substr (0, p.rfind ('/'));
+        struct stat st;
+        if (mkdir (dir.c_str(), 0700) < 0 && errno != EEXIST) {
+            return "";
+        }
+        if (lstat (dir.c_str(), &st) < 0 || !S_ISDIR (st.st_mode)
+            || st.st_uid != getuid() || (st.st_mode & 077) != 0) {
+            return "";
+        }
+    }
+    return p;
+}
+
+bool NXStatusServer::listen (const string& p, notQEventLoop * l)
+{
+    this->close();
+
+    struct sockaddr_un addr;
+    if (p.empty() || p.size() >= sizeof (addr.sun_path)) {
+        return false;
+    }
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, p.c_str());
+
+    int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    // A socket left by an nxcl which didn't exit cleanly
+    unlink (p.c_str());
+    mode_t mask = umask (077);
+    int rtn = bind (fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof (addr));
+    umask (mask);
+    if (rtn < 0 || ::listen (fd, 16) < 0) {
+        ::close (fd);
+        return false;
+    }
+    fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+    fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+    this->listenFD = fd;
+    this->path = p;
+    this->loop = l;
+    this->loop->setWatch (fd, POLLIN, this);
+    return true;
+}
+
+void NXStatusServer::close (void)
+{
+    while (!this->clients.empty()) {
+        this->disconnect (this->clients.begin()->first);
+    }
+    if (this->listenFD >= 0) {
+        this->loop->removeWatch (this->listenFD);
+        ::close (this->listenFD);
+        unlink (this->path.c_str());
+        this->listenFD = -1;
+    }
+    this->latest.clear();
+}
+
+void NXStatusServer::accept (void)
+{
+    int fd;
+    while ((fd = ::accept (this->listenFD, NULL, NULL)) >= 0) {
+        fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+        fcntl (fd, F_SETFD, FD_CLOEXEC);
+        this->clients[fd] = "";
+
+        // Subscribers only talk to say they've gone.
+        this->loop->setWatch (fd, POLLIN, this);
+
+        NXStatusRecord hello (NXSTATUS_HELLO, 0);
+        hello.addInt (NXSTATUS_VERSION);
+        hello.addInt (getpid());
+        string data = hello.bytes();
+        map<unsigned int, map<int, string> >::iterator s;
+        map<int, string>::iterator r;
+        for (s = this->latest.begin(); s != this->latest.end(); s++) {
+            for (r = s->second.begin(); r != s->second.end(); r++) {
+                data += r->second;
+            }
+        }
+        this->send (fd, data);
+    }
+}
+
+void NXStatusServer::publish (const NXStatusRecord& record)
+{
+    int type = record.getType();
+    if (type == NXSTATUS_FINISHED) {
+        this->latest.erase (record.getSession());
+    } else if (type == NXSTATUS_STAGE || type == NXSTATUS_LINK || type == NXSTATUS_INFO) {
+        this->latest[record.getSession()][type] = record.bytes();
+    }
+
+    // send() may disconnect the subscriber.
+    map<int, string>::iterator i = this->clients.begin();
+    while (i != this->clients.end()) {
+        int fd = (i++)->first;
+        this->send (fd, record.bytes());
+    }
+}
+
+bool NXStatusServer::send (int fd, const string& data)
+{
+    string& queued = this->clients[fd];
+    if (queued.size() + data.size() > NXSTATUS_MAX_QUEUED) {
+        this->dropped++;
+        this->disconnect (fd);
+        return false;
+    }
+    queued += data;
+    return this->flush (fd);
+}
+
+bool NXStatusServer::flush (int fd)
+{
+    string& queued = this->clients[fd];
+    while (!queued.empty()) {
+        ssize_t n = ::send (fd, queued.data(), queued.size(), MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            this->disconnect (fd);
+            return false;
+        }
+        queued.erase (0, n);
+    }
+    this->loop->setWatch (fd, queued.empty() ? POLLIN : (POLLIN | POLLOUT), this);
+    return true;
+}
+
+void NXStatusServer::disconnect (int fd)
+{
+    this->loop->removeWatch (fd);
+    ::close (fd);
+    this->clients.erase (fd);
+}
+
+void NXStatusServer::fdReadySignal (int fd, short events)
+{
+    if (fd == this->listenFD) {
+        this->accept();
+        return;
+    }
+    if (this->clients.find (fd) == this->clients.end()) {
+        return;
+    }
+    if (events & (POLLIN | POLLHUP | POLLERR)) {
+        char buf[256];
+        ssize_t n = read (fd, buf, sizeof (buf));
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+            this->disconnect (fd);
+            return;
+        }
+    }
+    if (events & POLLOUT) {
+        this->flush (fd);
+    }
+}
+
+void NXStatusServer::info (unsigned int session, int code, const string& text)
+{
+    NXStatusRecord r (NXSTATUS_INFO, session);
+    r.addInt (code);
+    r.addString (text);
+    this->publish (r);
+}
+
+void NXStatusServer::error (unsigned int session, const string& text)
+{
+    NXStatusRecord r (NXSTATUS_ERROR, session);
+    r.addString (text);
+    this->publish (r);
+}
+
+void NXStatusServer::stage (unsigned int session, const NXTraceEvent& event)
+{
+    NXStatusRecord r (NXSTATUS_STAGE, session);
+    r.addString (event.stage);
+    r.addString (event.detail);
+    this->publish (r);
+}
+
+void NXStatusServer::link (unsigned int session, const NXLinkStats& stats)
+{
+    NXStatusRecord r (NXSTATUS_LINK, session);
+    r.addInt (stats.minRtt);
+    r.addInt (stats.medianRtt);
+    r.addInt (stats.bytesPerSecond);
+    r.addString (stats.linkType);
+    this->publish (r);
+}
+
+void NXStatusServer::sessions (unsigned int session, const list<NXResumeData>& l)
+{
+    list<NXResumeData>::const_iterator i;
+    for (i = l.begin(); i != l.end(); i++) {
+        NXStatusRecord r (NXSTATUS_SESSION, session);
+        r.addInt (i->display);
+        r.addString (i->sessionID);
+        r.addString (i->sessionType);
+        r.addString (i->sessionName);
+        r.addString (i->available);
+        this->publish (r);
+    }
+    this->publish (NXStatusRecord (NXSTATUS_SESSIONS_END, session));
+}
+
+void NXStatusServer::finished (unsigned int session)
+{
+    this->publish (NXStatusRecord (NXSTATUS_FINISHED, session));
+}
+//@}
@@ -0,0 +1,163 @@
+/* -*-c++-*- */
+/***************************************************************************
+                             nxstatusserver.h
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*!
+ * \file nxstatusserver.h The sending side of the status channel
+ * described in nxstatus.h.
+ */
+
+#ifndef _NXSTATUSSERVER_H_
+#define _NXSTATUSSERVER_H_
+
+#include <string>
+#include <list>
+#include <map>
+#include "notQt.h"
+#include "nxdata.h"
+#include "nxtrace.h"
+#include "nxstatus.h"
+
+using namespace std;
+
+namespace nxcl {
+
+    /*!
+     * One record of the status channel, built a field at a time.
+     */
+    class NXStatusRecord
+    {
+        public:
+            /*!
+             * A record of \arg type (NXSTATUS_INFO and so on)
+             * about session \arg session, stamped now.
+             */
+            NXStatusRecord (int type, unsigned int session);
+            ~NXStatusRecord();
+
+            void addInt (long long i);
+            /*!
+             * Strings are cut to fit the record.
+             */
+            void addString (const string& s);
+
+            int getType (void) const { return this->type; }
+            unsigned int getSession (void) const { return this->session; }
+            /*!
+             * The record as it goes on the socket.
+             */
+            const string& bytes (void) const { return this->data; }
+
+        private:
+            int type;
+            unsigned int session;
+            string data;
+    };
+
+    /*!
+     * Listens on a Unix socket and sends each record it is given
+     * to everyone connected, through the event loop, so that a
+     * subscriber never makes us wait. See nxstatus.h for what
+     * they get.
+     */
+    class NXStatusServer : public notQWatchCallbacks
+    {
+        public:
+            NXStatusServer();
+            ~NXStatusServer();
+
+            /*!
+             * Make the socket at \arg path (replacing any left
+             * there), readable only by us, and watch it with
+             * \arg loop.
+             *
+             * \return false if it couldn't be made.
+             */
+            bool listen (const string& path, notQEventLoop * loop);
+            /*!
+             * Disconnect everyone and remove the socket.
+             */
+            void close (void);
+
+            /*!
+             * nxstatus_default_path() for this process. The
+             * directory in /tmp is made if need be.
+             */
+            static string defaultPath (void);
+
+            /*!
+             * Send \arg record to everyone, and keep the last
+             * stage, link and info records of each session for
+             * those who connect later.
+             */
+            void publish (const NXStatusRecord& record);
+
+            /*!
+             * Build and publish the records for each kind of
+             * news about session \arg session.
+             */
+            //@{
+            void info (unsigned int session, int code, const string& text);
+            void error (unsigned int session, const string& text);
+            void stage (unsigned int session, const NXTraceEvent& event);
+            void link (unsigned int session, const NXLinkStats& stats);
+            void sessions (unsigned int session, const list<NXResumeData>& sessions);
+            void finished (unsigned int session);
+            //@}
+
+            string getPath (void) const { return this->path; }
+            bool isListening (void) const { return this->listenFD >= 0; }
+            unsigned int getSubscribers (void) const { return this->clients.size(); }
+            /*!
+             * How many subscribers have been disconnected for
+             * falling behind.
+             */
+            unsigned int getDropped (void) const { return this->dropped; }
+
+            void fdReadySignal (int fd, short events);
+
+        private:
+            /*!
+             * Queue \arg data for subscriber \arg fd and send
+             * what we can.
+             *
+             * \return false if it has been disconnected.
+             */
+            bool send (int fd, const string& data);
+            /*!
+             * Send what is queued for \arg fd.
+             */
+            bool flush (int fd);
+            void disconnect (int fd);
+            void accept (void);
+
+            string path;
+            int listenFD;
+            notQEventLoop * loop;
+            /*!
+             * What is waiting to go to each subscriber, by
+             * descriptor.
+             */
+            map<int, string> clients;
+            /*!
+             * The records kept for new subscribers, by session
+             * and then type.
+             */
+            map<unsigned int, map<int, string> > latest;
+            unsigned int dropped;
+    };
+
+} // namespace
+#endif
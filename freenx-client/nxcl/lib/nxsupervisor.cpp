@@ -0,0 +1,180 @@
+/***************************************************************************
+                              nxsupervisor.cpp
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <sstream>
+extern "C" {
+#include <sys/wait.h>
+#include <sys/resource.h>
+}
+
+#include "nxsupervisor.h"
+
+using namespace std;
+using namespace nxcl;
+
+    string
+NXProcessExit::describe (void) const
+{
+    stringstream ss;
+    if (this->exited) {
+        ss << "exited with status " << this->exitCode;
+    } else {
+        ss << "killed by signal " << this->signal;
+    }
+    ss << ", " << this->userTime << "s user, " << this->systemTime
+       << "s system, peak RSS " << this->maxRSS << " KB";
+    return ss.str();
+}
+
+/*!
+ * Implementation of NXProcessSupervisor::Child
+ */
+//@{
+NXProcessSupervisor::Child::Child (NXProcessSupervisor * s, const string& n,
+                                   NXProcessHandler * h) :
+    supervisor(s),
+    name(n),
+    handler(h)
+{
+    this->process.setCallbacks (this);
+}
+
+NXProcessSupervisor::Child::~Child ()
+{
+}
+
+void NXProcessSupervisor::Child::startedSignal (string progName)
+{
+    this->handler->startedSignal (&this->process);
+}
+
+void NXProcessSupervisor::Child::errorSignal (int error)
+{
+    this->handler->errorSignal (&this->process, error);
+}
+
+void NXProcessSupervisor::Child::readyReadStandardOutputSignal (void)
+{
+    this->handler->readyReadStandardOutputSignal (&this->process);
+}
+
+void NXProcessSupervisor::Child::readyReadStandardErrorSignal (void)
+{
+    this->handler->readyReadStandardErrorSignal (&this->process);
+}
+
+void NXProcessSupervisor::Child::processFinishedSignal (string progName)
+{
+    NXProcessExit& e = this->supervisor->exits[this->name];
+    int status = this->process.getExitStatus();
+    const struct rusage& ru = this->process.getUsage();
+
+    e.name = this->name;
+    e.pid = this->process.getPid();
+    e.exited = WIFEXITED (status);
+    e.exitCode = e.exited ? WEXITSTATUS (status) : -1;
+    e.signal = WIFSIGNALED (status) ? WTERMSIG (status) : 0;
+    e.userTime = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0;
+    e.systemTime = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1000000.0;
+    // ru_maxrss is in kilobytes on Linux.
+    e.maxRSS = ru.ru_maxrss;
+
+    dbgln ("Process " << this->name << " (" << e.pid << ") " << e.describe());
+
+    this->handler->exitedSignal (&this->process, e);
+}
+//@}
+
+/*!
+ * Implementation of NXProcessSupervisor
+ */
+//@{
+NXProcessSupervisor::NXProcessSupervisor () :
+    eventLoop(NULL)
+{
+}
+
+NXProcessSupervisor::~NXProcessSupervisor ()
+{
+    map<string, Child*>::iterator i;
+    for (i = this->children.begin(); i != this->children.end(); i++) {
+        delete i->second;
+    }
+}
+
+    notQProcess *
+NXProcessSupervisor::add (const string& name, NXProcessHandler * handler)
+{
+    this->remove (name);
+    Child * c = new Child (this, name, handler);
+    c->process.setEventLoop (this->eventLoop);
+    this->children[name] = c;
+    return &c->process;
+}
+
+    notQProcess *
+NXProcessSupervisor::get (const string& name)
+{
+    map<string, Child*>::iterator i = this->children.find (name);
+    if (i == this->children.end()) {
+        return NULL;
+    }
+    return &i->second->process;
+}
+
+    void
+NXProcessSupervisor::remove (const string& name)
+{
+    map<string, Child*>::iterator i = this->children.find (name);
+    if (i != this->children.end()) {
+        // notQProcess's destructor takes it off the event loop.
+        delete i->second;
+        this->children.erase (i);
+    }
+}
+
+    string
+NXProcessSupervisor::getName (notQProcess * proc)
+{
+    map<string, Child*>::iterator i;
+    for (i = this->children.begin(); i != this->children.end(); i++) {
+        if (&i->second->process == proc) {
+            return i->first;
+        }
+    }
+    return "";
+}
+
+    bool
+NXProcessSupervisor::getExit (const string& name, NXProcessExit& status)
+{
+    map<string, NXProcessExit>::iterator i = this->exits.find (name);
+    if (i == this->exits.end()) {
+        return false;
+    }
+    status = i->second;
+    return true;
+}
+
+    void
+NXProcessSupervisor::setEventLoop (notQEventLoop * loop)
+{
+    this->eventLoop = loop;
+    map<string, Child*>::iterator i;
+    for (i = this->children.begin(); i != this->children.end(); i++) {
+        i->second->process.setEventLoop (loop);
+    }
+}
+//@}
@@ -0,0 +1,174 @@
+/* -*-c++-*- */
+/***************************************************************************
+                               nxsupervisor.h
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*!
+ * \file nxsupervisor.h Looks after the child processes (nxssh,
+ * nxproxy and friends) of a connection.
+ */
+
+#ifndef _NXSUPERVISOR_H_
+#define _NXSUPERVISOR_H_
+
+#include <map>
+#include <string>
+#include "notQt.h"
+
+using namespace std;
+
+namespace nxcl {
+
+    /*!
+     * How a child process ended, and what it cost.
+     */
+    struct NXProcessExit {
+        string name;
+        pid_t pid;
+        /*!
+         * True if the process called exit(), in which case
+         * exitCode is set; otherwise it was killed by
+         * signal.
+         */
+        bool exited;
+        int exitCode;
+        int signal;
+        /*!
+         * CPU time used, in seconds
+         */
+        double userTime;
+        double systemTime;
+        /*!
+         * Peak resident set size, in kilobytes
+         */
+        long maxRSS;
+
+        /*!
+         * True unless the process exited with a non-zero
+         * status or was killed.
+         */
+        bool clean (void) const { return this->exited && this->exitCode == 0; }
+
+        /*!
+         * e.g. "exited with status 0, 0.12s user, 0.03s
+         * system, peak RSS 5120 KB"
+         */
+        string describe (void) const;
+    };
+
+    /*!
+     * Virtual callback class for the processes of an
+     * NXProcessSupervisor. Each process may have its own handler;
+     * the process concerned is passed to each call.
+     */
+    class NXProcessHandler
+    {
+        public:
+            NXProcessHandler() {}
+            virtual ~NXProcessHandler() {}
+            virtual void startedSignal (notQProcess * proc) {}
+            virtual void errorSignal (notQProcess * proc, int error) {}
+            virtual void readyReadStandardOutputSignal (notQProcess * proc) {}
+            virtual void readyReadStandardErrorSignal (notQProcess * proc) {}
+            virtual void exitedSignal (notQProcess * proc, const NXProcessExit& status) {}
+    };
+
+    /*!
+     * NXProcessSupervisor owns any number of named child
+     * processes. It attaches them all to one notQEventLoop, so
+     * that they're reaped through the loop's single SIGCHLD
+     * handler, and passes each process's events on to that
+     * process's NXProcessHandler, with the exit status and
+     * resource usage once it has been reaped.
+     *
+     * Several supervisors (say, one per NXClientLib) can share
+     * one event loop.
+     */
+    class NXProcessSupervisor
+    {
+        public:
+            NXProcessSupervisor();
+            ~NXProcessSupervisor();
+
+            /*!
+             * Create a process called \arg name (which replaces
+             * any existing process of that name) whose events go
+             * to \arg handler. Start it with notQProcess::start().
+             */
+            notQProcess * add (const string& name, NXProcessHandler * handler);
+
+            /*!
+             * \return the process called \arg name, or NULL.
+             */
+            notQProcess * get (const string& name);
+
+            /*!
+             * Stop watching, and delete, the process called \arg
+             * name. It isn't killed; call terminate() first if it
+             * is still running.
+             */
+            void remove (const string& name);
+
+            /*!
+             * \return the name under which \arg proc was added.
+             */
+            string getName (notQProcess * proc);
+
+            /*!
+             * \return the exit of the last process called \arg
+             * name to finish, and whether there was one.
+             */
+            bool getExit (const string& name, NXProcessExit& status);
+
+            /*!
+             * Attach all the processes, now and in future, to
+             * \arg loop.
+             */
+            void setEventLoop (notQEventLoop * loop);
+
+            unsigned int size (void) { return this->children.size(); }
+
+        private:
+            /*!
+             * One child process, and the go-between which turns
+             * its notQProcessCallbacks into calls to its handler.
+             */
+            class Child : public notQProcessCallbacks
+            {
+                public:
+                    Child (NXProcessSupervisor * s, const string& n, NXProcessHandler * h);
+                    ~Child();
+
+                    void startedSignal (string name);
+                    void errorSignal (int error);
+                    void processFinishedSignal (string name);
+                    void readyReadStandardOutputSignal (void);
+                    void readyReadStandardErrorSignal (void);
+
+                    NXProcessSupervisor * supervisor;
+                    string name;
+                    NXProcessHandler * handler;
+                    notQProcess process;
+            };
+
+            map<string, Child*> children;
+            /*!
+             * How each process ended, by name
+             */
+            map<string, NXProcessExit> exits;
+            notQEventLoop * eventLoop;
+    };
+
+} // namespace
+#endif
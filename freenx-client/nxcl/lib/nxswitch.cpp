@@ -0,0 +1,406 @@
+/***************************************************************************
+                                nxswitch.cpp
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <ctype.h>
+#include <string.h>
+extern "C" {
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+}
+
+#include "nxswitch.h"
+#include "nxlineframer.h"
+#include "nxtrace.h"
+
+using namespace std;
+using namespace nxcl;
+
+/*!
+ * How long to leave the descriptor before peeking again, when part
+ * of a line of text has arrived, in milliseconds.
+ */
+#define NXSWITCH_PEEK_AGAIN 1
+
+/*!
+ * Implementation of NXSwitch
+ */
+//@{
+NXSwitch::NXSwitch (notQEventLoop * l) :
+    loop(l),
+    callbacks(NULL),
+    fd(-1),
+    fdFlags(-1),
+    deadline(0),
+    canPeek(true),
+    waiting(false),
+    done(false)
+{
+}
+
+NXSwitch::~NXSwitch ()
+{
+    if (this->waiting) {
+        this->loop->removeWatch (this->fd);
+        this->loop->removeTimer (this);
+        if (this->fdFlags != -1) {
+            fcntl (this->fd, F_SETFL, this->fdFlags);
+        }
+    }
+}
+
+    void
+NXSwitch::start (int f, int timeout)
+{
+    this->fd = f;
+    this->deadline = NXTrace::now() + static_cast<long long>(timeout) * 1000;
+    // Whoever has the descriptor next may want it blocking.
+    this->fdFlags = fcntl (f, F_GETFL);
+    if (this->fdFlags != -1) {
+        fcntl (f, F_SETFL, this->fdFlags | O_NONBLOCK);
+    }
+    this->waiting = true;
+    this->loop->setTimer (this, timeout);
+    this->readText();
+}
+
+    void
+NXSwitch::fdReadySignal (int f, short events)
+{
+    this->readText();
+}
+
+    void
+NXSwitch::timerSignal (void)
+{
+    long long left = (this->deadline - NXTrace::now() + 999) / 1000;
+    if (left <= 0) {
+        this->finish (NXSWITCH_TIMEOUT);
+        return;
+    }
+    // We were waiting for the rest of a line.
+    this->loop->setTimer (this, static_cast<int>(left));
+    this->readText();
+}
+
+    void
+NXSwitch::readText (void)
+{
+    char buf[4096];
+
+    for (;;) {
+        this->takeText();
+
+        if (!this->buffer.empty()) {
+            if (NXSwitch::textLength (this->buffer.data(), this->buffer.size()) < 0) {
+                this->finish (NXSWITCH_LEFTOVER);
+                return;
+            }
+            // Part of a line has already been read, so the
+            // rest of it must be read too.
+        } else if (this->done) {
+            this->finish (NXSWITCH_DONE);
+            return;
+        }
+
+        ssize_t n;
+        if (!this->buffer.empty() || !this->canPeek) {
+            n = read (this->fd, buf, sizeof (buf));
+            if (n > 0) {
+                this->buffer.append (buf, n);
+                continue;
+            }
+        } else {
+            n = recv (this->fd, buf, sizeof (buf), MSG_PEEK);
+            if (n == -1 && errno == ENOTSOCK) {
+                // Not a socket; we'll have to read.
+                this->canPeek = false;
+                continue;
+            }
+            if (n > 0) {
+                int len = NXSwitch::textLength (buf, n);
+                if (len < 0) {
+                    this->finish (NXSWITCH_PROXY_DATA);
+                    return;
+                } else if (len == 0) {
+                    // The rest of the line is on its way. We
+                    // mustn't take any of it until we know it is
+                    // text, and the descriptor stays readable
+                    // meanwhile, so look again in a moment.
+                    this->loop->removeWatch (this->fd);
+                    this->loop->setTimer (this, NXSWITCH_PEEK_AGAIN);
+                    return;
+                }
+                n = read (this->fd, buf, len);
+                if (n > 0) {
+                    this->buffer.append (buf, n);
+                }
+                continue;
+            }
+        }
+
+        if (n == 0) {
+            this->finish (NXSWITCH_EOF);
+        } else if (errno == EAGAIN || errno == EINTR) {
+            this->loop->setWatch (this->fd, POLLIN, this);
+        } else {
+            this->finish (NXSWITCH_EOF);
+        }
+        return;
+    }
+}
+
+    void
+NXSwitch::finish (NXSwitchResult result)
+{
+    this->waiting = false;
+    this->loop->removeWatch (this->fd);
+    this->loop->removeTimer (this);
+    if (this->fdFlags != -1) {
+        fcntl (this->fd, F_SETFL, this->fdFlags);
+    }
+    if (this->callbacks != NULL) {
+        this->callbacks->switchReadySignal (result);
+    }
+}
+
+    void
+NXSwitch::takeText (void)
+{
+    int len;
+    while (!this->buffer.empty()
+           && (len = NXSwitch::textLength (this->buffer.data(),
+                                           this->buffer.size())) > 0) {
+        string line = this->buffer.substr (0, len - 1);
+        this->buffer.erase (0, len);
+        if (!line.empty() && line[line.size()-1] == '\r') {
+            line.erase (line.size()-1);
+        }
+        this->text.push_back (line);
+        if (NXSwitch::isByeEcho (line)
+            || NXLineFramer::parseCode (line.data(), line.size()) == 999) {
+            this->done = true;
+        }
+    }
+}
+
+    int
+NXSwitch::textLength (const char * data, size_t n)
+{
+    const char * nl = static_cast<const char*>(memchr (data, '\n', n));
+    size_t len = nl ? nl - data : n;
+
+    if (memcmp (data, "NX> ", len < 4 ? len : 4) == 0) {
+        return nl ? static_cast<int>(len) + 1 : 0;
+    }
+
+    string line (data, len);
+    if (nl) {
+        return NXSwitch::isByeEcho (line) ? static_cast<int>(len) + 1 : -1;
+    }
+
+    // Could this become the echo?
+    if (!line.empty() && line[line.size()-1] == '\r') {
+        line.erase (line.size()-1);
+    }
+    if (line.size() > 4) {
+        return -1;
+    }
+    for (size_t i = 0; i < line.size(); i++) {
+        if (tolower (line[i]) != "bye."[i]) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+    bool
+NXSwitch::isByeEcho (const string& line)
+{
+    size_t len = line.size();
+    if (len > 0 && line[len-1] == '\r') {
+        len--;
+    }
+    if (len != 3 && len != 4) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (tolower (line[i]) != "bye."[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+//@}
+
+/*!
+ * Implementation of NXCommRelay
+ */
+//@{
+NXCommRelay::NXCommRelay (notQEventLoop * l) :
+    loop(l),
+    serverFD(-1),
+    localFD(-1),
+    proxyFD(-1)
+{
+    this->toProxy.from = this->toProxy.to = -1;
+    this->toProxy.eof = this->toProxy.shut = false;
+    this->toServer.from = this->toServer.to = -1;
+    this->toServer.eof = this->toServer.shut = false;
+}
+
+NXCommRelay::~NXCommRelay ()
+{
+    if (this->serverFD != -1) {
+        this->loop->removeWatch (this->serverFD);
+    }
+    if (this->localFD != -1) {
+        this->loop->removeWatch (this->localFD);
+        close (this->localFD);
+    }
+    if (this->proxyFD != -1) {
+        close (this->proxyFD);
+    }
+}
+
+    bool
+NXCommRelay::start (int fd, const string& leftover)
+{
+    int sv[2];
+    if (socketpair (AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+        return false;
+    }
+    this->localFD = sv[0];
+    this->proxyFD = sv[1];
+    fcntl (this->localFD, F_SETFD, FD_CLOEXEC);
+    fcntl (this->localFD, F_SETFL, fcntl (this->localFD, F_GETFL) | O_NONBLOCK);
+
+    // nxssh's descriptor comes to us blocking (see
+    // notQProcess::getParentFD()); it's ours alone now.
+    this->serverFD = fd;
+    fcntl (this->serverFD, F_SETFL, fcntl (this->serverFD, F_GETFL) | O_NONBLOCK);
+
+    this->toProxy.from = this->serverFD;
+    this->toProxy.to = this->localFD;
+    this->toProxy.pending = leftover;
+    this->toServer.from = this->localFD;
+    this->toServer.to = this->serverFD;
+
+    this->flush (this->toProxy);
+    this->updateWatches();
+    return true;
+}
+
+    void
+NXCommRelay::proxyStarted (void)
+{
+    if (this->proxyFD != -1) {
+        close (this->proxyFD);
+        this->proxyFD = -1;
+    }
+}
+
+    void
+NXCommRelay::fdReadySignal (int fd, short events)
+{
+    Direction * dirs[2] = { &this->toProxy, &this->toServer };
+    for (int i = 0; i < 2; i++) {
+        Direction& d = *dirs[i];
+        if (d.to == fd && !d.pending.empty()
+            && (events & (POLLOUT | POLLHUP | POLLERR))) {
+            this->flush (d);
+        }
+        if (d.from == fd && d.pending.empty() && !d.eof
+            && (events & (POLLIN | POLLHUP | POLLERR))) {
+            this->fill (d);
+        }
+    }
+    this->updateWatches();
+}
+
+    void
+NXCommRelay::fill (Direction& d)
+{
+    char buf[65536];
+    ssize_t n = read (d.from, buf, sizeof (buf));
+    if (n == -1 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    } else if (n <= 0) {
+        d.eof = true;
+        return;
+    }
+
+    // Straight through if we can; the rest waits for POLLOUT.
+    ssize_t w = ::write (d.to, buf, n);
+    if (w == -1 && errno != EINTR && errno != EAGAIN) {
+        d.eof = true;
+        return;
+    }
+    if (w < 0) {
+        w = 0;
+    }
+    d.pending.append (buf + w, n - w);
+}
+
+    void
+NXCommRelay::flush (Direction& d)
+{
+    size_t done = 0;
+    while (done < d.pending.size()) {
+        ssize_t w = ::write (d.to, d.pending.data() + done,
+                             d.pending.size() - done);
+        if (w > 0) {
+            done += w;
+        } else if (w == -1 && errno == EINTR) {
+            continue;
+        } else if (w == -1 && errno == EAGAIN) {
+            break;
+        } else {
+            // The other end has gone; so has what it hadn't read.
+            d.pending.clear();
+            d.eof = true;
+            return;
+        }
+    }
+    d.pending.erase (0, done);
+}
+
+    void
+NXCommRelay::updateWatches (void)
+{
+    // Pass each end of file on once the data before it has gone,
+    // but keep relaying the other way until that finishes too.
+    Direction * dirs[2] = { &this->toProxy, &this->toServer };
+    for (int i = 0; i < 2; i++) {
+        Direction& d = *dirs[i];
+        if (d.eof && d.pending.empty() && !d.shut) {
+            shutdown (d.to, SHUT_WR);
+            d.shut = true;
+        }
+    }
+
+    // Read a side only while what we read from it last has gone.
+    short serverEvents = 0, localEvents = 0;
+    if (!this->toServer.pending.empty()) { serverEvents |= POLLOUT; }
+    if (!this->toProxy.pending.empty()) { localEvents |= POLLOUT; }
+    if (!this->toProxy.eof && this->toProxy.pending.empty()) { serverEvents |= POLLIN; }
+    if (!this->toServer.eof && this->toServer.pending.empty()) { localEvents |= POLLIN; }
+    this->loop->setWatch (this->serverFD, serverEvents, this);
+    this->loop->setWatch (this->localFD, localEvents, this);
+}
+//@}
@@ -0,0 +1,287 @@
+/* -*-c++-*- */
+/***************************************************************************
+                                nxswitch.h
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*!
+ * \file nxswitch.h Hands the connection to nxserver over from the
+ * NX protocol to nxproxy, when the session is encrypted and nxssh is
+ * not used as the proxy's transport.
+ */
+
+#ifndef _NXSWITCH_H_
+#define _NXSWITCH_H_
+
+#include <string>
+#include <list>
+#include "notQt.h"
+
+using namespace std;
+
+namespace nxcl {
+
+    /*!
+     * Why NXSwitch finished.
+     */
+    enum NXSwitchResult {
+        /*!
+         * The server has said all it is going to say.
+         */
+        NXSWITCH_DONE,
+        /*!
+         * The next bytes in the descriptor are for nxproxy.
+         */
+        NXSWITCH_PROXY_DATA,
+        /*!
+         * Bytes for nxproxy had already been read; see
+         * NXSwitch::getLeftover().
+         */
+        NXSWITCH_LEFTOVER,
+        /*!
+         * Nothing more arrived in time.
+         */
+        NXSWITCH_TIMEOUT,
+        /*!
+         * The server closed the connection.
+         */
+        NXSWITCH_EOF
+    };
+
+    /*!
+     * Callbacks for NXSwitch
+     */
+    class NXSwitchCallbacks
+    {
+        public:
+            NXSwitchCallbacks() {}
+            virtual ~NXSwitchCallbacks() {}
+            /*!
+             * nxproxy can have the descriptor now, because of
+             * \arg result. The NXSwitch mustn't be deleted from
+             * here.
+             */
+            virtual void switchReadySignal (NXSwitchResult result) {}
+    };
+
+    /*!
+     * Once we have said "bye", nxserver stops talking NX
+     * protocol and the descriptor we share with nxssh carries the
+     * proxy connection instead. Before that, the server may still
+     * send the echo of our "bye" and "NX> 999 Bye", and a proxy at
+     * the other end may start talking straight after them.
+     *
+     * NXSwitch reads exactly those lines of text, peeking at the
+     * descriptor so that it never takes anything that belongs to
+     * nxproxy, and says when nxproxy can be started. It does so
+     * from an event loop, so other sessions in the loop carry on
+     * meanwhile.
+     */
+    class NXSwitch : public notQWatchCallbacks, public notQTimerCallbacks
+    {
+        public:
+            NXSwitch (notQEventLoop * loop);
+            ~NXSwitch();
+
+            /*!
+             * Data already read from the descriptor, but not
+             * yet parsed (e.g. what is left in an NXLineFramer).
+             */
+            void setBuffered (const string& data) { this->buffer = data; }
+            /*!
+             * Set true if the server has finished talking on the
+             * descriptor, e.g. "NX> 999 Bye" or the echo of "bye"
+             * was read from it already.
+             */
+            void setDone (bool d) { this->done = d; }
+            void setCallbacks (NXSwitchCallbacks * cb) { this->callbacks = cb; }
+
+            /*!
+             * Read the server's last lines from \arg fd as they
+             * arrive, for no longer than \arg timeout
+             * milliseconds, and then call switchReadySignal().
+             * That may happen before this returns, if what was
+             * buffered is enough to tell.
+             */
+            void start (int fd, int timeout);
+            /*!
+             * True from start() until switchReadySignal().
+             */
+            bool isWaiting (void) const { return this->waiting; }
+            /*!
+             * The descriptor given to start()
+             */
+            int getFD (void) const { return this->fd; }
+
+            /*!
+             * Bytes for nxproxy which had already been read from
+             * the descriptor.
+             */
+            const string& getLeftover (void) const { return this->buffer; }
+            /*!
+             * The lines that were read.
+             */
+            const list<string>& getText (void) const { return this->text; }
+
+            /*!
+             * Is there a line from the server at the start of
+             * \arg data?
+             *
+             * \return its length, including the newline; 0 if
+             * there might be, once more data has arrived; or -1
+             * if the data is not from the server.
+             */
+            static int textLength (const char * data, size_t n);
+            /*!
+             * Is \arg line (without its newline) the echo of our
+             * "bye"?
+             */
+            static bool isByeEcho (const string& line);
+
+            void fdReadySignal (int fd, short events);
+            void timerSignal (void);
+
+        private:
+            /*!
+             * Take the lines of text at the start of buffer.
+             */
+            void takeText (void);
+            /*!
+             * Read what has arrived, and finish() if that
+             * settles it; otherwise wait for more.
+             */
+            void readText (void);
+            /*!
+             * Stop watching fd, and tell the callbacks.
+             */
+            void finish (NXSwitchResult result);
+
+            notQEventLoop * loop;
+            NXSwitchCallbacks * callbacks;
+            int fd;
+            /*!
+             * fd's flags before start(), put back by finish()
+             */
+            int fdFlags;
+            /*!
+             * When we stop waiting (see NXTrace::now())
+             */
+            long long deadline;
+            /*!
+             * False once recv() has said fd isn't a socket.
+             */
+            bool canPeek;
+            bool waiting;
+            string buffer;
+            list<string> text;
+            bool done;
+    };
+
+    /*!
+     * When data for nxproxy has already been read, nxproxy can't
+     * be given the descriptor itself. It gets one end of a
+     * socketpair instead; NXCommRelay writes the data to the
+     * other end, and then copies between that and the real
+     * connection from the event loop.
+     *
+     * Both our descriptors are non-blocking. What one side can't
+     * take yet is kept until it can, and the other side isn't
+     * read meanwhile, so neither direction holds up the other or
+     * the loop.
+     */
+    class NXCommRelay : public notQWatchCallbacks
+    {
+        public:
+            NXCommRelay (notQEventLoop * loop);
+            ~NXCommRelay();
+
+            /*!
+             * Relay between \arg fd and a new socketpair,
+             * starting with \arg leftover.
+             *
+             * \return false if we couldn't.
+             */
+            bool start (int fd, const string& leftover);
+            /*!
+             * The descriptor to give to nxproxy.
+             */
+            int getProxyFD (void) const { return this->proxyFD; }
+            /*!
+             * Close our copy of the proxy's descriptor, once
+             * nxproxy has its own.
+             */
+            void proxyStarted (void);
+
+            void fdReadySignal (int fd, short events);
+
+        private:
+            /*!
+             * One direction of the relay
+             */
+            struct Direction {
+                int from;
+                int to;
+                /*!
+                 * Read from \arg from, not yet written to \arg to
+                 */
+                string pending;
+                /*!
+                 * Nothing more will be read from \arg from: it
+                 * has closed, or \arg to has failed.
+                 */
+                bool eof;
+                /*!
+                 * \arg to has been shut down for writing.
+                 */
+                bool shut;
+            };
+
+            /*!
+             * Read what is available for \arg d, and write as
+             * much of it as \arg d.to will take.
+             */
+            void fill (Direction& d);
+            /*!
+             * Write as much of \arg d.pending as \arg d.to will
+             * take.
+             */
+            void flush (Direction& d);
+            /*!
+             * Pass on ends of file whose data has all gone, and
+             * watch each descriptor for what we now need of it.
+             */
+            void updateWatches (void);
+
+            notQEventLoop * loop;
+            /*!
+             * The connection to the server, which belongs to
+             * the nxssh process.
+             */
+            int serverFD;
+            /*!
+             * Our end of the socketpair
+             */
+            int localFD;
+            /*!
+             * nxproxy's end of the socketpair
+             */
+            int proxyFD;
+            /*!
+             * From the server to nxproxy, and back
+             */
+            Direction toProxy;
+            Direction toServer;
+    };
+
+} // namespace
+#endif
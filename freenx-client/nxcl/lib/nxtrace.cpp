@@ -0,0 +1,135 @@
+/***************************************************************************
+                                nxtrace.cpp
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <sstream>
+#include <iomanip>
+extern "C" {
+#include <time.h>
+}
+
+#include "nxtrace.h"
+
+using namespace std;
+using namespace nxcl;
+
+/*!
+ * Implementation of NXTrace
+ */
+//@{
+NXTrace::NXTrace ()
+{
+}
+
+NXTrace::~NXTrace ()
+{
+}
+
+    void
+NXTrace::mark (const string& stage, const string& detail)
+{
+    NXTraceEvent e;
+    e.usec = NXTrace::now();
+    e.stage = stage;
+    e.detail = detail;
+    this->events.push_back (e);
+}
+
+    string
+NXTrace::str (void) const
+{
+    stringstream ss;
+    ss << fixed << setprecision (3);
+    list<NXTraceEvent>::const_iterator i;
+    for (i = this->events.begin(); i != this->events.end(); i++) {
+        ss << "+" << (i->usec - this->events.front().usec) / 1000.0 << "ms "
+            << i->stage;
+        if (!i->detail.empty()) {
+            ss << " (" << i->detail << ")";
+        }
+        ss << "\n";
+    }
+    return ss.str();
+}
+
+    string
+NXTrace::json (int session) const
+{
+    string s;
+    long long origin = this->getOrigin();
+    list<NXTraceEvent>::const_iterator i;
+    for (i = this->events.begin(); i != this->events.end(); i++) {
+        s += NXTrace::json (*i, origin, session);
+        s += "\n";
+    }
+    return s;
+}
+
+    long long
+NXTrace::getOrigin (void) const
+{
+    return this->events.empty() ? NXTrace::now() : this->events.front().usec;
+}
+
+/*!
+ * \arg s as a JSON string, with its quotes.
+ */
+static string jsonString (const string& s)
+{
+    stringstream ss;
+    ss << '"';
+    for (string::const_iterator c = s.begin(); c != s.end(); c++) {
+        switch (*c) {
+            case '"': ss << "\\\""; break;
+            case '\\': ss << "\\\\"; break;
+            case '\n': ss << "\\n"; break;
+            case '\r': ss << "\\r"; break;
+            case '\t': ss << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(*c) < 0x20) {
+                    ss << "\\u" << hex << setw (4) << setfill ('0')
+                        << static_cast<int>(*c) << dec;
+                } else {
+                    ss << *c;
+                }
+                break;
+        }
+    }
+    ss << '"';
+    return ss.str();
+}
+
+    string
+NXTrace::json (const NXTraceEvent& e, long long origin, int session)
+{
+    stringstream ss;
+    ss << "{";
+    if (session >= 0) {
+        ss << "\"session\":" << session << ",";
+    }
+    ss << "\"t\":" << e.usec
+        << ",\"ms\":" << fixed << setprecision (3) << (e.usec - origin) / 1000.0
+        << ",\"stage\":" << jsonString (e.stage)
+        << ",\"detail\":" << jsonString (e.detail) << "}";
+    return ss.str();
+}
+
+    long long
+NXTrace::now (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return static_cast<long long>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+//@}
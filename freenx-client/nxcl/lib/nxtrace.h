@@ -0,0 +1,100 @@
+/* -*-c++-*- */
+/***************************************************************************
+                                 nxtrace.h
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*!
+ * \file nxtrace.h A timestamped record of the stages a connection
+ * goes through, so that the time taken to start a session can be
+ * measured.
+ */
+
+#ifndef _NXTRACE_H_
+#define _NXTRACE_H_
+
+#include <list>
+#include <string>
+
+using namespace std;
+
+namespace nxcl {
+
+    /*!
+     * One stage reached, with the time it was reached.
+     */
+    struct NXTraceEvent {
+        /*!
+         * Microseconds on the monotonic clock
+         */
+        long long usec;
+        string stage;
+        string detail;
+    };
+
+    /*!
+     * NXTrace keeps the stages in the order they were marked.
+     */
+    class NXTrace
+    {
+        public:
+            NXTrace();
+            ~NXTrace();
+
+            /*!
+             * Record that \arg stage has been reached now.
+             */
+            void mark (const string& stage, const string& detail = "");
+            void clear (void) { this->events.clear(); }
+
+            const list<NXTraceEvent>& getEvents (void) const { return this->events; }
+
+            /*!
+             * The trace as text, one stage per line, each with
+             * the milliseconds since the first.
+             */
+            string str (void) const;
+            /*!
+             * The trace as JSON, one object per line (see
+             * json(const NXTraceEvent&, long long, int)).
+             */
+            string json (int session = -1) const;
+
+            /*!
+             * When the trace started: the time of the first
+             * stage, or now if there are none yet.
+             */
+            long long getOrigin (void) const;
+
+            /*!
+             * The monotonic clock, in microseconds.
+             */
+            static long long now (void);
+
+            /*!
+             * \arg e as a JSON object on one line:
+             *
+             * {"session":0,"t":12345678,"ms":1.234,"stage":"...","detail":"..."}
+             *
+             * t is the monotonic time in microseconds, ms the
+             * milliseconds since \arg origin. session is left
+             * out if it is negative.
+             */
+            static string json (const NXTraceEvent& e, long long origin, int session = -1);
+
+        private:
+            list<NXTraceEvent> events;
+    };
+
+} // namespace
+#endif
@@ -28,12 +28,22 @@
  * nxproxy. nxcl will send back a list of sessions to the launching
  * NX client (if there are multiple available sessions) and a signal
  * to say if the connection has been launched or if an error occurred.
+ *
+ * "nxcl N" serves one connection, for a client which listens on
+ * org.freenx.nxcl.nxclN and sends on org.freenx.nxcl.clientN, and
+ * exits when it is over. "nxcl --multi" claims the bus name
+ * org.freenx.nxcl.daemon and serves any number of connections from
+ * one process. A client asks it for connection N with an openSession
+ * signal (or method call, which returns the session's object path)
+ * on the org.freenx.nxcl.daemon interface, with N as its int32
+ * argument, and then carries on exactly as with "nxcl N".
  */
 
 #include "../config.h"
 #include "nxclientlib_i18n.h"
 #include "nxclientlib.h"
 #include "nxcl.h"
+#include "nxcldaemon.h"
 #include "nxdata.h"
 #include <fstream>
 
@@ -53,83 +63,62 @@ using namespace std;
  */
 ofstream debugLogFile;
 
-/*!
- * This probing routine is executed on a regular basis. It will set
- * off suitable signals if there is stdout or stderr to be analysed
- * from the nxssh process. It also recognises when the nxssh program
- * has exited.
- */
-bool probeNXCL (NXClientLib* lib);
-
 int main (int argc, char **argv)
 {
-	Nxcl nxcl;
+	NxclDaemon daemon;
 
 	debugLogFile.open("/tmp/nxcl.log", ios::out|ios::trunc);
 	if (!debugLogFile.is_open()) {
-		nxcl.callbacks.error ("Odd, couldn't open /tmp/nxcl.log");
+		cerr << "NXCL_ERROR> Odd, couldn't open /tmp/nxcl.log" << endl;
 	}
 
 	if (argc!=2) {
-		nxcl.callbacks.error ("This program is usually executed by another program. "
-				      "Trying to execute it alone is probably not the right "
-				      "thing to do, unless you are sure it is. Provide a single "
-				      "argument - the identifier for the dbus messages");
+		cerr << "NXCL_ERROR> This program is usually executed by another program. "
+		     << "Trying to execute it alone is probably not the right "
+		     << "thing to do, unless you are sure it is. Provide a single "
+		     << "argument - the identifier for the dbus messages, or "
+		     << "--multi to serve many sessions" << endl;
 		return -1;
 	}
 
-	stringstream ss;
-	int id;
-	ss << argv[1];
-	ss >> id;
-	nxcl.setupDbus(id);
-
-	// Send a message to the frontend client to say we are up and running
-	nxcl.callbacks.write (NXCL_ALIVE, _("nxcl is up and running"));
-
-	if (-1 == (nxcl.receiveSettings())) {
-		cerr << "Failed to obtain server and user for the session." << endl;
-		return -1;
+	if (!daemon.connectDbus()) {
+		return 1;
 	}
+	// Front-ends may also watch the sessions on the status
+	// socket; we carry on without it.
+	daemon.listenForStatus();
+
+	if (string(argv[1]) == "--multi") {
+		if (!daemon.requestName (NXCL_DAEMON_NAME)) {
+			cerr << "NXCL_ERROR> There appears to be another nxcl --multi running, "
+			     << "won't compete. Exiting." << endl;
+			return 1;
+		}
+		daemon.listenForSessions();
 
-	nxcl.callbacks.write (NXCL_STARTING, _("Connection is starting..."));
-	nxcl.startTheNXConnection();
-
-	NXClientLib* c = nxcl.getNXClientLib();
-	while (probeNXCL(c) == true && !c->getSessionRunning()) {
-		usleep (30000); // 3 100ths of a second => about 30 
-                                // probes a second. This will impact on power consumption.
+	} else {
+		stringstream ss;
+		int id;
+		ss << argv[1];
+		ss >> id;
+
+		ss.str("");
+		ss << "org.freenx.nxcl.nxcl" << id;
+		if (!daemon.requestName (ss.str())) {
+			/* What to do if someone else is running? Try another name? Exit? */
+			cerr << "NXCL_ERROR> There appears to be another nxcl running, "
+			     << "won't compete. Exiting." << endl;
+			return 1;
+		}
+		daemon.setExitWhenIdle (true);
+		daemon.openSession (id);
 	}
 
-	// Now the process has started, reduce polling.
-	while (probeNXCL(c) == true) {
-		usleep (2000000); // poll once every 2 seconds.
-	}
+	// Sleep until the dbus connection or one of the nxssh/nxproxy
+	// processes has something for us. Returns when the session
+	// (or, with --multi, the dbus connection) is finished.
+	daemon.run();
 
-	nxcl.callbacks.write (NXCL_FINISHED, _("Program finished."));
 	debugLogFile.close();
 	return 0;
 }
-
-
-bool
-probeNXCL (NXClientLib* lib)
-{
-	notQProcess* p = lib->getNXSSHProcess();
-
-	if ((lib->getIsFinished()) == false) {
-		// We need to repeatedly check if there is any output to parse.
-		if (lib->getReadyForProxy() == false) {
-			//p = lib->getNXSSHProcess();
-			p->probeProcess();
-		} else {
-			//p = lib->getNXSSHProcess();
-			p->probeProcess();
-			p = lib->getNXProxyProcess();
-			p->probeProcess();
-		}
-		return true;
-	} else {
-		return false;
-	}
-}
@@ -105,6 +105,16 @@ NxclCallbacks::serverCapacitySignal (void)
 {
 	this->parent->serverCapacityReached();
 }
+void
+NxclCallbacks::traceSignal (const NXTraceEvent& event)
+{
+	this->parent->traceEvent (event);
+}
+void
+NxclCallbacks::linkMeasuredSignal (const NXLinkStats& stats)
+{
+	this->parent->linkMeasured (stats);
+}
 //@}
 
 /*!
@@ -128,16 +138,44 @@ Nxcl::Nxcl (int n)
 
 Nxcl::~Nxcl ()
 {
+	if (this->conn != NULL && !this->dbusMatch.empty()) {
+		dbus_bus_remove_match (this->conn, this->dbusMatch.c_str(), NULL);
+	}
 }
 
 void
 Nxcl::initiate (void)
 {
+	this->conn = NULL;
+	this->status = NULL;
+	dbus_error_init (&this->error);
+	this->nxport = 22;
+	this->started = false;
+	this->finished = false;
 	this->setSessionDefaults();
 
+	// Sessions of nxcl --multi share the file, hence appending.
+	const char * trace = getenv ("NXCL_TRACE");
+	if (trace != NULL && trace[0] != '\0') {
+		this->traceFile.open (trace, ios::out | ios::app);
+		if (!this->traceFile.is_open()) {
+			cerr << "NXCL_ERROR> Can't open trace file " << trace << endl;
+		}
+	}
+
 	this->nxclientlib.setExternalCallbacks (&callbacks);
 	this->callbacks.setParent (this);
 
+	// Resume the session, up to NXCL_RECONNECT times in a row, if
+	// the link to the server goes.
+	const char * reconnect = getenv ("NXCL_RECONNECT");
+	if (reconnect != NULL && atoi (reconnect) > 0) {
+		this->nxclientlib.setAutoReconnect (true, atoi (reconnect));
+	}
+	// The choice of session to resume arrives as a dbus
+	// message some time after the list has been sent.
+	this->nxclientlib.getSession()->setDeferChoice (true);
+
 	// Get the X display information
 	Display* display;
 	display = XOpenDisplay (getenv("DISPLAY"));
@@ -199,11 +237,25 @@ Nxcl::setupDbus (void)
 	}
 	// Done getting connection to session bus
 
+	this->setupInterfaces();
+}
+
+void
+Nxcl::setupDbus (DBusConnection * c, int id)
+{
+	this->conn = c;
+	this->dbusNum = id;
+	this->setupInterfaces();
+}
+
+void
+Nxcl::setupInterfaces (void)
+{
+	stringstream ss;
 
 	// Prepare interface - add a rule for which messages we want
 	// to see. We listen for messages from the _client_
 	// connection.
-	ss.str("");
 	ss << "type='signal',interface='org.freenx.nxcl.client" << this->dbusNum << "'";
 	this->dbusMatch = ss.str();
 
@@ -220,183 +272,274 @@ Nxcl::setupDbus (void)
 	ss.str("");
 	ss << "org.freenx.nxcl.nxcl" << this->dbusNum;
 	this->dbusSendInterface = ss.str();
+	ss.str("");
+	ss << "/org/freenx/nxcl/session" << this->dbusNum;
+	this->objectPath = ss.str();
 
 	return;
 }
 
+bool
+Nxcl::isMessage (DBusMessage * message, const char * member)
+{
+	if (dbus_message_is_signal (message, this->dbusMatchInterface.c_str(), member)) {
+		return true;
+	}
+	return (dbus_message_is_method_call (message, "org.freenx.nxcl.session", member)
+		&& dbus_message_has_path (message, this->objectPath.c_str()));
+}
+
+/*!
+ * Get the single int32 argument of a sessionChoice or
+ * terminateSession message into \arg parameter.
+ */
+static bool
+getInt32Arg (DBusMessage * message, dbus_int32_t& parameter)
+{
+	DBusMessageIter args;
+	if (!dbus_message_iter_init(message, &args)) {
+		cerr << "Message has no arguments!\n";
+		return false;
+	}
+	if (DBUS_TYPE_INT32 != dbus_message_iter_get_arg_type(&args)) {
+		cerr << "Argument is not int32!\n";
+		return false;
+	}
+	dbus_message_iter_get_basic(&args, &parameter);
+	return true;
+}
+
+bool
+Nxcl::handleMessage (DBusMessage * message)
+{
+	dbus_int32_t parameter = 0;
+	stringstream ss;
+
+	if (this->isMessage (message, "sessionConfig")) {
+		if (this->started) {
+			this->callbacks.debug ("Ignoring sessionConfig; the connection has already started");
+		} else if (this->parseSettings (message) == -1) {
+			this->callbacks.error (_("Failed to obtain server and user for the session."));
+			this->finished = true;
+		} else {
+			this->started = true;
+			this->callbacks.debug ("Got the session settings over the dbus");
+			this->callbacks.write (NXCL_STARTING, _("Connection is starting..."));
+			this->startTheNXConnection();
+		}
+
+	} else if (this->isMessage (message, "sessionChoice")) {
+		if (getInt32Arg (message, parameter)) {
+			if (parameter < 0) {
+				// Start a new connection
+				this->nxclientlib.chooseNewSession();
+			} else if (!this->nxclientlib.chooseResumable (parameter)) {
+				ss << _("There is no session to resume numbered ") << parameter;
+				this->callbacks.error (ss.str());
+			}
+		}
+
+	} else if (this->isMessage (message, "terminateSession")) {
+		if (getInt32Arg (message, parameter)) {
+			ss << parameter;
+			this->callbacks.debug ("Terminating: " + ss.str());
+			if (parameter < 0) {
+				// No action, start a new connection
+				this->nxclientlib.chooseNewSession();
+			} else if (!this->nxclientlib.terminateSession (parameter)) {
+				ss.str("");
+				ss << _("There is no session to terminate numbered ") << parameter;
+				this->callbacks.error (ss.str());
+			}
+		}
+
+	} else {
+		return false;
+	}
+
+	if (dbus_message_get_type (message) == DBUS_MESSAGE_TYPE_METHOD_CALL
+	    && !dbus_message_get_no_reply (message)) {
+		DBusMessage * reply = dbus_message_new_method_return (message);
+		dbus_connection_send (this->conn, reply, NULL);
+		dbus_message_unref (reply);
+	}
+	return true;
+}
+
+void
+Nxcl::sendSignal (const char * member)
+{
+	if (this->conn == NULL) {
+		return;
+	}
+	DBusMessage *msg = dbus_message_new_signal (this->objectPath.c_str(),
+						    this->dbusSendInterface.c_str(),
+						    member);
+	dbus_connection_send (this->conn, msg, NULL);
+	dbus_message_unref (msg);
+}
+
 
 int
 Nxcl::receiveSettings (void)
 {
 	DBusMessage * message;
-	DBusMessageIter args;
-	char * parameter = NULL;
+	int rtn = -1;
 	bool settings_transferred = false;
-	stringstream ss;
-	int count = 0;
 
 	this->callbacks.debug ("receiveSettings called");
 
-	// loop listening for signals being emitted
 	while (settings_transferred == false) {
 
-		if (dbus_error_is_set(&this->error)) {
-			stringstream errmsg;
-			errmsg << "receiveSettings(): Got a dbus error '"
-			       << this->error.name << "': " << this->error.message;
-			this->callbacks.error (errmsg.str());
-			dbus_error_free (&this->error);
+		// Block until there's something to read; returns
+		// false if the connection has gone.
+		if (!dbus_connection_read_write (this->conn, -1)) {
+			this->callbacks.error ("receiveSettings(): Lost the dbus connection");
+			return -1;
 		}
 
-		// non blocking read of the next available message
-		dbus_connection_read_write(this->conn, 0);
-		message = dbus_connection_pop_message(this->conn);
-
-		// loop again if we haven't read a message
-		if (NULL == message) { 
-			//this->callbacks.debug ("receiveSettings(): No message yet, sleep a second.");
-			usleep(1000000);
-			continue;
+		while ((message = dbus_connection_pop_message (this->conn)) != NULL) {
+			if (!settings_transferred
+			    && dbus_message_is_signal (message, this->dbusMatchInterface.c_str(), "sessionConfig")) {
+				rtn = this->parseSettings (message);
+				settings_transferred = true;
+			} else {
+				this->callbacks.debug ("this message is not a sessionConfig signal");
+			}
+			dbus_message_unref (message);
 		}
+	}
+	this->callbacks.debug ("Got the session settings over the dbus\n");
+
+	return rtn;
+}
 
-		// check if the message is a signal from the
-		// correct interface and with the correct name
-		this->callbacks.debug ("call dbus_message_is_signal()");
-		if (dbus_message_is_signal (message, this->dbusMatchInterface.c_str(), "sessionConfig")) {
+int
+Nxcl::parseSettings (DBusMessage * message)
+{
+	DBusMessageIter args;
+	char * parameter = NULL;
+	stringstream ss;
+	int count = 0;
+
+	if (!dbus_message_iter_init(message, &args)) {
+		cerr << "Message has no arguments!\n";
+		return -1;
+	}
+	
+	if (DBUS_TYPE_STRING != dbus_message_iter_get_arg_type(&args)) {
+		cerr << "First argument is not a string!\n";
+	} else {
+		dbus_message_iter_get_basic(&args, &parameter);
+		ss.str("");
+		ss << parameter;
+		this->nxserver = ss.str();
+		count++;
+	}
 
-			if (!dbus_message_iter_init(message, &args)) {
-				cerr << "Message has no arguments!\n";
-				dbus_connection_flush (conn);
-				dbus_message_unref (message);
-				continue;
+	// read the rest of the parameters
+	int t;
+	while (dbus_message_iter_next (&args)) {
+		if (DBUS_TYPE_STRING == (t = dbus_message_iter_get_arg_type(&args))) {
+			dbus_message_iter_get_basic(&args, &parameter);
+			//cout << "Arg-" << count << ": " << parameter << endl;
+			ss.str("");
+			ss << parameter;
+			switch (count) {
+			case 2:
+				this->nxuser = ss.str();
+				break;
+			case 3:
+				this->nxpass = ss.str();
+				break;
+			case 4:
+				this->sessionData.sessionName = ss.str();
+				break;
+			case 5:
+				this->sessionData.sessionType = ss.str();
+				break;
+			case 8:
+				this->sessionData.linkType = ss.str();
+				break;
+			case 10:
+				this->sessionData.backingstore = ss.str();
+				break;
+			case 13:
+				this->sessionData.geometry = ss.str();
+				break;
+			case 14:
+				this->sessionData.keyboard = ss.str();
+				break;
+			case 15:
+				this->sessionData.kbtype = ss.str();
+				break;
+			case 17:
+				this->sessionData.agentServer = ss.str();
+				break;
+			case 18:
+				this->sessionData.agentUser = ss.str();
+				break;
+			case 19:
+				this->sessionData.agentPass = ss.str();
+				break;
+			case 21:
+				this->sessionData.key = ss.str();
+				break;
+			case 24:
+				this->sessionData.customCommand = ss.str();
+				break;
+			default:
+				this->callbacks.error ("ERROR: parameter type does not match its position in the message.");
+				break;
 			}
-			
-			if (DBUS_TYPE_STRING != dbus_message_iter_get_arg_type(&args)) {
-				cerr << "First argument is not a string!\n";
-			} else {
-				dbus_message_iter_get_basic(&args, &parameter);
-				ss.str("");
-				ss << parameter;
-				this->nxserver = ss.str();
-				count++;
+			count++;
+		} else if (t == DBUS_TYPE_INT32) {
+			int iparam = 0;
+			dbus_message_iter_get_basic(&args, &iparam);
+			switch (count) {
+			case 1:
+				this->nxport = iparam;
+				break;
+			case 6:
+				this->sessionData.cache = iparam;
+				break;
+			case 7:
+				this->sessionData.images = iparam;
+				break;
+			case 9:
+				this->sessionData.render = (iparam>0) ? true : false;
+				break;
+			case 11:
+				this->sessionData.imageCompressionMethod = iparam;
+				break;
+			case 12:
+				this->sessionData.imageCompressionLevel = iparam;
+				break;
+			case 16:
+				this->sessionData.media = (iparam>0) ? true : false;
+				break;
+			case 20:
+				this->sessionData.cups = iparam;
+				break;
+			case 22:
+				this->sessionData.encryption = (iparam>0) ? true : false;
+				break;
+			case 23:
+				this->sessionData.fullscreen = (iparam>0) ? true : false;
+				break;
+			case 25:
+				this->sessionData.virtualDesktop = (iparam>0) ? true : false;
+				break;
+			default:
+				this->callbacks.error ("ERROR: parameter type does not match its position in the message.");
+				break;
 			}
+			count++;
 
-			// read the rest of the parameters
-			int t;
-			while (dbus_message_iter_next (&args)) {
-				if (DBUS_TYPE_STRING == (t = dbus_message_iter_get_arg_type(&args))) {
-					dbus_message_iter_get_basic(&args, &parameter);
-					//cout << "Arg-" << count << ": " << parameter << endl;
-					ss.str("");
-					ss << parameter;
-					switch (count) {
-					case 2:
-						this->nxuser = ss.str();
-						break;
-					case 3:
-						this->nxpass = ss.str();
-						break;
-					case 4:
-						this->sessionData.sessionName = ss.str();
-						break;
-					case 5:
-						this->sessionData.sessionType = ss.str();
-						break;
-					case 8:
-						this->sessionData.linkType = ss.str();
-						break;
-					case 10:
-						this->sessionData.backingstore = ss.str();
-						break;
-					case 13:
-						this->sessionData.geometry = ss.str();
-						break;
-					case 14:
-						this->sessionData.keyboard = ss.str();
-						break;
-					case 15:
-						this->sessionData.kbtype = ss.str();
-						break;
-					case 17:
-						this->sessionData.agentServer = ss.str();
-						break;
-					case 18:
-						this->sessionData.agentUser = ss.str();
-						break;
-					case 19:
-						this->sessionData.agentPass = ss.str();
-						break;
-					case 21:
-						this->sessionData.key = ss.str();
-						break;
-					case 24:
-						this->sessionData.customCommand = ss.str();
-						break;
-					default:
-						this->callbacks.error ("ERROR: parameter type does not match its position in the message.");
-						break;
-					}
-					count++;
-				} else if (t == DBUS_TYPE_INT32) {
-					int iparam = 0;
-					dbus_message_iter_get_basic(&args, &iparam);
-					switch (count) {
-					case 1:
-						this->nxport = iparam;
-						break;
-					case 6:
-						this->sessionData.cache = iparam;
-						break;
-					case 7:
-						this->sessionData.images = iparam;
-						break;
-					case 9:
-						this->sessionData.render = (iparam>0) ? true : false;
-						break;
-					case 11:
-						this->sessionData.imageCompressionMethod = iparam;
-						break;
-					case 12:
-						this->sessionData.imageCompressionLevel = iparam;
-						break;
-					case 16:
-						this->sessionData.media = (iparam>0) ? true : false;
-						break;
-					case 20:
-						this->sessionData.cups = iparam;
-						break;
-					case 22:
-						this->sessionData.encryption = (iparam>0) ? true : false;
-						break;
-					case 23:
-						this->sessionData.fullscreen = (iparam>0) ? true : false;
-						break;
-					case 25:
-						this->sessionData.virtualDesktop = (iparam>0) ? true : false;
-						break;
-					default:
-						this->callbacks.error ("ERROR: parameter type does not match its position in the message.");
-						break;
-					}
-					count++;
-
-				} else {
-					this->callbacks.error ("ERROR: parameter is not string or int.");
-				}
-			}
-			settings_transferred = true;			
 		} else {
-			this->callbacks.debug ("this message is not a signal");
+			this->callbacks.error ("ERROR: parameter is not string or int.");
 		}
-
-		// Anything else required for cleanup?
-		dbus_connection_flush (this->conn);
-
-		// free the message
-		dbus_message_unref (message);
-
-	} // while()
-	this->callbacks.debug ("Got the session settings over the dbus\n");
+	}
 
 	if (this->nxserver.size() == 0 || this->nxuser.size() == 0) {
 		// We need at least these to be able to connect. Leave
@@ -468,6 +611,7 @@ Nxcl::startTheNXConnection (void)
 	/* If we have session info, start up the connection */
 	if (this->sessionData.key.size() == 0) { // Shouldn't need this->sessionData.encryption here.
 		this->callbacks.error (_("No key supplied! Please fix your client to send a key via dbus!"));
+		this->finished = true;
 	} else {
 		this->nxclientlib.invokeNXSSH("supplied",
 					      this->nxserver,
@@ -480,31 +624,31 @@ void
 Nxcl::haveResumableSessions (list<NXResumeData> resumable)
 {
 	this->callbacks.debug ("haveResumableSessions Called");
-	// Send the list to the calling client:
+	// Send the list to the calling client. Its sessionChoice or
+	// terminateSession reply comes in to handleMessage(), and
+	// nxclientlib holds the conversation with the server until
+	// then.
 	this->sendResumeList (resumable);
-	this->callbacks.debug ("sent the resume list, about to receiveStartInstruction");
-	// Wait (and block) until we are told whether to resume one of
-	// the sessions or start a new one.
-	this->receiveStartInstruction();
-	this->callbacks.debug ("receiveStartInstruction() returned.");
+	this->callbacks.debug ("sent the resume list");
 }
 
 void
 Nxcl::noResumableSessions (void)
 {
 	this->callbacks.debug ("noResumableSessions Called");
-	DBusMessage *msg = dbus_message_new_signal ("/org/freenx/nxcl/dbus/AvailableSession",
-						    this->dbusSendInterface.c_str(),
-						    "Connecting");
-
-	dbus_connection_send (this->conn, msg, NULL);
-	dbus_message_unref (msg);
+	this->sendSignal ("Connecting");
 }
 
 void
 Nxcl::sendResumeList (list<NXResumeData>& resumable)
 {
 	this->callbacks.debug ("sendResumeList called, will send on " + this->dbusSendInterface + " interface");
+	if (this->status != NULL) {
+		this->status->sessions (this->dbusNum, resumable);
+	}
+	if (this->conn == NULL) {
+		return;
+	}
 	list<NXResumeData>::iterator it;
 	for (it=resumable.begin(); it!=resumable.end(); it++) {
 
@@ -513,9 +657,9 @@ Nxcl::sendResumeList (list<NXResumeData>& resumable)
 		DBusMessage *message;
 
 		/* Create a new signal "AvailableSession" on the
-		 * "org.freenx.nxcl.nxcl" interface, from the object
-		 * "/org/freenx/nxcl/dbus/AvailableSession". */
-		message = dbus_message_new_signal ("/org/freenx/nxcl/dbus/AvailableSession",
+		 * "org.freenx.nxcl.nxcl" interface, from this
+		 * session's object. */
+		message = dbus_message_new_signal (this->objectPath.c_str(),
 						   this->dbusSendInterface.c_str(),
 						   "AvailableSession");
 
@@ -544,31 +688,27 @@ Nxcl::sendResumeList (list<NXResumeData>& resumable)
 		dbus_message_unref (message);
 	}
 
-	DBusMessage *complete = dbus_message_new_signal ("/org/freenx/nxcl/dbus/AvailableSession",
-						         this->dbusSendInterface.c_str(),
-							 "NoMoreAvailable");
-
 	this->callbacks.debug ("About to send the finishup message");
-	dbus_connection_send (this->conn, complete, NULL);
+	this->sendSignal ("NoMoreAvailable");
 	this->callbacks.debug ("Sent the finishup message");
-	dbus_message_unref (complete);
 }
 
 void
 Nxcl::serverCapacityReached (void)
 {
-	DBusMessage *msg = dbus_message_new_signal ("/org/freenx/nxcl/dbus/AvailableSession",
-						    this->dbusSendInterface.c_str(),
-						    "ServerCapacityReached");
-	
-	dbus_connection_send (this->conn, msg, NULL);
-	dbus_message_unref (msg);
+	this->sendSignal ("ServerCapacityReached");
 }
 
 void
 Nxcl::sendDbusInfoMsg (string& info)
 {
-	DBusMessage *msg = dbus_message_new_signal ("/org/freenx/nxcl/dbus/SessionStatus",
+	if (this->status != NULL) {
+		this->status->info (this->dbusNum, 0, info);
+	}
+	if (this->conn == NULL) {
+		return;
+	}
+	DBusMessage *msg = dbus_message_new_signal (this->objectPath.c_str(),
 						    this->dbusSendInterface.c_str(),
 						    "InfoMessage");
 
@@ -587,7 +727,13 @@ Nxcl::sendDbusInfoMsg (string& info)
 void
 Nxcl::sendDbusInfoMsg (int num, string& info)
 {
-	DBusMessage *msg = dbus_message_new_signal ("/org/freenx/nxcl/dbus/SessionStatus",
+	if (this->status != NULL) {
+		this->status->info (this->dbusNum, num, info);
+	}
+	if (this->conn == NULL) {
+		return;
+	}
+	DBusMessage *msg = dbus_message_new_signal (this->objectPath.c_str(),
 						    this->dbusSendInterface.c_str(),
 						    "InfoMessage");
 
@@ -607,7 +753,13 @@ Nxcl::sendDbusInfoMsg (int num, string& info)
 void
 Nxcl::sendDbusErrorMsg (string& errorMsg)
 {
-	DBusMessage *msg = dbus_message_new_signal ("/org/freenx/nxcl/dbus/SessionStatus",
+	if (this->status != NULL) {
+		this->status->error (this->dbusNum, errorMsg);
+	}
+	if (this->conn == NULL) {
+		return;
+	}
+	DBusMessage *msg = dbus_message_new_signal (this->objectPath.c_str(),
 						    this->dbusSendInterface.c_str(),
 						    "ErrorMessage");
 
@@ -624,70 +776,28 @@ Nxcl::sendDbusErrorMsg (string& errorMsg)
 }
 
 void
-Nxcl::receiveStartInstruction (void)
+Nxcl::traceEvent (const NXTraceEvent& event)
 {
-	DBusMessage * message;
-	DBusMessageIter args;
-	dbus_int32_t parameter = 0;
-	bool instruction_received = false;
-	stringstream ss;
-
-	this->callbacks.debug ("receiveStartInstruction() called");
-
-	// loop listening for signals being emitted
-	while (instruction_received == false) {
-		
-		// non blocking read of the next available message
-		dbus_connection_read_write(this->conn, 0);
-		message = dbus_connection_pop_message(this->conn);
-
-		// loop again if we haven't read a message
-		if (NULL == message) { 
-			usleep(1000000);
-			continue;
-		}
-
-		// check if the message is a signal from the
-		// correct interface and with the correct name
-		if (dbus_message_is_signal (message, this->dbusMatchInterface.c_str(), "sessionChoice")) {
-			// read the parameters
-			if (!dbus_message_iter_init(message, &args))
-				cerr << "Message has no arguments!\n"; 
-			else if (DBUS_TYPE_INT32 != dbus_message_iter_get_arg_type(&args))
-				cerr << "Argument is not int32!\n";
-			else {
-				dbus_message_iter_get_basic(&args, &parameter);
-				instruction_received = true;
-				if (parameter < 0) {
-					// No action, start a new connection
-				} else {
-					this->nxclientlib.chooseResumable (parameter);
-				}
-			}
-
-		} else if (dbus_message_is_signal (message, this->dbusMatchInterface.c_str(), "terminateSession")) {
-			// read the parameters
-			if (!dbus_message_iter_init(message, &args))
-				cerr << "Message has no arguments!\n"; 
-			else if (DBUS_TYPE_INT32 != dbus_message_iter_get_arg_type(&args))
-				cerr << "Argument is not int32!\n";
-			else {
-				dbus_message_iter_get_basic(&args, &parameter);
-				ss.str("");
-				ss << parameter;
-				this->callbacks.debug ("Terminating: " + ss.str());
-				instruction_received = true;
-				if (parameter < 0) {
-					// No action, start a new connection
-				} else {
-					this->nxclientlib.terminateSession (parameter);
-				}
-			}
-		}
-		dbus_connection_flush (this->conn);
-		dbus_message_unref (message);
+	if (this->status != NULL) {
+		this->status->stage (this->dbusNum, event);
+	}
+	if (!this->traceFile.is_open()) {
+		return;
 	}
+	// One write per line, flushed, so that lines from several
+	// sessions don't get mixed up.
+	this->traceFile << NXTrace::json (event,
+					  this->nxclientlib.getTrace().getOrigin(),
+					  this->dbusNum) + "\n";
+	this->traceFile.flush();
+}
 
+void
+Nxcl::linkMeasured (const NXLinkStats& stats)
+{
+	if (this->status != NULL) {
+		this->status->link (this->dbusNum, stats);
+	}
 }
 
 void
@@ -29,6 +29,7 @@
 
 #include "nxdata.h"
 #include "../lib/nxclientlib.h"
+#include "../lib/nxstatusserver.h"
 
 /* This define is required for slightly older versions of dbus as
  * found, for example, in Ubuntu 6.06. */
@@ -54,6 +55,8 @@ namespace nxcl
 		virtual void sendDbusInfoMsg (string&) {}
 		virtual void sendDbusInfoMsg (int, string&) {}
 		virtual void sendDbusErrorMsg (string&) {}
+		virtual void traceEvent (const NXTraceEvent&) {}
+		virtual void linkMeasured (const NXLinkStats&) {}
 	};
 
 	class NxclCallbacks : public NXClientLibExternalCallbacks
@@ -135,6 +138,16 @@ namespace nxcl
 		 * true).
 		 */
 		void serverCapacitySignal (void);
+		/*!
+		 * Passes each stage of the connection on to \see
+		 * Nxcl::traceEvent.
+		 */
+		void traceSignal (const NXTraceEvent& event);
+		/*!
+		 * Passes the link measurements on to \see
+		 * Nxcl::linkMeasured.
+		 */
+		void linkMeasuredSignal (const NXLinkStats& stats);
 
 		/*!
 		 * Accessor function to set a pointer to the parent Nxcl object.
@@ -174,12 +187,38 @@ namespace nxcl
 		 * connection (used as a suffix for interface names).
 		 */
 		void setupDbus (int id);
+		/*!
+		 * \brief Use the connection \arg c, shared with other
+		 * Nxcl objects, for session number \arg id.
+		 *
+		 * No bus name is requested; the owner of the
+		 * connection (see NxclDaemon) does that, and passes
+		 * incoming messages to \see handleMessage().
+		 */
+		void setupDbus (DBusConnection * c, int id);
+		/*!
+		 * \brief Act on a message from the client of this
+		 * session.
+		 *
+		 * The messages are the signals 'sessionConfig',
+		 * 'sessionChoice' and 'terminateSession' on the listen
+		 * interface, or method calls of the same names on
+		 * org.freenx.nxcl.session addressed to this session's
+		 * object path. sessionConfig starts the connection;
+		 * the other two answer the list of resumable sessions
+		 * sent by \see haveResumableSessions.
+		 *
+		 * \return true if the message was for this session.
+		 */
+		bool handleMessage (DBusMessage * message);
 		/*!
 		 * \brief Wait for a dbus message containing session settings.
 		 *
-		 * This waits for a dbus signal message called
-		 * 'sessionConfig' to come in on the listen interface,
+		 * This blocks until a dbus signal message called
+		 * 'sessionConfig' comes in on the listen interface,
 		 * then sets \see sessionData based on its contents.
+		 * It is for programs which drive one Nxcl without an
+		 * NxclDaemon.
 		 *
 		 * \return 0 if settings received ok, -1 if we didn't
 		 * receive at least the nxserver host and the nxuser
@@ -203,6 +242,23 @@ namespace nxcl
 		// Accessors
 		//@{
 		NXClientLib* getNXClientLib (void) { return &(this->nxclientlib); }
+		int getDbusNum (void) { return this->dbusNum; }
+		/*!
+		 * The object path this session's messages come from,
+		 * /org/freenx/nxcl/sessionN.
+		 */
+		string getObjectPath (void) { return this->objectPath; }
+		/*!
+		 * True once the connection has finished, or couldn't
+		 * be started.
+		 */
+		bool getFinished (void) { return this->finished || this->nxclientlib.getIsFinished(); }
+		/*!
+		 * Also send what is sent over dbus, the stages of the
+		 * connection and the link measurements to the
+		 * subscribers of \arg s (see nxstatus.h).
+		 */
+		void setStatusServer (NXStatusServer * s) { this->status = s; }
 		//@}
 
 		// Public Slots
@@ -246,6 +302,16 @@ namespace nxcl
 		 * Send an error message via dbus.
 		 */
 		void sendDbusErrorMsg (string& errorMsg);
+		/*!
+		 * If the environment variable NXCL_TRACE names a
+		 * file, append \arg event to it as a line of JSON
+		 * (see NXTrace::json()), with this session's number.
+		 */
+		void traceEvent (const NXTraceEvent& event);
+		/*!
+		 * Publish \arg stats on the status channel.
+		 */
+		void linkMeasured (const NXLinkStats& stats);
 		//@}
 
 		/*!
@@ -260,6 +326,31 @@ namespace nxcl
 		 * This is called by the constructors.
 		 */
 		void initiate (void);
+		/*!
+		 * Set up the interface names and object path from
+		 * dbusNum and add the match rule for the client's
+		 * signals. Called by both setupDbus methods once
+		 * conn is set.
+		 */
+		void setupInterfaces (void);
+		/*!
+		 * Set \see sessionData from a 'sessionConfig' message.
+		 *
+		 * \return 0 if we got at least the nxserver host and
+		 * the nxuser name, -1 otherwise.
+		 */
+		int parseSettings (DBusMessage * message);
+		/*!
+		 * Is \arg message a \arg member signal from our
+		 * client, or a \arg member method call to our object
+		 * path?
+		 */
+		bool isMessage (DBusMessage * message, const char * member);
+		/*!
+		 * Send a signal called \arg member from our object
+		 * path on the send interface, with no arguments.
+		 */
+		void sendSignal (const char * member);
 		/*!
 		 * Send the resumable sessions as dbus messages. One
 		 * message (called "AvailableSession") is sent for
@@ -274,18 +365,6 @@ namespace nxcl
 		 *
 		 */
 		void sendResumeList (list<NXResumeData>& resumable);
-		/*!
-		 * Wait for a message on the dbus interface to tell us
-		 * which of the resumable sessions available on the NX
-		 * server we should start. Call
-		 * nxclientlib.chooseResumable() or
-		 * nxclientlib.terminateSession based on the contents
-		 * of the received message.
-		 *
-		 * Called by \see haveResumableSessions.
-		 */
-		void receiveStartInstruction (void);
-
 		/*!
 		 * The nxclientlib object whose methods will negotiate
 		 * the NX session.
@@ -326,6 +405,19 @@ namespace nxcl
 		 * The DBUS interface we'll send on.
 		 */
 		string dbusSendInterface;
+		/*!
+		 * The object path our signals come from.
+		 */
+		string objectPath;
+		/*!
+		 * Set once the settings have been received and the
+		 * connection started.
+		 */
+		bool started;
+		/*!
+		 * Set if the connection couldn't be started.
+		 */
+		bool finished;
 		/*!
 		 * Holds the username for the connection to the NX
 		 * Server.
@@ -358,6 +450,15 @@ namespace nxcl
 		 * Colour depth of the screen.
 		 */
 		int displayDepth;
+		/*!
+		 * Where the stages of the connection are written, if
+		 * NXCL_TRACE is set.
+		 */
+		ofstream traceFile;
+		/*!
+		 * The status channel, or NULL
+		 */
+		NXStatusServer * status;
 	};
 
 } // namespace
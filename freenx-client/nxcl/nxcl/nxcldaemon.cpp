@@ -0,0 +1,437 @@
+/***************************************************************************
+                        nxcl: The NXCL dbus daemon.
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "../config.h"
+#include "nxclientlib_i18n.h"
+#include "nxclientlib.h"
+#include "nxcldaemon.h"
+
+/* This define is required for slightly older versions of dbus as
+ * found, for example, in Ubuntu 6.06. */
+#define DBUS_API_SUBJECT_TO_CHANGE 1
+extern "C" {
+#include <dbus/dbus.h>
+#include <time.h>
+#include <stdlib.h>
+}
+
+using namespace nxcl;
+using namespace std;
+
+/*!
+ * The functions given to libdbus, which pass the calls on to the
+ * NxclDaemon in data.
+ */
+//@{
+extern "C" {
+	static dbus_bool_t addWatchFunction (DBusWatch * w, void * data)
+	{
+		return static_cast<NxclDaemon*>(data)->addWatch (w);
+	}
+	static void removeWatchFunction (DBusWatch * w, void * data)
+	{
+		static_cast<NxclDaemon*>(data)->removeWatch (w);
+	}
+	static void toggleWatchFunction (DBusWatch * w, void * data)
+	{
+		static_cast<NxclDaemon*>(data)->toggleWatch (w);
+	}
+	static dbus_bool_t addTimeoutFunction (DBusTimeout * t, void * data)
+	{
+		return static_cast<NxclDaemon*>(data)->addTimeout (t);
+	}
+	static void removeTimeoutFunction (DBusTimeout * t, void * data)
+	{
+		static_cast<NxclDaemon*>(data)->removeTimeout (t);
+	}
+	static void toggleTimeoutFunction (DBusTimeout * t, void * data)
+	{
+		static_cast<NxclDaemon*>(data)->toggleTimeout (t);
+	}
+	static DBusHandlerResult filterFunction (DBusConnection * c, DBusMessage * m, void * data)
+	{
+		return static_cast<NxclDaemon*>(data)->filter (m);
+	}
+}
+//@}
+
+/*!
+ * The monotonic clock in milliseconds, for the dbus timeouts.
+ */
+static long long
+nowMs (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return static_cast<long long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*!
+ * Implementation of the NxclDaemon class
+ */
+//@{
+NxclDaemon::NxclDaemon () :
+	conn(NULL),
+	quitting(false),
+	exitWhenIdle(false)
+{
+	dbus_error_init (&this->error);
+}
+
+NxclDaemon::~NxclDaemon ()
+{
+	map<int, Nxcl*>::iterator i;
+	for (i = this->sessions.begin(); i != this->sessions.end(); i++) {
+		delete i->second;
+	}
+	if (this->conn != NULL) {
+		dbus_connection_remove_filter (this->conn, filterFunction, this);
+		dbus_connection_set_watch_functions (this->conn, NULL, NULL, NULL, NULL, NULL);
+		dbus_connection_set_timeout_functions (this->conn, NULL, NULL, NULL, NULL, NULL);
+		dbus_connection_unref (this->conn);
+	}
+}
+
+bool
+NxclDaemon::connectDbus (void)
+{
+	this->conn = dbus_bus_get (DBUS_BUS_SESSION, &this->error);
+	if (!this->conn) {
+		cerr << "Failed to connect to the D-BUS daemon: "
+		     << this->error.message << ".\n";
+		dbus_error_free (&this->error);
+		return false;
+	}
+
+	if (!dbus_connection_add_filter (this->conn, filterFunction, this, NULL)
+	    || !dbus_connection_set_watch_functions (this->conn,
+						     addWatchFunction,
+						     removeWatchFunction,
+						     toggleWatchFunction,
+						     this, NULL)
+	    || !dbus_connection_set_timeout_functions (this->conn,
+						       addTimeoutFunction,
+						       removeTimeoutFunction,
+						       toggleTimeoutFunction,
+						       this, NULL)) {
+		cerr << "Failed to hook the D-BUS connection into the event loop.\n";
+		return false;
+	}
+	return true;
+}
+
+bool
+NxclDaemon::requestName (const string& name)
+{
+	int ret = dbus_bus_request_name (this->conn, name.c_str(),
+					 DBUS_NAME_FLAG_REPLACE_EXISTING,
+					 &this->error);
+	if (dbus_error_is_set(&this->error)) {
+		cerr << "Name Error (" << this->error.message << ")\n";
+		dbus_error_free(&this->error);
+	}
+	return (DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER == ret);
+}
+
+bool
+NxclDaemon::listenForStatus (void)
+{
+	const char * env = getenv ("NXCL_STATUS");
+	string path = (env != NULL) ? env : NXStatusServer::defaultPath();
+	if (path == "none") {
+		return true;
+	}
+	if (!this->status.listen (path, &this->loop)) {
+		cerr << "NXCL_ERROR> Couldn't make the status socket " << path << endl;
+		return false;
+	}
+	return true;
+}
+
+void
+NxclDaemon::listenForSessions (void)
+{
+	dbus_bus_add_match (this->conn,
+			    "type='signal',interface='" NXCL_DAEMON_NAME "'",
+			    &this->error);
+	if (dbus_error_is_set(&this->error)) {
+		cerr << "Match Error (" << this->error.message << ")\n";
+		dbus_error_free(&this->error);
+	}
+}
+
+Nxcl*
+NxclDaemon::openSession (int id)
+{
+	if (this->sessions.find (id) != this->sessions.end()) {
+		return NULL;
+	}
+
+	Nxcl * nxcl = new Nxcl (id);
+	nxcl->getNXClientLib()->setEventLoop (&this->loop);
+	if (this->status.isListening()) {
+		nxcl->setStatusServer (&this->status);
+	}
+	nxcl->setupDbus (this->conn, id);
+	this->sessions[id] = nxcl;
+
+	// Send a message to the frontend client to say we are up and running
+	nxcl->callbacks.write (NXCL_ALIVE, _("nxcl is up and running"));
+	return nxcl;
+}
+
+void
+NxclDaemon::run (void)
+{
+	this->quitting = false;
+	while (!this->quitting) {
+		this->dispatch();
+		this->reapSessions();
+		if (this->quitting || (this->exitWhenIdle && this->sessions.empty())) {
+			break;
+		}
+		if (this->loop.runOnce (this->nextTimeout()) < 0) {
+			break;
+		}
+		this->runTimeouts();
+	}
+	dbus_connection_flush (this->conn);
+}
+
+void
+NxclDaemon::dispatch (void)
+{
+	while (dbus_connection_get_dispatch_status (this->conn) == DBUS_DISPATCH_DATA_REMAINS) {
+		dbus_connection_dispatch (this->conn);
+	}
+}
+
+void
+NxclDaemon::reapSessions (void)
+{
+	map<int, Nxcl*>::iterator i = this->sessions.begin();
+	while (i != this->sessions.end()) {
+		if (!i->second->getFinished()) {
+			i++;
+			continue;
+		}
+		i->second->callbacks.write (NXCL_FINISHED, _("Program finished."));
+		this->status.finished (i->first);
+		delete i->second;
+		this->sessions.erase (i++);
+	}
+}
+
+DBusHandlerResult
+NxclDaemon::filter (DBusMessage * message)
+{
+	if (dbus_message_is_signal (message, DBUS_INTERFACE_LOCAL, "Disconnected")) {
+		this->quit();
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+
+	if (dbus_message_is_signal (message, NXCL_DAEMON_NAME, "openSession")
+	    || dbus_message_is_method_call (message, NXCL_DAEMON_NAME, "openSession")) {
+		dbus_int32_t id = -1;
+		dbus_message_get_args (message, NULL,
+				       DBUS_TYPE_INT32, &id,
+				       DBUS_TYPE_INVALID);
+		Nxcl * nxcl = NULL;
+		if (id >= 0) {
+			nxcl = this->openSession (id);
+		}
+		if (dbus_message_get_type (message) == DBUS_MESSAGE_TYPE_METHOD_CALL
+		    && !dbus_message_get_no_reply (message)) {
+			DBusMessage * reply;
+			if (nxcl == NULL) {
+				reply = dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS,
+								"No session number, or that session is in use");
+			} else {
+				string path = nxcl->getObjectPath();
+				const char * p = path.c_str();
+				reply = dbus_message_new_method_return (message);
+				dbus_message_append_args (reply,
+							  DBUS_TYPE_OBJECT_PATH, &p,
+							  DBUS_TYPE_INVALID);
+			}
+			dbus_connection_send (this->conn, reply, NULL);
+			dbus_message_unref (reply);
+		}
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+
+	map<int, Nxcl*>::iterator i;
+	for (i = this->sessions.begin(); i != this->sessions.end(); i++) {
+		if (i->second->handleMessage (message)) {
+			return DBUS_HANDLER_RESULT_HANDLED;
+		}
+	}
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+dbus_bool_t
+NxclDaemon::addWatch (DBusWatch * watch)
+{
+	int fd = dbus_watch_get_unix_fd (watch);
+	this->watches[fd].push_back (watch);
+	this->updateWatch (fd);
+	return TRUE;
+}
+
+void
+NxclDaemon::removeWatch (DBusWatch * watch)
+{
+	int fd = dbus_watch_get_unix_fd (watch);
+	this->watches[fd].remove (watch);
+	this->updateWatch (fd);
+}
+
+void
+NxclDaemon::toggleWatch (DBusWatch * watch)
+{
+	this->updateWatch (dbus_watch_get_unix_fd (watch));
+}
+
+void
+NxclDaemon::updateWatch (int fd)
+{
+	short events = 0;
+	list<DBusWatch*>& l = this->watches[fd];
+	list<DBusWatch*>::iterator i;
+	for (i = l.begin(); i != l.end(); i++) {
+		if (!dbus_watch_get_enabled (*i)) {
+			continue;
+		}
+		unsigned int flags = dbus_watch_get_flags (*i);
+		if (flags & DBUS_WATCH_READABLE) { events |= POLLIN; }
+		if (flags & DBUS_WATCH_WRITABLE) { events |= POLLOUT; }
+	}
+	if (l.empty()) {
+		this->watches.erase (fd);
+	}
+	this->loop.setWatch (fd, events, this);
+}
+
+void
+NxclDaemon::fdReadySignal (int fd, short events)
+{
+	map<int, list<DBusWatch*> >::iterator w = this->watches.find (fd);
+	if (w == this->watches.end()) {
+		return;
+	}
+	// Handling one watch may remove the others.
+	list<DBusWatch*> l = w->second;
+	list<DBusWatch*>::iterator i;
+	for (i = l.begin(); i != l.end(); i++) {
+		w = this->watches.find (fd);
+		if (w == this->watches.end()) {
+			break;
+		}
+		list<DBusWatch*>::iterator j;
+		for (j = w->second.begin(); j != w->second.end() && *j != *i; j++) {}
+		if (j == w->second.end() || !dbus_watch_get_enabled (*i)) {
+			continue;
+		}
+		unsigned int want = dbus_watch_get_flags (*i);
+		unsigned int flags = 0;
+		if ((events & POLLIN) && (want & DBUS_WATCH_READABLE)) { flags |= DBUS_WATCH_READABLE; }
+		if ((events & POLLOUT) && (want & DBUS_WATCH_WRITABLE)) { flags |= DBUS_WATCH_WRITABLE; }
+		if (events & POLLHUP) { flags |= DBUS_WATCH_HANGUP; }
+		if (events & POLLERR) { flags |= DBUS_WATCH_ERROR; }
+		if (flags != 0) {
+			dbus_watch_handle (*i, flags);
+		}
+	}
+}
+
+dbus_bool_t
+NxclDaemon::addTimeout (DBusTimeout * timeout)
+{
+	this->timeouts[timeout] = -1;
+	this->toggleTimeout (timeout);
+	return TRUE;
+}
+
+void
+NxclDaemon::removeTimeout (DBusTimeout * timeout)
+{
+	this->timeouts.erase (timeout);
+}
+
+void
+NxclDaemon::toggleTimeout (DBusTimeout * timeout)
+{
+	if (dbus_timeout_get_enabled (timeout)) {
+		this->timeouts[timeout] = nowMs() + dbus_timeout_get_interval (timeout);
+	} else {
+		this->timeouts[timeout] = -1;
+	}
+}
+
+int
+NxclDaemon::nextTimeout (void)
+{
+	long long next = -1;
+	map<DBusTimeout*, long long>::iterator i;
+	for (i = this->timeouts.begin(); i != this->timeouts.end(); i++) {
+		if (i->second >= 0 && (next < 0 || i->second < next)) {
+			next = i->second;
+		}
+	}
+	long long now = nowMs();
+	map<int, Nxcl*>::iterator s;
+	for (s = this->sessions.begin(); s != this->sessions.end(); s++) {
+		int w = s->second->getNXClientLib()->getTimeout();
+		if (w >= 0 && (next < 0 || now + w < next)) {
+			next = now + w;
+		}
+	}
+	if (next < 0) {
+		return -1;
+	}
+	long long wait = next - now;
+	return (wait > 0) ? static_cast<int>(wait) : 0;
+}
+
+void
+NxclDaemon::runTimeouts (void)
+{
+	long long now = nowMs();
+	list<DBusTimeout*> due;
+	map<DBusTimeout*, long long>::iterator i;
+	for (i = this->timeouts.begin(); i != this->timeouts.end(); i++) {
+		if (i->second >= 0 && i->second <= now) {
+			due.push_back (i->first);
+		}
+	}
+	list<DBusTimeout*>::iterator t;
+	for (t = due.begin(); t != due.end(); t++) {
+		// An earlier handler may have removed it.
+		i = this->timeouts.find (*t);
+		if (i == this->timeouts.end()) {
+			continue;
+		}
+		// dbus timeouts repeat until removed or disabled.
+		i->second = now + dbus_timeout_get_interval (*t);
+		dbus_timeout_handle (*t);
+	}
+
+	// The sessions' own (login pipelining) timeouts
+	map<int, Nxcl*>::iterator s;
+	for (s = this->sessions.begin(); s != this->sessions.end(); s++) {
+		s->second->getNXClientLib()->runTimeouts();
+	}
+}
+//@}
@@ -0,0 +1,196 @@
+/* -*-c++-*- */
+/***************************************************************************
+                        nxcl: The NXCL dbus daemon.
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*!
+ * \file nxcldaemon.h This file contains the definition of the
+ * NxclDaemon class, which drives one or more Nxcl sessions and their
+ * shared dbus connection from a single event loop.
+ *
+ * See main.cpp for general notes.
+ */
+
+#ifndef _NXCLDAEMON_H_
+#define _NXCLDAEMON_H_ 1
+
+#include <map>
+#include <list>
+#include "notQt.h"
+#include "nxcl.h"
+#include "nxstatusserver.h"
+
+/*!
+ * The bus name requested by "nxcl --multi", which is also the
+ * interface of its openSession signal and method.
+ */
+#define NXCL_DAEMON_NAME "org.freenx.nxcl.daemon"
+
+using namespace std;
+
+namespace nxcl
+{
+	/*!
+	 * NxclDaemon owns the connection to the dbus daemon and a
+	 * notQEventLoop. The connection's file descriptors are
+	 * watched by the same loop as the nxssh and nxproxy
+	 * processes of all the sessions (using
+	 * dbus_connection_set_watch_functions), so the program
+	 * sleeps until either the bus or one of the processes has
+	 * something for it, and settings or a session choice are
+	 * acted upon as soon as they arrive.
+	 *
+	 * Each session is an Nxcl object, numbered as in the single
+	 * session nxcl: it listens to org.freenx.nxcl.clientN, sends
+	 * on org.freenx.nxcl.nxclN and its signals come from the
+	 * object path /org/freenx/nxcl/sessionN.
+	 */
+	class NxclDaemon : public notQWatchCallbacks
+	{
+	public:
+		NxclDaemon();
+		~NxclDaemon();
+
+		/*!
+		 * Connect to the session bus and hook the
+		 * connection into the event loop.
+		 *
+		 * \return false if we couldn't connect.
+		 */
+		bool connectDbus (void);
+		/*!
+		 * Request \arg name on the bus.
+		 *
+		 * \return false if someone else has it.
+		 */
+		bool requestName (const string& name);
+		/*!
+		 * Make the status socket (see nxstatus.h) at
+		 * $NXCL_STATUS, or at NXStatusServer::defaultPath()
+		 * if that isn't set. NXCL_STATUS=none turns it off.
+		 *
+		 * \return false if it couldn't be made.
+		 */
+		bool listenForStatus (void);
+		/*!
+		 * Listen for openSession signals on the
+		 * NXCL_DAEMON_NAME interface (openSession method
+		 * calls need no match rule), so that clients can ask
+		 * for sessions once run() has started.
+		 */
+		void listenForSessions (void);
+		/*!
+		 * Create session number \arg id and tell its client
+		 * that nxcl is up and running.
+		 *
+		 * \return the session, or NULL if there is already a
+		 * session with that number.
+		 */
+		Nxcl* openSession (int id);
+		/*!
+		 * If true, run() returns once the last session has
+		 * finished. This is how the single session nxcl
+		 * works.
+		 */
+		void setExitWhenIdle (bool exit) { this->exitWhenIdle = exit; }
+		/*!
+		 * Dispatch dbus messages and process events until
+		 * quit() is called or, see setExitWhenIdle(), there
+		 * are no more sessions.
+		 */
+		void run (void);
+		void quit (void) { this->quitting = true; }
+
+		/*!
+		 * Called by the event loop when one of the dbus
+		 * connection's descriptors is ready.
+		 */
+		void fdReadySignal (int fd, short events);
+
+		/*!
+		 * The dbus watch and timeout functions. These are
+		 * called (through static functions in nxcldaemon.cpp)
+		 * by libdbus.
+		 */
+		//@{
+		dbus_bool_t addWatch (DBusWatch * watch);
+		void removeWatch (DBusWatch * watch);
+		void toggleWatch (DBusWatch * watch);
+		dbus_bool_t addTimeout (DBusTimeout * timeout);
+		void removeTimeout (DBusTimeout * timeout);
+		void toggleTimeout (DBusTimeout * timeout);
+		//@}
+		/*!
+		 * The connection's message filter. Hands each
+		 * message to the session it is for.
+		 */
+		DBusHandlerResult filter (DBusMessage * message);
+
+	private:
+		/*!
+		 * Tell the event loop which events we want on \arg
+		 * fd, from the enabled watches on it.
+		 */
+		void updateWatch (int fd);
+		/*!
+		 * Milliseconds until the next dbus timeout is due,
+		 * or -1 if there are none.
+		 */
+		int nextTimeout (void);
+		/*!
+		 * Handle the dbus timeouts which are due.
+		 */
+		void runTimeouts (void);
+		/*!
+		 * Pass on all the messages which libdbus has queued.
+		 */
+		void dispatch (void);
+		/*!
+		 * Delete the sessions which have finished.
+		 */
+		void reapSessions (void);
+
+		DBusConnection * conn;
+		DBusError error;
+		/*!
+		 * Watches the dbus connection and all the sessions'
+		 * processes.
+		 */
+		notQEventLoop loop;
+		/*!
+		 * libdbus may have a read and a write watch on one
+		 * descriptor, so they are kept by descriptor.
+		 */
+		map<int, list<DBusWatch*> > watches;
+		/*!
+		 * The dbus timeouts, and when each is due (in
+		 * milliseconds on the monotonic clock), or -1 if it
+		 * is disabled.
+		 */
+		map<DBusTimeout*, long long> timeouts;
+		/*!
+		 * The sessions, by number.
+		 */
+		map<int, Nxcl*> sessions;
+		/*!
+		 * The status channel, shared by all the sessions
+		 */
+		NXStatusServer status;
+		bool quitting;
+		bool exitWhenIdle;
+	};
+
+} // namespace
+
+#endif // ifndef _NXCLDAEMON_H_
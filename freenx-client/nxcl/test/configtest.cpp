@@ -0,0 +1,378 @@
+/***************************************************************************
+   configtest.cpp - Read the connection files in nxs/ with
+                    NXConfigParser, checking the settings and timing it
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Each file is parsed in one go, a byte at a time and in chunks of
+ * random sizes, which must all give the same settings. The settings
+ * must also match the "expect field=value" lines in the file's
+ * leading comment; see fields() for the names. A few awkward bits of
+ * XML which aren't in any of the files are tried first.
+ *
+ * Each file is then parsed over and over, with NXConfigParser and
+ * the way qtnx used to do it (a QXmlAttributes-like list for every
+ * element, then a compare against each key we know), to time them.
+ *
+ * Usage: configtest [iterations] file.nxs...
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <stdlib.h>
+#include <ctype.h>
+#include <sys/time.h>
+
+#include "nxconfigparser.h"
+
+using namespace std;
+using namespace nxcl;
+
+ofstream debugLogFile;
+
+static double now (void)
+{
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static string str (int i)
+{
+	stringstream ss;
+	ss << i;
+	return ss.str();
+}
+
+/*!
+ * The settings in \arg d, by field name.
+ */
+static map<string, string> fields (const NXConfigData& d)
+{
+	map<string, string> f;
+	f["serverHost"] = d.serverHost;
+	f["serverPort"] = str (d.serverPort);
+	f["sessionUser"] = d.sessionUser;
+	f["sessionName"] = d.sessionName;
+	f["sessionType"] = d.sessionType;
+	f["cache"] = str (d.cache);
+	f["images"] = str (d.images);
+	f["linkType"] = d.linkType;
+	f["render"] = str (d.render);
+	f["imageCompressionMethod"] = str (d.imageCompressionMethod);
+	f["imageCompressionLevel"] = str (d.imageCompressionLevel);
+	f["geometry"] = d.geometry;
+	f["keyboard"] = d.keyboard;
+	f["kbtype"] = d.kbtype;
+	f["media"] = str (d.media);
+	f["agentServer"] = d.agentServer;
+	f["agentUser"] = d.agentUser;
+	f["cups"] = str (d.cups);
+	f["key"] = d.key;
+	f["encryption"] = str (d.encryption);
+	f["fullscreen"] = str (d.fullscreen);
+	f["virtualDesktop"] = str (d.virtualDesktop);
+	f["customCommand"] = d.customCommand;
+	return f;
+}
+
+/*!
+ * Parse \arg text in chunks of \arg chunk bytes, or of random sizes
+ * if \arg chunk is 0. Returns the settings, with "options" and "ok"
+ * added.
+ */
+static map<string, string> parseText (const string& text, size_t chunk)
+{
+	NXConfigData d = NXConfigData();
+	NXConfigParser parser (&d);
+	bool ok = true;
+
+	for (size_t i = 0; ok && i < text.size(); ) {
+		size_t n = (chunk != 0) ? chunk : 1 + rand() % 97;
+		if (n > text.size() - i) {
+			n = text.size() - i;
+		}
+		ok = parser.parse (text.data() + i, n);
+		i += n;
+	}
+	ok = parser.finish() && ok;
+
+	map<string, string> f = fields (d);
+	f["options"] = str (parser.getOptions());
+	f["ok"] = str (ok);
+	return f;
+}
+
+/*!
+ * How qtnx's NXParseXML read a file: every element's attributes go
+ * into a list, and the handler looks up "key" in that list once for
+ * each key it knows about.
+ */
+//@{
+typedef vector<pair<string, string> > Attributes;
+
+static string attrValue (const Attributes& a, const string& name)
+{
+	for (unsigned int i = 0; i < a.size(); i++) {
+		if (a[i].first == name) {
+			return a[i].second;
+		}
+	}
+	return "";
+}
+
+static void oldStartElement (const Attributes& a, NXConfigData& d)
+{
+	if (attrValue (a, "key") == "Connection Name") {
+		d.sessionName = attrValue (a, "value");
+	}
+	if (attrValue (a, "key") == "Server Hostname") {
+		d.serverHost = attrValue (a, "value");
+	}
+	if (attrValue (a, "key") == "Server Port") {
+		d.serverPort = atoi (attrValue (a, "value").c_str());
+	}
+	if (attrValue (a, "key") == "Session Type") {
+		d.sessionType = attrValue (a, "value");
+	}
+	if (attrValue (a, "key") == "Custom Session Command") {
+		d.customCommand = attrValue (a, "value");
+	}
+	if (attrValue (a, "key") == "Disk Cache") {
+		d.cache = atoi (attrValue (a, "value").c_str());
+	}
+	if (attrValue (a, "key") == "Image Cache") {
+		d.images = atoi (attrValue (a, "value").c_str());
+	}
+	if (attrValue (a, "key") == "Link Type") {
+		d.linkType = attrValue (a, "value");
+	}
+	if (attrValue (a, "key") == "Use Render Extension") {
+		d.render = (attrValue (a, "value") == "True");
+	}
+	if (attrValue (a, "key") == "Image Compression Method") {
+		d.imageCompressionMethod = (attrValue (a, "value") == "JPEG") ? -1 : 2;
+	}
+	if (attrValue (a, "key") == "JPEG Compression Level") {
+		d.imageCompressionLevel = atoi (attrValue (a, "value").c_str());
+	}
+	if (attrValue (a, "key") == "Desktop Geometry") {
+		d.geometry = attrValue (a, "value");
+	}
+	if (attrValue (a, "key") == "Keyboard Layout") {
+		d.keyboard = attrValue (a, "value");
+	}
+	if (attrValue (a, "key") == "Keyboard Type") {
+		d.kbtype = attrValue (a, "value");
+	}
+	if (attrValue (a, "key") == "Media") {
+		d.media = (attrValue (a, "value") == "True");
+	}
+	if (attrValue (a, "key") == "Agent Server") {
+		d.agentServer = attrValue (a, "value");
+	}
+	if (attrValue (a, "key") == "Agent User") {
+		d.agentUser = attrValue (a, "value");
+	}
+	if (attrValue (a, "key") == "CUPS Port") {
+		d.cups = atoi (attrValue (a, "value").c_str());
+	}
+	if (attrValue (a, "key") == "Authentication Key") {
+		d.key = attrValue (a, "value");
+	}
+	if (attrValue (a, "key") == "Use SSL Tunnelling") {
+		d.encryption = (attrValue (a, "value") == "True");
+	}
+	if (attrValue (a, "key") == "Enable Fullscreen Desktop") {
+		d.fullscreen = (attrValue (a, "value") == "True");
+	}
+}
+
+static void oldParse (const string& text, NXConfigData& d)
+{
+	string::size_type p = 0;
+
+	while ((p = text.find ('<', p)) != string::npos) {
+		string::size_type gt = text.find ('>', p);
+		if (gt == string::npos) {
+			break;
+		}
+		string tag = text.substr (p + 1, gt - p - 1);
+		p = gt + 1;
+		if (tag.empty() || tag[0] == '/' || tag[0] == '!' || tag[0] == '?') {
+			continue;
+		}
+
+		Attributes a;
+		string::size_type q = tag.find (' ');
+		while (q != string::npos) {
+			string::size_type eq = tag.find ('=', q);
+			if (eq == string::npos || eq + 1 >= tag.size()) {
+				break;
+			}
+			string::size_type close = tag.find (tag[eq + 1], eq + 2);
+			if (close == string::npos) {
+				break;
+			}
+			string name = tag.substr (q + 1, eq - q - 1);
+			name.erase (0, name.find_first_not_of (" \t\r\n"));
+			a.push_back (make_pair (name, tag.substr (eq + 2, close - eq - 2)));
+			q = tag.find_first_of (" \t\r\n", close);
+		}
+		oldStartElement (a, d);
+	}
+}
+//@}
+
+/*!
+ * Bits of XML which must be got right, and what they must give.
+ */
+static const struct {
+	const char * xml;
+	const char * field;
+	const char * value;
+	bool ok;
+} awkward[] = {
+	{ "<option key=\"Server host\" value=\"a&amp;b&lt;c&gt;&quot;&apos;\"/>",
+	  "serverHost", "a&b<c>\"'", true },
+	{ "<option key=\"Server host\" value=\"caf&#233;&#x21;\"/>",
+	  "serverHost", "caf\xc3\xa9!", true },
+	{ "<option key=\"Server host\" value=\"a > b\"/>", "serverHost", "a > b", true },
+	{ "<option value='x' key='Server host' />", "serverHost", "x", true },
+	{ "<!-- <option key=\"Server host\" value=\"no\"/> -> -- -->"
+	  "<option key=\"Server host\" value=\"yes\"/>", "serverHost", "yes", true },
+	{ "<group name=\"VNC Session\"><option key=\"User\" value=\"no\"/></group>"
+	  "<option key=\"User\" value=\"yes\"/>", "sessionUser", "yes", true },
+	{ "<option key=\"Server host\" value=\"a&b\"/>", "serverHost", "a&b", true },
+	{ "<option key=\"Server host\" value=x/>", "serverHost", "", false },
+	{ "<option key=\"Server host\" value=\"x/>", "serverHost", "", false },
+	{ "<option key=\"Server host\" value=\"x\"", "serverHost", "", false },
+	{ NULL, NULL, NULL, false }
+};
+
+int main (int argc, char ** argv)
+{
+	int iterations = 2000;
+	int arg = 1;
+	int failures = 0;
+
+	if (argc > arg && isdigit (argv[arg][0])) {
+		iterations = atoi (argv[arg++]);
+	}
+	if (arg >= argc) {
+		cerr << "Usage: configtest [iterations] file.nxs..." << endl;
+		return -1;
+	}
+	srand (1);
+
+	for (int i = 0; awkward[i].xml != NULL; i++) {
+		map<string, string> whole = parseText (awkward[i].xml, string (awkward[i].xml).size());
+		map<string, string> bytes = parseText (awkward[i].xml, 1);
+		string ok = str (awkward[i].ok);
+		if (whole != bytes || whole["ok"] != ok
+		    || (awkward[i].ok && whole[awkward[i].field] != awkward[i].value)) {
+			cerr << "'" << awkward[i].xml << "': expected " << awkward[i].field
+			     << " '" << awkward[i].value << "' and ok " << ok
+			     << ", got '" << whole[awkward[i].field] << "' and ok "
+			     << whole["ok"] << endl;
+			failures++;
+		}
+	}
+
+	for (; arg < argc; arg++) {
+		ifstream f (argv[arg]);
+		if (!f) {
+			cerr << "Can't read " << argv[arg] << endl;
+			return -1;
+		}
+		stringstream ss;
+		ss << f.rdbuf();
+		string text = ss.str();
+
+		map<string, string> whole = parseText (text, text.size());
+		bool ok = (whole["ok"] == "1");
+		if (!ok) {
+			cerr << argv[arg] << ": failed to parse" << endl;
+		}
+		for (int i = 0; ok && i < 20; i++) {
+			if (parseText (text, i == 0 ? 1 : 0) != whole) {
+				cerr << argv[arg] << ": the settings differ when it is fed in "
+				     << (i == 0 ? "bytes" : "random chunks") << endl;
+				ok = false;
+			}
+		}
+
+		// The "expect" lines
+		istringstream ls (text);
+		string l;
+		int expects = 0;
+		while (ok && getline (ls, l)) {
+			string::size_type e = l.find ("expect ");
+			string::size_type eq = l.find ('=', e);
+			if (e == string::npos || eq == string::npos) {
+				continue;
+			}
+			string name = l.substr (e + 7, eq - e - 7);
+			string value = l.substr (eq + 1);
+			string::size_type end = value.find_last_not_of (" \r");
+			value.erase (end == string::npos ? 0 : end + 1);
+			if (value.size() >= 4 && value.compare (value.size() - 4, 4, " -->") == 0) {
+				value.erase (value.size() - 4);
+			}
+			if (whole.find (name) == whole.end() || whole[name] != value) {
+				cerr << argv[arg] << ": expected " << name << " '" << value
+				     << "', got '" << whole[name] << "'" << endl;
+				ok = false;
+			}
+			expects++;
+		}
+		if (!ok) {
+			failures++;
+			continue;
+		}
+
+		unsigned int sink = 0;
+		double t0 = now();
+		for (int it = 0; it < iterations; it++) {
+			NXConfigData d = NXConfigData();
+			NXConfigParser parser (&d);
+			parser.parse (text.data(), text.size());
+			parser.finish();
+			sink += d.serverPort;
+		}
+		double newTime = now() - t0;
+		t0 = now();
+		for (int it = 0; it < iterations; it++) {
+			NXConfigData d = NXConfigData();
+			oldParse (text, d);
+			sink += d.serverPort;
+		}
+		double oldTime = now() - t0;
+
+		double n = static_cast<double>(iterations);
+		cout << argv[arg] << ": " << expects << " settings ok, "
+		     << whole["options"] << " options, " << text.size() << " bytes; "
+		     << "NXConfigParser " << newTime * 1e6 / n << " us/file ("
+		     << text.size() * n / (newTime * 1e6) << " MB/s), old way "
+		     << oldTime * 1e6 / n << " us/file ("
+		     << text.size() * n / (oldTime * 1e6) << " MB/s)"
+		     << (sink == 0 ? " " : "") << endl;
+	}
+
+	return failures == 0 ? 0 : 1;
+}
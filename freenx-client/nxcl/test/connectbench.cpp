@@ -0,0 +1,395 @@
+/***************************************************************************
+   connectbench.cpp - Time NXClientLib connecting to a scripted server
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Starts a session again and again through NXClientLib, with "ssh" and
+ * "nxproxy" in a temporary directory given to setCustomPath(). The ssh
+ * is a shell script playing a FreeNX server all the way from HELLO,
+ * through the login, the session list (NX> 127 to 148) and the
+ * startsession replies (NX> 1000, the 700s, 710, 1002, 1006) to "bye",
+ * "NX> 999 Bye" and "NX> 287"; the nxproxy just exits.
+ *
+ *   connectbench [-n connects] [-d delay_ms] [-s sessions] [-p padding]
+ *
+ * -d makes the server wait that long before each reply, -s puts that
+ * many sessions in its session list and -p adds that many bytes of
+ * nxnode chatter before the session replies. For each connect the time
+ * from starting ssh to starting nxproxy (the latency), the CPU time
+ * this process used (not the server's) and the C++ allocations made
+ * (by counting operator new) are measured; percentiles of each, and
+ * the median time to each stage of the trace, are printed at the end.
+ * The first connect teaches the server cache (in the temporary $HOME)
+ * that the login can be pipelined, so it is reported on its own.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <new>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "nxclientlib.h"
+#include "nxtestutil.h"
+
+using namespace std;
+using namespace nxcl;
+
+ofstream debugLogFile;
+
+/*!
+ * Every C++ allocation in the process, libnxcl's included
+ */
+//@{
+static long long allocations = 0;
+static long long allocatedBytes = 0;
+
+void * operator new (size_t n)
+{
+	allocations++;
+	allocatedBytes += n;
+	void * p = malloc (n == 0 ? 1 : n);
+	if (p == NULL) {
+		throw bad_alloc();
+	}
+	return p;
+}
+
+void * operator new[] (size_t n)
+{
+	return operator new (n);
+}
+
+/*
+ * Out of line, or once the sized deletes are inlined into the
+ * containers gcc sees new's pointer go to free(), and warns.
+ */
+static void __attribute__ ((noinline)) release (void * p)
+{
+	free (p);
+}
+
+void operator delete (void * p) throw()
+{
+	release (p);
+}
+
+void operator delete[] (void * p) throw()
+{
+	release (p);
+}
+
+void operator delete (void * p, size_t) throw()
+{
+	release (p);
+}
+
+void operator delete[] (void * p, size_t) throw()
+{
+	release (p);
+}
+//@}
+
+static const char * server =
+	"#!/bin/sh\n"
+	"reply() { [ -n \"$NXBENCH_DELAY\" ] && sleep \"$NXBENCH_DELAY\"; printf \"$@\"; }\n"
+	"printf 'NX> 203 NXSSH running with pid: %s\\nNX> 200 Connected to address: 127.0.0.1 on port: 22\\n' $$ >&2\n"
+	"reply 'HELLO NXSERVER - Version 3.2.0-74-SVN OS (GPL, using backend: 3.5.0)\\nNX> 105 '\n"
+	"state=\n"
+	"while read -r line; do\n"
+	"  case \"$state\" in\n"
+	"  user) state=pass; reply '%s\\nNX> 102 Password: ' \"$line\"; continue;;\n"
+	"  pass) state=; reply '\\nNX> 103 Welcome to: nxhost user: jdoe\\nNX> 105 '; continue;;\n"
+	"  esac\n"
+	"  case \"$line\" in\n"
+	"  hello*) reply '%s\\nNX> 134 Accepted protocol: 3.0.0\\nNX> 105 ' \"$line\";;\n"
+	"  \"SET AUTH_MODE\"*) reply '%s\\nSet auth_mode: password\\nNX> 105 ' \"$line\";;\n"
+	"  SET*) reply '%s\\nNX> 105 ' \"$line\";;\n"
+	"  login) state=user; reply '%s\\nNX> 101 User: ' \"$line\";;\n"
+	"  listsession*)\n"
+	"    reply '%s\\nNX> 127 Sessions list of user '\\''jdoe'\\'' for reconnect:\\n\\n' \"$line\"\n"
+	"    printf '%s' \"$NXBENCH_TABLE\"\n"
+	"    printf '\\n\\nNX> 148 Server capacity: not reached for user: jdoe\\nNX> 105 ';;\n"
+	"  startsession*|restoresession*)\n"
+	"    reply 'NX> 1000 NXNODE - Version 3.2.0-74-SVN OS (GPL, using backend: 3.5.0)\\n'\n"
+	"    printf '%s' \"$NXBENCH_PADDING\"\n"
+	"    printf 'NX> 700 Session id: nxhost-1001-5C7E1B0A7D1E4D3E8A54C2BF3E1D9C4A\\n'\n"
+	"    printf 'NX> 705 Session display: 1001\\nNX> 703 Session type: unix-kde\\n'\n"
+	"    printf 'NX> 701 Proxy cookie: 5d9a3c4f6e2b1a0c9d8e7f6a5b4c3d2e\\nNX> 702 Proxy IP: 127.0.0.1\\n'\n"
+	"    printf 'NX> 706 Agent cookie: 5d9a3c4f6e2b1a0c9d8e7f6a5b4c3d2e\\nNX> 704 Session cache: unix-kde\\n'\n"
+	"    printf 'NX> 707 SSL tunneling: 1\\nNX> 1009 Session status: starting\\n'\n"
+	"    printf 'NX> 710 Session status: running\\nNX> 1002 Commit\\nNX> 1006 Session status: running\\nNX> 105 ';;\n"
+	"  bye)\n"
+	"    reply 'bye\\nBye\\nNX> 999 Bye\\n'; printf 'NX> 999 Bye\\n' >&2\n"
+	"    printf 'NX> 287 Redirected I/O to channel descriptors\\n'; exit 0;;\n"
+	"  quit) printf 'quit\\nNX> 999 Bye\\n'; exit 0;;\n"
+	"  *) reply '%s\\nNX> 105 ' \"$line\";;\n"
+	"  esac\n"
+	"done\n";
+
+static const char * proxy = "#!/bin/sh\nexit 0\n";
+
+class BenchCallbacks : public NXClientLibExternalCallbacks
+{
+	public:
+		BenchCallbacks() : proxyStarted(false) {}
+		void traceSignal (const NXTraceEvent& e)
+		{
+			if (e.stage == "starting nxproxy") {
+				this->proxyStarted = true;
+			}
+		}
+		bool proxyStarted;
+};
+
+/*!
+ * What one connect cost
+ */
+struct Sample {
+	long long usec;
+	long long cpuUsec;
+	long long allocations;
+	long long bytes;
+	/*!
+	 * Microseconds from the start to each stage of the trace
+	 * (the first time it was reached).
+	 */
+	map<string, long long> stages;
+};
+
+static long long cpuTime (void)
+{
+	struct rusage ru;
+	getrusage (RUSAGE_SELF, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000LL
+		+ ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+/*!
+ * Start a session through a new NXClientLib, and wait for it to
+ * finish.
+ *
+ * \return false if nxproxy wasn't started.
+ */
+static bool connect (const string& dir, Sample& s)
+{
+	BenchCallbacks cb;
+	NXSessionData sd;
+	setDefaults (sd);
+	string user = "jdoe", pass = "secret";
+
+	long long cpu = cpuTime();
+	long long allocs = allocations, bytes = allocatedBytes;
+	long long start = NXTrace::now();
+
+	NXClientLib * lib = new NXClientLib;
+	lib->setExternalCallbacks (&cb);
+	lib->setCustomPath (dir);
+	lib->setSessionData (&sd);
+	lib->setUsername (user);
+	lib->setPassword (pass);
+	lib->runSession();
+	lib->invokeNXSSH ("default", "nxhost", true, "", 22);
+
+	long long deadline = start + 10000000LL;
+	while (!cb.proxyStarted && !lib->getIsFinished() && NXTrace::now() < deadline) {
+		if (lib->runOnce (100) < 0) {
+			break;
+		}
+	}
+
+	s.usec = NXTrace::now() - start;
+	s.cpuUsec = cpuTime() - cpu;
+	s.allocations = allocations - allocs;
+	s.bytes = allocatedBytes - bytes;
+	s.stages.clear();
+	const list<NXTraceEvent>& events = lib->getTrace().getEvents();
+	list<NXTraceEvent>::const_iterator e;
+	for (e = events.begin(); e != events.end(); e++) {
+		// NXSession's stages are all "stage", with the name as
+		// the detail.
+		string name = (e->stage == "stage") ? "stage " + e->detail : e->stage;
+		if (s.stages.find (name) == s.stages.end()) {
+			s.stages[name] = e->usec - start;
+		}
+	}
+
+	// Let ssh and nxproxy exit, so that they are reaped before
+	// the next connect.
+	notQProcess * p[] = { lib->getNXSSHProcess(), lib->getNXProxyProcess() };
+	deadline = NXTrace::now() + 2000000LL;
+	for (;;) {
+		bool running = false;
+		for (int i = 0; i < 2; i++) {
+			if (p[i]->getPid() > 0) {
+				running = true;
+				if (NXTrace::now() >= deadline) {
+					p[i]->terminate();
+				}
+			}
+		}
+		if (!running || lib->runOnce (100) < 0) {
+			break;
+		}
+	}
+	delete lib;
+	return cb.proxyStarted;
+}
+
+static long long percentile (vector<long long> v, int p)
+{
+	if (v.empty()) {
+		return 0;
+	}
+	sort (v.begin(), v.end());
+	return v[(v.size() - 1) * p / 100];
+}
+
+static void report (const string& name, const vector<long long>& v, double scale,
+		    const string& unit)
+{
+	cout << name << ": p50 " << percentile (v, 50) / scale
+	     << ", p90 " << percentile (v, 90) / scale
+	     << ", p99 " << percentile (v, 99) / scale
+	     << ", max " << percentile (v, 100) / scale << " " << unit << endl;
+}
+
+static void usage (void)
+{
+	cerr << "usage: connectbench [-n connects] [-d delay_ms] [-s sessions] [-p padding]" << endl;
+}
+
+int main (int argc, char ** argv)
+{
+	int connects = 50, delayMs = 0, sessions = 0, padding = 0;
+
+	for (int i = 1; i < argc; i++) {
+		string a = argv[i];
+		if (i + 1 >= argc) {
+			usage();
+			return 1;
+		}
+		int v = atoi (argv[++i]);
+		if (a == "-n") {
+			connects = v;
+		} else if (a == "-d") {
+			delayMs = v;
+		} else if (a == "-s") {
+			sessions = v;
+		} else if (a == "-p") {
+			padding = v;
+		} else {
+			usage();
+			return 1;
+		}
+	}
+	if (connects < 1) {
+		usage();
+		return 1;
+	}
+	signal (SIGPIPE, SIG_IGN);
+
+	string dir = makeFakeServerDir (server, proxy);
+	if (dir.empty()) {
+		return 1;
+	}
+
+	if (delayMs > 0) {
+		stringstream ss;
+		ss << delayMs / 1000.0;
+		setenv ("NXBENCH_DELAY", ss.str().c_str(), 1);
+	}
+	stringstream table;
+	if (sessions > 0) {
+		table << "Display Type             Session ID                       Options  Depth Screensize     Available Session Name\n"
+		      << "------- ---------------- -------------------------------- -------- ----- -------------- --------- ----------------------\n";
+		for (int i = 0; i < sessions; i++) {
+			char id[33];
+			snprintf (id, sizeof (id), "5C7E1B0A7D1E4D3E8A54C2BF%08X", i);
+			table << 1001 + i << "    unix-gnome       " << id
+			      << " -RD--PSA    24 1024x768       Running     desktop " << i << "\n";
+		}
+	}
+	setenv ("NXBENCH_TABLE", table.str().c_str(), 1);
+	string pad;
+	while (static_cast<int>(pad.size()) < padding) {
+		pad += "NX> 1001 Bye.\nInfo: nxnode is starting the session with the requested parameters\n";
+	}
+	pad.resize (padding);
+	if (!pad.empty() && pad[pad.size()-1] != '\n') {
+		pad[pad.size()-1] = '\n';
+	}
+	setenv ("NXBENCH_PADDING", pad.c_str(), 1);
+
+	cout << connects << " connects, " << delayMs << "ms per reply, "
+	     << sessions << " sessions listed, " << padding << " bytes of padding" << endl;
+
+	int failures = 0;
+	vector<long long> usec, cpu, allocs, bytes;
+	map<string, vector<long long> > stages;
+	Sample s;
+	for (int i = 0; i <= connects; i++) {
+		if (!connect (dir, s)) {
+			failures++;
+			continue;
+		}
+		if (i == 0) {
+			// Unpipelined, and the first to load everything
+			cout << "first connect: " << s.usec / 1000.0 << " ms, "
+			     << s.cpuUsec / 1000.0 << " ms CPU, " << s.allocations
+			     << " allocations" << endl;
+			continue;
+		}
+		usec.push_back (s.usec);
+		cpu.push_back (s.cpuUsec);
+		allocs.push_back (s.allocations);
+		bytes.push_back (s.bytes);
+		map<string, long long>::iterator j;
+		for (j = s.stages.begin(); j != s.stages.end(); j++) {
+			stages[j->first].push_back (j->second);
+		}
+	}
+
+	report ("latency", usec, 1000.0, "ms");
+	report ("CPU", cpu, 1000.0, "ms");
+	report ("allocations", allocs, 1, "");
+	report ("allocated", bytes, 1024.0, "KB");
+
+	// The stages in the order they were reached
+	vector<pair<long long, string> > order;
+	map<string, vector<long long> >::iterator j;
+	for (j = stages.begin(); j != stages.end(); j++) {
+		order.push_back (make_pair (percentile (j->second, 50), j->first));
+	}
+	sort (order.begin(), order.end());
+	cout << "median time to each stage:" << endl;
+	for (unsigned int k = 0; k < order.size(); k++) {
+		cout << "  " << order[k].first / 1000.0 << " ms " << order[k].second << endl;
+	}
+
+	if (failures > 0) {
+		cout << failures << " connects didn't start nxproxy" << endl;
+	}
+
+	removeFakeServerDir (dir);
+	return failures;
+}
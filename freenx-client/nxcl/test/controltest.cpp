@@ -0,0 +1,300 @@
+/***************************************************************************
+   controltest.cpp - Check NXSession's control mode against a scripted
+                     server
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Logs in to a scripted FreeNX server in control mode, with a list, a
+ * termination and another list requested before the login finishes,
+ * and checks that the three commands go out together (or one at a
+ * time without pipelining), that each answer reaches the right
+ * callback, and that resuming a session from the last list, or
+ * quitting, ends control mode. Each list's difference from the one
+ * before it must be reported, and NXSession::diffSessions() is
+ * checked on its own.
+ */
+
+#include <iostream>
+#include <string>
+#include <list>
+
+#include "nxsession.h"
+#include "nxlineframer.h"
+#include "nxtestutil.h"
+
+using namespace std;
+using namespace nxcl;
+
+ofstream debugLogFile;
+
+class ControlCallbacks : public NXSessionCallbacks
+{
+	public:
+		ControlCallbacks() : ready(false), lists(0), terminated(0), changes(0) {}
+		void controlReadySignal (void) { this->ready = true; }
+		void controlListSignal (list<NXResumeData> sessions)
+		{
+			this->lists++;
+			this->sessions = sessions;
+		}
+		void sessionsChangedSignal (const NXResumeDelta& d)
+		{
+			this->changes++;
+			this->delta = d;
+		}
+		void controlTerminatedSignal (const string& id, bool t)
+		{
+			if (t) {
+				this->terminated++;
+				this->lastTerminated = id;
+			}
+		}
+
+		bool ready;
+		int lists;
+		int terminated;
+		string lastTerminated;
+		list<NXResumeData> sessions;
+		int changes;
+		NXResumeDelta delta;
+};
+
+static const char * login[] = {
+	"HELLO NXSERVER - Version 3.2.0-74-SVN OS (GPL, using backend: 3.5.0)\nNX> 105 ",
+	"hello NXCLIENT - Version 3.0.0\nNX> 134 Accepted protocol: 3.0.0\nNX> 105 ",
+	"SET SHELL_MODE SHELL\nNX> 105 ",
+	"SET AUTH_MODE PASSWORD\nSet auth_mode: password\nNX> 105 ",
+	"login\nNX> 101 User: ",
+	"jdoe\nNX> 102 Password: ",
+	"\nNX> 103 Welcome to: nxhost user: jdoe\nNX> 105 ",
+	NULL
+};
+
+static const char * listAnswer =
+	"listsession --user=\"jdoe\" --status=\"suspended,running\" --geometry=\"1024x768x24+render\" --type=\"unix-kde\"\n"
+	"NX> 127 Sessions list of user 'jdoe' for reconnect:\n"
+	"\n"
+	"Display Type             Session ID                       Options  Depth Screensize     Available Session Name\n"
+	"------- ---------------- -------------------------------- -------- ----- -------------- --------- ----------------------\n"
+	"1001    unix-kde         5C7E1B0A7D1E4D3E8A54C2BF3E1D9C00 -RD--PSA    24 1024x768       Suspended   kde\n"
+	"1002    unix-kde         5C7E1B0A7D1E4D3E8A54C2BF3E1D9C01 -RD--PSA    24 1024x768       Suspended   kde desktop 2\n"
+	"\n"
+	"\n"
+	"NX> 148 Server capacity: not reached for user: jdoe\n"
+	"NX> 105 ";
+
+static const char * terminateAnswer =
+	"Terminate --sessionid=\"5C7E1B0A7D1E4D3E8A54C2BF3E1D9C00\"\n"
+	"NX> 900 Session id: 5C7E1B0A7D1E4D3E8A54C2BF3E1D9C00 terminated.\n"
+	"NX> 105 ";
+
+static const char * secondListAnswer =
+	"listsession --user=\"jdoe\" --status=\"suspended,running\" --geometry=\"1024x768x24+render\" --type=\"unix-kde\"\n"
+	"NX> 127 Sessions list of user 'jdoe' for reconnect:\n"
+	"\n"
+	"Display Type             Session ID                       Options  Depth Screensize     Available Session Name\n"
+	"------- ---------------- -------------------------------- -------- ----- -------------- --------- ----------------------\n"
+	"1002    unix-kde         5C7E1B0A7D1E4D3E8A54C2BF3E1D9C01 -RD--PSA    24 1024x768       Suspended   kde desktop 2\n"
+	"\n"
+	"\n"
+	"NX> 148 Server capacity: not reached for user: jdoe\n"
+	"NX> 105 ";
+
+/*!
+ * Give \arg server to the session a line at a time.
+ *
+ * \return the replies, each ending with a newline, and the number of
+ * separate writes in \arg writes.
+ */
+static string feed (NXSession& session, NXLineFramer& framer, const string& server, int& writes)
+{
+	string replies;
+	NXLine line;
+	framer.feed (server.data(), server.size());
+	while (framer.next (line)) {
+		string reply = session.parseSSH (line.str());
+		if (!reply.empty()) {
+			replies += reply;
+			writes++;
+		}
+	}
+	return replies;
+}
+
+/*!
+ * Log in, list, terminate the first session and list again, then
+ * resume (or quit).
+ */
+static int run (bool pipelining, bool quit)
+{
+	string name = string (pipelining ? "pipelined" : "one at a time")
+		+ (quit ? ", quitting" : ", resuming");
+	int failures = 0;
+
+	NXSessionData sd;
+	setDefaults (sd);
+	string user = "jdoe", pass = "secret";
+
+	NXSession session;
+	ControlCallbacks cb;
+	session.setCallbacks (&cb);
+	session.setUsername (user);
+	session.setPassword (pass);
+	session.setSessionData (&sd);
+	session.setControlMode (true);
+	session.setPipelining (pipelining);
+	session.runSession();
+
+	// Asked for before we've logged in
+	session.requestList();
+	session.requestTerminate ("5C7E1B0A7D1E4D3E8A54C2BF3E1D9C00");
+	session.requestList();
+	if (session.takeRequests() != "") {
+		cout << name << ": requests were sent before the login" << endl; failures++;
+	}
+
+	NXLineFramer framer;
+	int writes = 0;
+	string sent;
+	for (int i = 0; login[i] != NULL; i++) {
+		sent = feed (session, framer, login[i], writes);
+	}
+	if (!cb.ready || !session.getControlReady()) {
+		cout << name << ": not ready after the login" << endl; failures++;
+	}
+
+	// The answer to the last prompt of the login is the requests.
+	int expected = pipelining ? 3 : 1;
+	if (countLines (sent) != expected) {
+		cout << name << ": sent " << countLines (sent) << " requests after the login, not "
+		     << expected << endl; failures++;
+	}
+
+	sent = feed (session, framer, listAnswer, writes);
+	if (cb.lists != 1 || cb.sessions.size() != 2) {
+		cout << name << ": first list wrong" << endl; failures++;
+	}
+	if (cb.changes != 1 || cb.delta.added.size() != 2
+	    || !cb.delta.changed.empty() || !cb.delta.removed.empty()) {
+		cout << name << ": first list's changes wrong" << endl; failures++;
+	}
+	if (countLines (sent) != (pipelining ? 0 : 1)) {
+		cout << name << ": sent too much after the first list" << endl; failures++;
+	}
+	sent = feed (session, framer, terminateAnswer, writes);
+	if (cb.terminated != 1 || cb.lastTerminated != "5C7E1B0A7D1E4D3E8A54C2BF3E1D9C00") {
+		cout << name << ": termination wasn't reported" << endl; failures++;
+	}
+	sent = feed (session, framer, secondListAnswer, writes);
+	if (cb.lists != 2 || cb.sessions.size() != 1
+	    || cb.sessions.front().sessionID != "5C7E1B0A7D1E4D3E8A54C2BF3E1D9C01") {
+		cout << name << ": second list wrong" << endl; failures++;
+	}
+	if (cb.changes != 2 || !cb.delta.added.empty() || !cb.delta.changed.empty()
+	    || cb.delta.removed.size() != 1
+	    || cb.delta.removed.front() != "5C7E1B0A7D1E4D3E8A54C2BF3E1D9C00") {
+		cout << name << ": second list's changes wrong" << endl; failures++;
+	}
+	if (session.getRequestsPending() != 0) {
+		cout << name << ": requests left over" << endl; failures++;
+	}
+
+	string reply;
+	if (quit) {
+		session.requestQuit();
+		reply = session.takeRequests();
+		if (reply != "quit\n") {
+			cout << name << ": quit sent '" << reply << "'" << endl; failures++;
+		}
+	} else {
+		session.chooseResumable (0);
+		reply = session.releaseChoice();
+		if (reply.find ("restoresession --id=\"5C7E1B0A7D1E4D3E8A54C2BF3E1D9C01\"") != 0) {
+			cout << name << ": resuming sent '" << reply << "'" << endl; failures++;
+		}
+	}
+	if (session.getControlReady() || session.requestList()) {
+		cout << name << ": still taking requests" << endl; failures++;
+	}
+
+	cout << name << ": " << (writes + 1) << " writes to nxssh, "
+	     << (failures ? "FAILED" : "ok") << endl;
+	return failures;
+}
+
+/*!
+ * A session in \arg sessions, for diffSessions().
+ */
+static void addSession (list<NXResumeData>& sessions, int display, const string& id,
+			const string& available)
+{
+	NXResumeData r;
+	r.display = display;
+	r.sessionType = "unix-kde";
+	r.sessionID = id;
+	r.options = "-RD--PSA";
+	r.depth = 24;
+	r.screen = "1024x768";
+	r.available = available;
+	r.sessionName = "kde";
+	sessions.push_back (r);
+}
+
+static int checkDiff (void)
+{
+	list<NXResumeData> before, after;
+	NXResumeDelta delta;
+	int failures = 0;
+
+	addSession (before, 1001, "A", "Suspended");
+	addSession (before, 1002, "B", "Suspended");
+	addSession (before, 1003, "C", "Running");
+	// B has been resumed, C has gone and D is new; A is as it was.
+	addSession (after, 1004, "D", "Suspended");
+	addSession (after, 1002, "B", "Running");
+	addSession (after, 1001, "A", "Suspended");
+
+	if (!NXSession::diffSessions (before, after, delta)
+	    || delta.added.size() != 1 || delta.added.front().sessionID != "D"
+	    || delta.changed.size() != 1 || delta.changed.front().available != "Running"
+	    || delta.removed.size() != 1 || delta.removed.front() != "C") {
+		cout << "diffSessions: wrong differences" << endl; failures++;
+	}
+
+	NXResumeDelta none;
+	if (NXSession::diffSessions (after, after, none)) {
+		cout << "diffSessions: a list differs from itself" << endl; failures++;
+	}
+
+	cout << "diffSessions: " << (failures ? "FAILED" : "ok") << endl;
+	return failures;
+}
+
+int main()
+{
+	int failures = 0;
+	failures += checkDiff();
+	failures += run (true, false);
+	failures += run (false, false);
+	failures += run (true, true);
+
+	// Not in control mode, requests are refused.
+	NXSession session;
+	if (session.requestList()) {
+		cout << "requests accepted outside control mode" << endl;
+		failures++;
+	}
+
+	return failures;
+}
@@ -0,0 +1,182 @@
+/***************************************************************************
+   discoverytest.cpp - Check NXDiscovery against several scripted servers
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Puts a shell script called "ssh" in a temporary directory, and points
+ * NXDiscovery at it with setCustomPath(). The script plays a FreeNX
+ * server whose behaviour depends on the host name: "fast" hosts answer
+ * straight away, "slow" ones take 300ms to list their sessions, "bad"
+ * ones refuse the password and "dead" ones never say anything.
+ *
+ * Checks that each host's result is right, that the slow hosts are
+ * listed in parallel, and that a dead host costs no more than the
+ * timeout.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "nxdiscovery.h"
+#include "nxtestutil.h"
+
+using namespace std;
+using namespace nxcl;
+
+ofstream debugLogFile;
+
+static const char * script =
+	"#!/bin/sh\n"
+	"for a in \"$@\"; do case \"$a\" in nx@*) host=\"${a#nx@}\";; esac; done\n"
+	"case \"$host\" in dead*) exec sleep 30;; esac\n"
+	"printf 'HELLO NXSERVER - Version 3.2.0-74-SVN OS (GPL, using backend: 3.5.0)\\nNX> 105 '\n"
+	"state=\n"
+	"while read -r line; do\n"
+	"  case \"$state\" in\n"
+	"  user) state=pass; printf '%s\\nNX> 102 Password: ' \"$line\"; continue;;\n"
+	"  pass) state=\n"
+	"    case \"$host\" in bad*)\n"
+	"      printf '\\nNX> 404 ERROR: wrong password or login\\nNX> 999 Bye\\n'; exit 1;;\n"
+	"    esac\n"
+	"    printf '\\nNX> 103 Welcome to: %s user: jdoe\\nNX> 105 ' \"$host\"; continue;;\n"
+	"  esac\n"
+	"  case \"$line\" in\n"
+	"  hello*) printf '%s\\nNX> 134 Accepted protocol: 3.0.0\\nNX> 105 ' \"$line\";;\n"
+	"  \"SET AUTH_MODE\"*) printf '%s\\nSet auth_mode: password\\nNX> 105 ' \"$line\";;\n"
+	"  SET*) printf '%s\\nNX> 105 ' \"$line\";;\n"
+	"  login) state=user; printf '%s\\nNX> 101 User: ' \"$line\";;\n"
+	"  listsession*)\n"
+	"    case \"$host\" in slow*) sleep 0.3;; esac\n"
+	"    printf '%s\\nNX> 127 Sessions list of user '\\''jdoe'\\'' for reconnect:\\n\\n' \"$line\"\n"
+	"    printf 'Display Type             Session ID                       Options  Depth Screensize     Available Session Name\\n'\n"
+	"    printf '%s\\n' '------- ---------------- -------------------------------- -------- ----- -------------- --------- ----------------------'\n"
+	"    printf '1001    unix-kde         5C7E1B0A7D1E4D3E8A54C2BF3E1D9C00 -RD--PSA    24 1024x768       Suspended   %s\\n' \"$host\"\n"
+	"    case \"$host\" in fast*)\n"
+	"      printf '1002    unix-gnome       5C7E1B0A7D1E4D3E8A54C2BF3E1D9C01 -RD--PSA    24 1024x768       Suspended   %s 2\\n' \"$host\";;\n"
+	"    esac\n"
+	"    printf '\\n\\nNX> 148 Server capacity: not reached for user: jdoe\\nNX> 105 ';;\n"
+	"  quit) printf 'quit\\nNX> 999 Bye\\n'; exit 0;;\n"
+	"  *) printf '%s\\nNX> 105 ' \"$line\";;\n"
+	"  esac\n"
+	"done\n";
+
+static const char * statusName[] = {
+	"waiting", "listed", "failed", "timed out"
+};
+
+class DiscoveryCallbacks : public NXDiscoveryCallbacks
+{
+	public:
+		DiscoveryCallbacks() : signals(0) {}
+		void hostSignal (const NXDiscoveryResult& r)
+		{
+			this->signals++;
+			cout << "  " << r.host.host << ": " << statusName[r.status]
+			     << " after " << r.latencyUsec / 1000 << "ms";
+			if (r.status == NXDISCOVERY_LISTED) {
+				cout << " (logged in after " << r.loginUsec / 1000 << "ms), "
+				     << r.sessions.size() << " sessions";
+			} else {
+				cout << " (" << r.error << ")";
+			}
+			cout << endl;
+		}
+		int signals;
+};
+
+/*!
+ * Discover \arg hosts, and check that each ends up with the status in
+ * \arg expect, that \arg sessions sessions are found altogether, and
+ * that it takes between \arg minMs and \arg maxMs.
+ */
+static int check (const string& name, const string& dir, const char ** hosts,
+		  const NXDiscoveryStatus * expect, unsigned int sessions,
+		  int timeout, int minMs, int maxMs)
+{
+	int failures = 0;
+	cout << name << ":" << endl;
+
+	DiscoveryCallbacks cb;
+	NXDiscovery d;
+	d.setCustomPath (dir);
+	d.setCallbacks (&cb);
+	d.setTimeout (timeout);
+	int n = 0;
+	for (; hosts[n] != NULL; n++) {
+		NXDiscoveryHost h;
+		h.host = hosts[n];
+		h.user = "jdoe";
+		h.pass = "secret";
+		d.addHost (h);
+	}
+	d.run();
+
+	int ms = d.getElapsed() / 1000;
+	cout << "  " << n << " hosts in " << ms << "ms, "
+	     << d.getSessions().size() << " sessions" << endl;
+
+	vector<NXDiscoveryResult> r = d.getResults();
+	for (int i = 0; i < n; i++) {
+		if (r[i].status != expect[i]) {
+			cout << "  " << hosts[i] << " should have " << statusName[expect[i]] << endl;
+			failures++;
+		}
+	}
+	if (cb.signals != n) {
+		cout << "  " << cb.signals << " callbacks for " << n << " hosts" << endl; failures++;
+	}
+	if (d.getSessions().size() != sessions) {
+		cout << "  should have found " << sessions << " sessions" << endl; failures++;
+	}
+	if (ms < minMs || ms > maxMs) {
+		cout << "  should have taken " << minMs << "-" << maxMs << "ms" << endl; failures++;
+	}
+	return failures;
+}
+
+int main()
+{
+	signal (SIGPIPE, SIG_IGN);
+
+	string dir = makeFakeServerDir (script);
+	if (dir.empty()) {
+		return 1;
+	}
+
+	int failures = 0;
+
+	// Three 300ms servers together take 300ms, not 900ms.
+	const char * hosts[] = { "fast", "slow1", "slow2", "slow3", "bad", NULL };
+	NXDiscoveryStatus expect[] = {
+		NXDISCOVERY_LISTED, NXDISCOVERY_LISTED, NXDISCOVERY_LISTED,
+		NXDISCOVERY_LISTED, NXDISCOVERY_FAILED
+	};
+	failures += check ("parallel", dir, hosts, expect, 5, 5000, 300, 850);
+
+	// A dead server costs the timeout, and the others are unaffected.
+	const char * deadHosts[] = { "dead", "fast", "slow", NULL };
+	NXDiscoveryStatus deadExpect[] = {
+		NXDISCOVERY_TIMEOUT, NXDISCOVERY_LISTED, NXDISCOVERY_LISTED
+	};
+	failures += check ("timeout", dir, deadHosts, deadExpect, 3, 600, 600, 1000);
+
+	removeFakeServerDir (dir);
+
+	cout << (failures ? "FAILED" : "all passed") << endl;
+	return failures;
+}
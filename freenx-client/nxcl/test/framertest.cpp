@@ -0,0 +1,143 @@
+/***************************************************************************
+   framertest.cpp - Feed the recorded conversations in transcripts/ to
+                    NXLineFramer in randomly sized pieces
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * nxssh's output arrives in whatever pieces the pipe hands us, so a
+ * line may be split anywhere, or several may arrive together. For
+ * each transcript the lines are first framed with every server
+ * message fed whole, then again many times with the messages cut up
+ * at random; the lines (and prompts) handed out must be the same
+ * every time.
+ *
+ * Usage: framertest [iterations [seed]] transcript.nxt...
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+
+#include "nxlineframer.h"
+#include "transcript.h"
+
+using namespace std;
+using namespace nxcl;
+
+ofstream debugLogFile;
+
+/*!
+ * Frame the data in \arg pieces, writing a description of each line
+ * into \arg lines.
+ */
+static void frame (const vector<string>& pieces, vector<string>& lines)
+{
+	NXLineFramer framer;
+	NXLine line;
+
+	lines.clear();
+	for (unsigned int i = 0; i < pieces.size(); i++) {
+		framer.feed (pieces[i].data(), pieces[i].size());
+		while (framer.next (line)) {
+			stringstream ss;
+			ss << line.code << (line.prompt ? " P " : " L ") << line.str();
+			lines.push_back (ss.str());
+		}
+	}
+	if (framer.pending() != 0) {
+		lines.push_back ("unterminated: " + string (framer.pending(), '?'));
+	}
+}
+
+/*!
+ * Cut each server message into pieces of between 1 and 64 bytes. A
+ * piece never runs past the end of a message: the server waits for
+ * the client after each one.
+ */
+static void cut (const vector<TranscriptSegment>& segments, vector<string>& pieces)
+{
+	pieces.clear();
+	for (unsigned int i = 0; i < segments.size(); i++) {
+		const string& s = segments[i].server;
+		size_t pos = 0;
+		while (pos < s.size()) {
+			size_t n = 1 + rand() % 64;
+			pieces.push_back (s.substr (pos, n));
+			pos += n;
+		}
+	}
+}
+
+int main (int argc, char ** argv)
+{
+	int iterations = 1000;
+	unsigned int seed = 1;
+	int arg = 1;
+	int failures = 0;
+
+	if (argc > arg && isdigit (argv[arg][0])) {
+		iterations = atoi (argv[arg++]);
+	}
+	if (argc > arg && isdigit (argv[arg][0])) {
+		seed = atoi (argv[arg++]);
+	}
+	if (arg >= argc) {
+		cerr << "Usage: framertest [iterations [seed]] transcript.nxt..." << endl;
+		return -1;
+	}
+	srand (seed);
+
+	for (; arg < argc; arg++) {
+		vector<TranscriptSegment> segments;
+		if (!loadTranscript (argv[arg], segments)) {
+			cerr << "Can't read " << argv[arg] << endl;
+			return -1;
+		}
+
+		vector<string> pieces;
+		for (unsigned int i = 0; i < segments.size(); i++) {
+			pieces.push_back (segments[i].server);
+		}
+		vector<string> expected;
+		frame (pieces, expected);
+
+		int bad = 0;
+		for (int it = 0; it < iterations; it++) {
+			vector<string> got;
+			cut (segments, pieces);
+			frame (pieces, got);
+			if (got != expected) {
+				if (bad++ == 0) {
+					cerr << argv[arg] << ": iteration " << it << " differs:" << endl;
+					for (unsigned int j = 0; j < got.size() || j < expected.size(); j++) {
+						if (j >= got.size() || j >= expected.size() || got[j] != expected[j]) {
+							cerr << " expected '" << (j < expected.size() ? expected[j] : "")
+							     << "'" << endl << " got      '" << (j < got.size() ? got[j] : "")
+							     << "'" << endl;
+							break;
+						}
+					}
+				}
+			}
+		}
+
+		cout << argv[arg] << ": " << expected.size() << " lines, "
+		     << iterations << " iterations, " << bad << " failed" << endl;
+		failures += bad;
+	}
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,341 @@
+/***************************************************************************
+   handshaketest.cpp - Replay the recorded conversations in transcripts/
+                       through NXSession, checking its replies and
+                       timing it
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Each server line of a transcript is framed by NXLineFramer and
+ * handed to NXSession::parseSSH(), as NXClientLib does, until the
+ * session says it is ready for the proxy. The replies must be the
+ * client lines recorded in the transcript (session cookies aside,
+ * which are random). The whole replay is then repeated to measure
+ * the cost per line of parseSSH(), and of finding the strings
+ * parseSSH() looks for with NXPatternMatcher compared with a find()
+ * for each.
+ *
+ * A transcript may set the session data with lines like
+ * "D user jdoe"; see setData() for the names.
+ *
+ * Usage: handshaketest [iterations] transcript.nxt...
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "nxsession.h"
+#include "nxlineframer.h"
+#include "nxmatcher.h"
+#include "transcript.h"
+#include "nxtestutil.h"
+
+using namespace std;
+using namespace nxcl;
+
+ofstream debugLogFile;
+
+class ReplayCallbacks : public NXSessionCallbacks
+{
+	public:
+		ReplayCallbacks() : session(NULL), resume(-1), ready(false), defer(false) {}
+		void readyForProxySignal (void) { this->ready = true; }
+		void stageSignal (const string& stage) { this->stages.push_back (stage); }
+		void sessionsSignal (list<NXResumeData> sessions)
+		{
+			if (!this->defer && this->resume >= 0) {
+				this->session->chooseResumable (this->resume);
+			}
+		}
+
+		NXSession * session;
+		int resume;
+		bool ready;
+		/*!
+		 * Choose after parseSSH() returns, as nxcl does when the
+		 * choice comes back over dbus.
+		 */
+		bool defer;
+		vector<string> stages;
+};
+
+static double now (void)
+{
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*!
+ * Replace the value of --cookie="..." with stars
+ */
+static string hideCookie (const string& s)
+{
+	string::size_type a = s.find ("--cookie=\"");
+	if (a == string::npos) {
+		return s;
+	}
+	a += 10;
+	string::size_type b = s.find ('"', a);
+	if (b == string::npos) {
+		return s;
+	}
+	return s.substr (0, a) + "******" + s.substr (b);
+}
+
+/*!
+ * Apply a "D name value" line from a transcript.
+ */
+static void setData (const string& line, NXSessionData& d, string& user, string& pass, int& resume)
+{
+	string name, value;
+	string::size_type sp = line.find (' ');
+	name = line.substr (0, sp);
+	value = (sp == string::npos) ? "" : line.substr (sp+1);
+
+	if (name == "user") { user = value; }
+	else if (name == "password") { pass = value; }
+	else if (name == "session") { d.sessionName = value; }
+	else if (name == "type") { d.sessionType = value; }
+	else if (name == "link") { d.linkType = value; }
+	else if (name == "kbtype") { d.kbtype = value; }
+	else if (name == "geometry") { d.geometry = value; }
+	else if (name == "xres") { d.xRes = atoi (value.c_str()); }
+	else if (name == "yres") { d.yRes = atoi (value.c_str()); }
+	else if (name == "resume") { resume = atoi (value.c_str()); }
+	else { cerr << "Unknown session data '" << name << "'" << endl; }
+}
+
+/*!
+ * Replay \arg segments once. If \arg defer, the session to resume is
+ * chosen after the server has prompted for the next command, rather
+ * than from within sessionsSignal().
+ *
+ * \return the number of lines given to parseSSH(), the replies in
+ * \arg replies, the segment in which the session became ready for
+ * the proxy (or -1) in \arg readyAt, the time spent in parseSSH()
+ * in \arg t and, if \arg stages isn't NULL, the stages the session
+ * went through.
+ */
+static int replay (const vector<TranscriptSegment>& segments,
+		   const vector<string>& data, vector<string>& replies,
+		   int& readyAt, double& t, bool defer = false,
+		   vector<string> * stages = NULL)
+{
+	NXSessionData sd;
+	string user = "jdoe", pass = "secret";
+	int resume = -1;
+	setDefaults (sd);
+	for (unsigned int i = 0; i < data.size(); i++) {
+		setData (data[i], sd, user, pass, resume);
+	}
+
+	NXSession session;
+	ReplayCallbacks cb;
+	cb.session = &session;
+	cb.resume = resume;
+	cb.defer = defer;
+	session.setDeferChoice (defer);
+	session.setCallbacks (&cb);
+	session.setUsername (user);
+	session.setPassword (pass);
+	session.setSessionData (&sd);
+	session.runSession();
+
+	NXLineFramer framer;
+	NXLine line;
+	int lines = 0;
+
+	replies.clear();
+	readyAt = -1;
+	t = 0;
+	for (unsigned int i = 0; i < segments.size() && !cb.ready; i++) {
+		readyAt = i;
+		framer.feed (segments[i].server.data(), segments[i].server.size());
+		while (!cb.ready && framer.next (line)) {
+			string l = line.str();
+			double t0 = now();
+			string reply = session.parseSSH (l);
+			t += now() - t0;
+			lines++;
+			// Wait for the prompt which the session must hold
+			// back until the choice is made.
+			if (session.getAwaitingChoice() && line.prompt) {
+				if (resume >= 0) {
+					session.chooseResumable (resume);
+				} else {
+					session.chooseNewSession();
+				}
+				reply += session.releaseChoice();
+			}
+			if (!reply.empty()) {
+				replies.push_back (hideCookie (reply.substr (0, reply.size()-1)));
+			}
+		}
+	}
+	if (!cb.ready) {
+		readyAt = -1;
+	}
+	if (stages != NULL) {
+		*stages = cb.stages;
+	}
+	return lines;
+}
+
+int main (int argc, char ** argv)
+{
+	int iterations = 200;
+	int arg = 1;
+	int failures = 0;
+
+	if (argc > arg && isdigit (argv[arg][0])) {
+		iterations = atoi (argv[arg++]);
+	}
+	if (arg >= argc) {
+		cerr << "Usage: handshaketest [iterations] transcript.nxt..." << endl;
+		return -1;
+	}
+
+	for (; arg < argc; arg++) {
+		vector<TranscriptSegment> segments;
+		if (!loadTranscript (argv[arg], segments)) {
+			cerr << "Can't read " << argv[arg] << endl;
+			return -1;
+		}
+
+		// The session data are the "D" lines.
+		vector<string> data;
+		ifstream f (argv[arg]);
+		string l;
+		while (getline (f, l)) {
+			if (l.size() > 2 && l[0] == 'D' && l[1] == ' ') {
+				data.push_back (l.substr (2));
+			}
+		}
+
+		vector<string> replies;
+		int readyAt;
+		double t;
+		vector<string> stages;
+		int lines = replay (segments, data, replies, readyAt, t, false, &stages);
+
+		// Once the session is ready for the proxy, the rest of the
+		// conversation is up to NXClientLib, so the replies should be
+		// the client's lines up to there.
+		bool ok = (readyAt > 0);
+		if (!ok) {
+			cerr << argv[arg] << ": the session never became ready" << endl;
+		}
+		for (int i = 0; ok && (i < readyAt || i < static_cast<int>(replies.size())); i++) {
+			string expected = (i < readyAt) ? hideCookie (segments[i].client) : "(nothing)";
+			string got = (i < static_cast<int>(replies.size())) ? replies[i] : "(nothing)";
+			if (got != expected) {
+				cerr << argv[arg] << ": reply " << i << " differs:" << endl
+				     << " expected '" << expected << "'" << endl
+				     << " got      '" << got << "'" << endl;
+				ok = false;
+			}
+		}
+		// The stages must come in order, and end with the
+		// session ready for the proxy.
+		int last = -1;
+		for (unsigned int i = 0; ok && i < stages.size(); i++) {
+			int s = 0;
+			while (s < 16 && stages[i] != NXSession::stageName (s)) {
+				s++;
+			}
+			if (s <= last || s == 16) {
+				cerr << argv[arg] << ": stage '" << stages[i]
+				     << "' out of order" << endl;
+				ok = false;
+			}
+			last = s;
+		}
+		if (ok && (stages.empty() || stages.back() != "finished")) {
+			cerr << argv[arg] << ": the last stage wasn't 'finished'" << endl;
+			ok = false;
+		}
+		// The same again, with the choice of session made later.
+		vector<string> deferred;
+		int deferredAt;
+		replay (segments, data, deferred, deferredAt, t, true);
+		if (ok && (deferred != replies || deferredAt != readyAt)) {
+			cerr << argv[arg] << ": replies differ when the choice is deferred" << endl;
+			ok = false;
+		}
+		if (!ok) {
+			failures++;
+			continue;
+		}
+
+		double total = 0;
+		for (int it = 0; it < iterations; it++) {
+			replay (segments, data, replies, readyAt, t);
+			total += t;
+		}
+
+		// All the server's lines, through the matcher and through a
+		// find() for each pattern, as the old parseSSH() did.
+		const char * patterns[] = {
+			"Are you sure you want to continue connecting (yes/no)?",
+			"assword", "Permission denied", "su: Authentication failure",
+			"Unknown id:", "HELLO NXSERVER - Version", NULL
+		};
+		NXPatternMatcher matcher;
+		for (int i = 0; patterns[i] != NULL; i++) {
+			matcher.add (patterns[i]);
+		}
+		matcher.build();
+
+		vector<string> all;
+		for (unsigned int i = 0; i < segments.size(); i++) {
+			istringstream ss (segments[i].server);
+			while (getline (ss, l)) {
+				all.push_back (l);
+			}
+		}
+		unsigned int sink = 0;
+		double t0 = now();
+		for (int it = 0; it < iterations; it++) {
+			for (unsigned int i = 0; i < all.size(); i++) {
+				sink += matcher.match (all[i]);
+			}
+		}
+		double matchTime = now() - t0;
+		t0 = now();
+		for (int it = 0; it < iterations; it++) {
+			for (unsigned int i = 0; i < all.size(); i++) {
+				for (int j = 0; patterns[j] != NULL; j++) {
+					if (all[i].find (patterns[j]) != string::npos) {
+						sink += 1 << j;
+					}
+				}
+			}
+		}
+		double findTime = now() - t0;
+
+		double n = static_cast<double>(iterations);
+		cout << argv[arg] << ": " << replies.size() << " replies ok, "
+		     << stages.size() << " stages, "
+		     << lines << " lines, parseSSH " << total * 1e9 / (n * lines) << " ns/line; "
+		     << "patterns: matcher " << matchTime * 1e9 / (n * all.size())
+		     << " ns/line, find() " << findTime * 1e9 / (n * all.size())
+		     << " ns/line" << (sink == 0 ? " " : "") << endl;
+	}
+
+	return failures == 0 ? 0 : 1;
+}
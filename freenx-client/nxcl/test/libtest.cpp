@@ -109,23 +109,9 @@ int main (int argc, char **argv)
 	lib.stderrSignal.connect (&stderrInfo);
 	*/
 
-	//notQProcess& p = lib.getNXSSHProcess();
-	notQProcess* p;
-
-	while ((lib.getIsFinished()) == false) {
-		// We need to repeatedly check if there is any output to parse.
-		if (lib.getReadyForProxy() == false) {
-			p = lib.getNXSSHProcess();
-			p->probeProcess();
-		} else {
-			p = lib.getNXSSHProcess();
-			p->probeProcess();
-			p = lib.getNXProxyProcess();
-			p->probeProcess();
-		}
-
-		usleep (1000);
-	}
+	// Wait for output from nxssh/nxproxy and parse it, until the
+	// connection is finished.
+	lib.run();
 
 	writeOut ("Program finished.");
 
@@ -0,0 +1,308 @@
+/***************************************************************************
+   linktest.cpp - Check NXLinkMeter, and the link settings chosen for
+                  sessions with linkType "auto"
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Feeds NXLinkMeter made up timings for links from a LAN to a modem,
+ * and checks what it makes of them. Then starts sessions through
+ * NXClientLib against a scripted server ("ssh", as discoverytest
+ * does) which waits $NXTEST_DELAY seconds before each reply, and
+ * checks the startsession command it is sent.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "nxclientlib.h"
+#include "nxlinkmeter.h"
+#include "nxtestutil.h"
+
+using namespace std;
+using namespace nxcl;
+
+ofstream debugLogFile;
+
+static const char * server =
+	"#!/bin/sh\n"
+	"d() { [ -n \"$NXTEST_DELAY\" ] && sleep $NXTEST_DELAY; }\n"
+	"printf 'HELLO NXSERVER - Version 3.2.0-74-SVN OS (GPL, using backend: 3.5.0)\\nNX> 105 '\n"
+	"state=\n"
+	"while read -r line; do\n"
+	"  d\n"
+	"  case \"$state\" in\n"
+	"  user) state=pass; printf '%s\\nNX> 102 Password: ' \"$line\"; continue;;\n"
+	"  pass) state=; printf '\\nNX> 103 Welcome to: nxhost user: jdoe\\nNX> 105 '; continue;;\n"
+	"  esac\n"
+	"  case \"$line\" in\n"
+	"  hello*) printf '%s\\nNX> 134 Accepted protocol: 3.0.0\\nNX> 105 ' \"$line\";;\n"
+	"  \"SET AUTH_MODE\"*) printf '%s\\nSet auth_mode: password\\nNX> 105 ' \"$line\";;\n"
+	"  SET*) printf '%s\\nNX> 105 ' \"$line\";;\n"
+	"  login) state=user; printf '%s\\nNX> 101 User: ' \"$line\";;\n"
+	"  listsession*)\n"
+	"    printf '%s\\nNX> 127 Sessions list of user '\\''jdoe'\\'' for reconnect:\\n\\n' \"$line\"\n"
+	"    printf '\\n\\nNX> 148 Server capacity: not reached for user: jdoe\\nNX> 105 ';;\n"
+	"  startsession*)\n"
+	"    echo \"$line\" > \"$NXTEST_DIR/log\"\n"
+	"    printf 'NX> 1000 NXNODE - Version 3.2.0-74-SVN OS (GPL, using backend: 3.5.0)\\n'\n"
+	"    printf 'NX> 700 Session id: nxhost-1001-5C7E1B0A7D1E4D3E8A54C2BF3E1D9C4A\\n'\n"
+	"    printf 'NX> 705 Session display: 1001\\nNX> 703 Session type: unix-kde\\n'\n"
+	"    printf 'NX> 701 Proxy cookie: 5d9a3c4f6e2b1a0c9d8e7f6a5b4c3d2e\\nNX> 702 Proxy IP: 127.0.0.1\\n'\n"
+	"    printf 'NX> 706 Agent cookie: 5d9a3c4f6e2b1a0c9d8e7f6a5b4c3d2e\\nNX> 704 Session cache: unix-kde\\n'\n"
+	"    printf 'NX> 707 SSL tunneling: 1\\nNX> 710 Session status: running\\n'\n"
+	"    printf 'NX> 1002 Commit\\nNX> 1006 Session status: running\\nNX> 105 ';;\n"
+	"  bye)\n"
+	"    printf 'bye\\nBye\\nNX> 999 Bye\\n'; printf 'NX> 999 Bye\\n' >&2\n"
+	"    printf 'NX> 287 Redirected I/O to channel descriptors\\n'; exit 0;;\n"
+	"  *) printf '%s\\nNX> 105 ' \"$line\";;\n"
+	"  esac\n"
+	"done\n";
+
+class LinkCallbacks : public NXClientLibExternalCallbacks
+{
+	public:
+		LinkCallbacks() : measured(0), messages(0) {}
+		void linkMeasuredSignal (const NXLinkStats& stats)
+		{
+			this->measured++;
+			this->stats = stats;
+		}
+		void write (int num, string msg)
+		{
+			if (num == NXCL_LINK_MEASURED) {
+				this->messages++;
+			}
+		}
+
+		int measured;
+		int messages;
+		NXLinkStats stats;
+};
+
+/*!
+ * One exchange: write at \arg t, and the reply comes \arg rtt later,
+ * in \arg pieces reads of \arg bytes each, \arg gap apart (all in
+ * microseconds). \return when the last piece came.
+ */
+static long long exchange (NXLinkMeter& m, long long t, long long rtt,
+			   int pieces = 1, size_t bytes = 64, long long gap = 0)
+{
+	m.sent (t);
+	t += rtt;
+	for (int i = 0; i < pieces; i++, t += gap) {
+		m.received (bytes, t);
+	}
+	return t;
+}
+
+static int checkMeter (const string& name, NXLinkMeter& m, const char * expect,
+		       long long minRtt, long long rate = -1)
+{
+	int failures = 0;
+	NXLinkStats s = m.getStats();
+	if (s.linkType != expect) {
+		cout << name << ": looks like " << s.linkType << ", not " << expect << endl; failures++;
+	}
+	if (minRtt >= 0 && s.minRtt != minRtt) {
+		cout << name << ": shortest round trip " << s.minRtt << "us, not " << minRtt << endl;
+		failures++;
+	}
+	if (rate >= 0 && (s.bytesPerSecond < rate * 9 / 10 || s.bytesPerSecond > rate * 11 / 10)) {
+		cout << name << ": " << s.bytesPerSecond << " bytes/s, not about " << rate << endl;
+		failures++;
+	}
+	cout << name << ": " << s.samples << " round trips, " << s.minRtt << "us, "
+	     << s.bytesPerSecond << " bytes/s, " << s.linkType << ", "
+	     << (failures ? "FAILED" : "ok") << endl;
+	return failures;
+}
+
+/*!
+ * hello, two SETs, login, user, password (which the server takes its
+ * time over) and the list of sessions, over a link with round trip
+ * \arg rtt.
+ */
+static long long login (NXLinkMeter& m, long long rtt)
+{
+	long long t = 1000000;
+	for (int i = 0; i < 5; i++) {
+		t = exchange (m, t + 100, rtt);
+	}
+	t = exchange (m, t + 100, rtt + 300000);
+	return exchange (m, t + 100, rtt);
+}
+
+static int checkMeters (void)
+{
+	int failures = 0;
+	NXLinkMeter m;
+
+	failures += checkMeter ("nothing measured", m, "adsl", -1);
+
+	login (m, 400);
+	failures += checkMeter ("lan", m, "lan", 400);
+
+	m.reset();
+	login (m, 35000);
+	failures += checkMeter ("vpn", m, "adsl", 35000);
+
+	m.reset();
+	login (m, 8000);
+	failures += checkMeter ("wan", m, "wan", 8000);
+
+	m.reset();
+	login (m, 150000);
+	failures += checkMeter ("isdn", m, "isdn", 150000);
+
+	m.reset();
+	login (m, 600000);
+	failures += checkMeter ("modem", m, "modem", 600000);
+
+	// A short round trip, but a long list of sessions comes at
+	// 10 KB/s: 8 reads of 1000 bytes, 0.1s apart, after the first.
+	m.reset();
+	long long t = login (m, 500);
+	exchange (m, t + 100, 500, 9, 1000, 100000);
+	failures += checkMeter ("slow list", m, "isdn", 500, 10000);
+
+	// A long reply which all comes in one read, or a short one in
+	// pieces, tells us nothing of the rate.
+	m.reset();
+	t = login (m, 500);
+	t = exchange (m, t + 100, 500, 1, 100000);
+	exchange (m, t + 100, 500, 8, 100, 100000);
+	NXLinkStats s = m.getStats();
+	if (s.bytesPerSecond != -1 || s.linkType != "lan") {
+		cout << "no rate: " << s.bytesPerSecond << " bytes/s, " << s.linkType
+		     << ", FAILED" << endl;
+		failures++;
+	} else {
+		cout << "no rate: ok" << endl;
+	}
+
+	return failures;
+}
+
+/*!
+ * Start a session with \arg linkType over a link which takes \arg
+ * delay seconds to answer, and check that the startsession command
+ * has all of \arg expect.
+ */
+static int checkSession (const string& name, const string& dir, const string& linkType,
+			 const char * delay, const char ** expect)
+{
+	int failures = 0;
+	unlink ((dir + "/log").c_str());
+	if (delay != NULL) {
+		setenv ("NXTEST_DELAY", delay, 1);
+	} else {
+		unsetenv ("NXTEST_DELAY");
+	}
+
+	LinkCallbacks cb;
+	NXSessionData sd;
+	setDefaults (sd);
+	// The settings of a lan link, so that it shows which ones auto changed.
+	sd.linkType = linkType;
+	sd.cache = 1;
+	sd.images = 1;
+	sd.imageCompressionMethod = 0;
+	sd.imageCompressionLevel = 0;
+	string user = "jdoe", pass = "secret";
+
+	NXClientLib lib;
+	lib.setExternalCallbacks (&cb);
+	lib.setCustomPath (dir);
+	lib.setUseServerCache (false);
+	lib.setSessionData (&sd);
+	lib.setUsername (user);
+	lib.setPassword (pass);
+	lib.runSession();
+	lib.invokeNXSSH ("default", "nxhost", true, "", 22);
+
+	long long start = NXTrace::now();
+	while (!lib.getIsFinished() && NXTrace::now() - start < 10000000LL) {
+		if (lib.runOnce (100) < 0) {
+			break;
+		}
+	}
+	notQProcess * p[] = { lib.getNXSSHProcess(), lib.getNXProxyProcess() };
+	for (int i = 0; i < 2; i++) {
+		if (p[i]->getPid() > 0) {
+			p[i]->terminate();
+		}
+	}
+
+	string command;
+	{
+		ifstream f ((dir + "/log").c_str());
+		getline (f, command);
+	}
+	for (int i = 0; expect[i] != NULL; i++) {
+		if (command.find (expect[i]) == string::npos) {
+			cout << name << ": no " << expect[i] << " in" << endl << command << endl;
+			failures++;
+		}
+	}
+	bool automatic = (linkType == "auto");
+	if (cb.measured != 1 || cb.messages != (automatic ? 1 : 0)) {
+		cout << name << ": measured " << cb.measured << " times, "
+		     << cb.messages << " messages" << endl; failures++;
+	}
+	if (automatic && sd.linkType != cb.stats.linkType) {
+		cout << name << ": chose " << sd.linkType << ", but " << cb.stats.linkType
+		     << " was reported" << endl; failures++;
+	}
+
+	cout << name << ": " << cb.stats.samples << " round trips, shortest "
+	     << cb.stats.minRtt / 1000 << "ms, looks like " << cb.stats.linkType
+	     << ", sent " << sd.linkType << ", " << (failures ? "FAILED" : "ok") << endl;
+	return failures;
+}
+
+int main()
+{
+	signal (SIGPIPE, SIG_IGN);
+	int failures = checkMeters();
+
+	string dir = makeFakeServerDir (server, "#!/bin/sh\nexit 0\n");
+	if (dir.empty()) {
+		return 1;
+	}
+
+	// 40ms each way round looks like adsl
+	const char * adsl[] = { "--link=\"adsl\"", "--cache=\"8M\"", "--images=\"32M\"",
+		"--imagecompressionmethod=\"-1\"", NULL };
+	failures += checkSession ("auto, slow", dir, "auto", "0.04", adsl);
+
+	// The user's choice stands.
+	const char * lan[] = { "--link=\"lan\"", "--cache=\"1M\"", "--images=\"1M\"",
+		"--imagecompressionmethod=\"0\"", NULL };
+	failures += checkSession ("lan, slow", dir, "lan", "0.04", lan);
+
+	// On this machine it could be lan or wan; it's not auto.
+	const char * fast[] = { "--imagecompressionmethod=\"2\"", NULL };
+	failures += checkSession ("auto, fast", dir, "auto", NULL, fast);
+
+	removeFakeServerDir (dir);
+	if (failures == 0) {
+		cout << "all passed" << endl;
+	}
+	return failures;
+}
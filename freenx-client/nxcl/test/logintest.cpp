@@ -0,0 +1,335 @@
+/***************************************************************************
+   logintest.cpp - Check the server cache and the pipelined login
+                   against scripted servers
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Stores, looks up and forgets servers in an NXServerCache in a
+ * temporary directory. Then logs in to a scripted FreeNX server one
+ * command per prompt, and checks what NXSession learns of it; logs in
+ * again with that, and checks that the SET commands and the login go
+ * out in a single write; and checks that a server which doesn't echo
+ * them, or which throws away what it hasn't read yet, or which has
+ * been upgraded, gets them one at a time.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <list>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nxsession.h"
+#include "nxlineframer.h"
+#include "nxservercache.h"
+#include "nxtrace.h"
+#include "nxtestutil.h"
+
+using namespace std;
+using namespace nxcl;
+
+ofstream debugLogFile;
+
+class LoginCallbacks : public NXSessionCallbacks
+{
+	public:
+		LoginCallbacks() : learnt(0) {}
+		void serverInfoSignal (const NXServerInfo& info)
+		{
+			this->learnt++;
+			this->info = info;
+		}
+
+		int learnt;
+		NXServerInfo info;
+};
+
+#define HELLO "HELLO NXSERVER - Version 3.2.0-74-SVN OS (GPL, using backend: 3.5.0)\nNX> 105 "
+#define UPGRADED "HELLO NXSERVER - Version 3.3.0-1 OS (GPL, using backend: 3.5.0)\nNX> 105 "
+#define ACCEPTED "hello NXCLIENT - Version 3.0.0\nNX> 134 Accepted protocol: 3.0.0\nNX> 105 "
+#define USER "jdoe\nNX> 102 Password: "
+#define WELCOME "\nNX> 103 Welcome to: nxhost user: jdoe\nNX> 105 "
+
+/*
+ * Each string is what the server writes after reading our last
+ * reply; NULL for nothing at all.
+ */
+
+// One command per prompt, each echoed
+static const char * sequential[] = {
+	HELLO, ACCEPTED,
+	"SET SHELL_MODE SHELL\nNX> 105 ",
+	"SET AUTH_MODE PASSWORD\nSet auth_mode: password\nNX> 105 ",
+	"login\nNX> 101 User: ",
+	USER, WELCOME, NULL
+};
+
+// All three commands read at once, the prompts and echoes run together
+static const char * pipelined[] = {
+	HELLO, ACCEPTED,
+	"SET SHELL_MODE SHELL\nNX> 105 SET AUTH_MODE PASSWORD\nSet auth_mode: password\n"
+		"NX> 105 login\nNX> 101 User: ",
+	USER, WELCOME, NULL
+};
+
+// Doesn't echo what we send
+static const char * silent[] = {
+	HELLO, ACCEPTED,
+	"NX> 105 ",
+	"NX> 105 ",
+	"Set auth_mode: password\nNX> 105 ",
+	"NX> 101 User: ",
+	USER, WELCOME, NULL
+};
+
+static const char * upgraded[] = {
+	UPGRADED, ACCEPTED,
+	"SET SHELL_MODE SHELL\nNX> 105 ",
+	"SET AUTH_MODE PASSWORD\nSet auth_mode: password\nNX> 105 ",
+	"login\nNX> 101 User: ",
+	USER, WELCOME, NULL
+};
+
+/*!
+ * Log in to the server \arg script, with \arg cached (if not NULL)
+ * from the server cache.
+ *
+ * \return the number of writes it took, or -1 if the login failed.
+ */
+static int login (const char ** script, const NXServerInfo * cached, LoginCallbacks& cb,
+		  bool& pipelinedLogin)
+{
+	string user = "jdoe", pass = "secret";
+	NXSession session;
+	session.setCallbacks (&cb);
+	session.setUsername (user);
+	session.setPassword (pass);
+	session.setControlMode (true);
+	if (cached != NULL) {
+		session.setServerInfo (*cached);
+	}
+	session.runSession();
+
+	NXLineFramer framer;
+	NXLine line;
+	int writes = 0;
+	pipelinedLogin = false;
+	for (int i = 0; script[i] != NULL; i++) {
+		framer.feed (script[i], strlen (script[i]));
+		while (framer.next (line)) {
+			string reply = session.parseSSH (line.str());
+			if (session.getLoginPipelined()) {
+				pipelinedLogin = true;
+			}
+			if (!reply.empty()) {
+				writes++;
+			}
+		}
+	}
+	return session.getControlReady() ? writes : -1;
+}
+
+static bool sameInfo (const NXServerInfo& a, const NXServerInfo& b)
+{
+	return a.version == b.version && a.freenx == b.freenx
+		&& a.pipelining == b.pipelining && a.sets == b.sets;
+}
+
+static int checkCache (const string& dir)
+{
+	int failures = 0;
+	string path = dir + "/cache/servers";
+	NXServerCache cache (path);
+	NXServerInfo a, b, got;
+
+	a.version = "3.2.0-74-SVN";
+	a.freenx = true;
+	a.pipelining = true;
+	a.sets.push_back ("SHELL_MODE SHELL");
+	a.sets.push_back ("AUTH_MODE PASSWORD");
+	b.version = "3.5.0-9";
+	b.freenx = false;
+	b.pipelining = false;
+
+	if (cache.lookup ("nxhost", 22, got)) {
+		cout << "cache: found a server in an empty cache" << endl; failures++;
+	}
+	if (!cache.store ("nxhost", 22, a) || !cache.store ("nxhost", 2222, b)
+	    || !cache.store ("other", 22, b)) {
+		cout << "cache: couldn't write " << path << endl; failures++;
+	}
+	if (!cache.lookup ("nxhost", 22, got) || !sameInfo (got, a)
+	    || !cache.lookup ("nxhost", 2222, got) || !sameInfo (got, b)) {
+		cout << "cache: lookups wrong" << endl; failures++;
+	}
+
+	// A line we can't read is skipped, and dropped when the file
+	// is next written.
+	{
+		ofstream f (path.c_str(), ios::app);
+		f << "garbage\n";
+	}
+	b.version = "3.5.0-10";
+	if (!cache.store ("other", 22, b) || !cache.forget ("nxhost", 2222)) {
+		cout << "cache: couldn't rewrite " << path << endl; failures++;
+	}
+	if (cache.lookup ("nxhost", 2222, got)
+	    || !cache.lookup ("other", 22, got) || got.version != "3.5.0-10"
+	    || !cache.lookup ("nxhost", 22, got) || !sameInfo (got, a)) {
+		cout << "cache: wrong after rewriting" << endl; failures++;
+	}
+	{
+		ifstream f (path.c_str());
+		string all, line;
+		while (getline (f, line)) { all += line + "\n"; }
+		if (countLines (all) != 3 || all.find ("garbage") != string::npos) {
+			cout << "cache: file is" << endl << all; failures++;
+		}
+	}
+
+	cout << "cache: " << (failures ? "FAILED" : "ok") << endl;
+	return failures;
+}
+
+static int checkLogin (const string& name, const char ** script, const NXServerInfo * cached,
+		       int expectWrites, bool expectPipelined, bool expectPipelining,
+		       NXServerInfo * learnt = NULL)
+{
+	int failures = 0;
+	LoginCallbacks cb;
+	bool pipelinedLogin;
+	int writes = login (script, cached, cb, pipelinedLogin);
+
+	if (writes != expectWrites) {
+		cout << name << ": " << writes << " writes, not " << expectWrites << endl; failures++;
+	}
+	if (pipelinedLogin != expectPipelined) {
+		cout << name << ": login " << (pipelinedLogin ? "" : "not ") << "pipelined" << endl;
+		failures++;
+	}
+	if (cb.learnt != 1 || cb.info.pipelining != expectPipelining
+	    || cb.info.sets.size() != 2 || !cb.info.freenx) {
+		cout << name << ": learnt the wrong things of the server" << endl; failures++;
+	}
+	if (learnt != NULL) {
+		*learnt = cb.info;
+	}
+	cout << name << ": " << writes << " writes, " << (failures ? "FAILED" : "ok") << endl;
+	return failures;
+}
+
+/*!
+ * A server which reads the first SET and throws away the rest of what
+ * we sent, as some shells do: we must give up waiting for the echo of
+ * the second, and send it again.
+ */
+static int checkStall (const NXServerInfo& cached)
+{
+	int failures = 0;
+	LoginCallbacks cb;
+	string user = "jdoe", pass = "secret";
+	NXSession session;
+	session.setCallbacks (&cb);
+	session.setUsername (user);
+	session.setPassword (pass);
+	session.setControlMode (true);
+	session.setServerInfo (cached);
+	session.runSession();
+
+	NXLineFramer framer;
+	NXLine line;
+	const char * script[] = { HELLO, ACCEPTED, "SET SHELL_MODE SHELL\nNX> 105 ", NULL };
+	string reply;
+	for (int i = 0; script[i] != NULL; i++) {
+		framer.feed (script[i], strlen (script[i]));
+		while (framer.next (line)) {
+			reply = session.parseSSH (line.str());
+		}
+	}
+	int wait = session.getPipelineWait();
+	if (!reply.empty() || wait <= 0) {
+		cout << "stalled: not waiting for the echo" << endl; failures++;
+	}
+	if (session.pipelineStalled() != "") {
+		cout << "stalled: gave up too soon" << endl; failures++;
+	}
+
+	long long start = NXTrace::now();
+	usleep ((wait + 10) * 1000);
+	reply = session.pipelineStalled();
+	if (reply != "SET AUTH_MODE PASSWORD\n" || session.getPipelineWait() != -1) {
+		cout << "stalled: sent '" << reply << "' after the stall" << endl; failures++;
+	}
+
+	const char * rest[] = {
+		"SET AUTH_MODE PASSWORD\nSet auth_mode: password\nNX> 105 ",
+		"login\nNX> 101 User: ", USER, WELCOME, NULL
+	};
+	int writes = 0;
+	for (int i = 0; rest[i] != NULL; i++) {
+		framer.feed (rest[i], strlen (rest[i]));
+		while (framer.next (line)) {
+			if (!session.parseSSH (line.str()).empty()) {
+				writes++;
+			}
+		}
+	}
+	if (!session.getControlReady() || writes != 3) {
+		cout << "stalled: login didn't finish" << endl; failures++;
+	}
+	if (cb.learnt != 1 || cb.info.pipelining || cb.info.sets.size() != 2) {
+		cout << "stalled: pipelining wasn't given up" << endl; failures++;
+	}
+
+	cout << "stalled: resent after " << (NXTrace::now() - start) / 1000 << "ms, "
+	     << (failures ? "FAILED" : "ok") << endl;
+	return failures;
+}
+
+int main()
+{
+	int failures = 0;
+
+	string dir = makeFakeServerDir();
+	if (dir.empty()) {
+		return 1;
+	}
+	failures += checkCache (dir);
+	removeFakeServerDir (dir);
+
+	// hello, 3 commands, user and password
+	NXServerInfo learnt;
+	failures += checkLogin ("first login", sequential, NULL, 6, false, true, &learnt);
+	if (learnt.version != "3.2.0-74-SVN" || learnt.sets.front() != "SHELL_MODE SHELL") {
+		cout << "first login: learnt version '" << learnt.version << "'" << endl; failures++;
+	}
+
+	// hello, commands, user and password
+	failures += checkLogin ("pipelined", pipelined, &learnt, 4, true, true);
+
+	// The first prompt comes without the echo, so the SET is sent
+	// again and the rest go one at a time.
+	failures += checkLogin ("no echo", silent, &learnt, 7, true, false);
+
+	failures += checkLogin ("upgraded", upgraded, &learnt, 6, false, true);
+
+	failures += checkStall (learnt);
+
+	if (failures == 0) {
+		cout << "all passed" << endl;
+	}
+	return failures;
+}
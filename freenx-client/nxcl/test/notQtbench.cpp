@@ -0,0 +1,143 @@
+/***************************************************************************
+   notQtbench.cpp - Compare the cost of draining a process pipe the old
+                    way (read() and poll() per byte) with notQRingBuffer
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * For a range of message sizes (from a few lines of nxssh chatter up
+ * to a pipe-full of nxproxy statistics), fill a pipe and drain it
+ * again, counting the system calls and the time taken. Run it with
+ * no arguments; the output is one line per message size.
+ */
+
+#include <iostream>
+#include <string>
+
+extern "C" {
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/poll.h>
+}
+
+#include "notQt.h"
+
+using namespace std;
+using namespace nxcl;
+
+ofstream debugLogFile;
+
+static unsigned long oldSyscalls = 0;
+
+/*!
+ * This is how notQProcess::readAllStandardOutput() used to work.
+ */
+static string oldReadAll (int fd)
+{
+	string s;
+	char c;
+	struct pollfd p;
+
+	p.fd = fd;
+	p.events = POLLIN | POLLPRI;
+	p.revents = POLLIN;
+	while (p.revents & POLLIN || p.revents & POLLPRI) {
+		oldSyscalls++;
+		if (read (fd, &c, 1) == 1) {
+			s.append (1, c);
+		} else {
+			break;
+		}
+		p.revents = 0;
+		oldSyscalls++;
+		poll (&p, 1, 0);
+	}
+	return s;
+}
+
+static double now (void)
+{
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void fill (int fd, const string& data)
+{
+	if (write (fd, data.data(), data.size()) != static_cast<ssize_t>(data.size())) {
+		cerr << "short write to the pipe" << endl;
+	}
+}
+
+int main()
+{
+	const size_t sizes[] = { 128, 1024, 4096, 16384, 61440 };
+	const int repeats = 50;
+	int fds[2];
+
+	if (pipe (fds) == -1) {
+		cerr << "pipe() failed" << endl;
+		return -1;
+	}
+	fcntl (fds[0], F_SETFL, fcntl (fds[0], F_GETFL) | O_NONBLOCK);
+
+	notQRingBuffer ring;
+
+	cout << "bytes  old-syscalls/KB  new-syscalls/KB  old-us/KB  new-us/KB" << endl;
+
+	for (unsigned int i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++) {
+		string data (sizes[i], 'x');
+		for (size_t j = 79; j < data.size(); j += 80) {
+			data[j] = '\n';
+		}
+
+		oldSyscalls = 0;
+		double t = 0;
+		for (int r = 0; r < repeats; r++) {
+			fill (fds[1], data);
+			double t0 = now();
+			string got = oldReadAll (fds[0]);
+			t += now() - t0;
+			if (got.size() != data.size()) {
+				cerr << "old: read " << got.size() << " of " << data.size() << endl;
+			}
+		}
+		double oldTime = t;
+
+		unsigned long before = ring.getReadCalls();
+		t = 0;
+		for (int r = 0; r < repeats; r++) {
+			fill (fds[1], data);
+			double t0 = now();
+			string got;
+			ring.readFrom (fds[0]);
+			ring.takeAll (got);
+			t += now() - t0;
+			if (got.size() != data.size()) {
+				cerr << "new: read " << got.size() << " of " << data.size() << endl;
+			}
+		}
+		double newTime = t;
+		unsigned long newSyscalls = ring.getReadCalls() - before;
+
+		double kb = (sizes[i] * repeats) / 1024.0;
+		cout << sizes[i] << "  "
+		     << oldSyscalls / kb << "  "
+		     << newSyscalls / kb << "  "
+		     << oldTime * 1000000.0 / kb << "  "
+		     << newTime * 1000000.0 / kb << endl;
+	}
+
+	return 0;
+}
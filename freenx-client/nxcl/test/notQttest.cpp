@@ -19,6 +19,7 @@
 #include <iostream>
 #include <string>
 #include <list>
+#include <sys/time.h>
 
 #include "notQt.h"
 
@@ -29,10 +30,35 @@ ofstream debugLogFile;
 
 notQProcess p2;
 
+class WatchCallbacks : public notQWatchCallbacks
+{
+public:
+	WatchCallbacks() : calls(0) {}
+	void fdReadySignal (int fd, short events)
+	{
+		char buf[16];
+		this->calls++;
+		cout << "fdReadySignal called for fd " << fd << ", events " << events
+		     << ", read " << read (fd, buf, sizeof (buf)) << " bytes" << endl;
+	}
+	int calls;
+};
+
+class TimerCallbacks : public notQTimerCallbacks
+{
+public:
+	TimerCallbacks() : calls(0) {}
+	void timerSignal (void) { this->calls++; }
+	int calls;
+};
+
+string p2Output;
+
 void processParseStdout()
 {
 	string message = p2.readAllStandardOutput();
 	cout << "processParseStdout called, message is: " << message << endl;
+	p2Output += message;
 }
 void processParseStderr()
 {
@@ -40,8 +66,19 @@ void processParseStderr()
 	cout << "processParseStderr called, message is: " << message << endl;
 }
 
+/*!
+ * Pass p2's output on to the functions above.
+ */
+class ProcessCallbacks : public notQProcessCallbacks
+{
+public:
+	void readyReadStandardOutputSignal (void) { processParseStdout(); }
+	void readyReadStandardErrorSignal (void) { processParseStderr(); }
+};
+
 int main()
 {
+	int failures = 0;
 
 	debugLogFile.open("/tmp/notQttest.log", ios::out|ios::trunc);
 
@@ -77,65 +114,124 @@ int main()
 	}
 	*/
 
-	// Test processes to read some input
+	// Test watching a descriptor with the event loop
+	notQEventLoop loop;
+	WatchCallbacks wcb;
+	int fds[2];
+	if (pipe (fds) == -1) {
+		cout << "pipe() failed" << endl;
+		return -1;
+	}
+	loop.setWatch (fds[0], POLLIN, &wcb);
+	cout << "runOnce with nothing to read returns " << loop.runOnce (0) << endl;
+	if (write (fds[1], "x", 1) != 1) {
+		cout << "write() failed" << endl;
+	}
+	int n = loop.runOnce (1000);
+	cout << "runOnce with a byte to read returns " << n << endl;
+	loop.removeWatch (fds[0]);
+	cout << "runOnce with no watches returns " << loop.runOnce (0)
+	     << "; fdReadySignal was called " << wcb.calls << " time(s)" << endl;
+	close (fds[0]);
+	close (fds[1]);
+
+	// Test a timer: with nothing else in the loop, runOnce must
+	// still wait for it, and the loop is empty once it has run.
+	{
+		TimerCallbacks tcb, cancelled;
+		loop.setTimer (&tcb, 100);
+		loop.setTimer (&cancelled, 50);
+		loop.removeTimer (&cancelled);
+		struct timeval t0, t1;
+		gettimeofday (&t0, NULL);
+		n = loop.runOnce (-1);
+		gettimeofday (&t1, NULL);
+		long ms = (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_usec - t0.tv_usec) / 1000;
+		int after = loop.runOnce (0);
+		bool ok = (n == 1 && tcb.calls == 1 && cancelled.calls == 0
+			   && ms >= 100 && ms < 500 && after == -1);
+		cout << "timer ran after " << ms << "ms, then runOnce returns " << after
+		     << ": " << (ok ? "ok" : "FAILED") << endl;
+		if (!ok) {
+			failures++;
+		}
+	}
+
+	// Test two loops sharing SIGCHLD. The shells' pipes stay open
+	// (the sleep in the background has them), so only SIGCHLD says
+	// they've gone; whichever loop reads it must tell the other.
+	{
+		notQEventLoop loopA, loopB;
+		notQProcess a, b;
+		notQProcessCallbacks pcb;
+		list<string> shArgs;
+		shArgs.push_back ("/bin/sh");
+		shArgs.push_back ("-c");
+		shArgs.push_back ("sleep 0.2; sleep 2 & exit 0");
+		a.setCallbacks (&pcb);
+		b.setCallbacks (&pcb);
+		a.setEventLoop (&loopA);
+		b.setEventLoop (&loopB);
+		a.start ("/bin/sh", shArgs);
+		b.start ("/bin/sh", shArgs);
+		loopA.runOnce (0);
+		loopB.runOnce (0);
+		for (int i = 0; i < 10 && !a.getFinished(); i++) {
+			loopA.runOnce (1000);
+		}
+		struct timeval t0, t1;
+		gettimeofday (&t0, NULL);
+		for (int i = 0; i < 10 && !b.getFinished(); i++) {
+			loopB.runOnce (1000);
+		}
+		gettimeofday (&t1, NULL);
+		long ms = (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_usec - t0.tv_usec) / 1000;
+		bool ok = (a.getFinished() && b.getFinished() && ms < 500);
+		cout << "second loop saw its child exit after " << ms << "ms: "
+		     << (ok ? "ok" : "FAILED") << endl;
+		if (!ok) {
+			failures++;
+		}
+	}
+
+	// Test a process which reads some input
+	ProcessCallbacks pcb;
 	notQProcess p;
+	p.setCallbacks (&pcb);
 	string program = "/usr/bin/tee";
 	list<string> args;       
 	// Always push_back the program first.
 	args.push_back(program);
-	args.push_back("teeout");
+	args.push_back("/dev/null");
 	p.start (program, args);
 	cout << "p.getPid=" << p.getPid() << endl;
 	if (p.waitForStarted() == true) {
 		string data = "Some input text";
 		p.writeIn (data);
-
+		p.terminate();
 	} else { 
 		cout << "not started" << endl;
 		return -1;
 	}
 
-	// Test process that generates output
-	bool finished = false;
-//	program = "/usr/bin/eo";
-	program = "/usr/bin/tee";
-	args.clear();
-	// Always push_back the program first.
-	args.push_back(program);
-	args.push_back("hello");
-
-	// p2 is a global in this test
-
-/* FIXME: This needs to be changed, now that we got rid of boost signals.
-	p2.readyReadStandardOutputSignal.connect (&processParseStdout);
-	p2.readyReadStandardErrorSignal.connect (&processParseStderr);
-*/
+	// Test a process which generates output: tee gives back what
+	// it's given.
+	p2.setCallbacks (&pcb);
 	p2.start (program, args);
 	cout << "p2.getPid=" << p2.getPid() << endl;
 	if (p2.waitForStarted() == true) {
-		string output;
-		string errout;
-		string instring = "data, data";
-		while (finished == false) {
+		string instring = "data, data\n";
+		p2.writeIn (instring);
+		for (int i = 0; i < 200 && p2Output.size() < instring.size(); i++) {
+			usleep (10000);
 			p2.probeProcess();
-/* You can get the output without signals:
-			output = p2.readAllStandardOutput();
-			errout = p2.readAllStandardError();
-			if (output.size()>0) {
-				cout << program << " generated this output: " << output << endl;
-				finished = true;
-			}
-			if (errout.size()>0) {
-				cout << program << " generated this error: " << errout << endl;
-				finished = true;
-			}
-			cout << "sleeping" << endl;
-*/	
-			usleep (1000000);
-			p2.writeIn (instring);
-			usleep (1000000);
 		}
-
+		cout << program << " echoed '" << p2Output.substr (0, p2Output.size() - 1) << "': "
+		     << (p2Output == instring ? "ok" : "FAILED") << endl;
+		if (p2Output != instring) {
+			failures++;
+		}
+		p2.terminate();
 	} else { 
 		cout << "not started" << endl;
 		return -1;
@@ -143,5 +239,6 @@ int main()
 
 	debugLogFile.close();
 
-	return 0;
+	cout << (failures ? "FAILED" : "all passed") << endl;
+	return failures;
 }
@@ -26,10 +26,14 @@
  * This is a very hacked together program, part C, part C++, but it
  * serves its purpose of demonstrating the techniques you'll need to
  * write a simple client to nxcl.
+ *
+ * With --discover, it doesn't use nxcl at all, but lists the sessions
+ * on several servers at once with libnxcl's NXDiscovery.
  */
 
 #include <iostream>
 #include <sstream>
+#include <fstream>
 
 extern "C" {
 #include <stdlib.h>
@@ -43,10 +47,11 @@ extern "C" {
 #include <signal.h>
 }
 
-// This is the only dependency on nxcl here. If you want, all you have
-// to do is copy the NXConfigData structure out of nxdata.h and you
-// remove the dependency.
+// Apart from --discover, this is the only dependency on nxcl here. If
+// you want, all you have to do is copy the NXConfigData structure out
+// of nxdata.h and you remove the dependency.
 #include "../lib/nxdata.h"
+#include "../lib/nxdiscovery.h"
 
 using namespace std;
 
@@ -86,6 +91,12 @@ static int sendReply (DBusConnection *bus, int sessionNum);
  */
 static int terminateSession (DBusConnection *bus, int sessionNum);
 
+/*!
+ * List the sessions on each of the servers given on the command line
+ * (after "--discover"), all at once, and say how long each took.
+ */
+static int discover (int argc, char **argv);
+
 /*!
  * Lazily use some globals, as this is just an example command line program.
  */
@@ -93,6 +104,9 @@ string dbusSendInterface;
 string dbusRecvInterface;
 string dbusMatchString;
 
+// libnxcl logs here when built with DEBUG.
+ofstream debugLogFile;
+
 
 int
 main (int argc, char **argv)
@@ -105,13 +119,37 @@ main (int argc, char **argv)
 	pid_t pid;
 	bool gotName = false;
 	int i = 0;
+	string traceFile;
+
+	if (argc > 1 && string (argv[1]) == "--discover") {
+		return discover (argc - 2, argv + 2);
+	}
+
+	// With --trace FILE, nxcl writes the time it reaches each
+	// stage of the connection to FILE, one JSON object per line,
+	// and we print them when it has finished.
+	if (argc > 2 && string (argv[1]) == "--trace") {
+		traceFile = argv[2];
+		argc -= 2;
+		argv += 2;
+	}
 
 	if (argc != 5) {
-		cout << "NXCMD> Usage: nxcmd IP/DNSName user pass sessiontype\n";
+		cout << "NXCMD> Usage: nxcmd [--trace FILE] IP/DNSName user pass sessiontype\n";
+		cout << "NXCMD>        nxcmd --discover [--timeout MS] user pass host[:port]...\n";
 		cout << "NXCMD> Eg:    nxcmd 192.168.0.1 me mypass unix-gnome\n";
 		return -1;
 	}
 
+	if (!traceFile.empty()) {
+		// nxcl appends, so start with an empty file.
+		ofstream f (traceFile.c_str(), ios::out | ios::trunc);
+		if (!f.is_open()) {
+			cerr << "NXCMD> Can't write to " << traceFile << endl;
+			return -1;
+		}
+	}
+
 	cout << "NXCMD> Starting...\n";
 
 	/* Get a connection to the session bus */
@@ -171,6 +209,9 @@ main (int argc, char **argv)
 		// This is the CHILD process
 		// Allocate memory for the program arguments
 		// 1+ to allow space for NULL terminating pointer
+		if (!traceFile.empty()) {
+			setenv ("NXCL_TRACE", traceFile.c_str(), 1);
+		}
 		execl (PACKAGE_BIN_DIR"/nxcl", "nxcl", arg.str().c_str(), static_cast<char*>(NULL));
 		// If process returns, error occurred
 		theError = errno; 
@@ -289,6 +330,90 @@ main (int argc, char **argv)
 	int status = 0;
 	wait (&status);
 
+	if (!traceFile.empty()) {
+		cout << "NXCMD> Trace of the connection (" << traceFile << "):\n";
+		ifstream f (traceFile.c_str());
+		string line;
+		while (getline (f, line)) {
+			cout << line << endl;
+		}
+	}
+
+	return 0;
+}
+
+/*!
+ * Print each server's answer as it comes in.
+ */
+class DiscoverCallbacks : public nxcl::NXDiscoveryCallbacks
+{
+	public:
+		void hostSignal (const nxcl::NXDiscoveryResult& r)
+		{
+			cout << "NXCMD> " << r.host.host << ":" << r.host.port << " ";
+			if (r.status == nxcl::NXDISCOVERY_LISTED) {
+				cout << r.sessions.size() << " sessions, logged in after "
+				     << r.loginUsec / 1000 << "ms, listed after "
+				     << r.latencyUsec / 1000 << "ms\n";
+			} else {
+				cout << "failed after " << r.latencyUsec / 1000
+				     << "ms: " << r.error << endl;
+			}
+		}
+};
+
+static int
+discover (int argc, char **argv)
+{
+	int timeout = NXDISCOVERY_DEFAULT_TIMEOUT;
+	if (argc > 1 && string (argv[0]) == "--timeout") {
+		timeout = atoi (argv[1]);
+		argc -= 2;
+		argv += 2;
+	}
+	if (argc < 3) {
+		cout << "NXCMD> Usage: nxcmd --discover [--timeout MS] user pass host[:port]...\n";
+		return -1;
+	}
+
+	nxcl::NXDiscovery d;
+	DiscoverCallbacks cb;
+	d.setCallbacks (&cb);
+	d.setTimeout (timeout);
+	for (int i = 2; i < argc; i++) {
+		nxcl::NXDiscoveryHost h;
+		h.host = argv[i];
+		string::size_type colon = h.host.find (':');
+		if (colon != string::npos) {
+			h.port = atoi (h.host.substr (colon + 1).c_str());
+			h.host.erase (colon);
+		}
+		h.user = argv[0];
+		h.pass = argv[1];
+		h.key = cert;
+		d.addHost (h);
+	}
+
+	cout << "NXCMD> Listing sessions on " << argc - 2 << " servers\n";
+	d.run();
+
+	list<nxcl::NXDiscoveredSession> sessions = d.getSessions();
+	list<nxcl::NXDiscoveredSession>::iterator s;
+	int n = 0;
+	for (s = sessions.begin(); s != sessions.end(); s++) {
+		if (n == 0) {
+			cout << "NXCMD> Available sessions:\n";
+		}
+		cout << n++ << ": " << s->host << " " << s->session.display
+		     << " " << s->session.sessionType
+		     << " " << s->session.sessionID
+		     << " " << s->session.screen
+		     << " " << s->session.available
+		     << " " << s->session.sessionName << endl;
+	}
+	cout << "NXCMD> " << n << " sessions in "
+	     << d.getElapsed() / 1000 << "ms\n";
+
 	return 0;
 }
 
@@ -467,9 +592,12 @@ receiveSession (DBusConnection* conn)
 		dbus_connection_read_write(conn, 0);
 		message = dbus_connection_pop_message(conn);
 
-		// loop again if we haven't read a message
+		// wait for more if we haven't read a message
 		if (NULL == message) {
-			sleep (1);
+			if (!dbus_connection_read_write (conn, -1)) {
+				cerr << "NXCMD> Lost the connection to the bus\n";
+				break;
+			}
 			continue;
 		}
 
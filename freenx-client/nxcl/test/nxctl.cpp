@@ -0,0 +1,123 @@
+/***************************************************************************
+   nxctl.cpp - List and terminate sessions over one login to nxserver
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * An example of NXClientLib's control mode: logs in once, sends every
+ * request given on the command line and quits.
+ *
+ *   nxctl [--no-pipelining] host user pass [list | terminate ID]...
+ */
+
+#include "nxclientlib.h"
+#include <fstream>
+
+using namespace nxcl;
+using namespace std;
+
+ofstream debugLogFile;
+
+class CtlCallbacks : public NXClientLibExternalCallbacks
+{
+	public:
+		CtlCallbacks() {}
+		void error (string msg) { cerr << "nxctl: " << msg << endl; }
+		void controlReadySignal (void) { cout << "logged in" << endl; }
+		void controlListSignal (list<NXResumeData> sessions)
+		{
+			cout << sessions.size() << " sessions" << endl;
+			list<NXResumeData>::iterator i;
+			for (i = sessions.begin(); i != sessions.end(); i++) {
+				cout << "  " << i->sessionID << " :" << i->display
+				     << " " << i->sessionType << " " << i->screen
+				     << " " << i->sessionName << endl;
+			}
+		}
+		void controlTerminatedSignal (string id, bool terminated)
+		{
+			cout << id << (terminated ? " terminated" : " not terminated") << endl;
+		}
+};
+
+static int usage (void)
+{
+	cout << "Usage: nxctl [--no-pipelining] host user pass [list | terminate ID]..." << endl;
+	return -1;
+}
+
+int main (int argc, char **argv)
+{
+	NXClientLib lib;
+	CtlCallbacks cb;
+	lib.setExternalCallbacks (&cb);
+	lib.setControlMode (true);
+
+	int a = 1;
+	if (a < argc && string (argv[a]) == "--no-pipelining") {
+		lib.setPipelining (false);
+		a++;
+	}
+	if (argc - a < 3) {
+		return usage();
+	}
+	string host = argv[a++];
+	string un = argv[a++];
+	string pw = argv[a++];
+
+	// The requests wait until we have logged in.
+	for (; a < argc; a++) {
+		string op = argv[a];
+		if (op == "list") {
+			lib.requestList();
+		} else if (op == "terminate" && a + 1 < argc) {
+			lib.requestTerminate (argv[++a]);
+		} else {
+			return usage();
+		}
+	}
+	lib.requestQuit();
+
+	NXSessionData theSesh;
+	theSesh.sessionName = "nxctl";
+	theSesh.sessionType = "unix-kde";
+	theSesh.cache = 8;
+	theSesh.images = 32;
+	theSesh.linkType = "adsl";
+	theSesh.render = true;
+	theSesh.backingstore = "when_requested";
+	theSesh.imageCompressionMethod = 2;
+	theSesh.geometry = "800x600+0+0";
+	theSesh.keyboard = "defkeymap";
+	theSesh.kbtype = "pc102/defkeymap";
+	theSesh.media = false;
+	theSesh.agentServer = "";
+	theSesh.agentUser = "";
+	theSesh.agentPass = "";
+	theSesh.cups = 0;
+	theSesh.suspended = false;
+	theSesh.fullscreen = false;
+	theSesh.encryption = true;
+
+	lib.setSessionData (&theSesh);
+	lib.setUsername (un);
+	lib.setPassword (pw);
+	lib.setResolution (800, 600);
+	lib.setDepth (24);
+	lib.setRender (true);
+	lib.invokeNXSSH ("default", host, true, "", 22);
+
+	lib.run();
+
+	return 0;
+}
@@ -0,0 +1,117 @@
+/***************************************************************************
+   nxtestutil.cpp - What the tests that run a scripted server share
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "nxtestutil.h"
+
+using namespace std;
+using namespace nxcl;
+
+void setDefaults (NXSessionData& d)
+{
+	d.sessionName = "kde";
+	d.sessionType = "unix-kde";
+	d.cache = 8;
+	d.images = 32;
+	d.linkType = "adsl";
+	d.render = true;
+	d.backingstore = "never";
+	d.imageCompressionMethod = 2;
+	d.imageCompressionLevel = 9;
+	d.geometry = "1024x768";
+	d.keyboard = "defkeymap";
+	d.kbtype = "pc102/gb";
+	d.media = false;
+	d.agentServer = "";
+	d.agentUser = "";
+	d.agentPass = "";
+	d.cups = 0;
+	d.encryption = true;
+	d.fullscreen = false;
+	d.virtualDesktop = false;
+	d.suspended = false;
+	d.xRes = 1024;
+	d.yRes = 768;
+	d.depth = 24;
+	d.display = 0;
+	d.terminate = false;
+}
+
+int countLines (const string& s)
+{
+	int n = 0;
+	for (string::size_type i = 0; i < s.size(); i++) {
+		if (s[i] == '\n') { n++; }
+	}
+	return n;
+}
+
+int countFileLines (const string& path, string * all)
+{
+	ifstream f (path.c_str());
+	string line;
+	int n = 0;
+	while (getline (f, line)) {
+		n++;
+		if (all != NULL) {
+			*all += line + "\n";
+		}
+	}
+	return n;
+}
+
+/*!
+ * Write \arg contents to \arg path and make it executable.
+ */
+static bool writeScript (const string& path, const char * contents)
+{
+	{
+		ofstream f (path.c_str());
+		f << contents;
+		if (!f) { return false; }
+	}
+	return chmod (path.c_str(), 0755) == 0;
+}
+
+string makeFakeServerDir (const char * script, const char * proxy)
+{
+	char dir[] = "/tmp/nxtestXXXXXX";
+	if (mkdtemp (dir) == NULL) {
+		cout << "can't make a temporary directory" << endl;
+		return "";
+	}
+	if ((script != NULL && !writeScript (string (dir) + "/ssh", script))
+	    || (proxy != NULL && !writeScript (string (dir) + "/nxproxy", proxy))) {
+		cout << "can't write the scripts in " << dir << endl;
+		removeFakeServerDir (dir);
+		return "";
+	}
+	setenv ("NXTEST_DIR", dir, 1);
+	setenv ("HOME", dir, 1);
+	return dir;
+}
+
+void removeFakeServerDir (const string& dir)
+{
+	string cmd = "rm -rf " + dir;
+	if (system (cmd.c_str()) != 0) {
+		cout << "couldn't remove " << dir << endl;
+	}
+}
@@ -0,0 +1,59 @@
+/* -*-c++-*- */
+/***************************************************************************
+   nxtestutil.h - What the tests that run a scripted server share
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _NXTESTUTIL_H_
+#define _NXTESTUTIL_H_
+
+#include <string>
+
+#include "nxdata.h"
+
+using namespace std;
+
+/*!
+ * Fill in \arg d for a kde session on an adsl link, the way nxclient
+ * would. Tests which want something else change the fields after.
+ */
+void setDefaults (nxcl::NXSessionData& d);
+
+/*!
+ * \return the number of newlines in \arg s.
+ */
+int countLines (const string& s);
+
+/*!
+ * \return the number of lines in the file at \arg path, adding them
+ * to \arg all if it isn't NULL. A missing file has none.
+ */
+int countFileLines (const string& path, string * all = NULL);
+
+/*!
+ * Make a temporary directory holding, unless they're NULL, \arg
+ * script as an executable called "ssh" and \arg proxy as one called
+ * "nxproxy". HOME is pointed at it, so that the server cache and
+ * the session directories stay out of the real ~/.nx, and so is
+ * NXTEST_DIR for the scripts' own use.
+ *
+ * \return the directory, or an empty string if it couldn't be made.
+ */
+string makeFakeServerDir (const char * script = NULL, const char * proxy = NULL);
+
+/*!
+ * Remove a directory made by makeFakeServerDir() and everything in it.
+ */
+void removeFakeServerDir (const string& dir);
+
+#endif
@@ -0,0 +1,242 @@
+/***************************************************************************
+   reconnecttest.cpp - Check NXClientLib's auto-reconnect against a
+                       scripted server
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Puts an "ssh" playing a FreeNX server and an "nxproxy" in a temporary
+ * directory, as discoverytest does. The nxproxy exits with an error,
+ * as it does when the link to the server goes, the first
+ * $NXTEST_DROPS times it is run, and cleanly after that. The server
+ * lists the session it started until the file "gone" appears, and
+ * refuses connections while the file "down" exists.
+ *
+ * Checks that with auto-reconnect the session is resumed by its ID
+ * after a drop, that we give up when the server no longer has the
+ * session or can't be reached, and that without auto-reconnect, or
+ * when nxproxy exits cleanly, the connection just finishes.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "nxclientlib.h"
+#include "nxtestutil.h"
+
+using namespace std;
+using namespace nxcl;
+
+ofstream debugLogFile;
+
+#define SESSION_ID "5C7E1B0A7D1E4D3E8A54C2BF3E1D9C4A"
+
+static const char * server =
+	"#!/bin/sh\n"
+	"if [ -e \"$NXTEST_DIR/down\" ]; then\n"
+	"  echo 'ssh: connect to host nxhost port 22: Connection refused' >&2; exit 255\n"
+	"fi\n"
+	"printf 'HELLO NXSERVER - Version 3.2.0-74-SVN OS (GPL, using backend: 3.5.0)\\nNX> 105 '\n"
+	"state=\n"
+	"while read -r line; do\n"
+	"  case \"$state\" in\n"
+	"  user) state=pass; printf '%s\\nNX> 102 Password: ' \"$line\"; continue;;\n"
+	"  pass) state=; printf '\\nNX> 103 Welcome to: nxhost user: jdoe\\nNX> 105 '; continue;;\n"
+	"  esac\n"
+	"  case \"$line\" in\n"
+	"  hello*) printf '%s\\nNX> 134 Accepted protocol: 3.0.0\\nNX> 105 ' \"$line\";;\n"
+	"  \"SET AUTH_MODE\"*) printf '%s\\nSet auth_mode: password\\nNX> 105 ' \"$line\";;\n"
+	"  SET*) printf '%s\\nNX> 105 ' \"$line\";;\n"
+	"  login) state=user; printf '%s\\nNX> 101 User: ' \"$line\";;\n"
+	"  listsession*)\n"
+	"    printf '%s\\nNX> 127 Sessions list of user '\\''jdoe'\\'' for reconnect:\\n\\n' \"$line\"\n"
+	"    if [ -e \"$NXTEST_DIR/started\" ] && [ ! -e \"$NXTEST_DIR/gone\" ]; then\n"
+	"      printf 'Display Type             Session ID                       Options  Depth Screensize     Available Session Name\\n'\n"
+	"      printf '%s\\n' '------- ---------------- -------------------------------- -------- ----- -------------- --------- ----------------------'\n"
+	"      printf '1002    unix-gnome       5C7E1B0A7D1E4D3E8A54C2BF3E1D9C00 -RD--PSA    24 1024x768       Suspended   other\\n'\n"
+	"      printf '1001    unix-kde         " SESSION_ID " -RD--PSA    24 1024x768       Running     kde\\n'\n"
+	"    fi\n"
+	"    printf '\\n\\nNX> 148 Server capacity: not reached for user: jdoe\\nNX> 105 ';;\n"
+	"  startsession*|restoresession*)\n"
+	"    echo \"$line\" | cut -d' ' -f1-2 >> \"$NXTEST_DIR/log\"; touch \"$NXTEST_DIR/started\"\n"
+	"    printf 'NX> 1000 NXNODE - Version 3.2.0-74-SVN OS (GPL, using backend: 3.5.0)\\n'\n"
+	"    printf 'NX> 700 Session id: nxhost-1001-" SESSION_ID "\\n'\n"
+	"    printf 'NX> 705 Session display: 1001\\nNX> 703 Session type: unix-kde\\n'\n"
+	"    printf 'NX> 701 Proxy cookie: 5d9a3c4f6e2b1a0c9d8e7f6a5b4c3d2e\\nNX> 702 Proxy IP: 127.0.0.1\\n'\n"
+	"    printf 'NX> 706 Agent cookie: 5d9a3c4f6e2b1a0c9d8e7f6a5b4c3d2e\\nNX> 704 Session cache: unix-kde\\n'\n"
+	"    printf 'NX> 707 SSL tunneling: 1\\nNX> 710 Session status: running\\n'\n"
+	"    printf 'NX> 1002 Commit\\nNX> 1006 Session status: running\\nNX> 105 ';;\n"
+	"  bye)\n"
+	"    printf 'bye\\nBye\\nNX> 999 Bye\\n'; printf 'NX> 999 Bye\\n' >&2\n"
+	"    printf 'NX> 287 Redirected I/O to channel descriptors\\n'; exit 0;;\n"
+	"  *) printf '%s\\nNX> 105 ' \"$line\";;\n"
+	"  esac\n"
+	"done\n";
+
+static const char * proxy =
+	"#!/bin/sh\n"
+	"echo x >> \"$NXTEST_DIR/proxies\"\n"
+	"sleep 0.05\n"
+	"[ $(wc -l < \"$NXTEST_DIR/proxies\") -gt \"${NXTEST_DROPS:-0}\" ]\n";
+
+class ReconnectCallbacks : public NXClientLibExternalCallbacks
+{
+	public:
+		ReconnectCallbacks (const string& d, const string& f) :
+			dir(d), touchFile(f), reconnecting(0), reconnected(0), errors(0) {}
+		void reconnectingSignal (int attempt, int delayMs)
+		{
+			this->reconnecting++;
+			this->delays += (this->delays.empty() ? "" : ",") + toString (delayMs);
+			if (!this->touchFile.empty()) {
+				ofstream f ((this->dir + "/" + this->touchFile).c_str());
+			}
+		}
+		void reconnectedSignal (void) { this->reconnected++; }
+		void error (string msg)
+		{
+			this->errors++;
+			this->lastError = msg;
+		}
+
+		static string toString (int n)
+		{
+			stringstream ss;
+			ss << n;
+			return ss.str();
+		}
+
+		string dir;
+		string touchFile;
+		int reconnecting;
+		int reconnected;
+		int errors;
+		string lastError;
+		string delays;
+};
+
+/*!
+ * Start a session, with nxproxy dropping the link \arg drops times,
+ * and \arg touchFile (if any) made in the test directory when the
+ * first drop is noticed. \arg expect is what the server should have
+ * been sent (the first two words of each startsession or
+ * restoresession), \arg reconnecting the attempts to reconnect and
+ * \arg reconnected those that should work.
+ */
+static int check (const string& name, const string& dir, bool autoReconnect, int drops,
+		  const string& touchFile, const string& expect, int reconnecting,
+		  int reconnected, bool error)
+{
+	int failures = 0;
+	string files[] = { "log", "proxies", "started", "gone", "down", "" };
+	for (int i = 0; !files[i].empty(); i++) {
+		unlink ((dir + "/" + files[i]).c_str());
+	}
+	setenv ("NXTEST_DROPS", ReconnectCallbacks::toString (drops).c_str(), 1);
+
+	ReconnectCallbacks cb (dir, touchFile);
+	NXSessionData sd;
+	setDefaults (sd);
+	string user = "jdoe", pass = "secret";
+
+	NXClientLib lib;
+	lib.setExternalCallbacks (&cb);
+	lib.setCustomPath (dir);
+	lib.setUseServerCache (false);
+	lib.setSessionData (&sd);
+	lib.setUsername (user);
+	lib.setPassword (pass);
+	lib.setAutoReconnect (autoReconnect, 3);
+	lib.setReconnectDelay (20, 50);
+	lib.runSession();
+	lib.invokeNXSSH ("default", "nxhost", true, "", 22);
+
+	long long start = NXTrace::now();
+	while (!lib.getIsFinished() && NXTrace::now() - start < 10000000LL) {
+		if (lib.runOnce (100) < 0) {
+			break;
+		}
+	}
+	// Let the last processes go.
+	notQProcess * p[] = { lib.getNXSSHProcess(), lib.getNXProxyProcess() };
+	for (int i = 0; i < 20 && (p[0]->getPid() > 0 || p[1]->getPid() > 0); i++) {
+		if (lib.runOnce (100) < 0) {
+			break;
+		}
+	}
+
+	string log;
+	countFileLines (dir + "/log", &log);
+	if (!lib.getIsFinished()) {
+		cout << name << ": didn't finish" << endl; failures++;
+	}
+	if (log != expect) {
+		cout << name << ": the server was sent" << endl << log
+		     << "not" << endl << expect; failures++;
+	}
+	if (cb.reconnecting != reconnecting || cb.reconnected != reconnected) {
+		cout << name << ": " << cb.reconnecting << " attempts to reconnect and "
+		     << cb.reconnected << " reconnected, not " << reconnecting << " and "
+		     << reconnected << endl; failures++;
+	}
+	if ((cb.errors > 0) != error) {
+		cout << name << ": " << cb.errors << " errors (" << cb.lastError << ")" << endl;
+		failures++;
+	}
+	if (lib.getReconnectAttempt() != 0) {
+		cout << name << ": still reconnecting" << endl; failures++;
+	}
+
+	cout << name << ": " << (NXTrace::now() - start) / 1000 << "ms, "
+	     << countFileLines (dir + "/proxies") << " nxproxies";
+	if (!cb.delays.empty()) {
+		cout << ", waited " << cb.delays << "ms";
+	}
+	if (cb.errors > 0) {
+		cout << " (" << cb.lastError << ")";
+	}
+	cout << ", " << (failures ? "FAILED" : "ok") << endl;
+	return failures;
+}
+
+int main()
+{
+	signal (SIGPIPE, SIG_IGN);
+
+	// nxproxy's session directories go in here too
+	string dir = makeFakeServerDir (server, proxy);
+	if (dir.empty()) {
+		return 1;
+	}
+
+	const string start = "startsession --session=\"kde\"\n";
+	const string restore = "restoresession --id=\"" SESSION_ID "\"\n";
+	int failures = 0;
+
+	failures += check ("dropped twice", dir, true, 2, "", start + restore + restore, 2, 2, false);
+	failures += check ("session gone", dir, true, 1, "gone", start, 1, 0, true);
+	failures += check ("server down", dir, true, 1, "down", start, 3, 0, true);
+	failures += check ("not enabled", dir, false, 1, "", start, 0, 0, true);
+	failures += check ("ended cleanly", dir, true, 0, "", start, 0, 0, false);
+
+	removeFakeServerDir (dir);
+	if (failures == 0) {
+		cout << "all passed" << endl;
+	}
+	return failures;
+}
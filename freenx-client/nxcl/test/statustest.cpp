@@ -0,0 +1,382 @@
+/***************************************************************************
+   statustest.cpp - Check the status channel between NXStatusServer
+                    and the C client in nxstatus.h
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Runs an NXStatusServer on a socket in a temporary directory, and
+ * subscribes to it with nxstatus_open(). Checks that the records
+ * published arrive whole and in order, that a late subscriber is sent
+ * the state of the sessions under way, that a subscriber which
+ * doesn't read is dropped without holding up the others, and that
+ * nxstatus_decode() refuses broken records. Then times a stream of
+ * stage records to one subscriber ("statustest n" for n of them).
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <list>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "notQt.h"
+#include "nxtrace.h"
+#include "nxstatusserver.h"
+#include "nxstatus.h"
+#include "nxtestutil.h"
+
+using namespace std;
+using namespace nxcl;
+
+ofstream debugLogFile;
+
+/*!
+ * A record as read, with the strings copied out.
+ */
+struct Got {
+	int type;
+	unsigned long session;
+	vector<long long> ints;
+	vector<string> strings;
+};
+
+/*!
+ * Run \arg loop and read from \arg c until \arg n records have come,
+ * or a second has passed.
+ *
+ * \return false if they didn't all come, or one was corrupt.
+ */
+static bool pump (notQEventLoop& loop, struct nxstatus_client * c, vector<Got>& got, size_t n)
+{
+	long long deadline = NXTrace::now() + 1000000LL;
+	struct nxstatus_record rec;
+	while (got.size() < n && NXTrace::now() < deadline) {
+		loop.runOnce (0);
+		if (nxstatus_read (c) == 0) {
+			return false;
+		}
+		int r;
+		while ((r = nxstatus_next (c, &rec)) == 1) {
+			Got g;
+			g.type = rec.type;
+			g.session = rec.session;
+			for (int i = 0; i < rec.nfields; i++) {
+				if (rec.fields[i].tag == NXSTATUS_INT) {
+					g.ints.push_back (rec.fields[i].i);
+				} else {
+					g.strings.push_back (string (rec.fields[i].s, rec.fields[i].len));
+				}
+			}
+			got.push_back (g);
+		}
+		if (r < 0) {
+			return false;
+		}
+	}
+	return got.size() >= n;
+}
+
+static int checkRecords (notQEventLoop& loop, NXStatusServer& server)
+{
+	int failures = 0;
+	struct nxstatus_client * c = nxstatus_open (server.getPath().c_str());
+	if (c == NULL) {
+		cout << "records: couldn't connect" << endl;
+		return 1;
+	}
+
+	vector<Got> got;
+	if (!pump (loop, c, got, 1) || got[0].type != NXSTATUS_HELLO
+	    || got[0].ints.size() != 2 || got[0].ints[0] != NXSTATUS_VERSION
+	    || got[0].ints[1] != getpid()) {
+		cout << "records: no hello" << endl; failures++;
+	}
+
+	NXTraceEvent e;
+	e.usec = NXTrace::now();
+	e.stage = "stage";
+	e.detail = "login";
+	NXLinkStats stats;
+	stats.minRtt = 35000;
+	stats.medianRtt = 41000;
+	stats.bytesPerSecond = -1;
+	stats.linkType = "adsl";
+	list<NXResumeData> sessions;
+	NXResumeData d;
+	d.display = 1001;
+	d.sessionID = "5C7E1B0A7D1E4D3E8A54C2BF3E1D9C4A";
+	d.sessionType = "unix-kde";
+	d.sessionName = "kde";
+	d.available = "Suspended";
+	sessions.push_back (d);
+
+	server.info (3, NXCL_STARTING, "Connection is starting...");
+	server.stage (3, e);
+	server.link (3, stats);
+	server.sessions (3, sessions);
+	server.error (3, "");
+	server.finished (3);
+
+	got.clear();
+	if (!pump (loop, c, got, 7)) {
+		cout << "records: " << got.size() << " of 7 came" << endl; failures++;
+	} else if (got[0].type != NXSTATUS_INFO || got[0].session != 3
+		   || got[0].ints[0] != NXCL_STARTING || got[0].strings[0] != "Connection is starting..."
+		   || got[1].type != NXSTATUS_STAGE || got[1].strings.size() != 2
+		   || got[1].strings[1] != "login"
+		   || got[2].type != NXSTATUS_LINK || got[2].ints.size() != 3
+		   || got[2].ints[0] != 35000 || got[2].ints[2] != -1 || got[2].strings[0] != "adsl"
+		   || got[3].type != NXSTATUS_SESSION || got[3].ints[0] != 1001
+		   || got[3].strings[0] != d.sessionID || got[3].strings[3] != "Suspended"
+		   || got[4].type != NXSTATUS_SESSIONS_END
+		   || got[5].type != NXSTATUS_ERROR || got[5].strings[0] != ""
+		   || got[6].type != NXSTATUS_FINISHED) {
+		cout << "records: wrong" << endl; failures++;
+	}
+
+	nxstatus_close (c);
+	cout << "records: " << (failures ? "FAILED" : "ok") << endl;
+	return failures;
+}
+
+static int checkLateSubscriber (notQEventLoop& loop, NXStatusServer& server)
+{
+	int failures = 0;
+	NXTraceEvent e;
+	e.usec = NXTrace::now();
+	e.stage = "starting nxssh";
+	server.stage (1, e);
+	e.stage = "stage";
+	e.detail = "list sessions";
+	server.stage (1, e);
+	server.info (1, NXCL_AUTHENTICATING, "Authenticating with NX server");
+	server.stage (2, e);
+	server.finished (2);
+
+	struct nxstatus_client * c = nxstatus_open (server.getPath().c_str());
+	vector<Got> got;
+	// hello, and session 1's last stage and info; nothing of 2
+	if (c == NULL || !pump (loop, c, got, 3)) {
+		cout << "late: " << got.size() << " of 3 came" << endl; failures++;
+	} else {
+		bool stage = false, info = false;
+		for (size_t i = 1; i < got.size(); i++) {
+			if (got[i].session != 1) {
+				failures++;
+			} else if (got[i].type == NXSTATUS_STAGE && got[i].strings[1] == "list sessions") {
+				stage = true;
+			} else if (got[i].type == NXSTATUS_INFO) {
+				info = true;
+			}
+		}
+		if (!stage || !info) {
+			failures++;
+		}
+		if (failures) {
+			cout << "late: wrong state sent" << endl;
+		}
+	}
+	// Nothing more
+	got.clear();
+	loop.runOnce (10);
+	if (c != NULL && pump (loop, c, got, 1)) {
+		cout << "late: sent too much" << endl; failures++;
+	}
+	server.finished (1);
+	nxstatus_close (c);
+	cout << "late: " << (failures ? "FAILED" : "ok") << endl;
+	return failures;
+}
+
+static int checkSlowSubscriber (notQEventLoop& loop, NXStatusServer& server)
+{
+	int failures = 0;
+	struct nxstatus_client * slow = nxstatus_open (server.getPath().c_str());
+	struct nxstatus_client * fast = nxstatus_open (server.getPath().c_str());
+	vector<Got> got;
+	loop.runOnce (0);
+	if (server.getSubscribers() != 2) {
+		cout << "slow: " << server.getSubscribers() << " subscribers" << endl; failures++;
+	}
+
+	// 1000 records of about 1 KB: 1 MB, which the slow one never
+	// reads.
+	string text (1000, 'x');
+	long long start = NXTrace::now();
+	size_t n = 0;
+	for (int i = 0; i < 1000; i++) {
+		server.error (5, text);
+		pump (loop, fast, got, ++n);
+	}
+	long long usec = NXTrace::now() - start;
+	pump (loop, fast, got, n + 1);
+
+	if (server.getSubscribers() != 1 || server.getDropped() != 1) {
+		cout << "slow: " << server.getSubscribers() << " subscribers, "
+		     << server.getDropped() << " dropped" << endl; failures++;
+	}
+	if (got.size() != 1001) {
+		cout << "slow: the other got " << got.size() << " of 1001" << endl; failures++;
+	}
+	// The slow one gets what fitted, then the end.
+	size_t records = 0;
+	long r;
+	struct nxstatus_record rec;
+	while ((r = nxstatus_read (slow)) > 0) {
+		while (nxstatus_next (slow, &rec) == 1) {
+			records++;
+		}
+	}
+	if (r != 0 || records == 0 || records >= 1000) {
+		cout << "slow: read " << records << " records, then " << r << endl; failures++;
+	}
+
+	nxstatus_close (slow);
+	nxstatus_close (fast);
+	cout << "slow: dropped after " << records << " records, 1000 sent in "
+	     << usec / 1000 << "ms, " << (failures ? "FAILED" : "ok") << endl;
+	return failures;
+}
+
+static int checkDecode (void)
+{
+	int failures = 0;
+	NXStatusRecord r (NXSTATUS_STAGE, 7);
+	r.addString ("stage");
+	r.addInt (-2);
+	string b = r.bytes();
+	struct nxstatus_record rec;
+
+	if (nxstatus_decode (b.data(), b.size(), &rec) != 0 || rec.session != 7
+	    || rec.nfields != 2 || strcmp (rec.fields[0].s, "stage") != 0
+	    || rec.fields[1].i != -2) {
+		cout << "decode: good record refused" << endl; failures++;
+	}
+	for (size_t n = 0; n < b.size(); n++) {
+		if (nxstatus_decode (b.data(), n, &rec) == 0) {
+			cout << "decode: took " << n << " bytes of " << b.size() << endl; failures++;
+			break;
+		}
+	}
+	string bad = b;
+	bad[NXSTATUS_HEADER_SIZE + 3 + 5] = 'x';        // the 0 after "stage"
+	if (nxstatus_decode (bad.data(), bad.size(), &rec) == 0) {
+		cout << "decode: took an unterminated string" << endl; failures++;
+	}
+	bad = b;
+	bad[NXSTATUS_HEADER_SIZE] = 'q';
+	if (nxstatus_decode (bad.data(), bad.size(), &rec) == 0) {
+		cout << "decode: took an unknown field" << endl; failures++;
+	}
+
+	// A string too long for a record is cut.
+	NXStatusRecord big (NXSTATUS_ERROR, 0);
+	big.addString (string (100000, 'y'));
+	if (big.bytes().size() != NXSTATUS_MAX_RECORD
+	    || nxstatus_decode (big.bytes().data(), big.bytes().size(), &rec) != 0) {
+		cout << "decode: long string not cut to fit" << endl; failures++;
+	}
+	cout << "decode: " << (failures ? "FAILED" : "ok") << endl;
+	return failures;
+}
+
+/*!
+ * Publish \arg n stage records and read them all back.
+ */
+static int bench (notQEventLoop& loop, NXStatusServer& server, size_t n)
+{
+	struct nxstatus_client * c = nxstatus_open (server.getPath().c_str());
+	vector<Got> got;
+	pump (loop, c, got, 1);
+
+	NXTraceEvent e;
+	e.usec = NXTrace::now();
+	e.stage = "process exited";
+	e.detail = "nxproxy: exited with status 0";
+	long long start = NXTrace::now();
+	long long bytes = 0;
+	size_t received = 0;
+	struct nxstatus_record rec;
+	for (size_t i = 0; i < n; i++) {
+		NXStatusRecord r (NXSTATUS_STAGE, 1);
+		r.addString (e.stage);
+		r.addString (e.detail);
+		bytes += r.bytes().size();
+		server.publish (r);
+		if (i % 64 == 63 || i == n - 1) {
+			loop.runOnce (0);
+			while (nxstatus_read (c) > 0) {
+				while (nxstatus_next (c, &rec) == 1) {
+					received++;
+				}
+			}
+		}
+	}
+	long long deadline = NXTrace::now() + 1000000LL;
+	while (received < n && NXTrace::now() < deadline) {
+		loop.runOnce (0);
+		nxstatus_read (c);
+		while (nxstatus_next (c, &rec) == 1) {
+			received++;
+		}
+	}
+	long long usec = NXTrace::now() - start;
+	nxstatus_close (c);
+	server.finished (1);
+
+	cout << "bench: " << received << " of " << n << " records, "
+	     << bytes / n << " bytes each, "
+	     << (usec > 0 ? n * 1000000LL / usec : 0) << " records/s" << endl;
+	return received == n ? 0 : 1;
+}
+
+int main (int argc, char ** argv)
+{
+	signal (SIGPIPE, SIG_IGN);
+	size_t n = (argc > 1) ? atoi (argv[1]) : 100000;
+
+	string dir = makeFakeServerDir();
+	if (dir.empty()) {
+		return 1;
+	}
+	string path = dir + "/status";
+
+	notQEventLoop loop;
+	NXStatusServer server;
+	if (!server.listen (path, &loop)) {
+		cout << "can't listen on " << path << endl;
+		removeFakeServerDir (dir);
+		return 1;
+	}
+
+	int failures = 0;
+	failures += checkRecords (loop, server);
+	failures += checkLateSubscriber (loop, server);
+	failures += checkSlowSubscriber (loop, server);
+	failures += checkDecode();
+	failures += bench (loop, server, n);
+
+	server.close();
+	if (access (path.c_str(), F_OK) == 0) {
+		cout << "the socket is still there" << endl; failures++;
+	}
+	removeFakeServerDir (dir);
+	if (failures == 0) {
+		cout << "all passed" << endl;
+	}
+	return failures;
+}
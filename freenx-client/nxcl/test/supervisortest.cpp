@@ -0,0 +1,126 @@
+/***************************************************************************
+   supervisortest.cpp - Run several processes under one
+                        NXProcessSupervisor and report how they end
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Starts a handful of children which talk and then exit in different
+ * ways (cleanly, with an error, killed by a signal, after using some
+ * CPU and memory) plus one which doesn't exist, all on one event
+ * loop, and checks that each handler hears from its own process and
+ * gets the right exit status.
+ */
+
+#include <iostream>
+#include <string>
+#include <list>
+#include <signal.h>
+
+#include "notQt.h"
+#include "nxsupervisor.h"
+
+using namespace std;
+using namespace nxcl;
+
+ofstream debugLogFile;
+
+class Handler : public NXProcessHandler
+{
+	public:
+		Handler (const string& n) : name(n), out(0), exited(false), failed(false) {}
+
+		void readyReadStandardOutputSignal (notQProcess * proc)
+		{
+			string s;
+			proc->standardOutput().takeAll (s);
+			this->out += s.size();
+		}
+		void readyReadStandardErrorSignal (notQProcess * proc)
+		{
+			proc->standardError().clear();
+		}
+		void errorSignal (notQProcess * proc, int error)
+		{
+			this->failed = true;
+		}
+		void exitedSignal (notQProcess * proc, const NXProcessExit& status)
+		{
+			cout << this->name << ": " << this->out << " bytes of output, "
+			     << status.describe() << endl;
+			this->exited = true;
+			this->status = status;
+		}
+
+		string name;
+		size_t out;
+		bool exited;
+		bool failed;
+		NXProcessExit status;
+};
+
+static bool run (NXProcessSupervisor& sup, Handler& h, const string& script)
+{
+	list<string> args;
+	args.push_back ("sh");
+	args.push_back ("-c");
+	args.push_back (script);
+	notQProcess * p = sup.add (h.name, &h);
+	return (p->start ("/bin/sh", args) == NOTQTPROCESS_MAIN_APP);
+}
+
+int main()
+{
+	notQEventLoop loop;
+	NXProcessSupervisor sup;
+	sup.setEventLoop (&loop);
+
+	Handler clean ("clean"), error ("error"), killed ("killed"), busy ("busy"), missing ("missing");
+
+	run (sup, clean, "echo hello; exit 0");
+	run (sup, error, "echo oops >&2; exit 3");
+	run (sup, killed, "echo bye; kill -9 $$");
+	run (sup, busy, "i=0; s=x; while [ $i -lt 20000 ]; do i=$((i+1)); done; "
+	     "while [ ${#s} -lt 4000000 ]; do s=$s$s; done; echo ${#s}");
+
+	// A program which isn't there fails in start().
+	list<string> args;
+	args.push_back ("no-such-program");
+	notQProcess * p = sup.add (missing.name, &missing);
+	bool missingFailed = (p->start ("/nonexistent/no-such-program", args) != NOTQTPROCESS_MAIN_APP
+			      && p->getError() == NOTQPROCFAILEDTOSTART);
+	cout << "missing: " << (missingFailed ? "failed to start, as expected" : "STARTED?") << endl;
+	sup.remove (missing.name);
+
+	while (loop.runOnce (5000) > 0) {}
+
+	int failures = missingFailed ? 0 : 1;
+	if (!clean.exited || !clean.status.clean() || clean.out != 6) {
+		cout << "clean: wrong" << endl; failures++;
+	}
+	if (!error.exited || !error.status.exited || error.status.exitCode != 3) {
+		cout << "error: wrong" << endl; failures++;
+	}
+	if (!killed.exited || killed.status.exited || killed.status.signal != SIGKILL) {
+		cout << "killed: wrong" << endl; failures++;
+	}
+	if (!busy.exited || !busy.status.clean() || busy.status.maxRSS <= 0
+	    || busy.status.userTime + busy.status.systemTime <= 0) {
+		cout << "busy: wrong" << endl; failures++;
+	}
+	if (!loop.isEmpty()) {
+		cout << "the loop still has processes" << endl; failures++;
+	}
+
+	return failures;
+}
@@ -0,0 +1,366 @@
+/***************************************************************************
+   switchtest.cpp - Check the handover from the NX protocol to nxproxy
+                    on the connection shared with nxssh
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Plays the server's side of the "bye" handover down a socketpair, the
+ * way FreeNX and NoMachine servers do it, and checks that NXSwitch
+ * reads the server's last lines and nothing which is meant for
+ * nxproxy. Then checks that NXCommRelay passes on data which had
+ * already been read, followed by the rest of the connection, in both
+ * directions, and without blocking when both directions are full.
+ */
+
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "notQt.h"
+#include "nxswitch.h"
+#include "nxtrace.h"
+
+using namespace std;
+using namespace nxcl;
+
+ofstream debugLogFile;
+
+static const char * resultName[] = {
+	"done", "proxy data", "leftover", "timeout", "eof"
+};
+
+/*!
+ * Keep what the switch finished with.
+ */
+class SwitchCallbacks : public NXSwitchCallbacks
+{
+	public:
+		SwitchCallbacks() : calls(0), result(NXSWITCH_TIMEOUT) {}
+		void switchReadySignal (NXSwitchResult r)
+		{
+			this->calls++;
+			this->result = r;
+		}
+		int calls;
+		NXSwitchResult result;
+};
+
+/*!
+ * Whatever is waiting to be read from fd.
+ */
+static string drain (int fd)
+{
+	string s;
+	char buf[256];
+	ssize_t n;
+	int fl = fcntl (fd, F_GETFL);
+	fcntl (fd, F_SETFL, fl | O_NONBLOCK);
+	while ((n = read (fd, buf, sizeof (buf))) > 0) {
+		s.append (buf, n);
+	}
+	fcntl (fd, F_SETFL, fl);
+	return s;
+}
+
+/*!
+ * Write \arg first to the server end, and \arg later 20ms after
+ * the switch has started, then check what it finishes with and what
+ * it leaves in the descriptor and in its leftover.
+ */
+static int check (const string& name, const string& buffered, bool done,
+		  const string& first, const string& later, bool closeAfter,
+		  NXSwitchResult expect, const string& leftover,
+		  const string& remaining, int timeout = 500)
+{
+	int sv[2];
+	socketpair (AF_UNIX, SOCK_STREAM, 0, sv);
+
+	write (sv[0], first.data(), first.size());
+	pid_t pid = 0;
+	if (!later.empty() || closeAfter) {
+		pid = fork();
+		if (pid == 0) {
+			usleep (20000);
+			write (sv[0], later.data(), later.size());
+			_exit (0);
+		}
+	}
+	if (closeAfter) {
+		close (sv[0]);
+		sv[0] = -1;
+	}
+
+	notQEventLoop loop;
+	SwitchCallbacks cb;
+	NXSwitch sw (&loop);
+	sw.setBuffered (buffered);
+	sw.setDone (done);
+	sw.setCallbacks (&cb);
+	long long start = NXTrace::now();
+	sw.start (sv[1], timeout);
+	// Meanwhile the loop is free for everything else; it just
+	// has nothing else to do here.
+	int wakes = 0;
+	while (sw.isWaiting() && loop.runOnce (-1) >= 0) {
+		wakes++;
+	}
+	NXSwitchResult r = cb.result;
+	long long took = (NXTrace::now() - start) / 1000;
+	// nxproxy gets the descriptor blocking, as it came.
+	bool blocking = !(fcntl (sv[1], F_GETFL) & O_NONBLOCK);
+
+	if (pid > 0) {
+		waitpid (pid, NULL, 0);
+	}
+	string rest = drain (sv[1]);
+
+	int failures = 0;
+	cout << name << ": " << resultName[r] << " after " << took << "ms, "
+	     << wakes << " wakeups, "
+	     << sw.getText().size() << " lines of text, "
+	     << sw.getLeftover().size() << " bytes left over, "
+	     << rest.size() << " bytes left unread" << endl;
+	if (!blocking) {
+		cout << name << ": left the descriptor non-blocking" << endl; failures++;
+	}
+	if (cb.calls != 1 || !loop.isEmpty()) {
+		cout << name << ": switchReadySignal called " << cb.calls
+		     << " times, loop " << (loop.isEmpty() ? "empty" : "not empty") << endl;
+		failures++;
+	}
+	if (r != expect) {
+		cout << name << ": expected " << resultName[expect] << endl; failures++;
+	}
+	if (sw.getLeftover() != leftover) {
+		cout << name << ": wrong leftover '" << sw.getLeftover() << "'" << endl; failures++;
+	}
+	if (rest != remaining) {
+		cout << name << ": wrong data left unread '" << rest << "'" << endl; failures++;
+	}
+	if (r != NXSWITCH_TIMEOUT && took >= timeout) {
+		cout << name << ": took too long" << endl; failures++;
+	}
+
+	if (sv[0] != -1) {
+		close (sv[0]);
+	}
+	close (sv[1]);
+	return failures;
+}
+
+/*!
+ * Relay between one end of a "server" socketpair and a "proxy".
+ */
+static int checkRelay (void)
+{
+	int failures = 0;
+	int server[2];
+	socketpair (AF_UNIX, SOCK_STREAM, 0, server);
+
+	notQEventLoop loop;
+	NXCommRelay relay (&loop);
+	if (!relay.start (server[1], "NXPROXY-")) {
+		cout << "relay: failed to start" << endl;
+		return 1;
+	}
+	int proxy = relay.getProxyFD();
+
+	write (server[0], "3.0.0\n", 6);
+	write (proxy, "hello\n", 6);
+	while (loop.runOnce (50) > 0) {}
+
+	string toProxy = drain (proxy);
+	string toServer = drain (server[0]);
+	cout << "relay: proxy got '" << toProxy.substr (0, toProxy.size() - 1)
+	     << "', server got '" << toServer.substr (0, toServer.size() - 1) << "'" << endl;
+	if (toProxy != "NXPROXY-3.0.0\n") {
+		failures++;
+	}
+	if (toServer != "hello\n") {
+		failures++;
+	}
+
+	// The server hanging up reaches the proxy.
+	close (server[0]);
+	while (loop.runOnce (50) > 0) {}
+	char c;
+	if (read (proxy, &c, 1) != 0) {
+		cout << "relay: end of file wasn't passed on" << endl; failures++;
+	}
+
+	close (server[1]);
+	return failures;
+}
+
+/*!
+ * The byte at \arg i of what end \arg from sends in checkRelayFull()
+ */
+static char pattern (int from, size_t i)
+{
+	return static_cast<char>((i * (from ? 7 : 13)) % 251);
+}
+
+/*!
+ * Both ends write far more than the sockets hold before either reads
+ * anything, so the relay finds both directions full at once. It mustn't
+ * block on either; alarm() catches it if it does.
+ */
+static int checkRelayFull (void)
+{
+	const size_t total = 4 << 20;
+	int failures = 0;
+	int server[2];
+	socketpair (AF_UNIX, SOCK_STREAM, 0, server);
+
+	notQEventLoop loop;
+	NXCommRelay relay (&loop);
+	if (!relay.start (server[1], "")) {
+		cout << "relay, both full: failed to start" << endl;
+		return 1;
+	}
+	int ends[2] = { server[0], relay.getProxyFD() };
+	size_t sent[2] = { 0, 0 }, received[2] = { 0, 0 };
+	bool corrupt = false;
+	for (int e = 0; e < 2; e++) {
+		fcntl (ends[e], F_SETFL, fcntl (ends[e], F_GETFL) | O_NONBLOCK);
+	}
+
+	alarm (30);
+	char buf[65536];
+	// First only write, until neither end takes any more.
+	for (bool wrote = true; wrote; ) {
+		wrote = false;
+		for (int e = 0; e < 2; e++) {
+			size_t n = min (sizeof (buf), total - sent[e]);
+			for (size_t k = 0; k < n; k++) {
+				buf[k] = pattern (e, sent[e] + k);
+			}
+			ssize_t w = (n > 0) ? write (ends[e], buf, n) : 0;
+			if (w > 0) {
+				sent[e] += w;
+				wrote = true;
+			}
+		}
+		loop.runOnce (0);
+	}
+
+	// Then read as well, until it has all arrived.
+	while (received[0] < total || received[1] < total) {
+		for (int e = 0; e < 2; e++) {
+			size_t n = min (sizeof (buf), total - sent[e]);
+			for (size_t k = 0; k < n; k++) {
+				buf[k] = pattern (e, sent[e] + k);
+			}
+			ssize_t w = (n > 0) ? write (ends[e], buf, n) : 0;
+			if (w > 0) {
+				sent[e] += w;
+			}
+			ssize_t r = read (ends[e], buf, sizeof (buf));
+			for (ssize_t k = 0; k < r; k++) {
+				if (buf[k] != pattern (1 - e, received[e] + k)) {
+					corrupt = true;
+				}
+			}
+			if (r > 0) {
+				received[e] += r;
+			}
+		}
+		loop.runOnce (10);
+	}
+	alarm (0);
+
+	cout << "relay, both full: " << received[1] << " bytes to the proxy, "
+	     << received[0] << " to the server" << (corrupt ? ", corrupted" : "") << endl;
+	if (corrupt || received[0] != total || received[1] != total) {
+		failures++;
+	}
+
+	close (server[0]);
+	close (server[1]);
+	return failures;
+}
+
+int main()
+{
+	signal (SIGPIPE, SIG_IGN);
+
+	int failures = 0;
+
+	// Text lines are taken whole; anything else is nxproxy's.
+	struct { const char * data; int len; } lengths[] = {
+		{ "NX> 999 Bye\nNXPROXY", 12 },
+		{ "bye\n", 4 },
+		{ "Bye.\r\n", 6 },
+		{ "NX", 0 },
+		{ "NX> 99", 0 },
+		{ "by", 0 },
+		{ "NXPROXY-3.0.0\n", -1 },
+		{ "bye bye\n", -1 },
+		{ "\x01\x02", -1 },
+	};
+	for (size_t i = 0; i < sizeof (lengths) / sizeof (lengths[0]); i++) {
+		string d (lengths[i].data);
+		int len = NXSwitch::textLength (d.data(), d.size());
+		if (len != lengths[i].len) {
+			cout << "textLength of '" << d << "' is " << len
+			     << ", not " << lengths[i].len << endl;
+			failures++;
+		}
+	}
+
+	// FreeNX: the echo of "bye" on stdout (NX> 999 is on stderr),
+	// then the proxy's data.
+	failures += check ("freenx", "", false,
+			   "bye\nNXPROXY-1.5.0-3.0.0\n", "", false,
+			   NXSWITCH_DONE, "", "NXPROXY-1.5.0-3.0.0\n");
+	// The echo was read along with some proxy data, before we
+	// knew the rest was for nxproxy.
+	failures += check ("buffered", "NXPROXY-1.5", true,
+			   ".0-3.0.0\n", "", false,
+			   NXSWITCH_LEFTOVER, "NXPROXY-1.5", ".0-3.0.0\n");
+	// NoMachine: "NX> 999 Bye" on stdout, arriving in pieces.
+	failures += check ("split", "", false,
+			   "NX", "> 999 Bye.\nNXPROXY-3.0.0\n", false,
+			   NXSWITCH_DONE, "", "NXPROXY-3.0.0\n");
+	// Half a line had already been read.
+	failures += check ("half read", "NX> 9", false,
+			   "99 Bye.\n", "", false,
+			   NXSWITCH_DONE, "", "");
+	// No echo, but the proxy is talking.
+	failures += check ("proxy first", "", false,
+			   "NXPROXY-3.0.0\n", "", false,
+			   NXSWITCH_PROXY_DATA, "", "NXPROXY-3.0.0\n");
+	// Nothing at all.
+	failures += check ("silent", "", false,
+			   "", "", false,
+			   NXSWITCH_TIMEOUT, "", "", 100);
+	// The server went away.
+	failures += check ("closed", "", false,
+			   "NX> 999 Bye\n", "", true,
+			   NXSWITCH_DONE, "", "");
+	failures += check ("closed early", "", false,
+			   "", "", true,
+			   NXSWITCH_EOF, "", "");
+
+	failures += checkRelay();
+	failures += checkRelayFull();
+
+	cout << (failures ? "FAILED" : "all passed") << endl;
+	return failures;
+}
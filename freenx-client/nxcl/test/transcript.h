@@ -0,0 +1,87 @@
+/* -*-c++-*- */
+/***************************************************************************
+   transcript.h - Read the recorded nxssh conversations in transcripts/
+                             -------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _TRANSCRIPT_H_
+#define _TRANSCRIPT_H_
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*!
+ * One step of a recorded conversation: everything the server sent
+ * before it waited for the client, and what the client then said.
+ */
+struct TranscriptSegment {
+	/*!
+	 * The bytes from the server, newlines included. Ends with a
+	 * prompt unless this is the last segment.
+	 */
+	string server;
+	/*!
+	 * The client's reply, without its newline. Empty for the
+	 * last segment.
+	 */
+	string client;
+};
+
+/*!
+ * Load a transcript. Lines starting "S " are lines from the server,
+ * "P " a prompt (up to the final '$', with no newline) and "C " the
+ * client's reply. Anything else is a comment.
+ *
+ * \return false if the file couldn't be read.
+ */
+static inline bool loadTranscript (const string& path, vector<TranscriptSegment>& segments)
+{
+	ifstream f (path.c_str());
+	if (!f.is_open()) {
+		return false;
+	}
+
+	segments.clear();
+	segments.push_back (TranscriptSegment());
+
+	string line;
+	while (getline (f, line)) {
+		if (line.size() < 2 || line[1] != ' ') {
+			continue;
+		}
+		string rest = line.substr (2);
+		switch (line[0]) {
+		case 'S':
+			segments.back().server += rest + "\n";
+			break;
+		case 'P':
+			if (!rest.empty() && rest[rest.size()-1] == '$') {
+				rest.erase (rest.size()-1);
+			}
+			segments.back().server += rest;
+			break;
+		case 'C':
+			segments.back().client = rest;
+			segments.push_back (TranscriptSegment());
+			break;
+		default:
+			break;
+		}
+	}
+	return true;
+}
+
+#endif
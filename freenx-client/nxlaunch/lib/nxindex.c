@@ -0,0 +1,401 @@
+/***************************************************************************
+                   nxindex: A cache of the parsed .nxs files
+                   ---------------------------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "nxindex.h"
+
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+
+/*
+ * The index file is NX_INDEX_MAGIC, then a guint32 count of entries,
+ * each of which is:
+ *
+ *   guint32 length, name
+ *   gint64 mtime, guint64 inode, guint64 size
+ *   guint32 length, data
+ *
+ * where data is an nx_connection as written by nx_index_pack().
+ */
+
+struct nx_index_entry {
+	gint64 mtime;
+	guint64 ino;
+	guint64 size;
+	/* Read or updated since the index was loaded */
+	gboolean seen;
+	GByteArray * data;
+};
+
+struct nx_index {
+	gchar * path;
+	/* Connection name -> struct nx_index_entry */
+	GHashTable * entries;
+	gboolean dirty;
+};
+
+static void nx_index_entry_free (gpointer data)
+{
+	struct nx_index_entry * e = data;
+	g_byte_array_free (e->data, TRUE);
+	g_free (e);
+}
+
+static gboolean nx_index_matches (const struct nx_index_entry * e, const struct stat * st)
+{
+	return (e->mtime == (gint64) st->st_mtime
+		&& e->ino == (guint64) st->st_ino
+		&& e->size == (guint64) st->st_size);
+}
+
+/*!
+ * Pack and unpack the fields of an nx_connection. The two must list
+ * the fields in the same order.
+ */
+//@{
+static void put_uint (GByteArray * b, guint32 v)
+{
+	g_byte_array_append (b, (const guint8 *) &v, sizeof (v));
+}
+
+static void put_string (GByteArray * b, const gchar * s)
+{
+	guint32 len = s ? strlen (s) : 0;
+	put_uint (b, len);
+	g_byte_array_append (b, (const guint8 *) s, len);
+}
+
+static gboolean get_bytes (const guint8 ** p, const guint8 * end, void * dest, gsize n)
+{
+	if ((gsize) (end - *p) < n) {
+		return FALSE;
+	}
+	memcpy (dest, *p, n);
+	*p += n;
+	return TRUE;
+}
+
+static gboolean get_uint (const guint8 ** p, const guint8 * end, guint * v)
+{
+	guint32 u;
+	if (!get_bytes (p, end, &u, sizeof (u))) {
+		return FALSE;
+	}
+	*v = u;
+	return TRUE;
+}
+
+static gboolean get_bool (const guint8 ** p, const guint8 * end, gboolean * v)
+{
+	guint u;
+	if (!get_uint (p, end, &u)) {
+		return FALSE;
+	}
+	*v = u ? TRUE : FALSE;
+	return TRUE;
+}
+
+/*
+ * Read a string into dest, which has room for destlen chars, as
+ * allocated by nx_connection_malloc(). Longer strings are truncated.
+ */
+static gboolean get_string (const guint8 ** p, const guint8 * end, gchar * dest, gsize destlen)
+{
+	guint32 len;
+	if (!get_bytes (p, end, &len, sizeof (len))
+	    || (gsize) (end - *p) < len) {
+		return FALSE;
+	}
+	strncpy (dest, "", destlen);
+	memcpy (dest, *p, MIN (len, destlen - 1));
+	*p += len;
+	return TRUE;
+}
+
+static void nx_index_pack (GByteArray * b, const struct nx_connection * nx_conn)
+{
+	put_string (b, nx_conn->ConnectionName);
+	put_string (b, nx_conn->ServerHost);
+	put_uint   (b, nx_conn->ServerPort);
+	put_string (b, nx_conn->User);
+	put_string (b, nx_conn->Pass);
+	put_uint   (b, nx_conn->RememberPassword);
+	put_uint   (b, nx_conn->DisableNoDelay);
+	put_uint   (b, nx_conn->DisableZLIB);
+	put_uint   (b, nx_conn->EnableSSLOnly);
+	put_string (b, nx_conn->LinkSpeed);
+	put_string (b, nx_conn->PublicKey);
+	put_string (b, nx_conn->Desktop);
+	put_string (b, nx_conn->Session);
+	put_string (b, nx_conn->CustomUnixDesktop);
+	put_string (b, nx_conn->CommandLine);
+	put_uint   (b, nx_conn->VirtualDesktop);
+	put_uint   (b, nx_conn->XAgentEncoding);
+	put_uint   (b, nx_conn->UseTaint);
+	put_string (b, nx_conn->XdmMode);
+	put_string (b, nx_conn->XdmHost);
+	put_uint   (b, nx_conn->XdmPort);
+	put_uint   (b, nx_conn->FullScreen);
+	put_uint   (b, nx_conn->ResolutionWidth);
+	put_uint   (b, nx_conn->ResolutionHeight);
+	put_string (b, nx_conn->Geometry);
+	put_uint   (b, nx_conn->ImageEncoding);
+	put_uint   (b, nx_conn->JPEGQuality);
+	put_uint   (b, nx_conn->enableSound);
+	put_uint   (b, nx_conn->IPPPort);
+	put_uint   (b, nx_conn->IPPPrinting);
+	put_uint   (b, nx_conn->Shares);
+	put_string (b, nx_conn->agentServer);
+	put_string (b, nx_conn->agentUser);
+	put_string (b, nx_conn->agentPass);
+}
+
+static gboolean nx_index_unpack (const GByteArray * b, struct nx_connection * nx_conn)
+{
+	const guint8 * p = b->data;
+	const guint8 * e = b->data + b->len;
+
+	return (get_string (&p, e, nx_conn->ConnectionName, NX_FIELDLEN)
+		&& get_string (&p, e, nx_conn->ServerHost, NX_FIELDLEN)
+		&& get_uint   (&p, e, &nx_conn->ServerPort)
+		&& get_string (&p, e, nx_conn->User, NX_FIELDLEN)
+		&& get_string (&p, e, nx_conn->Pass, NX_FIELDLEN)
+		&& get_bool   (&p, e, &nx_conn->RememberPassword)
+		&& get_bool   (&p, e, &nx_conn->DisableNoDelay)
+		&& get_bool   (&p, e, &nx_conn->DisableZLIB)
+		&& get_bool   (&p, e, &nx_conn->EnableSSLOnly)
+		&& get_string (&p, e, nx_conn->LinkSpeed, NX_FIELDLEN)
+		&& get_string (&p, e, nx_conn->PublicKey, SSLKEYLEN)
+		&& get_string (&p, e, nx_conn->Desktop, NX_FIELDLEN)
+		&& get_string (&p, e, nx_conn->Session, NX_FIELDLEN)
+		&& get_string (&p, e, nx_conn->CustomUnixDesktop, NX_FIELDLEN)
+		&& get_string (&p, e, nx_conn->CommandLine, CMDLINELEN)
+		&& get_bool   (&p, e, &nx_conn->VirtualDesktop)
+		&& get_bool   (&p, e, &nx_conn->XAgentEncoding)
+		&& get_bool   (&p, e, &nx_conn->UseTaint)
+		&& get_string (&p, e, nx_conn->XdmMode, NX_FIELDLEN)
+		&& get_string (&p, e, nx_conn->XdmHost, NX_FIELDLEN)
+		&& get_uint   (&p, e, &nx_conn->XdmPort)
+		&& get_bool   (&p, e, &nx_conn->FullScreen)
+		&& get_uint   (&p, e, &nx_conn->ResolutionWidth)
+		&& get_uint   (&p, e, &nx_conn->ResolutionHeight)
+		&& get_string (&p, e, nx_conn->Geometry, NX_FIELDLEN)
+		&& get_uint   (&p, e, &nx_conn->ImageEncoding)
+		&& get_uint   (&p, e, &nx_conn->JPEGQuality)
+		&& get_bool   (&p, e, &nx_conn->enableSound)
+		&& get_uint   (&p, e, &nx_conn->IPPPort)
+		&& get_bool   (&p, e, &nx_conn->IPPPrinting)
+		&& get_bool   (&p, e, &nx_conn->Shares)
+		&& get_string (&p, e, nx_conn->agentServer, NX_FIELDLEN)
+		&& get_string (&p, e, nx_conn->agentUser, NX_FIELDLEN)
+		&& get_string (&p, e, nx_conn->agentPass, NX_FIELDLEN));
+}
+//@}
+
+struct nx_index * nx_index_load (void)
+{
+	struct nx_index * idx;
+	gchar * contents = NULL;
+	gsize length = 0;
+	const guint8 * p, * end;
+	guint32 count, i;
+
+	idx = g_malloc0 (sizeof (struct nx_index));
+	idx->path = g_strdup_printf ("%s/%s", getenv("HOME"), NX_INDEX_FILE);
+	idx->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+					      g_free, nx_index_entry_free);
+
+	if (!g_file_get_contents (idx->path, &contents, &length, NULL)) {
+		printerr ("NXLAUNCH> No connection index in %s\n", idx->path);
+		return idx;
+	}
+
+	p = (const guint8 *) contents;
+	end = p + length;
+	if (length < strlen (NX_INDEX_MAGIC)
+	    || memcmp (p, NX_INDEX_MAGIC, strlen (NX_INDEX_MAGIC))) {
+		printerr ("NXLAUNCH> %s is not a connection index\n", idx->path);
+		g_free (contents);
+		return idx;
+	}
+	p += strlen (NX_INDEX_MAGIC);
+
+	if (!get_bytes (&p, end, &count, sizeof (count))) {
+		count = 0;
+	}
+	for (i = 0; i < count; i++) {
+		struct nx_index_entry * e;
+		guint32 len;
+		gchar * name;
+
+		if (!get_bytes (&p, end, &len, sizeof (len))
+		    || (gsize) (end - p) < len) {
+			break;
+		}
+		name = g_strndup ((const gchar *) p, len);
+		p += len;
+
+		e = g_malloc0 (sizeof (struct nx_index_entry));
+		e->data = g_byte_array_new();
+		if (!get_bytes (&p, end, &e->mtime, sizeof (e->mtime))
+		    || !get_bytes (&p, end, &e->ino, sizeof (e->ino))
+		    || !get_bytes (&p, end, &e->size, sizeof (e->size))
+		    || !get_bytes (&p, end, &len, sizeof (len))
+		    || (gsize) (end - p) < len) {
+			g_free (name);
+			nx_index_entry_free (e);
+			break;
+		}
+		g_byte_array_append (e->data, p, len);
+		p += len;
+
+		g_hash_table_replace (idx->entries, name, e);
+	}
+
+	if (i < count) {
+		/* Damaged; start again. */
+		printerr ("NXLAUNCH> %s is damaged, ignoring it\n", idx->path);
+		g_hash_table_remove_all (idx->entries);
+		idx->dirty = TRUE;
+	}
+
+	printerr ("NXLAUNCH> %d connections in the index\n",
+		  g_hash_table_size (idx->entries));
+	g_free (contents);
+	return idx;
+}
+
+gint nx_index_read (struct nx_index * idx, struct nx_connection * nx_conn,
+		    const gchar * name, const struct stat * st)
+{
+	struct nx_index_entry * e;
+
+	e = g_hash_table_lookup (idx->entries, name);
+	if (e == NULL) {
+		return NX_INDEX_MISSING;
+	}
+	if (!nx_index_unpack (e->data, nx_conn)) {
+		g_hash_table_remove (idx->entries, name);
+		idx->dirty = TRUE;
+		return NX_INDEX_MISSING;
+	}
+
+	e->seen = TRUE;
+	return nx_index_matches (e, st) ? NX_INDEX_FRESH : NX_INDEX_STALE;
+}
+
+void nx_index_update (struct nx_index * idx, const struct nx_connection * nx_conn,
+		      const gchar * name, const struct stat * st)
+{
+	struct nx_index_entry * e;
+
+	e = g_malloc0 (sizeof (struct nx_index_entry));
+	e->mtime = st->st_mtime;
+	e->ino = st->st_ino;
+	e->size = st->st_size;
+	e->seen = TRUE;
+	e->data = g_byte_array_new();
+	nx_index_pack (e->data, nx_conn);
+
+	g_hash_table_replace (idx->entries, g_strdup (name), e);
+	idx->dirty = TRUE;
+}
+
+void nx_index_remove (struct nx_index * idx, const gchar * name)
+{
+	if (g_hash_table_remove (idx->entries, name)) {
+		idx->dirty = TRUE;
+	}
+}
+
+static gboolean nx_index_unseen (gpointer key, gpointer value, gpointer data)
+{
+	struct nx_index_entry * e = value;
+	return !e->seen;
+}
+
+static void nx_index_write_entry (gpointer key, gpointer value, gpointer data)
+{
+	GByteArray * b = data;
+	struct nx_index_entry * e = value;
+
+	put_string (b, key);
+	g_byte_array_append (b, (const guint8 *) &e->mtime, sizeof (e->mtime));
+	g_byte_array_append (b, (const guint8 *) &e->ino, sizeof (e->ino));
+	g_byte_array_append (b, (const guint8 *) &e->size, sizeof (e->size));
+	put_uint (b, e->data->len);
+	g_byte_array_append (b, e->data->data, e->data->len);
+}
+
+gint nx_index_save (struct nx_index * idx)
+{
+	GByteArray * b;
+	gchar * tmp;
+	gint fd, rtn = -1;
+
+	if (g_hash_table_foreach_remove (idx->entries, nx_index_unseen, NULL) > 0) {
+		idx->dirty = TRUE;
+	}
+	if (!idx->dirty) {
+		return 0;
+	}
+
+	b = g_byte_array_new();
+	g_byte_array_append (b, (const guint8 *) NX_INDEX_MAGIC, strlen (NX_INDEX_MAGIC));
+	put_uint (b, g_hash_table_size (idx->entries));
+	g_hash_table_foreach (idx->entries, nx_index_write_entry, b);
+
+	/*
+	 * Write a new file and rename it over the old, so that
+	 * another nxlaunch never reads half an index. It holds the
+	 * passwords from the connection files, so only the user may
+	 * read it.
+	 */
+	tmp = g_strdup_printf ("%s.%d", idx->path, getpid());
+	fd = open (tmp, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (fd >= 0) {
+		if (write (fd, b->data, b->len) == (ssize_t) b->len) {
+			rtn = 0;
+		}
+		if (close (fd) != 0 || (rtn == 0 && rename (tmp, idx->path) != 0)) {
+			rtn = -1;
+		}
+		if (rtn != 0) {
+			unlink (tmp);
+		}
+	}
+
+	if (rtn == 0) {
+		printerr ("NXLAUNCH> Wrote %d connections to %s\n",
+			  g_hash_table_size (idx->entries), idx->path);
+		idx->dirty = FALSE;
+	} else {
+		printerr ("NXLAUNCH> Failed to write %s\n", idx->path);
+	}
+
+	g_free (tmp);
+	g_byte_array_free (b, TRUE);
+	return rtn;
+}
+
+void nx_index_free (struct nx_index * idx)
+{
+	if (idx == NULL) {
+		return;
+	}
+	g_hash_table_destroy (idx->entries);
+	g_free (idx->path);
+	g_free (idx);
+}
@@ -0,0 +1,101 @@
+/***************************************************************************
+                   nxindex: A cache of the parsed .nxs files
+                   ---------------------------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+/*! \file nxindex.h
+ *
+ * Parsing every connection file in ~/.nx/config with libxml takes a
+ * while when there are hundreds of them, so the parsed nx_connection
+ * structures are kept in a binary index, ~/.nx/nxlaunch.index, along
+ * with the mtime, inode and size of the file each came from. A file
+ * which hasn't changed since it was indexed can be read from the
+ * index instead of being parsed again.
+ *
+ * The index is only a cache: it is written in the host's byte order,
+ * and if it is missing, from another version or damaged it is simply
+ * ignored and rebuilt.
+ */
+
+#ifndef __NXINDEX__
+#define __NXINDEX__
+
+#include <glib.h>
+#include <sys/stat.h>
+
+#include "callbacks_nx.h"
+
+/*!
+ * The index file, relative to $HOME.
+ */
+#define NX_INDEX_FILE ".nx/nxlaunch.index"
+
+/*!
+ * Change this whenever the layout of the index, or of struct
+ * nx_connection, changes.
+ */
+#define NX_INDEX_MAGIC "NXLIDX01"
+
+/* Return codes of nx_index_read */
+#define NX_INDEX_FRESH 0
+#define NX_INDEX_STALE 1 /* The file has changed since it was indexed */
+#define NX_INDEX_MISSING -1
+
+/*!
+ * The index, as loaded by nx_index_load().
+ */
+struct nx_index;
+
+/*!
+ * Load the index from NX_INDEX_FILE. Returns an empty index if there
+ * is no usable index file.
+ */
+struct nx_index * nx_index_load (void);
+
+/*!
+ * Fill in nx_conn, which must have come from nx_connection_malloc(),
+ * from the index entry for the connection file called name. st is
+ * the stat of that file.
+ *
+ * Returns NX_INDEX_FRESH if the file is as it was when it was
+ * indexed, NX_INDEX_STALE if it has changed (nx_conn is filled in
+ * with the old settings anyway), or NX_INDEX_MISSING if it isn't in
+ * the index.
+ */
+gint nx_index_read (struct nx_index * idx, struct nx_connection * nx_conn,
+		    const gchar * name, const struct stat * st);
+
+/*!
+ * Put nx_conn, freshly parsed from the connection file called name
+ * whose stat is st, in the index.
+ */
+void nx_index_update (struct nx_index * idx, const struct nx_connection * nx_conn,
+		      const gchar * name, const struct stat * st);
+
+/*!
+ * The connection file called name has gone.
+ */
+void nx_index_remove (struct nx_index * idx, const gchar * name);
+
+/*!
+ * Write the index out, if it has changed since it was loaded. Entries
+ * which have been neither read nor updated since the load are for
+ * files which have gone, and are dropped.
+ *
+ * Returns 0 if all ok, -1 on error.
+ */
+gint nx_index_save (struct nx_index * idx);
+
+void nx_index_free (struct nx_index * idx);
+
+#endif
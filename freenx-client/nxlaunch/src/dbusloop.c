@@ -0,0 +1,197 @@
+/***************************************************************************
+          dbusloop: Run nxlaunch's D-Bus connection from the GLib
+                    main loop
+                   ---------------------------------------
+    begin                : October 2026
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include "i18n.h"
+
+/*!
+ * config.h is created by the configure script and contains
+ * configure/compile time choices made by the program compiler.
+ */
+#include "../config.h"
+
+#include <glib.h>
+#include <stdio.h>
+#define DBUS_API_SUBJECT_TO_CHANGE 1
+#include <dbus/dbus.h>
+
+#include "nxlaunch.h"
+
+/*
+ * libdbus tells us which descriptors and timers it needs through
+ * these functions, and we turn them into GLib sources. We don't use
+ * dbus_connection_setup_with_g_main() because it would pull in
+ * dbus-glib for the sake of these few functions.
+ *
+ * The GLib source id of each watch and timeout is kept as its data.
+ */
+
+/*!
+ * The idle source which dispatches queued messages, or 0.
+ */
+static guint dispatch_id = 0;
+
+/*!
+ * TRUE while dbusloop_dispatch() is dispatching. nxlaunch still runs
+ * "while (gtk_events_pending()) gtk_main_iteration();" here and there,
+ * including from within the filter, and libdbus must not be asked to
+ * dispatch again until the filter returns.
+ */
+static gboolean dispatching = FALSE;
+
+static gboolean dbusloop_dispatch (gpointer data)
+{
+	DBusConnection * conn = data;
+
+	dispatch_id = 0;
+	if (dispatching) {
+		/* The outer call carries on until the queue is empty. */
+		return FALSE;
+	}
+
+	dispatching = TRUE;
+	dbus_connection_ref (conn);
+	while (dbus_connection_dispatch (conn) == DBUS_DISPATCH_DATA_REMAINS) {}
+	dbus_connection_unref (conn);
+	dispatching = FALSE;
+	return FALSE;
+}
+
+static void dbusloop_dispatch_status (DBusConnection * conn,
+				      DBusDispatchStatus status,
+				      void * data)
+{
+	/* Not from in here: libdbus may be in the middle of
+	 * something. */
+	if (status == DBUS_DISPATCH_DATA_REMAINS && dispatch_id == 0) {
+		dispatch_id = g_idle_add (dbusloop_dispatch, conn);
+	}
+}
+
+static gboolean dbusloop_io (GIOChannel * source,
+			     GIOCondition condition,
+			     gpointer data)
+{
+	DBusWatch * watch = data;
+	unsigned int flags = 0;
+
+	if (condition & G_IO_IN)  { flags |= DBUS_WATCH_READABLE; }
+	if (condition & G_IO_OUT) { flags |= DBUS_WATCH_WRITABLE; }
+	if (condition & G_IO_ERR) { flags |= DBUS_WATCH_ERROR; }
+	if (condition & G_IO_HUP) { flags |= DBUS_WATCH_HANGUP; }
+
+	dbus_watch_handle (watch, flags);
+	return TRUE;
+}
+
+static dbus_bool_t dbusloop_add_watch (DBusWatch * watch, void * data)
+{
+	GIOChannel * channel;
+	GIOCondition condition = G_IO_ERR | G_IO_HUP;
+	unsigned int flags;
+	guint id;
+
+	if (!dbus_watch_get_enabled (watch)) {
+		return TRUE;
+	}
+
+	flags = dbus_watch_get_flags (watch);
+	if (flags & DBUS_WATCH_READABLE) { condition |= G_IO_IN; }
+	if (flags & DBUS_WATCH_WRITABLE) { condition |= G_IO_OUT; }
+
+	channel = g_io_channel_unix_new (dbus_watch_get_unix_fd (watch));
+	id = g_io_add_watch (channel, condition, dbusloop_io, watch);
+	g_io_channel_unref (channel);
+
+	dbus_watch_set_data (watch, GUINT_TO_POINTER (id), NULL);
+	return TRUE;
+}
+
+static void dbusloop_remove_watch (DBusWatch * watch, void * data)
+{
+	guint id = GPOINTER_TO_UINT (dbus_watch_get_data (watch));
+
+	if (id != 0) {
+		g_source_remove (id);
+		dbus_watch_set_data (watch, NULL, NULL);
+	}
+}
+
+static void dbusloop_toggle_watch (DBusWatch * watch, void * data)
+{
+	dbusloop_remove_watch (watch, data);
+	dbusloop_add_watch (watch, data);
+}
+
+static gboolean dbusloop_timeout (gpointer data)
+{
+	DBusTimeout * timeout = data;
+
+	/* It stays until libdbus removes it. */
+	dbus_timeout_handle (timeout);
+	return TRUE;
+}
+
+static dbus_bool_t dbusloop_add_timeout (DBusTimeout * timeout, void * data)
+{
+	guint id;
+
+	if (!dbus_timeout_get_enabled (timeout)) {
+		return TRUE;
+	}
+
+	id = g_timeout_add (dbus_timeout_get_interval (timeout),
+			    dbusloop_timeout, timeout);
+	dbus_timeout_set_data (timeout, GUINT_TO_POINTER (id), NULL);
+	return TRUE;
+}
+
+static void dbusloop_remove_timeout (DBusTimeout * timeout, void * data)
+{
+	guint id = GPOINTER_TO_UINT (dbus_timeout_get_data (timeout));
+
+	if (id != 0) {
+		g_source_remove (id);
+		dbus_timeout_set_data (timeout, NULL, NULL);
+	}
+}
+
+static void dbusloop_toggle_timeout (DBusTimeout * timeout, void * data)
+{
+	dbusloop_remove_timeout (timeout, data);
+	dbusloop_add_timeout (timeout, data);
+}
+
+void dbusloop_attach (DBusConnection * conn, DBusHandleMessageFunction filter)
+{
+	dbus_connection_set_watch_functions (conn,
+					     dbusloop_add_watch,
+					     dbusloop_remove_watch,
+					     dbusloop_toggle_watch,
+					     NULL, NULL);
+	dbus_connection_set_timeout_functions (conn,
+					       dbusloop_add_timeout,
+					       dbusloop_remove_timeout,
+					       dbusloop_toggle_timeout,
+					       NULL, NULL);
+	dbus_connection_set_dispatch_status_function (conn,
+						      dbusloop_dispatch_status,
+						      NULL, NULL);
+	if (!dbus_connection_add_filter (conn, filter, NULL, NULL)) {
+		printerr ("NXLAUNCH> Out Of Memory!\n");
+	}
+
+	/* Anything which arrived while we were setting up. */
+	dbusloop_dispatch_status (conn, dbus_connection_get_dispatch_status (conn), NULL);
+}
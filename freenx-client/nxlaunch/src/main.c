@@ -102,6 +102,9 @@ main (gint argc, gchar * argv[])
 #endif
 
 	dbusNum = obtainDbusConnection();
+	if (dbusConn != NULL) {
+		dbusloop_attach (dbusConn, &nxlaunch_dbus_filter);
+	}
 
 	/*
 	 * See nxlaunch.h for the enums which relate to these list stores.
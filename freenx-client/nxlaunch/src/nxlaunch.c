@@ -38,8 +38,13 @@
 #define DBUS_API_SUBJECT_TO_CHANGE 1
 #include <dbus/dbus.h>
 
+#ifdef HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+#endif
+
 #include "nxlaunch.h"
 #include "../lib/callbacks_nx.h"
+#include "../lib/nxindex.h"
 
 /* Use a global for the xml tree */
 extern GladeXML * xml_nxlaunch_glob;
@@ -465,12 +470,275 @@ void on_treeview_connection_cursor_changed (GtkWidget * widget)
 //@} Callbacks
 
 
+/*!
+ * The index of parsed connection files; see nxindex.h
+ */
+static struct nx_index * conn_index = NULL;
+
+/*!
+ * Names of the connection files which need parsing, and the idle
+ * source which parses them, or 0.
+ */
+//@{
+static GQueue * conn_pending = NULL;
+static guint conn_pending_id = 0;
+//@}
+
+/*!
+ * If name ends in .nxs, it should be an NX config file. Put the
+ * connection name (name without the .nxs) in nxname and return TRUE.
+ */
+static gboolean nxconnection_name (const gchar * name, gchar * nxname, gsize len)
+{
+	gsize nlen = strlen (name);
+
+	if (nlen <= 4 || nlen - 4 >= len || strcmp (name + nlen - 4, ".nxs")) {
+		return FALSE;
+	}
+	strncpy (nxname, name, nlen - 4);
+	nxname[nlen - 4] = '\0';
+	return TRUE;
+}
+
+/*!
+ * Find the row for the connection called name in conn_store.
+ */
+static gboolean nxconnection_find (const gchar * name, GtkTreeIter * iter)
+{
+	gchar * str_data;
+	gboolean valid;
+
+	valid = gtk_tree_model_get_iter_first (GTK_TREE_MODEL (conn_store), iter);
+	while (valid) {
+		gtk_tree_model_get (GTK_TREE_MODEL (conn_store), iter,
+				    CONN_CONNECTIONNAME, &str_data, -1);
+		if (!strcmp (str_data, name)) {
+			g_free (str_data);
+			return TRUE;
+		}
+		g_free (str_data);
+		valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (conn_store), iter);
+	}
+	return FALSE;
+}
+
+/*!
+ * Place nx_conn in the row of the connection store list pointed to
+ * by iter.
+ */
+static void nxconnection_setrow (GtkTreeIter * iter, struct nx_connection * nx_conn)
+{
+	gtk_list_store_set (conn_store, iter,
+			    CONN_CONNECTIONNAME,    nx_conn->ConnectionName,
+			    CONN_SERVERHOST,        nx_conn->ServerHost,
+			    CONN_SERVERPORT,        nx_conn->ServerPort,
+			    CONN_USER,              nx_conn->User,
+			    CONN_PASS,              nx_conn->Pass,
+			    CONN_REMEMBERPASS,      nx_conn->RememberPassword ? TRUE : FALSE,
+			    CONN_DISABLENODELAY,    nx_conn->DisableNoDelay ? TRUE : FALSE,
+			    CONN_DISABLEZLIB,       nx_conn->DisableZLIB ? TRUE : FALSE,
+			    CONN_ENABLESSLONLY,     nx_conn->EnableSSLOnly ? TRUE : FALSE,
+			    CONN_LINKSPEED,         nx_conn->LinkSpeed,
+			    CONN_PUBLICKEY,         nx_conn->PublicKey,
+			    CONN_DESKTOP,           nx_conn->Desktop,
+			    CONN_SESSION,           nx_conn->Session,
+			    CONN_CUSTOMUNIXDESKTOP, nx_conn->CustomUnixDesktop,
+			    CONN_COMMANDLINE,       nx_conn->CommandLine,
+			    CONN_VIRTUALDESKTOP,    nx_conn->VirtualDesktop ? TRUE : FALSE,
+			    CONN_XAGENTENCODING,    nx_conn->XAgentEncoding ? TRUE : FALSE,
+			    CONN_USETAINT,          nx_conn->UseTaint ? TRUE : FALSE,
+			    CONN_XDMMODE,           nx_conn->XdmMode,
+			    CONN_XDMHOST,           nx_conn->XdmHost,
+			    CONN_XDMPORT,           nx_conn->XdmPort,
+			    CONN_FULLSCREEN,        nx_conn->FullScreen ? TRUE : FALSE,	    
+			    CONN_RESOLUTIONWIDTH,   nx_conn->ResolutionWidth,
+			    CONN_RESOLUTIONHEIGHT,  nx_conn->ResolutionHeight,
+			    CONN_GEOMETRY,          nx_conn->Geometry,
+			    CONN_IMAGEENCODING,     nx_conn->ImageEncoding,
+			    CONN_JPEGQUALITY,       nx_conn->JPEGQuality,
+			    CONN_ENABLESOUND,       nx_conn->enableSound ? TRUE : FALSE,
+			    CONN_IPPPORT,           nx_conn->IPPPort,
+			    CONN_IPPPRINTING,       nx_conn->IPPPrinting ? TRUE : FALSE,
+			    CONN_SHARES,            nx_conn->Shares ? TRUE : FALSE,
+			    CONN_AGENTSERVER,       nx_conn->agentServer,
+			    CONN_AGENTUSER,         nx_conn->agentUser,
+			    CONN_AGENTPASS,         nx_conn->agentPass,
+			    -1);
+}
+
+/*!
+ * Parse the next connection file in conn_pending, and update its
+ * row and the index. Returns FALSE when there are none left.
+ */
+static gboolean nxconnection_parse_next (void)
+{
+	gchar * nxname;
+	gchar path[1024];
+	struct stat st;
+	struct nx_connection * nx_conn;
+	GtkTreeIter iter;
+	GtkTreeSelection * select;
+	gboolean have_row;
+
+	if (conn_pending == NULL || g_queue_is_empty (conn_pending)) {
+		return FALSE;
+	}
+	nxname = g_queue_pop_head (conn_pending);
+
+	snprintf (path, 1023, "%s/.nx/config/%s.nxs", getenv("HOME"), nxname);
+	have_row = nxconnection_find (nxname, &iter);
+	nx_conn = nx_connection_malloc();
+	nx_connection_zero (nx_conn);
+
+	/* Read in the connection using the callbacks_nx library fn */
+	if (stat (path, &st) == 0 && 0 == read_nx_connection (nx_conn, nxname)) {
+		if (!have_row) {
+			gtk_list_store_append (conn_store, &iter);
+		}
+		nxconnection_setrow (&iter, nx_conn);
+		nx_index_update (conn_index, nx_conn, nxname, &st);
+
+		/* The user entry box shows the selected connection's user. */
+		select = gtk_tree_view_get_selection (
+			GTK_TREE_VIEW (glade_xml_get_widget (xml_nxlaunch_glob,
+							     "treeview_nxconnection")));
+		if (gtk_tree_selection_iter_is_selected (select, &iter)) {
+			on_treeview_connection_cursor_changed (
+				glade_xml_get_widget (xml_nxlaunch_glob, "treeview_nxconnection"));
+		}
+	} else {
+		printerr ("NXLAUNCH> Couldn't read connection %s\n", nxname);
+		if (have_row) {
+			gtk_list_store_remove (conn_store, &iter);
+		}
+		nx_index_remove (conn_index, nxname);
+	}
+
+	nx_connection_free (nx_conn);
+	g_free (nxname);
+	return !g_queue_is_empty (conn_pending);
+}
+
+/*!
+ * Parses the pending connection files one at a time, so that the
+ * window stays responsive, and saves the index when they are done.
+ */
+static gboolean nxconnection_parse_idle (gpointer data)
+{
+	if (nxconnection_parse_next()) {
+		return TRUE;
+	}
+	conn_pending_id = 0;
+	nx_index_save (conn_index);
+	return FALSE;
+}
+
+/*!
+ * Parse the connection file for nxname, when there is nothing else to
+ * do.
+ */
+static void nxconnection_queue (const gchar * nxname)
+{
+	if (conn_pending == NULL) {
+		conn_pending = g_queue_new();
+	}
+	if (g_queue_find_custom (conn_pending, nxname, (GCompareFunc) strcmp) == NULL) {
+		g_queue_push_tail (conn_pending, g_strdup (nxname));
+	}
+	if (conn_pending_id == 0) {
+		conn_pending_id = g_idle_add (&nxconnection_parse_idle, NULL);
+	}
+}
+
+void nxconnection_flush (void)
+{
+	if (conn_pending_id == 0) {
+		return;
+	}
+	g_source_remove (conn_pending_id);
+	while (nxconnection_parse_idle (NULL)) {}
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+/*!
+ * Something has happened in ~/.nx/config.
+ */
+static gboolean nxconnection_notify (GIOChannel * source,
+				     GIOCondition condition,
+				     gpointer data)
+{
+	char buf[4096] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+	const struct inotify_event * ev;
+	ssize_t len;
+	char * p;
+	gchar nxname[128];
+	GtkTreeIter iter;
+
+	while ((len = read (g_io_channel_unix_get_fd (source), buf, sizeof (buf))) > 0) {
+		for (p = buf; p < buf + len; p += sizeof (struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event *) p;
+			if (ev->len == 0
+			    || !nxconnection_name (ev->name, nxname, sizeof (nxname))) {
+				continue;
+			}
+
+			if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+				printerr ("NXLAUNCH> Connection %s has gone\n", nxname);
+				if (nxconnection_find (nxname, &iter)) {
+					gtk_list_store_remove (conn_store, &iter);
+				}
+				nx_index_remove (conn_index, nxname);
+				if (conn_pending_id == 0) {
+					nx_index_save (conn_index);
+				}
+			} else {
+				printerr ("NXLAUNCH> Connection %s has changed\n", nxname);
+				nxconnection_queue (nxname);
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+/*!
+ * Watch ~/.nx/config for connection files being written, moved in or
+ * deleted, so that the list is kept up to date.
+ */
+static void nxconnection_watch (const gchar * config)
+{
+	GIOChannel * channel;
+	int fd;
+
+	if ((fd = inotify_init()) < 0) {
+		printerr ("NXLAUNCH> inotify_init failed\n");
+		return;
+	}
+	fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+	fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+	if (inotify_add_watch (fd, config,
+			       IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0) {
+		printerr ("NXLAUNCH> Can't watch %s\n", config);
+		close (fd);
+		return;
+	}
+
+	channel = g_io_channel_unix_new (fd);
+	g_io_add_watch (channel, G_IO_IN, &nxconnection_notify, NULL);
+	g_io_channel_unref (channel);
+}
+#endif
+
 int nxconnection_buildlist (void)
 {
 	DIR *dp;
 	struct dirent *ep;
-	int nlen = 0, rtn = 0;
+	int rtn = 0, fresh = 0;
 	gchar config[1024];
+	gchar path[1024];
+	struct stat st;
+	GTimer * timer;
 
 	snprintf (config, 1023, "%s/.nx/config", getenv("HOME"));
 
@@ -480,66 +748,67 @@ int nxconnection_buildlist (void)
 		return 0;
 	}
 
+	timer = g_timer_new();
+	if (conn_index == NULL) {
+		conn_index = nx_index_load();
+	}
+
 	while ((ep = readdir (dp))) {
 
-		/* If d_name ends in .nxs, it should be an NX config file. */
-		nlen = strlen (ep->d_name);
-		if ( ep->d_name[--nlen] == 's'
-		     && ep->d_name[--nlen] == 'x'
-		     && ep->d_name[--nlen] == 'n'
-		     && ep->d_name[--nlen] == '.' ) {
-			
-			gchar nxname[128];
-			snprintf (nxname, ++nlen, ep->d_name);
-			struct nx_connection * nx_conn;
-			nx_conn = nx_connection_malloc();
-			/* Read in the connection using the callbacks_nx library fn */
-			if (0 == read_nx_connection (nx_conn, nxname)) {
-				/* Now place it in the connection store list */
-				gtk_list_store_append (conn_store, &conn_iter);
-				gtk_list_store_set (conn_store, &conn_iter,
-						    CONN_CONNECTIONNAME,    nx_conn->ConnectionName,
-						    CONN_SERVERHOST,        nx_conn->ServerHost,
-						    CONN_SERVERPORT,        nx_conn->ServerPort,
-						    CONN_USER,              nx_conn->User,
-						    CONN_PASS,              nx_conn->Pass,
-						    CONN_REMEMBERPASS,      nx_conn->RememberPassword ? TRUE : FALSE,
-						    CONN_DISABLENODELAY,    nx_conn->DisableNoDelay ? TRUE : FALSE,
-						    CONN_DISABLEZLIB,       nx_conn->DisableZLIB ? TRUE : FALSE,
-						    CONN_ENABLESSLONLY,     nx_conn->EnableSSLOnly ? TRUE : FALSE,
-						    CONN_LINKSPEED,         nx_conn->LinkSpeed,
-						    CONN_PUBLICKEY,         nx_conn->PublicKey,
-						    CONN_DESKTOP,           nx_conn->Desktop,
-						    CONN_SESSION,           nx_conn->Session,
-						    CONN_CUSTOMUNIXDESKTOP, nx_conn->CustomUnixDesktop,
-						    CONN_COMMANDLINE,       nx_conn->CommandLine,
-						    CONN_VIRTUALDESKTOP,    nx_conn->VirtualDesktop ? TRUE : FALSE,
-						    CONN_XAGENTENCODING,    nx_conn->XAgentEncoding ? TRUE : FALSE,
-						    CONN_USETAINT,          nx_conn->UseTaint ? TRUE : FALSE,
-						    CONN_XDMMODE,           nx_conn->XdmMode,
-						    CONN_XDMHOST,           nx_conn->XdmHost,
-						    CONN_XDMPORT,           nx_conn->XdmPort,
-						    CONN_FULLSCREEN,        nx_conn->FullScreen ? TRUE : FALSE,	    
-						    CONN_RESOLUTIONWIDTH,   nx_conn->ResolutionWidth,
-						    CONN_RESOLUTIONHEIGHT,  nx_conn->ResolutionHeight,
-						    CONN_GEOMETRY,          nx_conn->Geometry,
-						    CONN_IMAGEENCODING,     nx_conn->ImageEncoding,
-						    CONN_JPEGQUALITY,       nx_conn->JPEGQuality,
-						    CONN_ENABLESOUND,       nx_conn->enableSound ? TRUE : FALSE,
-						    CONN_IPPPORT,           nx_conn->IPPPort,
-						    CONN_IPPPRINTING,       nx_conn->IPPPrinting ? TRUE : FALSE,
-						    CONN_SHARES,            nx_conn->Shares ? TRUE : FALSE,
-						    CONN_AGENTSERVER,       nx_conn->agentServer,
-						    CONN_AGENTUSER,         nx_conn->agentUser,
-						    CONN_AGENTPASS,         nx_conn->agentPass,
-						    -1);
-				rtn++;
-			}
-			nx_connection_free (nx_conn);
+		gchar nxname[128];
+		struct nx_connection * nx_conn;
+
+		if (!nxconnection_name (ep->d_name, nxname, sizeof (nxname))) {
+			continue;
 		}
+
+		snprintf (path, 1023, "%s/%s", config, ep->d_name);
+		if (stat (path, &st) != 0) {
+			continue;
+		}
+
+		/*
+		 * Unchanged files come straight from the index. The
+		 * others are listed with their old settings, or the
+		 * defaults, and parsed once the window is up.
+		 */
+		nx_conn = nx_connection_malloc();
+		nx_connection_zero (nx_conn);
+		switch (nx_index_read (conn_index, nx_conn, nxname, &st)) {
+		case NX_INDEX_FRESH:
+			fresh++;
+			break;
+		case NX_INDEX_MISSING:
+			strncpy (nx_conn->ConnectionName, nxname, NX_FIELDLEN-1);
+			/* Fall through */
+		default:
+			nxconnection_queue (nxname);
+			break;
+		}
+
+		/* Now place it in the connection store list */
+		gtk_list_store_append (conn_store, &conn_iter);
+		nxconnection_setrow (&conn_iter, nx_conn);
+		rtn++;
+
+		nx_connection_free (nx_conn);
 	}
 	closedir (dp);
 
+	printerr ("NXLAUNCH> Listed %d connections (%d from the index) in %.1f ms\n",
+		  rtn, fresh, g_timer_elapsed (timer, NULL) * 1000.0);
+	g_timer_destroy (timer);
+
+	if (conn_pending_id == 0) {
+		/* Nothing to parse, but entries for files which have
+		 * gone are dropped. */
+		nx_index_save (conn_index);
+	}
+
+#ifdef HAVE_SYS_INOTIFY_H
+	nxconnection_watch (config);
+#endif
+
 	if (rtn > 0) {
 		GtkTreeIter treeIter;
 		GtkTreeView * list_tree;
@@ -676,6 +945,26 @@ void nxlaunch_create_nxsession_list (void)
 }
 
 int sendSettings (DBusConnection *bus, struct nx_connection * nx_conn)
+{
+	DBusMessage *message = settingsMessage (nx_conn);
+
+	if (NULL == message) {
+		return -1;
+	}
+
+	/* Send the signal */
+	if (!dbus_connection_send (bus, message, NULL)) {
+		printerr ("NXLAUNCH> Out Of Memory!\n");
+		_exit(1);
+	}
+
+	/* Clean up */
+	dbus_message_unref (message);
+	dbus_connection_flush (bus);
+	return 1;
+}
+
+DBusMessage * settingsMessage (struct nx_connection * nx_conn)
 {
 	DBusMessage *message;
 
@@ -686,7 +975,7 @@ int sendSettings (DBusConnection *bus, struct nx_connection * nx_conn)
 					   "sessionConfig");
 	if (NULL == message) {
 		printerr ("NXLAUNCH> Message Null\n");
-		return -1;
+		return NULL;
 	}
 
 	int media=0, enc=0, fs=0, cups=0, vdesk=0;
@@ -767,17 +1056,8 @@ int sendSettings (DBusConnection *bus, struct nx_connection * nx_conn)
 		 DBUS_TYPE_INT32,  &vdesk,
 		 DBUS_TYPE_INVALID);
 
-	/* Send the signal */
-	if (!dbus_connection_send (bus, message, NULL)) {
-		printerr ("NXLAUNCH> Out Of Memory!\n");
-		_exit(1);
-	}
-
-	/* Clean up */
-	dbus_message_unref (message);
-	dbus_connection_flush (bus);
 	g_free (session_type);
-	return 1;
+	return message;
 }
 
 int sendReply (DBusConnection *bus, int sessionNum)
@@ -858,11 +1138,78 @@ int terminateSession (DBusConnection *bus, int sessionNum)
 	return 1;
 }
 
-void callReceiveSession (gboolean relist_call)
+/*!
+ * What nxlaunch is waiting to hear from nxcl. nxlaunch_dbus_filter()
+ * passes each message from nxcl to the function which deals with the
+ * current state, as soon as it arrives.
+ */
+//@{
+#define WAITING_FOR_NOTHING  0
+#define WAITING_FOR_ALIVE    1
+#define WAITING_FOR_SESSIONS 2
+#define WAITING_FOR_PROGRESS 3
+static int waiting_for = WAITING_FOR_NOTHING;
+//@}
+
+/*!
+ * The relist_call argument of the last callReceiveSession().
+ */
+static gboolean relisting = FALSE;
+
+/*!
+ * The number of sessions listed so far by receiveSession().
+ */
+static int sessions_listed = 0;
+
+/*!
+ * The GLib source which gives up waiting, or 0.
+ */
+static guint wait_timeout_id = 0;
+
+/*!
+ * The settings for nxcl, held until it says it is alive.
+ */
+static DBusMessage * pending_settings = NULL;
+
+/*!
+ * Started when the settings are sent, to see how long the session
+ * list takes.
+ */
+static GTimer * list_timer = NULL;
+
+/*!
+ * Give up waiting after \arg seconds by calling \arg fn, or stop
+ * waiting to give up if seconds is 0.
+ */
+static void setWaitTimeout (guint seconds, GSourceFunc fn)
+{
+	if (wait_timeout_id != 0) {
+		g_source_remove (wait_timeout_id);
+		wait_timeout_id = 0;
+	}
+	if (seconds > 0) {
+		wait_timeout_id = g_timeout_add (seconds * 1000, fn, NULL);
+	}
+}
+
+/*!
+ * nxcl has sent the list of sessions (or said that it is connecting,
+ * or that the server is full), or we've given up waiting. ret is as
+ * returned by receiveSession().
+ */
+static void sessionsReceived (int ret)
 {
-	int ret = 0;
+	setWaitTimeout (0, NULL);
+	waiting_for = WAITING_FOR_NOTHING;
+
+	if (list_timer != NULL) {
+		printerr ("NXLAUNCH> Session information received %.1f ms after sending the settings\n",
+			  g_timer_elapsed (list_timer, NULL) * 1000.0);
+		g_timer_destroy (list_timer);
+		list_timer = NULL;
+	}
 
-	if (REPLY_REQUIRED == (ret = receiveSession (dbusConn))) {
+	if (REPLY_REQUIRED == ret) {
 		/* Session window should have been populated
 		 * by receiveSession, so we now return and
 		 * wait for a button press event (the choice
@@ -899,7 +1246,7 @@ void callReceiveSession (gboolean relist_call)
 		 * new session.
 		 */
 
-		if (!relist_call) {
+		if (!relisting) {
 			nxlaunch_display_progress();
 		}
 	}
@@ -908,181 +1255,193 @@ void callReceiveSession (gboolean relist_call)
 }
 
 /*
- * Wait for and receive a message with available sessions, or a
- * message saying there are no available sessions
+ * Give up waiting for the list of sessions.
  */
 #define RECEIVE_TIMEOUT_SECONDS 30
-int receiveSession (DBusConnection* conn)
+static gboolean receiveSessionTimedOut (gpointer data)
+{
+	wait_timeout_id = 0;
+	printerr ("NXLAUNCH> No session information after %d seconds\n",
+		  RECEIVE_TIMEOUT_SECONDS);
+	sessionsReceived (sessions_listed > 0 ? REPLY_REQUIRED : 0);
+	return FALSE;
+}
+
+void callReceiveSession (gboolean relist_call)
+{
+	printerr (_("NXLAUNCH> Waiting to receive session information\n"));
+
+	// Clear the list store we're about to populate.
+	gtk_list_store_clear (sess_store);
+	sessions_listed = 0;
+
+	relisting = relist_call;
+	waiting_for = WAITING_FOR_SESSIONS;
+	setWaitTimeout (RECEIVE_TIMEOUT_SECONDS, &receiveSessionTimedOut);
+
+	return;
+}
+
+/*
+ * Add an available session to the list, or interpret a message saying
+ * there are no more available sessions
+ */
+int receiveSession (DBusMessage * message)
 {
 	GtkWidget * widget;
 	GdkPixbuf * icon;
 	GError * gerror = NULL;
-	DBusMessage * message;
 	DBusMessageIter args;
-	DBusError error;
 	char * parameter = NULL;
 	dbus_int32_t iparam = 0, t = 0;
 	int count = 0;
-	int timeout = 0;
-	gboolean sessions_obtained = FALSE;
-	int rtn = 0;
-
-	printerr (_("NXLAUNCH> Waiting to receive session information\n"));
-
-	// Clear the list store we're about to populate.
-	gtk_list_store_clear (sess_store);
-
-	dbus_error_init (&error);
 
-	int sessionNum = 0;
+	// Is the message the one we're interested in?
+	if (dbus_message_is_signal (message, dbusRecvInterface, "AvailableSession")) {
 
-	// loop listening for signals being emitted
-	while ((sessions_obtained == FALSE) && (++timeout < RECEIVE_TIMEOUT_SECONDS)) {
-		
-		if (dbus_error_is_set(&error)) { 
-			printerr ("NXLAUNCH> Name Error (%s)\n", error.message); 
-			dbus_error_free(&error); 
+		if (!dbus_message_iter_init (message, &args)) {
+			printerr ("NXLAUNCH> Message has no arguments!\n");
+			return 0;
 		}
 
-		count = 0;
+		/* Now we have a message containing an
+		 * available session, append an entry to the
+		 * gtk_list_store of available connections. */
+		gtk_list_store_append (sess_store, &sess_iter);
 
-		// non blocking read of the next available message
-		dbus_connection_read_write (conn, 0);
-		message = dbus_connection_pop_message (conn);
+		/* Read the parameters of the message into the sess_store gtk_list_store.
+		 * The order of session parameters passed in the dbus message is:
+		 * [0]Display(i) | [1]Type(s)   | [2]Session ID(s) | [3]Options(s)
+		 * [4]Depth(i)   | [5]Screen(s) | [6]Status(s)     | [7]Session Name(s)
+		 */
 
-		// loop again if we haven't read a message
-		if (NULL == message) {
-			usleep (1000000);
-			continue;
-		}
+		gtk_list_store_set (sess_store, &sess_iter, SESS_INDEX, sessions_listed, -1);
+		printerr ("N-%2d: ", sessions_listed++);
+		do {
+			if (DBUS_TYPE_STRING == (t = dbus_message_iter_get_arg_type(&args))) {
+				dbus_message_iter_get_basic(&args, &parameter);
+				printerr (" '%s'", parameter);
+				switch (count) {
+				case 1: // Type
+					gtk_list_store_set (sess_store, &sess_iter, SESS_SESSIONTYPE, parameter, -1);
+					if (!strcmp ("unix-gnome", parameter)) {
+						icon = gdk_pixbuf_new_from_file(PACKAGE_DATA_DIR"/gnome-nx-session.png", &gerror);
+						gtk_list_store_set (sess_store, &sess_iter, SESS_TYPEICON, icon, -1);
+					} else if (!strcmp ("unix-kde", parameter)) {
+						icon = gdk_pixbuf_new_from_file(PACKAGE_DATA_DIR"/kde-nx-session.png", &gerror);
+						gtk_list_store_set (sess_store, &sess_iter, SESS_TYPEICON, icon, -1);
+					} else {
+						icon = gdk_pixbuf_new_from_file(PACKAGE_DATA_DIR"/unknown-nx-session.png", &gerror);
+						gtk_list_store_set (sess_store, &sess_iter, SESS_TYPEICON, icon, -1);
+					}
+					break;
+				case 2: // Session ID
+					gtk_list_store_set (sess_store, &sess_iter, SESS_SESSIONID, parameter, -1);
+					break;
+				case 3: // Options
+					gtk_list_store_set (sess_store, &sess_iter, SESS_OPTIONS, parameter, -1);
+					break;
+				case 5: // Screen
+					gtk_list_store_set (sess_store, &sess_iter, SESS_SCREEN, parameter, -1);
+					break;
+				case 6: // Status
+					gtk_list_store_set (sess_store, &sess_iter, SESS_AVAILABLE, parameter, -1);
+					break;
+				case 7: // Session Name
+					gtk_list_store_set (sess_store, &sess_iter, SESS_SESSIONNAME, parameter, -1);
+					break;
+				default:
+					break;
+				}
+				count++;
 
-		// Is the message the one we're interested in?
-		if (dbus_message_is_signal (message, dbusRecvInterface, "AvailableSession")) {
+			} else if (t == DBUS_TYPE_INT32) {
+				dbus_message_iter_get_basic (&args, &iparam);
+				printerr (" d%d", iparam);
+				//snprintf (parameter, 16, "%d", iparam);
+				switch (count) {
+				case 0:
+					gtk_list_store_set (sess_store, &sess_iter, SESS_DISPLAY, iparam, -1);
+					break;
+				case 4: // Depth
+					gtk_list_store_set (sess_store, &sess_iter, SESS_DEPTH, iparam, -1);
+					break;
+				default:
+					break;
+				}
+				count++;
 
-			if (!dbus_message_iter_init (message, &args)) {
-				printerr ("NXLAUNCH> Message has no arguments!\n");
-				dbus_connection_flush (conn);
-				dbus_message_unref (message);
-				continue;
+			} else {
+				printerr ("NXLAUNCH> Error, parameter is not string or int.\n");
 			}
 
-			/* Now we have a message containing an
-			 * available session, append an entry to the
-			 * gtk_list_store of available connections. */
-			gtk_list_store_append (sess_store, &sess_iter);
-
-			/* Read the parameters of the message into the sess_store gtk_list_store.
-			 * The order of session parameters passed in the dbus message is:
-			 * [0]Display(i) | [1]Type(s)   | [2]Session ID(s) | [3]Options(s)
-			 * [4]Depth(i)   | [5]Screen(s) | [6]Status(s)     | [7]Session Name(s)
-			 */
-
-			gtk_list_store_set (sess_store, &sess_iter, SESS_INDEX, sessionNum, -1);
-			printerr ("N-%2d: ", sessionNum++);
-			do {
-				if (DBUS_TYPE_STRING == (t = dbus_message_iter_get_arg_type(&args))) {
-					dbus_message_iter_get_basic(&args, &parameter);
-					printerr (" '%s'", parameter);
-					switch (count) {
-					case 1: // Type
-						gtk_list_store_set (sess_store, &sess_iter, SESS_SESSIONTYPE, parameter, -1);
-						if (!strcmp ("unix-gnome", parameter)) {
-							icon = gdk_pixbuf_new_from_file(PACKAGE_DATA_DIR"/gnome-nx-session.png", &gerror);
-							gtk_list_store_set (sess_store, &sess_iter, SESS_TYPEICON, icon, -1);
-						} else if (!strcmp ("unix-kde", parameter)) {
-							icon = gdk_pixbuf_new_from_file(PACKAGE_DATA_DIR"/kde-nx-session.png", &gerror);
-							gtk_list_store_set (sess_store, &sess_iter, SESS_TYPEICON, icon, -1);
-						} else {
-							icon = gdk_pixbuf_new_from_file(PACKAGE_DATA_DIR"/unknown-nx-session.png", &gerror);
-							gtk_list_store_set (sess_store, &sess_iter, SESS_TYPEICON, icon, -1);
-						}
-						break;
-					case 2: // Session ID
-						gtk_list_store_set (sess_store, &sess_iter, SESS_SESSIONID, parameter, -1);
-						break;
-					case 3: // Options
-						gtk_list_store_set (sess_store, &sess_iter, SESS_OPTIONS, parameter, -1);
-						break;
-					case 5: // Screen
-						gtk_list_store_set (sess_store, &sess_iter, SESS_SCREEN, parameter, -1);
-						break;
-					case 6: // Status
-						gtk_list_store_set (sess_store, &sess_iter, SESS_AVAILABLE, parameter, -1);
-						break;
-					case 7: // Session Name
-						gtk_list_store_set (sess_store, &sess_iter, SESS_SESSIONNAME, parameter, -1);
-						break;
-					default:
-						break;
-					}
-					count++;
+		} while (dbus_message_iter_next (&args));
 
-				} else if (t == DBUS_TYPE_INT32) {
-					dbus_message_iter_get_basic (&args, &iparam);
-					printerr (" d%d", iparam);
-					//snprintf (parameter, 16, "%d", iparam);
-					switch (count) {
-					case 0:
-						gtk_list_store_set (sess_store, &sess_iter, SESS_DISPLAY, iparam, -1);
-						break;
-					case 4: // Depth
-						gtk_list_store_set (sess_store, &sess_iter, SESS_DEPTH, iparam, -1);
-						break;
-					default:
-						break;
-					}
-					count++;
+		printerr ("\n");
 
-				} else {
-					printerr ("NXLAUNCH> Error, parameter is not string or int.\n");
-				}
+		/*
+		 * Reveal the session box as soon as it has a session
+		 * in it; the rest follow as they arrive.
+		 */
+		widget = glade_xml_get_widget (xml_nxlaunch_glob, "session_list");
+		gtk_widget_show (widget);
+		return 0;
 
-			} while (dbus_message_iter_next (&args));
+	} else if (dbus_message_is_signal (message,
+					   dbusRecvInterface,
+					   "NoMoreAvailable")) {
+		printerr ("NXLAUNCH> Server says \"NoMoreAvailable\"\n");
+		return REPLY_REQUIRED;
+
+	} else if (dbus_message_is_signal (message,
+					   dbusRecvInterface,
+					   "Connecting")) {
+		printerr ("NXLAUNCH> Server says \"Connection\"\n");
+		return NEW_CONNECTION;
+
+	} else if (dbus_message_is_signal (message,
+					   dbusRecvInterface,
+					   "ServerCapacityReached")) {
+		printerr ("NXLAUNCH> Server says \"ServerCapacityReached\"\n");
+		return SERVER_CAPACITY;
+	}
 
-			printerr ("\n");
-		
-			/*
-			 * The session box should now have been populated, so just reveal it
-			 */
-			widget = glade_xml_get_widget (xml_nxlaunch_glob, "session_list");
-			gtk_widget_show (widget);
-			while (gtk_events_pending()) gtk_main_iteration();
-			rtn = REPLY_REQUIRED;
-
-		} else if (dbus_message_is_signal (message,
-						   dbusRecvInterface,
-						   "NoMoreAvailable")) {
-			printerr ("NXLAUNCH> Server says \"NoMoreAvailable\"\n");
-			sessions_obtained = TRUE;
-			rtn = REPLY_REQUIRED;
-
-		} else if (dbus_message_is_signal (message,
-						   dbusRecvInterface,
-						   "Connecting")) {
-			printerr ("NXLAUNCH> Server says \"Connection\"\n");
-			sessions_obtained = TRUE;
-			rtn = NEW_CONNECTION;
-
-		} else if (dbus_message_is_signal (message,
-						   dbusRecvInterface,
-						   "ServerCapacityReached")) {
-			printerr ("NXLAUNCH> Server says \"ServerCapacityReached\"\n");
-			sessions_obtained = TRUE;
-			rtn = SERVER_CAPACITY;
+	/* Nothing */
+	return 0;
+}
 
-		} else {
-			/* Nothing */
-		}	
+DBusHandlerResult nxlaunch_dbus_filter (DBusConnection * conn,
+					DBusMessage * message,
+					void * data)
+{
+	int ret;
 
-		dbus_connection_flush (conn);
-		dbus_message_unref (message);
+	if (dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_SIGNAL
+	    || !dbus_message_has_interface (message, dbusRecvInterface)) {
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	}
 
-	} // while()
+	switch (waiting_for) {
+	case WAITING_FOR_ALIVE:
+		if (isAliveMessage (message)) {
+			sendPendingSettings();
+		}
+		break;
+	case WAITING_FOR_SESSIONS:
+		if ((ret = receiveSession (message)) != 0) {
+			sessionsReceived (ret);
+		}
+		break;
+	case WAITING_FOR_PROGRESS:
+		nxlaunch_status_message (message);
+		break;
+	default:
+		break;
+	}
 
-	return rtn;
+	return DBUS_HANDLER_RESULT_HANDLED;
 }
 
-
 /*!
  * This populates global variables
  */
@@ -1209,6 +1568,7 @@ void execNxcl (void)
 }
 
 
+#define ALIVE_TIMEOUT_SECONDS 60
 void sendNxclSettings (struct nx_connection * nx_conn)
 {
 	/* Prepare interface - add a rule for which messages we want
@@ -1223,16 +1583,39 @@ void sendNxclSettings (struct nx_connection * nx_conn)
 		printerr ("NXLAUNCH> Added match '%s'\n", dbusMatchString);
 	}
 
-	if (waitForAlive() == FALSE) {
-		printerr ("NXLAUNCH> nxcl didn't start!");
-		_exit (-1);		
+	/* nxcl can't take the settings until it says it is alive, so
+	 * make the message now, while we have nx_conn, and send it
+	 * from nxlaunch_dbus_filter() when it does. */
+	if (pending_settings != NULL) {
+		dbus_message_unref (pending_settings);
+	}
+	pending_settings = settingsMessage (nx_conn);
+	waiting_for = WAITING_FOR_ALIVE;
+	setWaitTimeout (ALIVE_TIMEOUT_SECONDS, &aliveTimedOut);
+
+	return;
+}
+
+void sendPendingSettings (void)
+{
+	setWaitTimeout (0, NULL);
+
+	if (pending_settings == NULL) {
+		return;
 	}
 
 	// ...and then send it on dbus.
-	sendSettings (dbusConn, nx_conn);
+	if (!dbus_connection_send (dbusConn, pending_settings, NULL)) {
+		printerr ("NXLAUNCH> Out Of Memory!\n");
+		_exit(1);
+	}
+	dbus_message_unref (pending_settings);
+	pending_settings = NULL;
+	dbus_connection_flush (dbusConn);
 	printerr ("NXLAUNCH> sent settings\n");
-	
-	return;
+
+	list_timer = g_timer_new();
+	callReceiveSession (FALSE);
 }
 
 /*!
@@ -1298,6 +1681,9 @@ void getActiveConnection (struct nx_connection * nx_conn)
 
 	printerr ("%s() called\n", __FUNCTION__);
 
+	/* Make sure the row isn't waiting to be parsed. */
+	nxconnection_flush();
+
 	list_tree = GTK_TREE_VIEW (glade_xml_get_widget (xml_nxlaunch_glob, "treeview_nxconnection"));
 	selected = gtk_tree_view_get_selection (list_tree);
 	tree_model = GTK_TREE_MODEL (conn_store);
@@ -1365,6 +1751,9 @@ gboolean launch_named_connection (gchar * connection_name)
 
 	nx_conn = g_malloc0 (sizeof (struct nx_connection));
 
+	/* We're about to read the rows, so finish parsing them. */
+	nxconnection_flush();
+
 	/* Need to get the associated treemodel */
 	tree = glade_xml_get_widget (xml_nxlaunch_glob, "treeview_nxconnection");
 	valid = gtk_tree_model_get_iter_first (GTK_TREE_MODEL (conn_store), &iter);
@@ -1454,9 +1843,9 @@ void launch_connection (struct nx_connection * nx_conn)
 	printerr ("%s() called\n", __FUNCTION__);
 
 	execNxcl();
+	/* The rest happens in nxlaunch_dbus_filter() as nxcl
+	 * answers. */
 	sendNxclSettings (nx_conn);
-	callReceiveSession (FALSE);
-	printerr ("NXLAUNCH> Received session\n");
 
 	if (!(nx_conn->Pass = g_try_realloc (nx_conn->Pass, NX_FIELDLEN * sizeof(gchar)))) {
 		printerr ("NXLAUNCH> Failed g_try_realloc in %s()\n", __FUNCTION__);
@@ -1552,45 +1941,32 @@ void nxlaunch_display_progress (void)
 	while (gtk_events_pending()) gtk_main_iteration();
 	widget = glade_xml_get_widget (xml_nxlaunch_glob, "label_progress");
 	gtk_widget_show (widget);
-	/* Add a status message listener - this will update the status
-	   message in the nxlaunch_progress window, and the messages will
-	   be used to set the progress bar, too. */
-	g_timeout_add (500, &nxlaunch_status_listener, NULL);
+	/* From now on, status messages update the status message in
+	   the nxlaunch_progress window, and are used to set the
+	   progress bar, too. */
+	setWaitTimeout (0, NULL);
+	waiting_for = WAITING_FOR_PROGRESS;
 	return;
 }
 
-gboolean nxlaunch_status_listener (gpointer data)
+static gboolean nxlaunch_quit_later (gpointer data)
+{
+	gtk_main_quit();
+	return FALSE;
+}
+
+void nxlaunch_status_message (DBusMessage * message)
 {
 	GtkWidget * widget;
-	DBusMessage * message;
 	DBusMessageIter args;
-	DBusError error;
 	char * parameter = NULL;
 	dbus_int32_t iparam = 0, t = 0;
 
-	//printerr (_("NXLAUNCH> Listening for status information\n"));
-
-	dbus_error_init (&error);
-
-	if (dbus_error_is_set(&error)) { 
-		printerr ("NXLAUNCH> Name Error (%s)\n", error.message); 
-		dbus_error_free(&error); 
-	}
-
-	// non blocking read of the next available message
-	dbus_connection_read_write(dbusConn, 0);
-	message = dbus_connection_pop_message(dbusConn);
-
-	// return if no message
-	if (NULL == message) { return TRUE; }
-
 	if (dbus_message_is_signal (message, dbusRecvInterface, "InfoMessage")) {
 
 		if (!dbus_message_iter_init (message, &args)) {
 			printerr ("NXLAUNCH> That message had no arguments.\n");
-			dbus_connection_flush (dbusConn);
-			dbus_message_unref (message);
-			return TRUE;
+			return;
 		}
 		printerr ("(NXCL)> Info: ");
 		do {
@@ -1629,9 +2005,9 @@ gboolean nxlaunch_status_listener (gpointer data)
 						break;
 					case 287: /* 'The session has been started successfully' */
 						gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (widget), 1.000);
-						while (gtk_events_pending()) gtk_main_iteration();
-						usleep (2000000);
-						gtk_main_quit();
+						/* Leave the full bar up for a moment. */
+						waiting_for = WAITING_FOR_NOTHING;
+						g_timeout_add (2000, &nxlaunch_quit_later, NULL);
 						break;
 					default:
 						break;
@@ -1647,9 +2023,7 @@ gboolean nxlaunch_status_listener (gpointer data)
 
 		if (!dbus_message_iter_init (message, &args)) {
 			printerr ("NXLAUNCH> That message had no arguments.\n");
-			dbus_connection_flush (dbusConn);
-			dbus_message_unref (message);
-			return TRUE;
+			return;
 		}
 
 		printerr ("(NXCL)> Error: ");
@@ -1673,80 +2047,50 @@ gboolean nxlaunch_status_listener (gpointer data)
 	} else {
 		/* Nothing */
 	}	
-	
-	dbus_connection_flush (dbusConn);
-	dbus_message_unref (message);
 
-	return TRUE;
+	return;
 }
 
-gboolean waitForAlive (void)
+gboolean isAliveMessage (DBusMessage * message)
 {
-	DBusMessage * message = NULL;
 	DBusMessageIter args;
-	DBusError error;
-	char * parameter = NULL;
 	dbus_int32_t iparam = 0, t = 0;
-	gboolean nxclAlive = FALSE;
-	int i = 0;
-
-	dbus_error_init (&error);
-
-	while (nxclAlive == FALSE && i<60) {
-
-		i++;
 
-		if (dbus_error_is_set(&error)) { 
-			printerr ("NXLAUNCH> Name Error (%s)\n", error.message); 
-			dbus_error_free(&error); 
-		}
-
-		// non blocking read of the next available message
-		dbus_connection_read_write(dbusConn, 0);
-		message = dbus_connection_pop_message(dbusConn);
-
-		// return if no message
-		if (NULL == message) {
-			usleep (1000000);
-			continue;
-		}
+	if (!dbus_message_is_signal (message, dbusRecvInterface, "InfoMessage")) {
+		return FALSE;
+	}
 
-		if (dbus_message_is_signal (message, dbusRecvInterface, "InfoMessage")) {
+	if (!dbus_message_iter_init (message, &args)) {
+		printerr ("NXLAUNCH> That message had no arguments.\n");
+		return FALSE;
+	}
 
-			if (!dbus_message_iter_init (message, &args)) {
-				printerr ("NXLAUNCH> That message had no arguments.\n");
-				dbus_connection_flush (dbusConn);
-				dbus_message_unref (message);
-				continue;
+	do {
+		if (DBUS_TYPE_INT32 == (t = dbus_message_iter_get_arg_type(&args))) {
+			dbus_message_iter_get_basic (&args, &iparam);
+			if (iparam == NXCL_ALIVE) {
+				return TRUE;
 			}
+		} else if (t != DBUS_TYPE_STRING) {
+			printerr ("NXLAUNCH> Error, parameter is not string or int.\n");
+		}
 
-			do {
-				if (DBUS_TYPE_STRING == (t = dbus_message_iter_get_arg_type(&args))) {
-					dbus_message_iter_get_basic(&args, &parameter);
-				} else if (t == DBUS_TYPE_INT32) {
-		 			dbus_message_iter_get_basic (&args, &iparam);
-					if (iparam == NXCL_ALIVE) {
-						/* Set global variable to say we're alive */
-						nxclAlive = TRUE;
-					}
-				} else {
-					printerr ("NXLAUNCH> Error, parameter is not string or int.\n");
-				}
-
-			} while (dbus_message_iter_next (&args));
+	} while (dbus_message_iter_next (&args));
 
-		} else {
-			/* Nothing */
-		}	
-	}
-	dbus_connection_flush (dbusConn);
-	dbus_message_unref (message);
+	return FALSE;
+}
 
-	if (i<60 && nxclAlive == TRUE) {
-		return TRUE;
-	} else {
-		return FALSE;
+gboolean aliveTimedOut (gpointer data)
+{
+	wait_timeout_id = 0;
+	waiting_for = WAITING_FOR_NOTHING;
+	if (pending_settings != NULL) {
+		dbus_message_unref (pending_settings);
+		pending_settings = NULL;
 	}
+	printerr ("NXLAUNCH> nxcl didn't start!");
+	nxlaunch_error_requiring_quit (_("nxcl didn't start."));
+	return FALSE;
 }
 
 void nxlaunch_error_requiring_quit (const char * message)
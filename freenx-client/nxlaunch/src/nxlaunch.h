@@ -202,12 +202,21 @@ void on_treeview_connection_cursor_changed (GtkWidget * widget);
 
 /*!
  * Look in ~/.nx, and build a list of connections based on the number
- * of .nxs files in there.
+ * of .nxs files in there. Files which haven't changed since they were
+ * last parsed are read from the index (see nxindex.h); the rest are
+ * parsed from the main loop, and the list is kept up to date as files
+ * change.
  *
  * Return number of connections.
  */
 int nxconnection_buildlist (void);
 
+/*!
+ * Parse any connection files which are still waiting to be parsed,
+ * now.
+ */
+void nxconnection_flush (void);
+
 /*!
  * Create the memory structure for the treelist of connections
  */
@@ -224,7 +233,16 @@ void nxlaunch_create_nxsession_list (void);
 int sendSettings (DBusConnection *bus, struct nx_connection * nx_conn);
 
 /*!
- * Calls receiveSession and interprets the output.
+ * Make the dbus signal which sendSettings sends. Returns NULL on
+ * error; the caller unrefs the message.
+ */
+DBusMessage * settingsMessage (struct nx_connection * nx_conn);
+
+/*!
+ * Clears the session list and starts passing nxcl's messages to
+ * receiveSession, whose answer is interpreted once the list is
+ * complete. Returns straight away; the list fills in from the main
+ * loop as the sessions arrive.
  *
  * \param relist_call Set this to TRUE if this is a call to
  * receiveSession to re-list the sessions in the session list, after
@@ -239,12 +257,23 @@ void callReceiveSession (gboolean relist_call);
 #define NEW_CONNECTION  2
 #define SERVER_CAPACITY 3
 /*!
- * Listen to the dbus, waiting for a signal to say either that
- * connection is in progress, or giving us a list of possible sessions
- * we could connect to. Return true if nxcld requires a reply such
- * as "please resume session 1".
+ * Deal with a message from nxcl while waiting for a signal to say
+ * either that connection is in progress, or giving us a list of
+ * possible sessions we could connect to. Each available session is
+ * added to the session list as it arrives. Returns 0 until the list
+ * is complete, then REPLY_REQUIRED if nxcld requires a reply such as
+ * "please resume session 1", NEW_CONNECTION or SERVER_CAPACITY.
+ */
+int receiveSession (DBusMessage * message);
+
+/*!
+ * The dbus filter which receives nxcl's signals from the main loop
+ * (see dbusloop_attach), and passes them to the function for
+ * whatever we are waiting for.
  */
-int receiveSession (DBusConnection* conn);
+DBusHandlerResult nxlaunch_dbus_filter (DBusConnection * conn,
+					DBusMessage * message,
+					void * data);
 
 /*!
  * Send a signal containing the identifier for the NX session that the
@@ -278,10 +307,17 @@ int obtainDbusConnection (void);
 void execNxcl (void);
 
 /*!
- * Prepare DBUS for sending/receiving and then send the settings
+ * Prepare DBUS for sending/receiving and then send the settings,
+ * once nxcl says it is alive.
  */
 void sendNxclSettings (struct nx_connection * nx_conn);
 
+/*!
+ * Send the settings held by sendNxclSettings, and wait for the
+ * session list.
+ */
+void sendPendingSettings (void);
+
 /*!
  * Populate nx_conn from the treeview list.
  */
@@ -332,17 +368,21 @@ void nxlaunch_quit_with_window (void);
 void nxlaunch_display_progress (void);
 
 /*!
- * A listener for dbus status messages. We use the contents of these
+ * Deal with a dbus status message. We use the contents of these
  * messages to update the progress bar for user feedback on connection
  * progress.
  */
-gboolean nxlaunch_status_listener (gpointer data);
+void nxlaunch_status_message (DBusMessage * message);
 
 /*!
- * Wait for an alive message from nxcl. This function blocks until the
- * message is received or a timeout has occurred.
+ * Is message the alive message from nxcl?
  */
-gboolean waitForAlive (void);
+gboolean isAliveMessage (DBusMessage * message);
+
+/*!
+ * A GLib timeout: nxcl didn't say it was alive in time.
+ */
+gboolean aliveTimedOut (gpointer data);
 
 /*!
  * A non-recoverable error occurred. Show the user a dialog explaining
@@ -353,6 +393,12 @@ gboolean waitForAlive (void);
  */
 void nxlaunch_error_requiring_quit (const char * message);
 
+/*!
+ * Run conn from the GLib main loop, passing messages to filter as
+ * soon as they arrive. In dbusloop.c.
+ */
+void dbusloop_attach (DBusConnection * conn, DBusHandleMessageFunction filter);
+
 //@} Fn Declarations
 
 #endif /* _NXLAUNCH_H_ */
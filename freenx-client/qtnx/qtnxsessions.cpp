@@ -20,29 +20,156 @@
 
 using namespace nxcl;
 
-QtNXSessions::QtNXSessions(QList<NXResumeData> sessions)
+#define SESSION_COLUMNS 6
+
+QtNXSessionModel::QtNXSessionModel(QObject *parent) :
+    QAbstractTableModel(parent)
+{
+}
+
+QtNXSessionModel::~QtNXSessionModel()
+{
+}
+
+int QtNXSessionModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : sessions.size();
+}
+
+int QtNXSessionModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : SESSION_COLUMNS;
+}
+
+QVariant QtNXSessionModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || role != Qt::DisplayRole ||
+            index.row() >= sessions.size())
+        return QVariant();
+
+    const NXResumeData &s = sessions.at(index.row());
+    switch (index.column()) {
+        case 0:
+            return s.display;
+        case 1:
+            return QString::fromStdString(s.sessionType);
+        case 2:
+            return QString::fromStdString(s.sessionID);
+        case 3:
+            return s.depth;
+        case 4:
+            return QString::fromStdString(s.screen);
+        case 5:
+            return QString::fromStdString(s.sessionName);
+    }
+    return QVariant();
+}
+
+QVariant QtNXSessionModel::headerData(int section,
+        Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QVariant();
+
+    switch (section) {
+        case 0:
+            return tr("Display");
+        case 1:
+            return tr("Type");
+        case 2:
+            return tr("Session ID");
+        case 3:
+            return tr("Colour Depth");
+        case 4:
+            return tr("Resolution");
+        case 5:
+            return tr("Session Name");
+    }
+    return QVariant();
+}
+
+void QtNXSessionModel::apply(const NXResumeDelta &delta)
+{
+    list<string>::const_iterator id;
+    list<NXResumeData>::const_iterator it;
+
+    // Remove from the bottom up, so the rows still to go keep
+    // their numbers.
+    QList<int> gone;
+    for (id = delta.removed.begin(); id != delta.removed.end(); id++) {
+        QHash<QString, int>::const_iterator r =
+            rows.find(QString::fromStdString(*id));
+        if (r != rows.end())
+            gone.append(r.value());
+    }
+    qSort(gone.begin(), gone.end(), qGreater<int>());
+    for (int i = 0; i < gone.size(); ++i) {
+        beginRemoveRows(QModelIndex(), gone.at(i), gone.at(i));
+        sessions.removeAt(gone.at(i));
+        endRemoveRows();
+    }
+    if (!gone.isEmpty())
+        reindex();
+
+    for (it = delta.changed.begin(); it != delta.changed.end(); it++) {
+        QHash<QString, int>::const_iterator r =
+            rows.find(QString::fromStdString((*it).sessionID));
+        if (r == rows.end())
+            continue;
+        sessions[r.value()] = *it;
+        emit dataChanged(index(r.value(), 0),
+                index(r.value(), SESSION_COLUMNS - 1));
+    }
+
+    if (!delta.added.empty()) {
+        int first = sessions.size();
+        beginInsertRows(QModelIndex(), first,
+                first + delta.added.size() - 1);
+        for (it = delta.added.begin(); it != delta.added.end(); it++) {
+            rows.insert(QString::fromStdString((*it).sessionID),
+                    sessions.size());
+            sessions.append(*it);
+        }
+        endInsertRows();
+    }
+}
+
+void QtNXSessionModel::clear()
+{
+    if (sessions.isEmpty())
+        return;
+
+    beginRemoveRows(QModelIndex(), 0, sessions.size() - 1);
+    sessions.clear();
+    rows.clear();
+    endRemoveRows();
+}
+
+QString QtNXSessionModel::sessionID(int row) const
+{
+    if (row < 0 || row >= sessions.size())
+        return QString();
+
+    return QString::fromStdString(sessions.at(row).sessionID);
+}
+
+void QtNXSessionModel::reindex()
+{
+    rows.clear();
+    for (int i = 0; i < sessions.size(); ++i)
+        rows.insert(QString::fromStdString(sessions.at(i).sessionID), i);
+}
+
+QtNXSessions::QtNXSessions(QtNXSessionModel *sessionModel) :
+    model(sessionModel)
 {
     ui_sd.setupUi(this);
 
+    ui_sd.sessionsList->setModel(model);
+
     connect(ui_sd.newButton, SIGNAL(pressed()), this, SLOT(pressedNew()));
     connect(ui_sd.resumeButton, SIGNAL(pressed()), this, 
             SLOT(pressedResume()));
-
-    for (int i = 0; i < sessions.size(); ++i) {
-        sessionItems.append(new QTreeWidgetItem(ui_sd.sessionsList));
-        sessionItems.last()->setText(0,
-                QString::number(sessions.at(i).display));
-        sessionItems.last()->setText(1,
-                QString::fromStdString(sessions.at(i).sessionType));
-        sessionItems.last()->setText(2,
-                QString::fromStdString(sessions.at(i).sessionID));
-        sessionItems.last()->setText(3,
-                QString::number(sessions.at(i).depth));
-        sessionItems.last()->setText(4,
-                QString::fromStdString(sessions.at(i).screen));
-        sessionItems.last()->setText(5,
-                QString::fromStdString(sessions.at(i).sessionName));
-    }
 }
 
 QtNXSessions::~QtNXSessions()
@@ -57,6 +184,11 @@ void QtNXSessions::pressedNew()
 
 void QtNXSessions::pressedResume()
 {
-    emit resumePressed(ui_sd.sessionsList->currentItem()->text(2));
+    QModelIndex current = ui_sd.sessionsList->currentIndex();
+
+    if (!current.isValid())
+        return;
+
+    emit resumePressed(model->sessionID(current.row()));
     close();
 }
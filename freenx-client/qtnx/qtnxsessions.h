@@ -19,9 +19,9 @@
 #ifndef _QTNXSESSIONS_H_
 #define _QTNXSESSIONS_H_
 
+#include <QAbstractTableModel>
+#include <QHash>
 #include <QList>
-#include <QTreeWidget>
-#include <QTreeWidgetItem>
 
 #include "nxdata.h"
 
@@ -29,11 +29,43 @@
 
 using namespace nxcl;
 
+/*
+ * The sessions on the server, as a table for the sessions dialog.
+ * It is kept up to date with the differences nxcl reports between one
+ * list of sessions and the next, so that only the rows which have
+ * changed are redrawn.
+ */
+class QtNXSessionModel : public QAbstractTableModel
+{
+    Q_OBJECT
+    public:
+        QtNXSessionModel(QObject *parent = 0);
+        ~QtNXSessionModel();
+
+        int rowCount(const QModelIndex &parent = QModelIndex()) const;
+        int columnCount(const QModelIndex &parent = QModelIndex()) const;
+        QVariant data(const QModelIndex &index,
+                int role = Qt::DisplayRole) const;
+        QVariant headerData(int section, Qt::Orientation orientation,
+                int role = Qt::DisplayRole) const;
+
+        void apply(const NXResumeDelta &delta);
+        // For a new connection, whose first list will be all additions
+        void clear();
+        QString sessionID(int row) const;
+    private:
+        void reindex();
+
+        QList<NXResumeData> sessions;
+        // The row of each session ID
+        QHash<QString, int> rows;
+};
+
 class QtNXSessions : public QDialog
 {
     Q_OBJECT
     public:
-        QtNXSessions(QList<NXResumeData>);
+        QtNXSessions(QtNXSessionModel *);
         ~QtNXSessions();
     public slots:
             void pressedNew();
@@ -42,10 +74,8 @@ class QtNXSessions : public QDialog
         void newPressed();
         void resumePressed(QString);
     private:
-        void empty();
-
         Ui_SessionsDialog ui_sd;
-        QList<QTreeWidgetItem*> sessionItems;
+        QtNXSessionModel *model;
 };
 
 #endif
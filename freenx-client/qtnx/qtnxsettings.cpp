@@ -21,7 +21,7 @@ email                : gwright@kde.org
 #include "qtnxsettings.h"
 
 #include "nxdata.h"
-#include "nxparsexml.h"
+#include "nxconfigparser.h"
 #include "nxwritexml.h"
 
 using namespace nxcl;
@@ -57,16 +57,8 @@ QtNXSettings::~QtNXSettings()
 void QtNXSettings::parseFile()
 {
     if (!fileName.isEmpty()) {
-        NXParseXML handler;
-        handler.setData(&config);
-
-        QFile file(fileName);
-        QXmlInputSource inputSource(&file);
-
-        QXmlSimpleReader reader;
-        reader.setContentHandler(&handler);
-        reader.setErrorHandler(&handler);
-        reader.parse(inputSource);
+        NXConfigParser::parseFile(QFile::encodeName(fileName).constData(),
+                config);
 
         ui_sd.hostname->setText(QString::fromStdString(config.serverHost));
         ui_sd.port->setValue(config.serverPort);
@@ -103,6 +95,8 @@ void QtNXSettings::parseFile()
             ui_sd.link->setCurrentIndex(ui_sd.link->findText(tr("WAN")));
         else if (config.linkType == "lan")
             ui_sd.link->setCurrentIndex(ui_sd.link->findText(tr("LAN")));
+        else if (config.linkType == "auto")
+            ui_sd.link->setCurrentIndex(ui_sd.link->findText(tr("Automatic")));
 
         if (config.imageCompressionMethod == -1) {
             ui_sd.imageCompressionType->setCurrentIndex(ui_sd.imageCompressionType->findText(tr("JPEG")));
@@ -254,6 +248,8 @@ void QtNXSettings::applyPressed()
         config.linkType = "wan";
     else if (ui_sd.link->currentText() == tr("LAN"))
         config.linkType = "lan";
+    else if (ui_sd.link->currentText() == tr("Automatic"))
+        config.linkType = "auto";
 
     if (ui_sd.imageCompressionType->currentText() == tr("JPEG")) {
         config.imageCompressionMethod = -1;
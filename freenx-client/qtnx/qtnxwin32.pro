@@ -4,9 +4,9 @@ CONFIG		+= static qt warn_on release
 
 FORMS = settingsdialog.ui logindialog.ui sessionsdialog.ui keydialog.ui logwindow.ui
 
-SOURCES = main.cpp qtnxwindow.cpp qtnxsettings.cpp qtnxsessions.cpp nxparsexml.cpp nxwritexml.cpp
+SOURCES = main.cpp qtnxwindow.cpp qtnxsettings.cpp qtnxsessions.cpp nxwritexml.cpp
 
-HEADERS = qtnxwindow.h qtnxsettings.h qtnxsessions.h nxparsexml.h nxwritexml.h
+HEADERS = qtnxwindow.h qtnxsettings.h qtnxsessions.h nxwritexml.h
 
 INCLUDEPATH	+= $(QTDIR)/include
 
@@ -14,7 +14,7 @@ DEPENDPATH	+= $(QTDIR)/include
 
 QMAKE_LFLAGS += -Wl,-subsystem,windows
 
-QT += ui xml
+QT += ui
 
 TARGET		= qtnx
 
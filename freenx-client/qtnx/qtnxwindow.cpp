@@ -71,8 +71,11 @@ QtNXWindow::QtNXWindow() :
     connect(&callback, SIGNAL(status(QString)), this,
             SLOT(handleStatus(QString)));
 
-    connect(&callback, SIGNAL(suspendedSessions(QList<NXResumeData>)), this,
-            SLOT(handleSuspendedSessions(QList<NXResumeData>)));
+    connect(&callback, SIGNAL(suspendedSessions()), this,
+            SLOT(handleSuspendedSessions()));
+
+    connect(&callback, SIGNAL(sessionsChanged(const NXResumeDelta &)), this,
+            SLOT(handleSessionsChanged(const NXResumeDelta &)));
 
     connect(&callback, SIGNAL(noSessions()), this, SLOT(handleNoSessions()));
 
@@ -219,6 +222,9 @@ void QtNXWindow::reinitialiseClient()
 {
     delete m_NXClient;
 
+    // The new client's first list of sessions will be all additions.
+    sessionModel.clear();
+
     m_NXClient = new NXClientLib();
     initialiseClient();
 }
@@ -269,6 +275,8 @@ void QtNXWindow::startConnect()
         session.linkType = "wan";
     else if (ui_lg.link->currentText() == tr("LAN"))
         session.linkType = "lan";
+    else if (ui_lg.link->currentText() == tr("Automatic"))
+        session.linkType = "auto";
 
     if (!config.key.empty()) {
         key = config.key;
@@ -371,18 +379,11 @@ void QtNXWindow::handleTimeout()
 
 void QtNXWindow::parseXML()
 {
-    NXParseXML handler;
-    handler.setData(&config);
-
-    QFile file(QDir::homePath() + "/.qtnx/" +
-            ui_lg.session->currentText() + ".nxml");
+    QString fileName = QDir::homePath() + "/.qtnx/" +
+            ui_lg.session->currentText() + ".nxml";
 
-    QXmlInputSource inputSource(&file);
-
-    QXmlSimpleReader reader;
-    reader.setContentHandler(&handler);
-    reader.setErrorHandler(&handler);
-    reader.parse(inputSource);
+    NXConfigParser::parseFile(QFile::encodeName(fileName).constData(),
+            config);
 
     if (config.linkType == "modem")
         ui_lg.link->setCurrentIndex(ui_lg.link->findText(tr("Modem")));
@@ -394,6 +395,8 @@ void QtNXWindow::parseXML()
         ui_lg.link->setCurrentIndex(ui_lg.link->findText(tr("WAN")));
     else if (config.linkType == "lan")
         ui_lg.link->setCurrentIndex(ui_lg.link->findText(tr("LAN")));
+    else if (config.linkType == "auto")
+        ui_lg.link->setCurrentIndex(ui_lg.link->findText(tr("Automatic")));
 }
 
 void QtNXWindow::configure()
@@ -446,15 +449,26 @@ void QtNXWindow::handleStatus(QString message)
     statusBar->showMessage(message);
 }
 
-void QtNXWindow::handleSuspendedSessions(QList<NXResumeData> data)
+void QtNXWindow::handleSuspendedSessions()
 {
-    delete sessionsDialog;
-    sessionsDialog = new QtNXSessions(data);
+    // The dialog shows sessionModel, which is already up to date, so
+    // it is made once and shown again for later lists.
+    if (sessionsDialog == NULL) {
+        sessionsDialog = new QtNXSessions(&sessionModel);
+
+        connect(sessionsDialog, SIGNAL(newPressed()), this,
+                SLOT(resumeNewPressed()));
+        connect(sessionsDialog, SIGNAL(resumePressed(QString)),
+                this, SLOT(resumeResumePressed(QString)));
+    }
+
     sessionsDialog->show();
+    sessionsDialog->raise();
+}
 
-    connect(sessionsDialog, SIGNAL(newPressed()), this, SLOT(resumeNewPressed()));
-    connect(sessionsDialog, SIGNAL(resumePressed(QString)),
-            this, SLOT(resumeResumePressed(QString)));
+void QtNXWindow::handleSessionsChanged(const NXResumeDelta &delta)
+{
+    sessionModel.apply(delta);
 }
 
 void QtNXWindow::handleNoSessions()
@@ -514,6 +528,9 @@ void QtNXWindow::handleProgress(int id, QString message)
         case NXCL_PROCESS_ERROR:
             handleStatus(tr("Process error"));
             break;
+        case NXCL_LINK_MEASURED:
+            handleStatus(tr("Measured the link speed"));
+            break;
         default:
             break;
     }
@@ -26,7 +26,7 @@
 
 #include "nxclientlib.h"
 #include "nxdata.h"
-#include "nxparsexml.h"
+#include "nxconfigparser.h"
 
 #include "qtnxsessions.h"
 #include "qtnxsettings.h"
@@ -68,9 +68,12 @@ class QtNXCallback :
         void stdinSignal(string msg)
           { emit logging("stdin>  " + QString::fromStdString(msg)); }
 
+        // The sessions themselves come as changes, to sessionsChanged.
         void resumeSessionsSignal(list<NXResumeData> sessions)
-          { emit suspendedSessions(QList<NXResumeData>::
-                  fromStdList(sessions)); }
+          { emit suspendedSessions(); }
+
+        void sessionsChangedSignal(const NXResumeDelta &delta)
+          { emit sessionsChanged(delta); }
 
         void noSessionsSignal()
           { emit noSessions(); }
@@ -89,7 +92,8 @@ class QtNXCallback :
         void error(QString);
         void connectedSuccessfully();
 
-        void suspendedSessions(QList<NXResumeData>);
+        void suspendedSessions();
+        void sessionsChanged(const NXResumeDelta &);
         void noSessions();
         void atCapacity();
 };
@@ -108,7 +112,8 @@ class QtNXWindow : public QMainWindow
         void updateLinkType(QString);
 
         // Callback handlers
-        void handleSuspendedSessions(QList<NXResumeData>);
+        void handleSuspendedSessions();
+        void handleSessionsChanged(const NXResumeDelta &);
         void handleNoSessions();
         void handleLogging(QString);
         void handleTimeout();
@@ -145,6 +150,7 @@ class QtNXWindow : public QMainWindow
 
         QtNXSettings *settingsDialog;
         QtNXSessions *sessionsDialog;
+        QtNXSessionModel sessionModel;
 
         QAction *closeWindowAction;
         QDialog *logWindow;
@@ -0,0 +1,257 @@
+/* Memory and connection churn of nxsocksd. Usage:
+   churnbench [-n idle] [-m churn] [-p port] [nxsocksd...]
+
+   For each nxsocksd (./nxsocksd and ./nxsocksd-nopool by default),
+   relaying with splice() and copying (-c): opens that many connections
+   through it to a sink of our own on localhost, passes a little over
+   each and leaves them idle, then reports how much its resident set
+   grew per connection. Then it closes them, and times the given number
+   of short ones one after the other, the way a printer is polled:
+   connect, a request, an answer, close. Build it with
+   "make churnbench". */
+
+#include "config.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+extern int optind;
+extern char *optarg;
+
+#include "lib.h"
+#include "log.h"
+
+#define SINKPORT_OFFSET 1
+#define MSG 100
+
+static unsigned short port=11080;
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec+tv.tv_usec/1e6;
+}
+
+/* Resident set of a process in kB, from /proc */
+static long rss(pid_t pid)
+{
+    char buf[256];
+    FILE *f;
+    long r=-1;
+
+    sprintf(buf, "/proc/%d/status", (int)pid);
+    if (!(f=fopen(buf, "r")))
+	return -1;
+    while (fgets(buf, sizeof(buf), f))
+	if (sscanf(buf, "VmRSS: %ld", &r)==1)
+	    break;
+    fclose(f);
+    return r;
+}
+
+/* Read exactly n bytes, blocking. */
+static int readn(int fd, unsigned char *p, int n)
+{
+    int r;
+    while (n>0) {
+	if ((r=read(fd, p, n))<=0)
+	    return -1;
+	p+=r; n-=r;
+    }
+    return 0;
+}
+
+/* Connect to the sink through nxsocksd, as user "bench". */
+static int socksconnect(unsigned short sinkport)
+{
+    struct sockaddr_in sa;
+    unsigned char buf[16];
+    int s=socket(AF_INET, SOCK_STREAM, 0);
+
+    sockaddr_init(&sa);
+    sa.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+    sa.sin_port=htons(port);
+    if ((s<0) || (connect(s, (struct sockaddr *)&sa, sizeof(sa))<0)) {
+	perror("churnbench: connect to nxsocksd");
+	if (s>=0)
+	    close(s);
+	return -1;
+    }
+    if ((write(s, "\005\001\002", 3)!=3) || (readn(s, buf, 2)<0) ||
+	(buf[1]!=2) ||
+	(write(s, "\001\005bench\001x", 9)!=9) || (readn(s, buf, 2)<0) ||
+	(buf[1]!=0)) {
+	eprintf0("churnbench: nxsocksd refused us");
+	close(s);
+	return -1;
+    }
+    memcpy(buf, "\005\001\000\001", 4);
+    memcpy(buf+4, &sa.sin_addr, 4);
+    sa.sin_port=htons(sinkport);
+    memcpy(buf+8, &sa.sin_port, 2);
+    if ((write(s, buf, 10)!=10) || (readn(s, buf, 10)<0) || (buf[1]!=0)) {
+	eprintf0("churnbench: CONNECT failed");
+	close(s);
+	return -1;
+    }
+    return s;
+}
+
+/* A request from c to the sink's end s, and an answer back. */
+static int exchange(int c, int s)
+{
+    unsigned char buf[MSG];
+    memset(buf, 'x', MSG);
+    if ((write(c, buf, MSG)!=MSG) || (readn(s, buf, MSG)<0) ||
+	(write(s, buf, MSG)!=MSG) || (readn(c, buf, MSG)<0)) {
+	eprintf0("churnbench: exchange failed");
+	return -1;
+    }
+    return 0;
+}
+
+/* Run prog, copying if copy, with n idle and m churned connections. */
+static int bench(const char *prog, int copy, int n, int m)
+{
+    struct sockaddr_in sa;
+    int *fds, lsn, i, c, s, ok=0, o=1;
+    long r0, r1, r2;
+    double t=0;
+    pid_t pid;
+    char portarg[16];
+
+    sockaddr_init(&sa);
+    sa.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+    sa.sin_port=htons(port+SINKPORT_OFFSET);
+    if (((lsn=socket(AF_INET, SOCK_STREAM, 0))<0) ||
+	(setsockopt(lsn, SOL_SOCKET, SO_REUSEADDR, &o, sizeof(o))<0) ||
+	(bind(lsn, (struct sockaddr *)&sa, sizeof(sa))<0) ||
+	(listen(lsn, 128)<0)) {
+	perror("churnbench: sink");
+	return -1;
+    }
+    if (!(fds=malloc(2*n*sizeof(int))))
+	return -1;
+
+    sprintf(portarg, "%d", port);
+    setenv("NXSOCKS_PASSWORD", "x", 1);
+    if ((pid=fork())==0) {
+	if (!freopen("/dev/null", "w", stdout))
+	    exit(1);
+	if (copy)
+	    execl(prog, prog, "-p", portarg, "-a", "127.0.0.1", "-u",
+		  "127.0.0.1", "-U", "bench", "-c", (char *)NULL);
+	else
+	    execl(prog, prog, "-p", portarg, "-a", "127.0.0.1", "-u",
+		  "127.0.0.1", "-U", "bench", (char *)NULL);
+	perror(prog);
+	exit(1);
+    }
+    usleep(300000);
+    r0=rss(pid);
+
+    /* The idle ones */
+    for (i=0; i<n; ++i) {
+	if ((fds[2*i]=socksconnect(port+SINKPORT_OFFSET))<0)
+	    break;
+	if ((fds[2*i+1]=accept(lsn, NULL, NULL))<0) {
+	    perror("churnbench: accept");
+	    close(fds[2*i]);
+	    break;
+	}
+	if (exchange(fds[2*i], fds[2*i+1])<0) {
+	    close(fds[2*i]);
+	    close(fds[2*i+1]);
+	    break;
+	}
+    }
+    usleep(100000);
+    r1=rss(pid);
+    if (i==n)
+	ok=1;
+    while (--i>=0) {
+	close(fds[2*i]);
+	close(fds[2*i+1]);
+    }
+    if (!ok)
+	goto out;
+
+    /* The churn */
+    usleep(100000);
+    t=now();
+    for (i=0; i<m; ++i) {
+	if ((c=socksconnect(port+SINKPORT_OFFSET))<0)
+	    break;
+	if ((s=accept(lsn, NULL, NULL))<0) {
+	    perror("churnbench: accept");
+	    close(c);
+	    break;
+	}
+	o=exchange(c, s);
+	close(c);
+	close(s);
+	if (o<0)
+	    break;
+    }
+    t=now()-t;
+    if (i<m)
+	ok=0;
+ out:
+    r2=rss(pid);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    close(lsn);
+    free(fds);
+    if (!ok) {
+	eprintf1("churnbench: %s failed", prog);
+	return -1;
+    }
+    printf("%-20s %-7s %6d %8ld %8.2f %8.0f %8ld\n", prog,
+	   copy ? "copy" : "splice", n, r0, (r1-r0)/(double)n,
+	   m/t, r2);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    static char *progs[]={"./nxsocksd", "./nxsocksd-nopool", NULL};
+    struct rlimit rl;
+    char **p=progs;
+    int n=500, m=5000, i;
+
+    setunbuf(stdout);
+    while ((i=getopt(argc, argv, "n:m:p:"))!=EOF) {
+	switch(i) {
+	case 'n': n=atoi(optarg); break;
+	case 'm': m=atoi(optarg); break;
+	case 'p': port=atoi(optarg); break;
+	default:
+	    eprintf0("usage: churnbench [-n idle] [-m churn] [-p port] [nxsocksd...]");
+	    exit(1);
+	}
+    }
+    if (optind<argc)
+	p=argv+optind;
+    /* Enough fds for the idle ones, for us and nxsocksd */
+    if (getrlimit(RLIMIT_NOFILE, &rl)==0) {
+	rl.rlim_cur=rl.rlim_max;
+	(void)setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    printf("nxsocksd             relay    idle  rss0 kB kB/idle   conns/s  rss1 kB\n");
+    for (; *p; ++p)
+	if ((bench(*p, 0, n, m)<0) || (bench(*p, 1, n, m)<0))
+	    return 1;
+    return 0;
+}
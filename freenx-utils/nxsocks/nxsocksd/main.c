@@ -50,21 +50,14 @@ int debug=0;
 unsigned short port=1080;
 int maxfail=0;
 
+/* workers */
+static int workers=1;
+static int reuseport=0;         /* each one has its own listening socket */
+static int lsock;               /* the listening socket of worker 0 */
+
 /* statistics */
-int s_connects=0;
-int s_refused=0;
-int s_protfail=0;
-int s_authfail=0;
-int s_addrfail=0;
-int s_rconn=0;
-int s_rbind=0;
-int s_rudp=0;
-#ifdef DO_SPAWN
-int s_rspawn=0;
-#endif
-int s_fconn=0;
-int s_fbind=0;
-int s_fudp=0;
+WORKER_LOCAL sockstats *stats;
+static sockstats *workerstats;
 
 #ifdef __GNUC__
 /* Shut up warnings */
@@ -88,8 +81,22 @@ typedef struct {
     struct sockaddr_in caddr;   /* connecting address */
     int pendfd, idfd;           /* connecting/ident fd*/
     ident_state state;          /* ident state */
+    int shared;                 /* listening socket shared by workers */
 } perm;
 
+static perm *mainperm;
+
+/* Add up the counters of all workers. */
+static void sumstats(sockstats *t)
+{
+    int i;
+    size_t j;
+    memset(t, 0, sizeof(*t));
+    for (i=0; i<workers; ++i)
+	for (j=0; j<sizeof(sockstats)/sizeof(int); ++j)
+	    ((int *)t)[j]+=((int *)&workerstats[i])[j];
+}
+
 /* Look up host names/IP addresses. */
 static int blookup(const char *c, struct in_addr *sa)
 {
@@ -134,7 +141,8 @@ static int blookupn(const char *c, struct in_addr **sa, int *n)
     return 0;
 }
 
-/* Open a listening socket on specified port. */
+/* Open a listening socket on specified port. With reuseport set, the
+   socket of each worker gets the same port. */
 static int opensock(short p)
 {
     struct sockaddr_in sa;
@@ -149,6 +157,18 @@ static int opensock(short p)
     if (setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &o, sizeof(o))<0) {
 	perror("warning: SO_REUSEADDR"); /* not fatal */
     }
+    if (reuseport) {
+#ifdef SO_REUSEPORT
+	if (setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &o, sizeof(o))<0) {
+	    perror("warning: SO_REUSEPORT"); /* they share this one */
+	    reuseport=0;
+	}
+#else
+	reuseport=0;
+#endif
+    }
+    if (workers>1)
+	fcntl(s, F_SETFL, O_NONBLOCK); /* another worker may have taken it */
     if (bind(s, (struct sockaddr *)&sa, sizeof(sa))<0) {
 	perror("bind"); return -1;
     }
@@ -207,7 +227,7 @@ void ident_rd(int fd, void *a)
 	i=identparse(buf);
 	if (strcmp(i, p->id)) {
 	    eprintf1("refused connect from ident %s", i);
-	    ++s_refused;
+	    ++stats->refused;
 	    close(p->pendfd);
 	    return;
 	}
@@ -271,7 +291,7 @@ void ident_to(int fd, void *a)
     dprintf0(DEB_ID, "ident_to");
     thread_fd_close(fd);
     eprintf0("refused connect, no ident");
-    ++s_refused;
+    ++stats->refused;
     close(p->pendfd);
 }
 
@@ -282,27 +302,35 @@ void newconn(int fd, void *a)
     int n, c;
     struct sockaddr_in sa;
     size_t sal=sizeof(sa);
-
-    if (maxfail>0 && s_refused+s_protfail+s_authfail>maxfail) {
-	printf("Too many failed requests. Throttling.\n");
-	thread_fd_close(fd);
-	return;
+    sockstats t;
+
+    if (maxfail>0) {
+	sumstats(&t);
+	if (t.refused+t.protfail+t.authfail>maxfail) {
+	    printf("Too many failed requests. Throttling.\n");
+	    if (p->shared)
+		thread_fd_rd_off(fd);
+	    else
+		thread_fd_close(fd);
+	    return;
+	}
     }
 
     if ((c=accept(fd, (struct sockaddr *)&sa, &sal))<0) {
-	perror("newconn: accept");
+	if (errno!=EAGAIN)
+	    perror("newconn: accept");
 	return; /* eh? */
     }
     dprintf3(DEB_CONN, "newconn: from %s:%d -> %d", inet_ntoa(sa.sin_addr),
 	     ntohs(sa.sin_port), c);
 
-    ++s_connects;
+    ++stats->connects;
     if (p->nacc) {
         for (n=0; n<p->nacc; ++n)
             if (sa.sin_addr.s_addr==p->acc[n].s_addr)
                 goto okay;
 	eprintf1("refused connect from %s", inet_ntoa(sa.sin_addr));
-	++s_refused;
+	++stats->refused;
 	close(c);
 	return;
     }
@@ -426,14 +454,35 @@ static void usage(const char *p)
 {
     eprintf1("usage: %s [-p port] [-a accepthost[,...]] [-u udphost[,...]]",
              p);
-    eprintf0("       [-i identuser] [-U authuser]");
+    eprintf0("       [-i identuser] [-U authuser] [-c] [-t timeout] [-w workers]");
     exit(1);
 }
 
+/* The life of a worker: accept and serve connections until stopped. */
+static void worker(int w)
+{
+    perm pm=*mainperm;
+    int s=lsock;
+
+    stats=&workerstats[w];
+    if (w>0) {
+	if ((thread_init()<0) || (resolv_init()<0)) {
+	    eprintf1("worker %d: out of memory", w);
+	    return;
+	}
+	if (reuseport && ((s=opensock(port))<0))
+	    return;
+    }
+    pm.shared=(workers>1) && (!reuseport);
+    thread_fd_register(s, newconn, NULL, NULL, &pm);
+    thread_mainloop();
+}
+
 int main(int argc, char *argv[])
 {
     int n;
     perm pm;
+    sockstats t;
     char *acchost=NULL;
     char *udphost=NULL;
     char buf[128];
@@ -442,7 +491,7 @@ int main(int argc, char *argv[])
     setunbuf(stderr);
     memset(&pm, 0, sizeof(pm));
     printf("nxsocksd version " VERSION " (c) Olaf Titz 1997-1999\n");
-    while((n=getopt(argc, argv, "p:a:u:i:U:d:f:"))!=EOF) {
+    while((n=getopt(argc, argv, "p:a:u:i:U:d:f:ct:w:"))!=EOF) {
 	switch(n) {
 	case 'p': port=atoi(optarg); break;
 	case 'a': acchost=optarg; break;
@@ -453,6 +502,9 @@ int main(int argc, char *argv[])
 	case 'd': debug=atoi(optarg); break;
 #endif
 	case 'f': maxfail=atoi(optarg); break;
+	case 'c': use_splice=0; break;
+	case 't': conntimeout=atof(optarg)*1000; break;
+	case 'w': workers=atoi(optarg); break;
 	default: usage(argv[0]);
 	}
     }
@@ -462,7 +514,16 @@ int main(int argc, char *argv[])
 	usage(argv[0]);
     }
 #endif
-    if ((thread_init()<0) || (resolv_init()<0)) {
+    if (workers<1)
+	usage(argv[0]);
+#ifndef HAVE_LIBPTHREAD
+    if (workers>1) {
+	eprintf1("%s: compiled without threads, can't have workers", argv[0]);
+	exit(1);
+    }
+#endif
+    if ((thread_init()<0) || (resolv_init()<0) ||
+	(!(workerstats=calloc(workers, sizeof(sockstats))))) {
 	eprintf1("%s: out of memory, a hopeless case", argv[0]);
 	exit(1);
     }
@@ -474,9 +535,10 @@ int main(int argc, char *argv[])
 	exit(1);
 
     setup_myaddress();
-    if ((n=opensock(port))<0)
+    reuseport=(workers>1);
+    if ((lsock=opensock(port))<0)
 	exit(1);
-    thread_fd_register(n, newconn, NULL, NULL, &pm);
+    mainperm=&pm;
 
     printaddrlist(" Accepting connnections from %s", pm.acc, pm.nacc);
     printf(" ident %s\n", (pm.id) ? pm.id : "(anyone)");
@@ -516,7 +578,11 @@ int main(int argc, char *argv[])
     {
         pm.pass=strncpy(buf, getenv("NXSOCKS_PASSWORD"), sizeof(buf));
     }
-    printf("Listening on port %d.\n", port);
+    printf("Listening on port %d", port);
+    if (workers>1)
+	printf(" with %d workers%s", workers,
+	       (reuseport) ? "" : " on one socket");
+    printf(".\n");
     /*thread_fd_register(0, eofh, NULL, NULL, NULL); */
     setsig(SIGINT, finish);
     setsig(SIGTERM, finish);
@@ -524,20 +590,30 @@ int main(int argc, char *argv[])
 #ifdef DO_SPAWN
     setsig(SIGCHLD, reap);
 #endif
-    thread_mainloop();
+    if (thread_workers(workers, worker)<0) {
+	eprintf1("%s: can't start the workers", argv[0]);
+	exit(1);
+    }
     if (thread_stop>0)
 	printf("Got signal %d\n", thread_stop);
+    sumstats(&t);
     printf("Connection stats: %d connects, %d refused\n",
-	   s_connects, s_refused);
+	   t.connects, t.refused);
     printf(" %d handshake failed, %d auth failed, %d addressing failed\n",
-	   s_protfail, s_authfail, s_addrfail);
+	   t.protfail, t.authfail, t.addrfail);
     printf(" Requests: %d connect, %d bind, %d UDP",
-	   s_rconn, s_rbind, s_rudp);
+	   t.rconn, t.rbind, t.rudp);
 #ifdef DO_SPAWN
-    printf(", %d spawn", s_rspawn);
+    printf(", %d spawn", t.rspawn);
 #endif
     printf("\n Requests failed: %d connect, %d bind, %d UDP\n",
-	   s_fconn, s_fbind, s_fudp);
+	   t.fconn, t.fbind, t.fudp);
+    if (workers>1) {
+	printf(" Connects by worker:");
+	for (n=0; n<workers; ++n)
+	    printf(" %d", workerstats[n].connects);
+	printf("\n");
+    }
 #ifdef MDEBUG
     memorymap(1);
 #endif
@@ -0,0 +1,69 @@
+/*
+   nxsocksd - user specific SOCKS5 daemon
+
+   pool.c - fixed size block allocator
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version
+   2 of the License, or (at your option) any later version.
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include "pool.h"
+
+/* Build with -DNO_POOL to use plain malloc and free, to compare. */
+
+void *pool_get(pool *p)
+{
+    char *s;
+
+#ifndef NO_POOL
+    if (p->free) {
+	s=p->free;
+	p->free=*(void **)s;
+	--p->nfree;
+	++p->used;
+	return s;
+    }
+    if (p->perslab>1) {
+	int i;
+	if (!(s=malloc(p->perslab*p->size)))
+	    return NULL;
+	++p->slabs;
+	/* the first is for the caller, the rest go on the free list */
+	for (i=p->perslab-1; i>0; --i) {
+	    *(void **)(s+i*p->size)=p->free;
+	    p->free=s+i*p->size;
+	}
+	p->nfree+=p->perslab-1;
+	++p->used;
+	return s;
+    }
+#endif
+    if (!(s=malloc(p->size)))
+	return NULL;
+    ++p->slabs;
+    ++p->used;
+    return s;
+}
+
+void pool_put(pool *p, void *b)
+{
+    if (!b)
+	return;
+    --p->used;
+#ifndef NO_POOL
+    if ((p->perslab>1) || (p->nfree<p->keep)) {
+	*(void **)b=p->free;
+	p->free=b;
+	++p->nfree;
+	return;
+    }
+#endif
+    --p->slabs;
+    free(b);
+}
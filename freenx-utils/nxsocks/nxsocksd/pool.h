@@ -0,0 +1,36 @@
+#ifndef _pool_h_
+#define _pool_h_
+
+#include <stddef.h>
+
+/* A pool of blocks of one size. They are cut from slabs of "perslab"
+   at a time and go back on a free list when done with, so a busy
+   daemon does not keep asking malloc for the same few sizes. Slabs
+   are never given back; a pool of one per slab gives back what it
+   has spare beyond "keep" blocks instead, which suits big buffers.
+   There is no locking: a pool belongs to one worker, or is guarded
+   by its user. */
+typedef struct pool {
+    size_t size;                /* block size, rounded up */
+    int perslab;                /* blocks per slab */
+    int keep;                   /* spare blocks to keep, if perslab==1 */
+    void *free;                 /* the spare blocks, linked through */
+    int nfree;                  /* how many of them */
+    int used;                   /* blocks out */
+    int slabs;                  /* slabs got */
+} pool;
+
+/* Round up to keep every block aligned for anything */
+#define POOL_ALIGN(s) (((s)+2*sizeof(void *)-1)&~(2*sizeof(void *)-1))
+
+/* Static initializer */
+#define POOL_INIT(size, perslab, keep) \
+    { POOL_ALIGN(size), (perslab), (keep), NULL, 0, 0, 0 }
+
+/* Get a block (uninitialized), NULL if out of memory */
+extern void *pool_get(pool *p);
+
+/* Give a block back */
+extern void pool_put(pool *p, void *b);
+
+#endif
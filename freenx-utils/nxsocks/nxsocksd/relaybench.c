@@ -0,0 +1,247 @@
+/* Throughput of the nxsocksd relay. Usage:
+   relaybench [-m megabytes] [-c connections] [-p port] [-w workers]
+              [nxsocksd]
+
+   Starts nxsocksd (./nxsocksd by default) on the port, once relaying
+   with splice() and once copying (-c), and for each pushes the
+   megabytes over each of that many connections at once to a sink of
+   our own on localhost. Reports the throughput and the CPU time nxsocksd
+   took per gigabyte, run with the workers given. Build it with
+   "make relaybench". */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+extern int optind;
+extern char *optarg;
+
+#include "lib.h"
+#include "log.h"
+
+#define CHUNK 65536
+#define SINKPORT_OFFSET 1
+
+static unsigned short port=11080;
+static char *workers="1";
+static char chunk[CHUNK];
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec+tv.tv_usec/1e6;
+}
+
+static double cputime(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_CHILDREN, &ru);
+    return ru.ru_utime.tv_sec+ru.ru_utime.tv_usec/1e6+
+	ru.ru_stime.tv_sec+ru.ru_stime.tv_usec/1e6;
+}
+
+/* Read exactly n bytes, blocking. */
+static int readn(int fd, unsigned char *p, int n)
+{
+    int r;
+    while (n>0) {
+	if ((r=read(fd, p, n))<=0)
+	    return -1;
+	p+=r; n-=r;
+    }
+    return 0;
+}
+
+/* Connect to the sink through nxsocksd, as user "bench". */
+static int socksconnect(unsigned short sinkport)
+{
+    struct sockaddr_in sa;
+    unsigned char buf[16];
+    int s=socket(AF_INET, SOCK_STREAM, 0);
+
+    sockaddr_init(&sa);
+    sa.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+    sa.sin_port=htons(port);
+    if ((s<0) || (connect(s, (struct sockaddr *)&sa, sizeof(sa))<0)) {
+	perror("relaybench: connect to nxsocksd");
+	if (s>=0)
+	    close(s);
+	return -1;
+    }
+    if ((write(s, "\005\001\002", 3)!=3) || (readn(s, buf, 2)<0) ||
+	(buf[1]!=2) ||
+	(write(s, "\001\005bench\001x", 9)!=9) || (readn(s, buf, 2)<0) ||
+	(buf[1]!=0)) {
+	eprintf0("relaybench: nxsocksd refused us");
+	close(s);
+	return -1;
+    }
+    memcpy(buf, "\005\001\000\001", 4);
+    memcpy(buf+4, &sa.sin_addr, 4);
+    sa.sin_port=htons(sinkport);
+    memcpy(buf+8, &sa.sin_port, 2);
+    if ((write(s, buf, 10)!=10) || (readn(s, buf, 10)<0) || (buf[1]!=0)) {
+	eprintf0("relaybench: CONNECT failed");
+	close(s);
+	return -1;
+    }
+    return s;
+}
+
+/* Push mb megabytes over each of c connections through nxsocksd. */
+static int bench(const char *prog, int copy, long mb, int c)
+{
+    struct sockaddr_in sa;
+    struct pollfd *pfd;
+    long long *left, total=0;
+    double t=0, cpu;
+    int lsn, i, n, open=c, o=1;
+    pid_t pid;
+    char portarg[16];
+
+    /* The sink */
+    sockaddr_init(&sa);
+    sa.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+    sa.sin_port=htons(port+SINKPORT_OFFSET);
+    if (((lsn=socket(AF_INET, SOCK_STREAM, 0))<0) ||
+	(setsockopt(lsn, SOL_SOCKET, SO_REUSEADDR, &o, sizeof(o))<0) ||
+	(bind(lsn, (struct sockaddr *)&sa, sizeof(sa))<0) ||
+	(listen(lsn, c)<0)) {
+	perror("relaybench: sink");
+	return -1;
+    }
+
+    sprintf(portarg, "%d", port);
+    setenv("NXSOCKS_PASSWORD", "x", 1);
+    cpu=cputime();
+    if ((pid=fork())==0) {
+	if (!freopen("/dev/null", "w", stdout))
+	    exit(1);
+	if (copy)
+	    execl(prog, prog, "-p", portarg, "-a", "127.0.0.1", "-u",
+		  "127.0.0.1", "-U", "bench", "-w", workers, "-c",
+		  (char *)NULL);
+	else
+	    execl(prog, prog, "-p", portarg, "-a", "127.0.0.1", "-u",
+		  "127.0.0.1", "-U", "bench", "-w", workers, (char *)NULL);
+	perror(prog);
+	exit(1);
+    }
+    usleep(300000);
+
+    /* c sources, then c sinks */
+    pfd=calloc(2*c, sizeof(struct pollfd));
+    left=calloc(c, sizeof(long long));
+    for (i=0; i<c; ++i) {
+	if ((pfd[i].fd=socksconnect(port+SINKPORT_OFFSET))<0)
+	    goto out;
+	if ((pfd[c+i].fd=accept(lsn, NULL, NULL))<0) {
+	    perror("relaybench: accept");
+	    goto out;
+	}
+	/* a blocked write would stop us reading the sinks */
+	fcntl(pfd[i].fd, F_SETFL, O_NONBLOCK);
+	fcntl(pfd[c+i].fd, F_SETFL, O_NONBLOCK);
+	pfd[i].events=POLLOUT;
+	pfd[c+i].events=POLLIN;
+	left[i]=mb*1048576LL;
+    }
+    total=0;
+    open=c;
+    t=now();
+    while (open>0) {
+	if (poll(pfd, 2*c, 10000)<=0) {
+	    eprintf0("relaybench: stuck");
+	    goto out;
+	}
+	for (i=0; i<c; ++i) {
+	    if (!(pfd[i].revents&POLLOUT))
+		continue;
+	    n=write(pfd[i].fd, chunk,
+		    (left[i]<CHUNK) ? (int)left[i] : CHUNK);
+	    if ((n<0) && (errno==EAGAIN))
+		continue;
+	    if (n<0) {
+		perror("relaybench: write");
+		goto out;
+	    }
+	    if ((left[i]-=n)==0) {
+		shutdown(pfd[i].fd, 1);
+		pfd[i].events=0;
+	    }
+	}
+	for (i=c; i<2*c; ++i) {
+	    if (!(pfd[i].revents&(POLLIN|POLLHUP)))
+		continue;
+	    n=read(pfd[i].fd, chunk, CHUNK);
+	    if (n>0) {
+		total+=n;
+	    } else if ((n<0) && (errno==EAGAIN)) {
+		continue;
+	    } else {
+		pfd[i].events=0;
+		--open;
+	    }
+	}
+    }
+    t=now()-t;
+ out:
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    cpu=cputime()-cpu;
+    for (i=0; i<2*c; ++i)
+	if (pfd[i].fd>0)
+	    close(pfd[i].fd);
+    close(lsn);
+    free(pfd);
+    free(left);
+    if (open>0 || total!=mb*1048576LL*c) {
+	eprintf2("relaybench: %lld of %lld bytes came", total,
+		 mb*1048576LL*c);
+	return -1;
+    }
+    printf("%-7s %6d %8ld %10.1f %10.2f\n", copy ? "copy" : "splice",
+	   c, mb*c, total/t/1048576, cpu*1024/(total/1048576.0));
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    long mb=256;
+    int c=4, i;
+    const char *prog="./nxsocksd";
+
+    setunbuf(stdout);
+    while ((i=getopt(argc, argv, "m:c:p:w:"))!=EOF) {
+	switch(i) {
+	case 'm': mb=atol(optarg); break;
+	case 'c': c=atoi(optarg); break;
+	case 'p': port=atoi(optarg); break;
+	case 'w': workers=optarg; break;
+	default:
+	    eprintf0("usage: relaybench [-m megabytes] [-c connections] [-p port] [-w workers] [nxsocksd]");
+	    exit(1);
+	}
+    }
+    if (optind<argc)
+	prog=argv[optind];
+    signal(SIGPIPE, SIG_IGN);
+    printf("relay    conns       MB       MB/s  cpu s/GB\n");
+    if ((bench(prog, 0, mb, c)<0) || (bench(prog, 1, mb, c)<0))
+	return 1;
+    return 0;
+}
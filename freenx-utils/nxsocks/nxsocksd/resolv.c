@@ -27,6 +27,9 @@
 #include <stdlib.h>
 #include <time.h>
 #include <unistd.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 extern struct RES_STATE _res;
 
@@ -34,6 +37,7 @@ extern struct RES_STATE _res;
 #include "resolv.h"
 #include "log.h"
 #include "lib.h"
+#include "pool.h"
 
 #ifndef MAXTTL
 /* upper bound on rrset TTLs */
@@ -45,6 +49,12 @@ extern struct RES_STATE _res;
 #define BADTTL 60
 #endif
 
+#ifndef RETRANS
+/* First wait for an answer in ms, doubled for each retry. We give up
+   when the resolver's own retrans and retry would have. */
+#define RETRANS 500
+#endif
+
 const char *resolv_strerr(int s)
 {
     switch(abs(s)) {
@@ -81,6 +91,23 @@ typedef struct hash_t {
 
 static hash **ht=NULL;
 
+/* The cache is shared by all workers. Whoever holds this may look at
+   and change it; an answer from it is copied before it is let go. */
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t cachelock=PTHREAD_MUTEX_INITIALIZER;
+#define LOCK() pthread_mutex_lock(&cachelock)
+#define UNLOCK() pthread_mutex_unlock(&cachelock)
+#else
+#define LOCK()
+#define UNLOCK()
+#endif
+
+/* Cache slots, guarded by cachelock */
+static pool hashpool=POOL_INIT(sizeof(hash), 64, 0);
+
+/* Where the copy handed to the callbacks lives */
+static WORKER_LOCAL struct hostent heans;
+static WORKER_LOCAL char *hebuf=NULL;
 
 /* Free a null-terminated list */
 #define lfree(typ,p) { typ **x=p; while (*x) { free(*x); ++x; }; free(p); }
@@ -99,6 +126,36 @@ static void hefree(struct hostent *h)
 	lfree(struct in_addr, (struct in_addr **)(h->h_addr_list));
 }
 
+/* Copy an hostent into our own memory, which is valid until the next
+   copy. NULL if out of memory. */
+static struct hostent *hecopy(const struct hostent *h)
+{
+    int na=0, nd=0, l=strlen(h->h_name)+1;
+    char **p, *q, *b;
+
+    for (p=h->h_aliases; *p; ++p, ++na)
+	l+=strlen(*p)+1;
+    for (p=h->h_addr_list; *p; ++p, ++nd);
+    if (!(b=malloc((na+nd+2)*sizeof(char *)+nd*sizeof(struct in_addr)+l)))
+	return NULL;
+    free(hebuf);
+    hebuf=b;
+    heans=*h;
+    heans.h_aliases=(char **)b;
+    heans.h_addr_list=heans.h_aliases+na+1;
+    q=(char *)(heans.h_addr_list+nd+1);
+    for (p=h->h_addr_list; *p; ++p, q+=sizeof(struct in_addr)) {
+	memcpy(q, *p, sizeof(struct in_addr));
+	heans.h_addr_list[p-h->h_addr_list]=q;
+    }
+    heans.h_addr_list[nd]=NULL;
+    for (p=h->h_aliases; *p; ++p, q+=strlen(q)+1)
+	heans.h_aliases[p-h->h_aliases]=strcpy(q, *p);
+    heans.h_aliases[na]=NULL;
+    heans.h_name=strcpy(q, h->h_name);
+    return &heans;
+}
+
 /* Hash function on a domain name.
    Experiments have shown that this primitive rotate-xor type hash does not
    distribute much worse than taking a CRC, which is what dbz uses.
@@ -141,6 +198,7 @@ void dumpcache(void)
     int i;
     hash *p;
     time_t t0=time(0);
+    LOCK();
     for (i=0; i<HASHSIZE; ++i) {
 	if (ht[i]) {
 	    printf("dumpcache: %d ", i);
@@ -150,6 +208,7 @@ void dumpcache(void)
 	    printf("\n");
 	}
     }
+    UNLOCK();
 }
 #endif
 
@@ -157,8 +216,8 @@ void dumpcache(void)
 /*** DNS resolver ***/
 
 typedef struct res_parm {
-    time_t retrans;           /* Query timeout */
-    int retry;                /* Query retry count (goes down) */
+    long retrans;             /* Query timeout, ms */
+    long long deadline;       /* thread_clock() to give up at */
     int smask;                /* server status bitmap */
     int thens;                /* counter */
     hash *hashp;              /* Cache slot for this query */
@@ -170,6 +229,9 @@ typedef struct res_parm {
     char rcvbuf[PACKETSZ];    /* Receive buffer */
 } resparm;
 
+/* Queries in progress, per worker */
+static WORKER_LOCAL pool rppool=POOL_INIT(sizeof(resparm), 16, 0);
+
 
 /* Answer parsing */
 
@@ -259,6 +321,7 @@ static void gotanswer(resparm *rp)
     char **nn;
     struct in_addr **addrs=NULL;
     int naddrs=0;
+    struct hostent *hc;
 
     /* is this really our request? compare QNAME */
     e=-GENFAIL;
@@ -303,18 +366,26 @@ static void gotanswer(resparm *rp)
     he.h_addrtype=AF_INET;
     he.h_length=sizeof(struct in_addr);
     he.h_addr_list=(char **)addrs;
-    if (rp->hashp->status!=1)
+    LOCK();
+    if (rp->hashp->status==0)
 	/* another lookup has filled the cache slot. Throw away the old one. */
 	hefree(&(rp->hashp->hent));
     rp->hashp->hent=he;
     rp->hashp->status=0;
     rp->hashp->attl=time(0)+l1;
-    rp->callback(&he, NOERROR, rp->callfd, rp->callpar);
+    hc=hecopy(&he);
+    UNLOCK();
+    if (hc)
+	rp->callback(hc, NOERROR, rp->callfd, rp->callpar);
+    else
+	rp->callback(NULL, -OUTOFMEM, rp->callfd, rp->callpar);
     return;
 
  failed:
+    LOCK();
     rp->hashp->status=e;
     rp->hashp->attl=time(0)+BADTTL;
+    UNLOCK();
     rp->callback(NULL, e, rp->callfd, rp->callpar);
     if (names)
 	lfree(char, names);
@@ -331,24 +402,29 @@ void resolv_er(int fd, void *a)
     dprintf1(DEB_RES, "resolv_er: fd=%d", fd);
     thread_fd_close(fd);
     thread_timer_cancel(fd);
+    LOCK();
     rp->hashp->status=-TIMEOUT;
     rp->hashp->attl=time(0)+BADTTL;
+    UNLOCK();
     rp->callback(NULL, -TIMEOUT, rp->callfd, rp->callpar);
-    free(rp);
+    pool_put(&rppool, rp);
 }
 
 /* Query timeout. Restart or return error. */
 void resolv_to(int fd, void *a)
 {
     resparm *rp=a;
-    dprintf2(DEB_RES, "resolv_to: fd=%d, r=%d", fd, rp->retry);
-    if (--rp->retry<=0) {
+    long long left=rp->deadline-thread_clock();
+    dprintf2(DEB_RES, "resolv_to: fd=%d, left=%ldms", fd, (long)left);
+    if (left<=0) {
 	resolv_er(fd, a);
 	return;
     }
     rp->retrans<<=1;
+    if (rp->retrans>left)
+	rp->retrans=left;
     thread_fd_wr_on(fd);
-    thread_timer_register(rp->retrans, resolv_to, fd, a);
+    thread_timer_register_ms(rp->retrans, resolv_to, fd, a);
 }
 
 /* Resolver read handler. */
@@ -407,15 +483,17 @@ void resolv_rd(int fd, void *a)
 
  aserverr:
     /* Authoritative error or no server left to query */
+    LOCK();
     rp->hashp->status=e;
     rp->hashp->attl=time(0)+BADTTL;
+    UNLOCK();
     rp->callback(NULL, e, rp->callfd, rp->callpar);
 
  finish:
     /* Now done with the request */
     thread_fd_close(fd);
     thread_timer_cancel(fd);
-    free(rp);
+    pool_put(&rppool, rp);
 }
 
 /* Resolver write handler: send a query and reset timeout */
@@ -435,31 +513,30 @@ void resolv_wr(int fd, void *a)
 	rp->thens=0;
 	thread_fd_wr_off(fd);
 	thread_timer_cancel(fd);
-	thread_timer_register(rp->retrans, resolv_to, fd, a);
+	thread_timer_register_ms(rp->retrans, resolv_to, fd, a);
     }
 }
 
-/* Start a DNS lookup. Prepare to call "rch" when complete. */
+/* Start a DNS lookup into the slot "hp", which the caller has marked
+   as in progress. Prepare to call "rch" when complete. */
 static int startlookup(const char *c, int typ, hash *hp,
 		       rescall rch, int rfd, void *rpar)
 {
     int fd;
-    resparm *rp=malloc(sizeof(resparm));
+    resparm *rp=pool_get(&rppool);
     if (!rp)
 	return -OUTOFMEM;
     if (((fd=nsocket(AF_INET, SOCK_DGRAM, 0))<0) ||
 	((rp->qlen=res_mkquery(QUERY, c, C_IN, typ, NULL, 0, NULL,
 			       rp->sndbuf, PACKETSZ))<0)) {
 	eprintf1("startlookup: %s", strerror(errno));
-	free(rp);
+	pool_put(&rppool, rp);
 	close(fd);
 	return -GENFAIL;
     }
     dprintf2(DEB_RES, "startlookup: `%s' typ=%d", c, typ);
-    hp->status=1; /* lookup in progress */
-    hp->attl=time(0);
-    rp->retrans=_res.retrans;
-    rp->retry=_res.retry;
+    rp->retrans=(_res.retrans*1000L<RETRANS) ? _res.retrans*1000L : RETRANS;
+    rp->deadline=thread_clock()+_res.retrans*1000L*((1<<_res.retry)-1);
     rp->smask=(1<<_res.nscount)-1;
     rp->thens=0;
     rp->hashp=hp;
@@ -467,7 +544,7 @@ static int startlookup(const char *c, int typ, hash *hp,
     rp->callfd=rfd;
     rp->callpar=rpar;
     thread_fd_register(fd, resolv_rd, resolv_wr, NULL, rp);
-    thread_timer_register(_res.retrans, resolv_er, fd, rp);
+    thread_timer_register_ms(rp->deadline-thread_clock(), resolv_er, fd, rp);
     return 1; /* in progress */
 }
 
@@ -480,21 +557,28 @@ static void glookup(const char *c, int typ, rescall rch, int fd, void *parm)
 {
     hash *p, *p1;
     char *c1;
+    struct hostent *h=NULL;
     int e=NOERROR;
 
+    LOCK();
     if (!hashlook(c, typ, &p)) {
 	/* from cache */
 	if (time(0)<p->attl) {
 	    dprintf1(DEB_RES, "glookup: from cache: `%s'", c);
-	    e=p->status;
+	    if (((e=p->status)==0) && (!(h=hecopy(&(p->hent)))))
+		e=-OUTOFMEM;
+	    UNLOCK();
 	    goto immed;
 	}
-	hefree(&(p->hent));
+	if (p->status==0)
+	    hefree(&(p->hent));
 	/* ttl expired: fall through to lookup */
     } else {
 	/* insert new element into cache */
-	if ((!(p1=malloc(sizeof(hash)))) ||
+	if ((!(p1=pool_get(&hashpool))) ||
 	    (!(c1=strdup(c)))) {
+	    pool_put(&hashpool, p1);
+	    UNLOCK();
 	    e=-OUTOFMEM; goto immed;
 	}
 	p->next=p1;
@@ -503,14 +587,15 @@ static void glookup(const char *c, int typ, rescall rch, int fd, void *parm)
 	p->name=c1;
 	p->typ=typ;
     }
-    p->status=1;
+    p->status=1; /* lookup in progress */
     p->attl=time(0);
+    UNLOCK();
     e=startlookup(c, typ, p, rch, fd, parm);
     if (e>0)
 	return;
 
  immed:
-    rch((e==0) ? &(p->hent) : NULL, e, fd, parm);
+    rch(h, e, fd, parm);
 }
 
 /* Do a forward query - gethostbyname() equivalent */
@@ -623,9 +708,12 @@ void rlookup(struct in_addr a, rescall rch, int fd, void *parm)
 int resolv_init(void)
 {
     int i;
+    /* each worker has its own resolver state */
     if (res_init()<0)
 	return -1;
     _res.options|=RES_RECURSE; /* we rely on this */
+    if (ht)
+	return 0; /* the cache is shared */
     if (!(ht=malloc(HASHSIZE*sizeof(hash *))))
 	return -1;
     for (i=0; i<HASHSIZE; ++i)
@@ -13,6 +13,9 @@
 /* $Id: socks.c,v 1.19 1999/05/13 22:28:11 olaf Exp $ */
 
 #include "config.h"
+#ifdef HAVE_SPLICE
+#define _GNU_SOURCE /* splice() */
+#endif
 
 #include <errno.h>
 #include <fcntl.h>
@@ -30,13 +33,35 @@
 #include "stats.h"
 #include "udp.h"
 #include "resolv.h"
+#include "pool.h"
 
 #ifndef BUFS
 #define BUFS 16384
 #endif
 
+/* How long to wait for a CONNECT to connect, in ms (0: for ever) */
+#ifndef CONNTIMEOUT
+#define CONNTIMEOUT 30000
+#endif
+
+/* Buffers kept spare for new connections, by each worker */
+#ifndef BUFSPARE
+#define BUFSPARE 16
+#endif
+
+/* What a relay pipe may hold: the default pipe size on Linux */
+#ifndef PIPES
+#define PIPES 65536
+#endif
+
 /* Global */
 struct in_addr myaddress;
+#ifdef HAVE_SPLICE
+int use_splice=1;
+#else
+int use_splice=0;
+#endif
+long conntimeout=CONNTIMEOUT;
 
 typedef enum socks_state {
     st_rinit, st_rauths, st_wauths,
@@ -60,9 +85,17 @@ typedef struct socks_parm {
     struct socks_parm *peer;        /* Peer parameter block */
     struct in_addr *udpclient;      /* UDP expectance */
     int udpclientn;
-    unsigned char buf[BUFS];        /* The buffer proper */
+    int pipe[2];                    /* splice() relay pipe, or -1 */
+    unsigned int inpipe;            /* bytes in it */
+    unsigned char *buf;             /* The buffer proper, BUFS long */
 } socksparm;
 
+/* Parameter blocks, and their buffers. A connection only has one
+   while there is something in it: in the handshake, and while
+   relaying until it is written out. */
+static WORKER_LOCAL pool sppool=POOL_INIT(sizeof(socksparm), 64, 0);
+static WORKER_LOCAL pool bufpool=POOL_INIT(BUFS, 1, BUFSPARE);
+
 /* Fields of the request/reply */
 #define rq_ver(s) ((s)->buf[0])
 #define rq_cmd(s) ((s)->buf[1])
@@ -88,6 +121,31 @@ static void bufset(socksparm *sp, int pos, int len)
     sp->bufpos=pos; sp->bufgoal=pos+len;
 }
 
+/* Give back the buffer of a connection with nothing in it */
+static void bufdrop(socksparm *sp)
+{
+    pool_put(&bufpool, sp->buf);
+    sp->buf=NULL;
+    bufset(sp, 0, 0);
+}
+
+/* Give back a parameter block */
+static void spfree(socksparm *sp)
+{
+    pool_put(&bufpool, sp->buf);
+    pool_put(&sppool, sp);
+}
+
+/* Close the relay pipe, if there is one */
+static void unpipe(socksparm *sp)
+{
+    if (sp->pipe[0]>=0) {
+	close(sp->pipe[0]);
+	close(sp->pipe[1]);
+	sp->pipe[0]=sp->pipe[1]=-1;
+    }
+}
+
 /* Close this fd and its proxy. */
 void closeboth(int fd, void *a)
 {
@@ -97,11 +155,17 @@ void closeboth(int fd, void *a)
 	thread_fd_close(sp->proxy);
 	thread_timer_cancel(sp->proxy);
     }
-    if (sp->peer)
+    unpipe(sp);
+    /* peer is only a socksparm when relaying (see the UDP request) */
+    if (sp->peer && (sp->state==st_running || sp->state==st_eof)) {
+	unpipe(sp->peer);
+	spfree(sp->peer);
+    } else if (sp->peer) {
 	free(sp->peer);
+    }
     thread_fd_close(fd);
     thread_timer_cancel(fd);
-    free(sp);
+    spfree(sp);
 }
 
 /* Read a chunk into buffer. Return true if complete. */
@@ -287,6 +351,11 @@ void shuffle_rd(int fd, void *a)
 {
     int n;
     socksparm *sp=a;
+    if ((!sp->buf) && (!(sp->buf=pool_get(&bufpool)))) {
+	eprintf0("shuffle_rd: out of memory");
+	closeboth(fd, sp);
+	return;
+    }
     n=BUFS-sp->bufgoal;
     if (n<=0) {
 	if (sp->bufpos>=BUFS) {
@@ -333,7 +402,7 @@ void shuffle_wr(int fd, void *a)
             }
             shutdown(fd, 1);
         }
-        bufset(sp, 0, 0);
+        bufdrop(sp);
 	thread_fd_wr_off(fd);
 	return;
     }
@@ -348,6 +417,99 @@ void shuffle_wr(int fd, void *a)
     thread_fd_rd_on(sp->me);
 }
 
+#ifdef HAVE_SPLICE
+/*** The same, moving the data through a pipe with splice(), so that it
+     never has to be copied to us and back. ***/
+
+/* Read into pipe... */
+void splice_rd(int fd, void *a)
+{
+    int n;
+    socksparm *sp=a;
+    n=PIPES-sp->inpipe;
+    if (n<=0) {
+	/* pipe full */
+	thread_fd_rd_off(fd);
+	return;
+    }
+    n=splice(fd, NULL, sp->pipe[1], NULL, n,
+	     SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+    if ((n<0) && (errno==EAGAIN)) {
+	/* The pipe is full after all (our count is only what we put
+	   in, the kernel's is in pages), or nothing had come */
+	if (sp->inpipe)
+	    thread_fd_rd_off(fd);
+	return;
+    }
+    if (n<=0) {
+        /* EOF or read error */
+        dprintf2(DEB_CONN, "splice_rd %d %s", fd, n<0?"error":"eof");
+        sp->state=st_eof;
+        shutdown(fd, 0);
+        thread_fd_rd_off(fd);
+        thread_fd_wr_on(sp->proxy);
+        return;
+    }
+    sp->inpipe+=n;
+    thread_fd_wr_on(sp->proxy);
+}
+
+/* Write from pipe... */
+void splice_wr(int fd, void *a)
+{
+    socksparm *sp=a;
+    int n;
+    sp=sp->peer; /* write from peer pipe */
+    if (sp->inpipe==0) {
+        /* pipe empty */
+        if (sp->state==st_eof) {
+            dprintf1(DEB_CONN, "splice_wr eof %d", fd);
+            if (sp->peer->state==st_eof) {
+                closeboth(fd, sp->peer);
+                return;
+            }
+            shutdown(fd, 1);
+        }
+	thread_fd_wr_off(fd);
+	return;
+    }
+    n=splice(sp->pipe[0], NULL, fd, NULL, sp->inpipe,
+	     SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+    if ((n<0) && (errno==EAGAIN))
+	return;
+    if (n<=0) {
+	/* broken pipe */
+	dprintf1(DEB_CONN, "splice_wr err close %d", fd);
+	closeboth(fd, sp->peer);
+	return;
+    }
+    sp->inpipe-=n;
+    thread_fd_rd_on(sp->me);
+}
+
+/* Give sp a relay pipe if we may. Return true if it has one. */
+static int mkpipe(socksparm *sp)
+{
+#ifdef DEBUG
+    /* the data must pass through us to be dumped */
+    if (debug&DEB_DDUMP)
+	return 0;
+#endif
+    if (!use_splice)
+	return 0;
+    if (pipe(sp->pipe)<0) {
+	/* out of fds, perhaps: copy this one */
+	perror("warning: relay pipe");
+	sp->pipe[0]=sp->pipe[1]=-1;
+	return 0;
+    }
+    fcntl(sp->pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(sp->pipe[1], F_SETFD, FD_CLOEXEC);
+    sp->inpipe=0;
+    return 1;
+}
+#endif
+
 
 /*** Handlers for new proxy. The parameter block is that of the master ***/
 
@@ -358,7 +520,7 @@ void proxy_rd(int fd, void *a)
     int n=doaccept(sp, 1);
     rp_rep(sp)=n;
     if (n>0)
-	++s_fbind;
+	++stats->fbind;
     sp->state=(n>0) ? st_err : st_bopened;
     thread_fd_wr_on(sp->me);
     bufset(sp, reppos, reqsize);
@@ -369,16 +531,32 @@ void proxy_rd(int fd, void *a)
 void proxy_wr(int fd, void *a)
 {
     socksparm *sp=a;
-    int n=doconnect(sp, 1);
+    int n;
+    thread_timer_cancel(fd);
+    n=doconnect(sp, 1);
     rp_rep(sp)=n;
     if (n>0)
-	++s_fconn;
+	++stats->fconn;
     sp->state=(n>0) ? st_err : st_copened;
     thread_fd_wr_on(sp->me);
     bufset(sp, reppos, reqsize);
     thread_fd_wr_off(fd);
 }
 
+/* Newly opened proxy has not connected in time */
+void proxy_to(int fd, void *a)
+{
+    socksparm *sp=a;
+    dprintf1(DEB_SO, "proxy_to %d", fd);
+    thread_fd_close(fd);
+    sp->proxy=-1;
+    rp_rep(sp)=6; /* TTL expired, the usual for a timeout */
+    ++stats->fconn;
+    sp->state=st_err;
+    thread_fd_wr_on(sp->me);
+    bufset(sp, reppos, reqsize);
+}
+
 
 /*** Handlers for the socks control connection ***/
 
@@ -390,7 +568,7 @@ void socks_rd_gotaddr(struct hostent *h, int s, int fd, void *a)
     dprintf2(DEB_SOS, "socks_rd_gotaddr fd %d status %d", fd, s);
     if (s!=0) {
 	eprintf1("DNS lookup failed: `%s'", sp->buf+5);
-	++s_addrfail;
+	++stats->addrfail;
 	sp->buf[1]=1;
 	bufset(sp, 0, 10);
 	sp->state=st_err;
@@ -442,14 +620,14 @@ void socks_rd(int fd, void *a)
 		}
 	}
 	eprintf1("%d not socks5", fd);
-	++s_protfail;
+	++stats->protfail;
 	goto err255;
 
     case st_ruser:
 	waitcompl();
 	if (rq_ver(sp)!=1) {
 	    eprintf1("%d not passwd auth", fd);
-	    ++s_protfail;
+	    ++stats->protfail;
 	    goto err255;
 	}
 	bufset(sp, 2, sp->buf[1]+1);
@@ -471,7 +649,7 @@ void socks_rd(int fd, void *a)
 	if (strcmp(sp->uname, (char *)(sp->buf+2)) ||
 	    strcmp(sp->pass, (char *)(p+1))) {
 	    eprintf1("%d passwd auth failed", fd);
-	    ++s_authfail;
+	    ++stats->authfail;
 	    goto err255;
 	}
 	sp->buf[1]=0;
@@ -487,7 +665,7 @@ void socks_rd(int fd, void *a)
 	case 3:
 	    bufset(sp, 5, sp->buf[4]+2); break;
 	default:
-	    ++s_addrfail;
+	    ++stats->addrfail;
 	    flagerr(8);
 	}
 	trans(st_raddr);
@@ -508,7 +686,7 @@ void socks_rd(int fd, void *a)
 	    return;
 	default: /* invalid/unsupported */
 	    thread_fd_wr_on(fd);
-	    ++s_addrfail;
+	    ++stats->addrfail;
 	    flagerr(1);
 	}
 	/*fallthru*/
@@ -519,7 +697,7 @@ void socks_rd(int fd, void *a)
 	memcpy(sp->buf+reppos, sp->buf, reqsize);
         /* rp_rsv(sp)=0; NEC extension using that as flags */
 	if (rq_ver(sp)!=5) {
-	    ++s_protfail;
+	    ++stats->protfail;
 	    flagerr(7);
 	}
 	
@@ -529,16 +707,16 @@ void socks_rd(int fd, void *a)
 
 	    if (rq_cmd(sp) != 1 || (strcmp(inet_ntoa(rq_addr(sp)),"127.0.0.1")!=0) || (ntohs(rq_port(sp)) != 631 && ntohs(rq_port(sp)) != 6201))
 	    {
-		++s_refused;
+		++stats->refused;
 		flagerr(2);
             }
 	}
 
 	switch(rq_cmd(sp)) {
 	case 1: /* CONNECT */
-	    ++s_rconn;
+	    ++stats->rconn;
 	    if ((n=nsocket(AF_INET, SOCK_STREAM, 0))<0) {
-		++s_fconn;
+		++stats->fconn;
 		flagerr(1);
 	    }
             i=2*BUFS;
@@ -561,12 +739,14 @@ void socks_rd(int fd, void *a)
 	    if ((i=doconnect(sp, 0))>0) {
 		close(n);
 		sp->proxy=-1;
-		++s_fconn;
+		++stats->fconn;
 		flagerr(i);
 	    }
 	    thread_fd_rd_off(fd);
 	    if (i<0) { /* waiting */
 		thread_fd_register(n, NULL, proxy_wr, closeboth, sp);
+		if (conntimeout>0)
+		    thread_timer_register_ms(conntimeout, proxy_to, n, sp);
 		thread_fd_wr_off(fd);
 		trans(st_copening);
 	    }
@@ -576,9 +756,9 @@ void socks_rd(int fd, void *a)
 	    trans(st_copened);
 
 	case 2: /* BIND */
-	    ++s_rbind;
+	    ++stats->rbind;
 	    if ((n=nsocket(AF_INET, SOCK_STREAM, 0))<0) {
-		++s_fbind;
+		++stats->fbind;
 		flagerr(1);
 	    }
             i=2*BUFS;
@@ -591,7 +771,7 @@ void socks_rd(int fd, void *a)
 	    if ((i=dobind(sp, 0))>0) {
 		close(n);
 		sp->proxy=-1;
-		++s_fbind;
+		++stats->fbind;
 		flagerr(i);
 	    }
 	    rp_rep(sp)=0;
@@ -599,9 +779,9 @@ void socks_rd(int fd, void *a)
 	    trans(st_bopening);
 
 	case 3: /* UDP */
-	    ++s_rudp;
+	    ++stats->rudp;
 	    if ((n=nsocket(AF_INET, SOCK_DGRAM, 0))<0) {
-		++s_fudp;
+		++stats->fudp;
 		flagerr(1);
 	    }
 	    sockaddr_init(&pa);
@@ -609,7 +789,7 @@ void socks_rd(int fd, void *a)
 	    pa.sin_port=rq_port(sp);
 	    if (!(a=udp_init(n, &pa, sp->udpclient, sp->udpclientn))) {
 		close(n);
-		++s_fudp;
+		++stats->fudp;
 		flagerr(1);
 	    }
 	    sp->proxy=n;
@@ -625,7 +805,7 @@ void socks_rd(int fd, void *a)
 #ifdef DO_SPAWN
         case 128: /* ping */
         case 129: /* traceroute */
-            ++s_rspawn;
+            ++stats->rspawn;
             rp_rep(sp)=0;
             bufset(sp, reppos, reqsize);
             thread_fd_wr_on(fd);
@@ -667,6 +847,9 @@ void socks_wr(int fd, void *a)
 {
     socksparm *sp=a;
     socksparm *sp2;
+#ifdef HAVE_SPLICE
+    int n;
+#endif
 
 #define trans(x) do{sp->state=(x); return;}while(0)
 #define waitcompl() if (!writecompl(fd,sp)) return;
@@ -693,7 +876,7 @@ void socks_wr(int fd, void *a)
     case st_copened: /* connect response */
     case st_bopened: /* accept response */
 	waitcompl();
-	if (!(sp2=malloc(sizeof(socksparm)))) {
+	if (!(sp2=pool_get(&sppool))) {
 	    eprintf0("socks_wr 12: out of memory");
 	    closeboth(fd, sp);
 	    return;
@@ -703,9 +886,29 @@ void socks_wr(int fd, void *a)
 	sp2->peer=sp;
 	sp2->me=sp->proxy;
 	sp2->proxy=fd;
+	sp2->pipe[0]=sp2->pipe[1]=-1;
 	sp2->state=sp->state=st_running;
-	bufset(sp, 0, 0);
+	/* both get a buffer when something comes to copy */
+	bufdrop(sp);
+	sp2->buf=NULL;
 	bufset(sp2, 0, 0);
+#ifdef HAVE_SPLICE
+	if (mkpipe(sp)) {
+	    if (mkpipe(sp2)) {
+		/* splice_wr copes with a full socket, and must not
+		   wait for one with a pipe's worth to write. Those
+		   from accept() block. */
+		if ((n=fcntl(fd, F_GETFL))>=0)
+		    fcntl(fd, F_SETFL, n|O_NONBLOCK);
+		if ((n=fcntl(sp->proxy, F_GETFL))>=0)
+		    fcntl(sp->proxy, F_SETFL, n|O_NONBLOCK);
+		thread_fd_register(fd, splice_rd, splice_wr, NULL, sp);
+		thread_fd_register(sp->proxy, splice_rd, splice_wr, NULL, sp2);
+		return;
+	    }
+	    unpipe(sp);
+	}
+#endif
 	thread_fd_register(fd, shuffle_rd, shuffle_wr, NULL, sp);
 	thread_fd_register(sp->proxy, shuffle_rd, shuffle_wr, NULL, sp2);
 	return;
@@ -719,6 +922,7 @@ void socks_wr(int fd, void *a)
 
     case st_uopening: /* udp response */
 	waitcompl();
+	bufdrop(sp);
 	thread_fd_wr_off(fd);
 	trans(st_uwaiting);
 
@@ -749,7 +953,11 @@ void socks_wr(int fd, void *a)
 void socks_init(int fd, const char *uname, const char *pass,
 		struct in_addr *udpclient, int udpclientn)
 {
-    socksparm *sp=malloc(sizeof(socksparm));
+    socksparm *sp=pool_get(&sppool);
+    if (sp && (!(sp->buf=pool_get(&bufpool)))) {
+	pool_put(&sppool, sp);
+	sp=NULL;
+    }
     if (!sp) {
 	close(fd);
 	return;
@@ -758,6 +966,7 @@ void socks_init(int fd, const char *uname, const char *pass,
     sp->me=fd;
     sp->proxy=-1;
     sp->peer=NULL;
+    sp->pipe[0]=sp->pipe[1]=-1;
     sp->uname=uname;
     sp->pass=pass;
     sp->udpclient=udpclient;
@@ -2,6 +2,10 @@
 #define _socks_h_
 
 extern struct in_addr myaddress;
+/* Relay with splice() where we can (the default), else copy */
+extern int use_splice;
+/* How long a CONNECT may take, in ms, or 0 */
+extern long conntimeout;
 
 extern void socks_init(int fd, const char *user, const char *pass,
 		       struct in_addr *udpclient, int udpclientn);
@@ -1,17 +1,25 @@
 #ifndef _stats_h_
 #define _stats_h_
 
-extern int s_connects;
-extern int s_refused;
-extern int s_protfail;
-extern int s_authfail;
-extern int s_addrfail;
-extern int s_rconn;
-extern int s_rbind;
-extern int s_rudp;
-extern int s_rspawn;
-extern int s_fconn;
-extern int s_fbind;
-extern int s_fudp;
+#include "thread.h"
+
+/* Counted by each worker for itself, and added up at the end. */
+typedef struct {
+    int connects;
+    int refused;
+    int protfail;
+    int authfail;
+    int addrfail;
+    int rconn;
+    int rbind;
+    int rudp;
+    int rspawn;
+    int fconn;
+    int fbind;
+    int fudp;
+} sockstats;
+
+/* The counters of this worker */
+extern WORKER_LOCAL sockstats *stats;
 
 #endif
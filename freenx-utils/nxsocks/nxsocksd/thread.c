@@ -17,37 +17,110 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+/* epoll where we have it, select() otherwise. Define NO_EPOLL to
+   build the select() version anyway. */
+#if defined(HAVE_SYS_EPOLL_H) && !defined(NO_EPOLL)
+#define USE_EPOLL
+#endif
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#else
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
 #endif
+#endif
 
 #include "thread.h"
 #include "log.h"
 #include "lib.h"
+#include "pool.h"
+
+#ifdef USE_EPOLL
+const char thread_backend[]="epoll";
 
-static fd_set mfd_ma, mfd_rd, mfd_wr, mfd_ex;
+/* Bits of registry.on */
+#define T_MA 1
+#define T_RD 2
+#define T_WR 4
+#define T_EX 8
 
-static struct registry {
+/* Events returned by one epoll_wait() */
+#define MAXEVENTS 256
+
+static WORKER_LOCAL int epfd=-1;
+/* fds whose handlers were switched on or off since the last
+   epoll_wait(). The kernel is told once per loop, so a handler which
+   switches itself off and on again costs no system call. */
+static WORKER_LOCAL int *dirty=NULL;
+static WORKER_LOCAL int ndirty;
+#else
+const char thread_backend[]="select";
+
+static WORKER_LOCAL fd_set mfd_ma, mfd_rd, mfd_wr, mfd_ex;
+#endif
+
+struct registry {
     handler rdhand, wrhand, exhand;
     void *parm;
-} *regs=NULL;
+    struct timer *timers; /* pending with this fd as id */
+#ifdef USE_EPOLL
+    int on;    /* T_ bits of the handlers active */
+    int have;  /* events the kernel is watching for */
+    int dirty; /* on the dirty list */
+#endif
+};
+
+static WORKER_LOCAL struct registry *regs=NULL;
 
-static struct timer {
-    struct timer *next;
-    time_t tim;
+struct timer {
+    long long due;       /* thread_clock() when due */
+    unsigned long seq;   /* keeps those due at once in order */
+    int pos;             /* where in the heap */
+    struct timer *next;  /* next with the same id */
     handler doit;
     int id;
     void *parm;
-} *tpending=NULL;
+};
 
-static int nregs, maxfd;
+/* Pending timers, a binary heap on (due, seq). Those whose id is an
+   fd are also chained from its registry, to be cancelled without a
+   search; the rest are searched for. */
+static WORKER_LOCAL struct timer **theap=NULL;
+static WORKER_LOCAL int ntimers, maxtimers;
+static WORKER_LOCAL unsigned long tseq;
+
+static WORKER_LOCAL pool tpool=POOL_INIT(sizeof(struct timer), 64, 0);
+
+static WORKER_LOCAL int nregs, maxfd;
+
+/* Readable once a worker's loop has stopped, to wake the others */
+static int wakepipe[2]={-1, -1};
 
 /* Initialize the module. */
 int thread_init(void)
 {
     dprintf0(DEB_THR, "thread_init");
+#ifdef USE_EPOLL
+    if (((nregs=getdtablesize())>0) &&
+	((regs=calloc(nregs, sizeof(struct registry)))) &&
+	((dirty=malloc(nregs*sizeof(int)))) &&
+	((epfd=epoll_create(MAXEVENTS))>=0)) {
+	fcntl(epfd, F_SETFD, FD_CLOEXEC);
+	ndirty=0;
+	maxfd=0;
+	return 0;
+    }
+    return -1;
+#else
     if (((nregs=getdtablesize())>0) &&
 	((regs=calloc(nregs, sizeof(struct registry))))) {
 	FD_ZERO(&mfd_ma);
@@ -58,8 +131,376 @@ int thread_init(void)
 	return 0;
     }
     return -1;
+#endif
+}
+
+/* Milliseconds on a clock which is never set back */
+long long thread_clock(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts)==0)
+	return ts.tv_sec*1000LL+ts.tv_nsec/1000000;
+#endif
+    {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec*1000LL+tv.tv_usec/1000;
+    }
+}
+
+#define tbefore(a,b) (((a)->due<(b)->due) || \
+		      (((a)->due==(b)->due) && ((long)((a)->seq-(b)->seq)<0)))
+
+/* Put timer p at heap position i, or nearer the top if it is due
+   sooner than those above. */
+static void heap_up(struct timer *p, int i)
+{
+    while (i>0 && tbefore(p, theap[(i-1)/2])) {
+	theap[i]=theap[(i-1)/2];
+	theap[i]->pos=i;
+	i=(i-1)/2;
+    }
+    theap[i]=p;
+    p->pos=i;
+}
+
+/* The same, further down if those below are due sooner. */
+static void heap_down(struct timer *p, int i)
+{
+    int c;
+    while ((c=2*i+1)<ntimers) {
+	if ((c+1<ntimers) && tbefore(theap[c+1], theap[c]))
+	    ++c;
+	if (!tbefore(theap[c], p))
+	    break;
+	theap[i]=theap[c];
+	theap[i]->pos=i;
+	i=c;
+    }
+    theap[i]=p;
+    p->pos=i;
+}
+
+/* Take timer p out of the heap (not its id chain) */
+static void heap_remove(struct timer *p)
+{
+    struct timer *l=theap[--ntimers];
+    if (l!=p) {
+	if ((p->pos>0) && tbefore(l, theap[(p->pos-1)/2]))
+	    heap_up(l, p->pos);
+	else
+	    heap_down(l, p->pos);
+    }
+}
+
+/* Take timer p out of the chain of its id */
+static void chain_remove(struct timer *p)
+{
+    struct timer **q;
+    if ((p->id<0) || (p->id>=nregs))
+	return;
+    for (q=&regs[p->id].timers; *q; q=&(*q)->next)
+	if (*q==p) {
+	    *q=p->next;
+	    return;
+	}
+}
+
+/* Milliseconds until the first timer is due, or -1 if there is none. */
+static long timer_wait(void)
+{
+    long long t;
+    if (!ntimers)
+	return -1;
+    t=theap[0]->due-thread_clock();
+    return (t<0) ? 0 : (t>86400000) ? 86400000 : (long)t;
+}
+
+/* Call the expired timers. Those registered meanwhile wait for the
+   next round, even if due at once. */
+static void timer_run(void)
+{
+    struct timer *p;
+    long long now=thread_clock();
+    unsigned long seq=tseq;
+    handler doit;
+    int id;
+    void *parm;
+
+    while (ntimers) {
+	p=theap[0];
+	if ((now<p->due) || ((long)(p->seq-seq)>=0))
+	    break;
+	/* dequeue a timer event */
+	heap_remove(p);
+	chain_remove(p);
+	doit=p->doit; id=p->id; parm=p->parm;
+	pool_put(&tpool, p);
+	dprintf1(DEB_THRTR, "timhand %d", id);
+	doit(id, parm);
+    }
+}
+
+sig_atomic_t thread_stop;
+
+/* Stopping: nothing to read, the loop will see thread_stop */
+static void wakeup(int fd, void *parm)
+{
+    (void)fd; (void)parm;
+}
+
+/* Start and finish a run of the main loop, for the workers. */
+static void loop_start(void)
+{
+    /* a worker may be stopped before it gets here */
+    if (wakepipe[0]>=0)
+	thread_fd_register(wakepipe[0], wakeup, NULL, NULL, NULL);
+    else
+	thread_stop=0;
+}
+
+static void loop_end(void)
+{
+    if (wakepipe[1]>=0)
+	(void)write(wakepipe[1], "", 1);
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void (*workerbody)(int worker);
+
+static void *worker(void *a)
+{
+    workerbody((int)(long)a);
+    return NULL;
+}
+#endif
+
+int thread_workers(int n, void (*body)(int worker))
+{
+#ifdef HAVE_LIBPTHREAD
+    pthread_t *t;
+    sigset_t s, s0;
+    int i;
+
+    if (n>1) {
+	if ((pipe(wakepipe)<0) || (!(t=malloc(n*sizeof(pthread_t)))))
+	    return -1;
+	fcntl(wakepipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(wakepipe[1], F_SETFD, FD_CLOEXEC);
+	fcntl(wakepipe[1], F_SETFL, O_NONBLOCK);
+	workerbody=body;
+	thread_stop=0;
+	/* the new threads start with all signals blocked */
+	sigfillset(&s);
+	pthread_sigmask(SIG_BLOCK, &s, &s0);
+	for (i=1; i<n; ++i) {
+	    if (pthread_create(&t[i], NULL, worker, (void *)(long)i)) {
+		eprintf2("warning: only %d of %d workers started", i, n);
+		break;
+	    }
+	}
+	n=i;
+	pthread_sigmask(SIG_SETMASK, &s0, NULL);
+	body(0);
+	for (i=1; i<n; ++i)
+	    pthread_join(t[i], NULL);
+	free(t);
+	return 0;
+    }
+#else
+    if (n>1)
+	return -1;
+#endif
+    body(0);
+    return 0;
+}
+
+#ifdef USE_EPOLL
+
+/* Note that the handlers of fd have been switched. */
+static void mark(int fd)
+{
+    if (!regs[fd].dirty) {
+	regs[fd].dirty=1;
+	dirty[ndirty++]=fd;
+    }
+}
+
+/* Tell the kernel what we now want of the dirty fds. */
+static void update(void)
+{
+    struct epoll_event ev;
+    int i, fd, want, r;
+
+    for (i=0; i<ndirty; ++i) {
+	fd=dirty[i];
+	regs[fd].dirty=0;
+	want=0;
+	if (regs[fd].on&T_RD)
+	    want|=EPOLLIN;
+	if (regs[fd].on&T_WR)
+	    want|=EPOLLOUT;
+	if (regs[fd].on&T_EX)
+	    want|=EPOLLPRI;
+	/* A hangup is reported whatever we ask for. With only the
+	   exception handler on, select() would not call anything for
+	   it, so take it once rather than on every wakeup. */
+	if (want==EPOLLPRI)
+	    want|=EPOLLET;
+	if (want==regs[fd].have)
+	    continue;
+	memset(&ev, 0, sizeof(ev));
+	ev.events=want;
+	ev.data.fd=fd;
+	if (!want) {
+	    /* it may have been closed without thread_fd_close */
+	    (void)epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev);
+	    regs[fd].have=0;
+	    continue;
+	}
+	/* The kernel forgets an fd closed behind our back, and
+	   remembers one opened again under the same number. */
+	if (regs[fd].have) {
+	    if (((r=epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev))<0) &&
+		(errno==ENOENT))
+		r=epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+	} else {
+	    if (((r=epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev))<0) &&
+		(errno==EEXIST))
+		r=epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+	}
+	if (r<0) {
+	    /* Theoretically, caused by an internal error of the
+	       program (not this module) */
+	    eprintf1("WARNING: epoll_ctl failed on %d, dropping it", fd);
+	    regs[fd].on=0;
+	    regs[fd].have=0;
+	    continue;
+	}
+	regs[fd].have=want;
+    }
+    ndirty=0;
+}
+
+/* The main loop.
+   For each run, tell the kernel what has changed, call epoll_wait,
+   then call the handlers for the active fds,
+   then call expired timers. */
+int thread_mainloop(void)
+{
+    struct epoll_event evs[MAXEVENTS];
+    int i, n, fd, e;
+    long t;
+
+    if (!regs)
+	return -1; /* initialized? - sanity */
+    loop_start();
+    while (!thread_stop) {
+	update();
+	t=timer_wait();
+	dprintf2(DEB_THRTR, "thread_mainloop: maxfd=%d to=%ld", maxfd, t);
+	if ((n=epoll_wait(epfd, evs, MAXEVENTS, (int)t))<0) {
+	    if (errno!=EINTR)
+		perror("epoll_wait");
+	    continue;
+	}
+	for (i=0; i<n; ++i) {
+	    fd=evs[i].data.fd;
+	    e=evs[i].events;
+	    dprintf2(DEB_THRTR, "epoll_wait-> %d events %x", fd, e);
+	    /* select() calls an fd which is at EOF or in error
+	       readable and writable, and so do we. The handlers
+	       may switch each other off. */
+	    if ((e&(EPOLLIN|EPOLLHUP|EPOLLERR))&&(regs[fd].on&T_RD)) {
+		dprintf1(DEB_THRTR, "rdhand %d", fd);
+		regs[fd].rdhand(fd, regs[fd].parm);
+	    }
+	    if ((e&(EPOLLOUT|EPOLLHUP|EPOLLERR))&&(regs[fd].on&T_WR)) {
+		dprintf1(DEB_THRTR, "wrhand %d", fd);
+		regs[fd].wrhand(fd, regs[fd].parm);
+	    }
+	    if ((e&EPOLLPRI)&&(regs[fd].on&T_EX)) {
+		dprintf1(DEB_THRTR, "exhand %d", fd);
+		regs[fd].exhand(fd, regs[fd].parm);
+	    }
+	}
+	timer_run();
+    }
+    loop_end();
+    return 0;
+}
+
+/* Register handler routines for a file descriptor. */
+void thread_fd_register(int fd, handler rdh, handler wrh, handler exh,
+			void *parm)
+{
+    dprintf1(DEB_THR, "thread_fd_register %d", fd);
+    regs[fd].on=T_MA;
+    if ((regs[fd].rdhand=rdh))
+	regs[fd].on|=T_RD;
+    if ((regs[fd].wrhand=wrh))
+	regs[fd].on|=T_WR;
+    if ((regs[fd].exhand=exh))
+	regs[fd].on|=T_EX;
+    regs[fd].parm=parm;
+    mark(fd);
+    if (fd+1>maxfd)
+	maxfd=fd+1;
+}
+
+/* Activate/deactivate handlers. */
+
+void thread_fd_rd_off(int fd)
+{
+    if (regs[fd].on&T_RD) {
+	regs[fd].on&=~T_RD;
+	mark(fd);
+    }
 }
 
+void thread_fd_rd_on(int fd)
+{
+    if (regs[fd].rdhand && !(regs[fd].on&T_RD)) {
+	regs[fd].on|=T_RD;
+	mark(fd);
+    }
+}
+
+void thread_fd_wr_off(int fd)
+{
+    if (regs[fd].on&T_WR) {
+	regs[fd].on&=~T_WR;
+	mark(fd);
+    }
+}
+
+void thread_fd_wr_on(int fd)
+{
+    if (regs[fd].wrhand && !(regs[fd].on&T_WR)) {
+	regs[fd].on|=T_WR;
+	mark(fd);
+    }
+}
+
+/* Close an fd and deactivate its handlers. */
+int thread_fd_close(int fd)
+{
+    struct epoll_event ev;
+    dprintf1(DEB_THR, "thread_fd_close %d", fd);
+    /* Now, not at the next update(): a child may share the file, and
+       then the kernel would keep reporting it after the close. */
+    if (regs[fd].have) {
+	memset(&ev, 0, sizeof(ev));
+	(void)epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev);
+    }
+    regs[fd].on=0;
+    regs[fd].have=0;
+    return close(fd);
+}
+
+#else /* USE_EPOLL */
+
 /* Check which fds are valid. Theoretically, a call of this is caused
    by an internal error of the program (not this module) */
 static void checkfds(void)
@@ -98,8 +539,6 @@ void printfd(int m, fd_set *f)
 }
 #endif
 
-sig_atomic_t thread_stop;
-
 /* The main loop.
    For each run, look what is active, call select,
    then call the handlers for the active fds,
@@ -109,18 +548,18 @@ int thread_mainloop(void)
     fd_set fd_rd, fd_wr, fd_ex;
     int i, n;
     struct timeval t;
-    struct timer *p;
 
     if (!regs)
 	return -1; /* initialized? - sanity */
-    thread_stop=0;
+    loop_start();
     while (!thread_stop) {
 	fd_rd=mfd_rd;
 	fd_wr=mfd_wr;
 	fd_ex=mfd_ex;
-	if (tpending) {
-	    t.tv_sec=tpending->tim-time(0);
-	    t.tv_usec=0;
+	if (ntimers) {
+	    n=timer_wait();
+	    t.tv_sec=n/1000;
+	    t.tv_usec=(n%1000)*1000;
 	}
 #ifdef DEBUG
 	if (debug&DEB_THRTR) {
@@ -128,11 +567,11 @@ int thread_mainloop(void)
 	    printf("  rd( "); printfd(maxfd, &fd_rd);
 	    printf(")  wr( "); printfd(maxfd, &fd_wr);
 	    printf(")  ex( "); printfd(maxfd, &fd_ex);
-	    printf(")  to=%ld\n", (tpending) ? t.tv_sec : -1L);
+	    printf(")  to=%ld\n", (ntimers) ? t.tv_sec : -1L);
 	}
 #endif
 	if ((n=select(maxfd, &fd_rd, &fd_wr, &fd_ex,
-		      (tpending) ? &t : NULL))<0) {
+		      (ntimers) ? &t : NULL))<0) {
 	    switch (errno) {
 	    case EBADF: checkfds(); break;
             case EINTR: break;
@@ -162,17 +601,9 @@ int thread_mainloop(void)
 		regs[i].exhand(i, regs[i].parm);
 	    }
 	}
-	while (tpending) {
-	    if (time(0)<tpending->tim)
-		break;
-	    /* dequeue a timer event */
-	    p=tpending;
-	    tpending=p->next;
-	    dprintf1(DEB_THRTR, "timhand %d", p->id);
-	    p->doit(p->id, p->parm);
-	    free(p);
-	}
+	timer_run();
     }
+    loop_end();
     return 0;
 }
 
@@ -236,46 +667,66 @@ int thread_fd_close(int fd)
     return close(fd);
 }
 
+#endif /* USE_EPOLL */
+
 /* Register a timer event. */
-int thread_timer_register(time_t secs, handler toh, int id, void *parm)
+int thread_timer_register_ms(long ms, handler toh, int id, void *parm)
 {
-#ifdef DEBUG
-    int c=0;
-#endif
-    time_t tim=time(0)+secs;
-    struct timer *p=tpending, *p0=(struct timer *)&tpending; /* XX */
-    while (p && (p->tim<=tim)) {
-	p0=p; p=p->next;
-#ifdef DEBUG
-	++c;
-#endif
+    struct timer *p, **h;
+
+    if (ntimers>=maxtimers) {
+	if (!(h=realloc(theap, (maxtimers+64)*sizeof(struct timer *))))
+	    return -1;
+	theap=h;
+	maxtimers+=64;
     }
-    if (!(p=malloc(sizeof(struct timer))))
+    if (!(p=pool_get(&tpool)))
 	return -1;
-
-    dprintf3(DEB_THR, "thread_timer_register %d time=%ld pos=%d", id, tim, c);
-    p->next=p0->next;
-    p->tim=tim;
+    p->due=thread_clock()+ms;
+    p->seq=tseq++;
     p->doit=toh;
     p->id=id;
     p->parm=parm;
-
-    p0->next=p;
+    p->next=NULL;
+    if ((id>=0) && (id<nregs)) {
+	p->next=regs[id].timers;
+	regs[id].timers=p;
+    }
+    heap_up(p, ntimers++);
+    dprintf3(DEB_THR, "thread_timer_register %d in %ldms pos=%d", id, ms,
+	     p->pos);
     return 0;
 }
 
+int thread_timer_register(time_t secs, handler toh, int id, void *parm)
+{
+    return thread_timer_register_ms(secs*1000L, toh, id, parm);
+}
+
 /* Cancel all timer events for a given ID. */
 void thread_timer_cancel(int id)
 {
-    struct timer *p=tpending, *p0=(struct timer *)&tpending; /* XX */
+    struct timer *p;
+    int i;
+
     dprintf1(DEB_THR, "thread_timer_cancel %d", id);
-    while (p) {
-	if (p->id==id) {
-	    p0->next=p->next;
-	    free(p);
-	    p=p0->next;
+    if ((id>=0) && (id<nregs)) {
+	while ((p=regs[id].timers)) {
+	    regs[id].timers=p->next;
+	    heap_remove(p);
+	    pool_put(&tpool, p);
+	}
+	return;
+    }
+    /* taking one out moves others about: look again from the top */
+    for (i=0; i<ntimers; ) {
+	if (theap[i]->id==id) {
+	    p=theap[i];
+	    heap_remove(p);
+	    pool_put(&tpool, p);
+	    i=0;
 	} else {
-	    p0=p; p=p->next;
+	    ++i;
 	}
     }
 }
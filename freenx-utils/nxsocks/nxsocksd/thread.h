@@ -4,10 +4,23 @@
 #include "config.h"
 #include <signal.h>
 
+/* Storage class of the state each worker keeps for itself: the
+   module state here, and whatever of its own a program keeps per
+   worker (see thread_workers). */
+#ifdef HAVE_LIBPTHREAD
+#define WORKER_LOCAL __thread
+#else
+#define WORKER_LOCAL
+#endif
+
 typedef void (*handler)(int fd, void *parm);
 
+/* Stops the main loops of all workers */
 extern sig_atomic_t thread_stop;
 
+/* "epoll" or "select" */
+extern const char thread_backend[];
+
 extern int thread_init(void);
 
 extern int thread_mainloop(void);
@@ -25,8 +38,21 @@ extern void thread_fd_wr_on(int fd);
 
 extern int thread_fd_close(int fd);
 
+/* Call toh(id, parm) once, so many seconds or milliseconds from now */
 extern int thread_timer_register(time_t secs, handler toh, int id, void *parm);
 
+extern int thread_timer_register_ms(long ms, handler toh, int id, void *parm);
+
 extern void thread_timer_cancel(int id);
 
+/* Milliseconds on a clock which is never set back */
+extern long long thread_clock(void);
+
+/* Run body(0) ... body(n-1) at once, each in a thread of its own which
+   must call thread_init and then run its own thread_mainloop. body(0)
+   runs in the calling thread, and is the only one to get signals.
+   Returns when all have returned, or -1 if there can't be more than
+   one (no pthreads). */
+extern int thread_workers(int n, void (*body)(int worker));
+
 #endif
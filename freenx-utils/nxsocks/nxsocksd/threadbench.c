@@ -0,0 +1,179 @@
+/* How the cost of a wakeup of thread.c grows with the number of
+   connections. Usage:
+   threadbench [-m messages] [-a active] [-t] [count...]
+
+   For each count, opens that many socket pairs, all waiting to be
+   read like idle tunnels, and bounces a byte back and forth over a
+   few of them the way socks.c shuffles data: read handler off and
+   write handler on, then back. With -t each fd also has a timer, as
+   in an ident or DNS lookup, renewed with each message. Build it with
+   "make threadbench", and "make threadbench-select" for the select()
+   version to compare. */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+
+extern int optind;
+extern char *optarg;
+
+#include "thread.h"
+#include "log.h"
+
+#ifdef DEBUG
+int debug=0;
+#endif
+
+static long messages=100000;
+static long done;
+static int timers=0;
+
+static void bench_wr(int fd, void *parm);
+
+/* Never comes */
+static void bench_to(int fd, void *parm)
+{
+    eprintf1("threadbench: timer of %d went off", fd);
+}
+
+/* A byte has come: send it back when we can. */
+static void bench_rd(int fd, void *parm)
+{
+    char c;
+    if (read(fd, &c, 1)!=1) {
+	perror("threadbench: read");
+	thread_stop=-1;
+	return;
+    }
+    thread_fd_rd_off(fd);
+    thread_fd_wr_on(fd);
+    if (timers) {
+	thread_timer_cancel(fd);
+	thread_timer_register(60, bench_to, fd, NULL);
+    }
+}
+
+static void bench_wr(int fd, void *parm)
+{
+    char c='x';
+    if (write(fd, &c, 1)!=1) {
+	perror("threadbench: write");
+	thread_stop=-1;
+	return;
+    }
+    thread_fd_wr_off(fd);
+    thread_fd_rd_on(fd);
+    if (++done>=messages)
+	thread_stop=1;
+}
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec+tv.tv_usec/1e6;
+}
+
+/* Run with n connections, a of them busy.
+   Returns -1 if they could not be opened. */
+static int run(int n, int a)
+{
+    int *fds, i, ok=0;
+    double t;
+
+    if (!(fds=malloc(2*n*sizeof(int))))
+	return -1;
+    for (i=0; i<n; ++i) {
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds+2*i)<0)
+	    break;
+	if (fds[2*i+1]>=getdtablesize()) {
+	    close(fds[2*i]);
+	    close(fds[2*i+1]);
+	    break;
+	}
+	thread_fd_register(fds[2*i], bench_rd, bench_wr, NULL, NULL);
+	thread_fd_register(fds[2*i+1], bench_rd, bench_wr, NULL, NULL);
+	thread_fd_wr_off(fds[2*i]);
+	thread_fd_wr_off(fds[2*i+1]);
+	if (timers) {
+	    thread_timer_register(60, bench_to, fds[2*i], NULL);
+	    thread_timer_register(60, bench_to, fds[2*i+1], NULL);
+	}
+    }
+    if (i==n) {
+	/* the busy ones are the last opened, with the highest fds */
+	for (i=n-a; i<n; ++i)
+	    if (write(fds[2*i], "x", 1)!=1)
+		perror("threadbench: write");
+	done=0;
+	t=now();
+	thread_mainloop();
+	t=now()-t;
+	printf("%-8s %8d %8d %10.0f %8.2f\n", thread_backend, n, a,
+	       done/t, t*1e6/done);
+	ok=1;
+    } else {
+	printf("%-8s %8d: only %d connections could be opened\n",
+	       thread_backend, n, i);
+    }
+    while (--i>=0) {
+	thread_timer_cancel(fds[2*i]);
+	thread_timer_cancel(fds[2*i+1]);
+	thread_fd_close(fds[2*i]);
+	thread_fd_close(fds[2*i+1]);
+    }
+    free(fds);
+    return ok ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    static int counts[]={16, 64, 256, 480, 1024, 4096, 0};
+    struct rlimit rl;
+    int i, a=8;
+
+    setunbuf(stdout);
+    while ((i=getopt(argc, argv, "m:a:t"))!=EOF) {
+	switch(i) {
+	case 'm': messages=atol(optarg); break;
+	case 'a': a=atoi(optarg); break;
+	case 't': timers=1; break;
+	default:
+	    eprintf0("usage: threadbench [-m messages] [-a active] [-t] [count...]");
+	    exit(1);
+	}
+    }
+    /* As many fds as we may have, before thread_init sizes its table */
+    if (getrlimit(RLIMIT_NOFILE, &rl)==0) {
+	rl.rlim_cur=rl.rlim_max;
+	(void)setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    if (thread_init()<0) {
+	eprintf0("threadbench: thread_init failed");
+	exit(1);
+    }
+    printf("backend     conns   active    msgs/s  usec/msg\n");
+    if (optind<argc) {
+	for (i=optind; i<argc; ++i)
+	    run(atoi(argv[i]), (a<atoi(argv[i])) ? a : atoi(argv[i]));
+    } else {
+	for (i=0; counts[i]; ++i) {
+	    /* select() can't watch fds above FD_SETSIZE */
+	    if ((thread_backend[0]=='s') && (2*counts[i]+8>FD_SETSIZE))
+		break;
+	    if (run(counts[i], (a<counts[i]) ? a : counts[i])<0)
+		break;
+	}
+    }
+    return 0;
+}